@@ -46,6 +46,7 @@
 
 #include <string>
 #include <list>
+#include <vector>
 #include <memory>
 #include "containers/include/iscenario_runner.h"
 class Timer;
@@ -75,6 +76,23 @@ class Timer;
  *          "BatchMode". The name of the configuration file is determined by the
  *          file configuration value "BatchFileName".
  *
+ *          By default scenarios are run one after another.  If the integer
+ *          configuration value "batch-concurrent-scenarios" is greater than one,
+ *          and the platform supports it, up to that many scenarios are run at
+ *          once each in a child process which is limited to an equal share of
+ *          "max-parallelism" threads.  Each child appends the scenario name to
+ *          all of it's output files except the XML database, which children
+ *          write to one at a time, and the batch CSV file, which is collected
+ *          from all children in the usual scenario order once they finish.
+ *
+ *          If in addition the boolean configuration value "batch-fork-after-parse"
+ *          is set, and all scenario runners are SingleScenarioRunners, the base
+ *          input file and configuration scenario components are parsed only once
+ *          before any children are started.  Each child then shares that parsed
+ *          model copy-on-write and only parses the files from it's own file sets.
+ *          This implies concurrent children even if "batch-concurrent-scenarios"
+ *          is one.
+ *
  *          <b>XML specification for BatchRunner</b>
  *          - XML name: \c BatchRunner
  *          - Contained by: None.
@@ -184,12 +202,35 @@ protected:
     //! The current scenario runner.
     IScenarioRunner* mInternalRunner;
 
+    //! Flag if this is a child process running a single scenario concurrently
+    //! with others.
+    bool mIsConcurrentChild;
+
+    //! Flag if the inputs shared by all scenarios have already been parsed
+    //! by each of the scenario runners before forking children.
+    bool mIsSharedParsed;
+
 	BatchRunner();
+    void createScenarioList( std::vector<Component>& aScenarios );
+
 	bool runSingleScenario( IScenarioRunner* aScenarioRunner,
                             const Component& aCurrComponent,
                             const int aSinglePeriod,
                             Timer& aTimer );
 
+    bool runScenariosConcurrently( const std::vector<Component>& aScenarios,
+                                   const int aNumConcurrent,
+                                   const int aSinglePeriod,
+                                   Timer& aTimer );
+
+    bool runConcurrentChild( IScenarioRunner* aScenarioRunner,
+                             const Component& aComponent,
+                             const int aNumThreads,
+                             const std::string& aCSVFileName,
+                             const std::string& aBinaryFileName,
+                             const int aSinglePeriod,
+                             Timer& aTimer );
+
     bool XMLParseComponentSet( rapidxml::xml_node<char>* aNode );
 
     bool XMLParseRunnerSet( rapidxml::xml_node<char>* aNode );
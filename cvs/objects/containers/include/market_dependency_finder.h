@@ -48,6 +48,7 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <cstdint>
 
 #include "util/base/include/definitions.h"
 
@@ -80,7 +81,9 @@ class GcamFlowGraph;
  *              - Get the global ordering via getOrdering() or a market specific
  *                ordering via getOrdering(int marketNumber).  Note that for market
  *                specific ordering a search will be performed to get a complete
- *                list of items to calculate.
+ *                list of items to calculate.  Alternatively the orderings, and
+ *                optionally flow graphs, for all markets may be created at once
+ *                via createAllMarketOrderings.
  *
  * \author Pralit Patel
  */
@@ -108,6 +111,8 @@ public:
                                       IActivity* aPriceActivity = 0 );
     
     void createOrdering();
+    
+    void createAllMarketOrderings( const bool aCreateFlowGraphs );
 
     // CalcVertex and related declarations
     struct DependencyItem;
@@ -159,7 +164,38 @@ public:
     typedef std::vector<CalcVertex*> VertexList;
     typedef VertexList::iterator VertexIterator;
     typedef VertexList::const_iterator CVertexIterator;
-    typedef std::map<CalcVertex*, int, CalcVertexComp> CalcVertexCountMap;
+
+    /*!
+     * \brief The number of remaining dependencies on each CalcVertex which has
+     *        not yet been placed in the global ordering.
+     * \details Counts are kept in flat arrays indexed by CalcVertex::mUID, which
+     *          are assigned sequentially from zero.  Any vertex whose count is
+     *          changed is remembered so that the topological sort only needs to
+     *          check those vertices to find the next ones without dependencies
+     *          rather than scanning all of the remaining vertices each pass.
+     */
+    class VertexCounts {
+    public:
+        explicit VertexCounts( const size_t aNumVertices );
+        bool contains( const CalcVertex* aVertex ) const;
+        bool empty() const;
+        void set( const CalcVertex* aVertex, const int aCount );
+        void increment( const CalcVertex* aVertex );
+        void decrement( const CalcVertex* aVertex );
+        void takeReady( const std::vector<CalcVertex*>& aVertices, std::vector<CalcVertex*>& aReady );
+    private:
+        //! The dependency count for each vertex.
+        std::vector<int> mCount;
+
+        //! Whether each vertex still remains to be ordered.
+        std::vector<bool> mIsRemaining;
+
+        //! The UIDs of vertices whose count changed since the last takeReady.
+        std::vector<int> mChanged;
+
+        //! The number of vertices which remain to be ordered.
+        size_t mNumRemaining;
+    };
     
     // DependencyItem and related declarations
     
@@ -324,7 +360,8 @@ public:
         //! A flow graph of vertices to re-calculate in parallel should this market
         //! change it's price.  Note that this is essentially a cache and only computed
         //! the first time it is needed.  This memory is owned my MarketDependencyFinder
-        //! and will be released explictly by it.
+        //! and will be released explictly by it.  Note markets which affect exactly
+        //! the same activities may share the same flow graph.
         GcamFlowGraph* mFlowGraph;
 #endif
     };
@@ -362,10 +399,17 @@ public:
 #endif
     
     void findVerticesToCalculate( CalcVertex* aVertex, std::set<IActivity*>& aVisited ) const;
-    void findStronglyConnected( CalcVertex* aCurrVertex, int& aMaxIndex,std::list<CalcVertex*>& aHasVisited,
-                                CalcVertexCountMap& aTotalVisits ) const;
-    int markCycles( CalcVertex* aCurrVertex, std::list<CalcVertex*>& aHasVisited, CalcVertexCountMap& aTotalVisits ) const;
-    void createTrialsForItem( CItemIterator aItemToReset, CalcVertexCountMap& aNumDependencies );
+    void createGlobalOrdering( const VertexList& aVertices, VertexCounts& aNumDependencies,
+                               VertexList& aTrialVertices, VertexList& aOrdering );
+    void findStronglyConnected( CalcVertex* aRootVertex, int& aMaxIndex, std::vector<bool>& aOnStack,
+                                VertexList& aCycleVertices ) const;
+    int markCycles( CalcVertex* aCurrVertex, std::vector<bool>& aOnPath, std::vector<int>& aCycleVisits ) const;
+    void createTrialsForItem( CItemIterator aItemToReset, VertexCounts& aNumDependencies );
+    uint64_t calcOrderingHash( const VertexList& aVertices ) const;
+    bool loadOrderingCache( const std::string& aFileName, const uint64_t aHash,
+                            const VertexList& aVertices, VertexCounts& aNumDependencies );
+    void saveOrderingCache( const std::string& aFileName, const uint64_t aHash,
+                            const VertexList& aTrialVertices, const VertexList& aOrdering ) const;
 };
 
 #endif // _MARKET_DEPENDENCY_FINDER_H_
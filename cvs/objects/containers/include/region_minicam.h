@@ -96,6 +96,7 @@ public:
     virtual ~RegionMiniCAM();
     static const std::string& getXMLNameStatic();
     virtual bool XMLParse( rapidxml::xml_node<char>* & aNode );
+    virtual bool isXMLParseReflected() const;
     virtual void completeInit();
     
     virtual void initCalc( const int period );
@@ -68,6 +68,7 @@ class OutputMetaData;
 class SolutionInfoParamParser;
 class IModelFeedbackCalc;
 class ManageStateVariables;
+class PeriodResultsStreamer;
 
 /*!
 * \ingroup Objects
@@ -161,6 +162,10 @@ protected:
     
     ManageStateVariables* mManageStateVars;
 
+    //! Appends the results of each period to a file as it is calculated if
+    //! requested, created when the first period is calculated.
+    std::unique_ptr<PeriodResultsStreamer> mPeriodResultsStreamer;
+
     bool solve( const int period );
 
     bool calculatePeriod( const int aPeriod,
@@ -181,6 +186,8 @@ protected:
         const int aPeriod ) const;
 
     void initSolvers();
+
+    void streamPeriodResults( const int aPeriod );
 };
 
 #endif // _SCENARIO_H_
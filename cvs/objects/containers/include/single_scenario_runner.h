@@ -75,6 +75,12 @@ class XMLDBOutputter;
  *          correctly reinitialize any existing data correctly, such as
  *          resetting markets.
  *
+ *          The first two may be parsed ahead of time by calling
+ *          parseSharedComponents in which case the next call to setupScenarios
+ *          only parses the scenario components passed into it.  This allows a
+ *          process to parse the inputs shared by many scenarios once and fork a
+ *          copy for each scenario.
+ *
  *          printOutput is called after runScenarios to print output to any
  *          configured databases.
  *          
@@ -96,6 +102,8 @@ public:
                                  const std::list<std::string> aScenComponents =
                                    std::list<std::string>() );
     
+    bool parseSharedComponents();
+    
     virtual bool runScenarios( const int aSinglePeriod,
                                const bool aPrintDebugging,
                                Timer& aTimer );
@@ -126,5 +134,9 @@ protected:
     //! it around in case we want to do additional processing once GCAM
     //! is done running.
     mutable XMLDBOutputter* mXMLDBOutputter;
+
+    //! Flag if the base input file and configuration scenario components have
+    //! already been parsed into mScenario by parseSharedComponents.
+    bool mIsSharedParsed;
 };
 #endif // _SINGLE_SCENARIO_RUNNER_H_
@@ -120,6 +120,7 @@ public:
     GcamFlowGraph* mTBBGraphGlobal;
   public:
     void calc( const int aPeriod, GcamFlowGraph *aWorkGraph, const std::vector<IActivity*>* aCalcList = 0 );
+    bool calcPartial( const int aPeriod, GcamFlowGraph* aWorkGraph, const std::vector<IActivity*>& aCalcList );
     /*!
      * \brief Return a pointer to the global flow graph
      * \details The flow graph structure is opaque to everything but World and GcamParallel, so
@@ -43,15 +43,42 @@
 
 #include "util/base/include/definitions.h"
 #include <string>
+#include <fstream>
+#include <map>
+#include <thread>
+#include <cstdio>
 #include "containers/include/batch_runner.h"
 #include "containers/include/scenario_runner_factory.h"
+#include "containers/include/single_scenario_runner.h"
 #include "util/base/include/timer.h"
 #include "util/base/include/xml_helper.h"
 #include "util/base/include/xml_parse_helper.h"
 #include "util/base/include/configuration.h"
 #include "util/logger/include/ilogger.h"
+#include "util/logger/include/logger_factory.h"
 #include "containers/include/scenario.h"
 #include "reporting/include/batch_csv_outputter.h"
+#include "reporting/include/batch_binary_outputter.h"
+#include "reporting/include/xml_db_outputter.h"
+#include "util/base/include/auto_file.h"
+#include "util/base/include/util.h"
+
+// Scenarios can only be run concurrently where we can fork child processes.
+#if defined(__unix__) || defined(__APPLE__)
+#define BATCH_RUNNER_CAN_FORK 1
+#include <unistd.h>
+#include <fcntl.h>
+#include <csignal>
+#include <cerrno>
+#include <sys/file.h>
+#include <sys/wait.h>
+#else
+#define BATCH_RUNNER_CAN_FORK 0
+#endif
+
+#if GCAM_PARALLEL_ENABLED
+#include <tbb/global_control.h>
+#endif
 
 using namespace std;
 
@@ -63,7 +90,9 @@ typedef list<IScenarioRunner*>::iterator RunnerIterator;
  * \brief Constructor
  */
 BatchRunner::BatchRunner() :
-mInternalRunner( 0 ){ 
+mInternalRunner( 0 ),
+mIsConcurrentChild( false ),
+mIsSharedParsed( false ){ 
 }
 
 //! Destructor
@@ -110,32 +139,72 @@ bool BatchRunner::runScenarios( const int aSinglePeriod,
         return false;
     }
 
+    vector<Component> scenarios;
+    createScenarioList( scenarios );
+
+#if BATCH_RUNNER_CAN_FORK
+    const Configuration* conf = Configuration::getInstance();
+    const int numConcurrent = conf->getInt( "batch-concurrent-scenarios", 1, false );
+    if( numConcurrent > 1 || conf->getBool( "batch-fork-after-parse", false, false ) ) {
+        return runScenariosConcurrently( scenarios, max( numConcurrent, 1 ), aSinglePeriod, aTimer );
+    }
+#endif
+
+    // All generated scenarios are run with each scenario runner in the order in
+    // which the scenario runners were read.
+    bool success = true;
+    BatchCSVOutputter csvOutputter;
+    unique_ptr<BatchBinaryOutputter> binaryOutputter;
+    if( Configuration::getInstance()->shouldWriteFile( "batchBinaryOutputFile", false, false ) ){
+        binaryOutputter.reset( new BatchBinaryOutputter(
+            Configuration::getInstance()->getFile( "batchBinaryOutputFile", "batch-summary.gbsum" ), true ) );
+    }
+    for( vector<Component>::const_iterator fileSetsToRun = scenarios.begin(); fileSetsToRun != scenarios.end(); ++fileSetsToRun ){
+        // Run it using each possible type of IScenarioRunner.
+        for( RunnerIterator runner = mScenarioRunners.begin(); runner != mScenarioRunners.end(); ++runner ){
+            bool scenarioSuccess = runSingleScenario( *runner, *fileSetsToRun, aSinglePeriod, aTimer );
+            success &= scenarioSuccess;
+            (*runner)->getInternalScenario()->accept( &csvOutputter, -1 );
+            csvOutputter.writeDidScenarioSolve( scenarioSuccess );
+            if( binaryOutputter ){
+                (*runner)->getInternalScenario()->accept( binaryOutputter.get(), -1 );
+                binaryOutputter->writeDidScenarioSolve( scenarioSuccess );
+            }
+            // Clean up the current scenario runner before we move on to the next
+            // so that we do not accumulate a large amount of idle memory.
+            (*runner)->cleanup();
+        }
+    }
+    return success;
+}
+
+/*!
+ * \brief Create the list of scenarios to run from all combinations of file sets.
+ * \details The scenarios are created by determining all possible combinations of
+ *          file sets. The algorithm operates as follows:
+ *          1) Set the current file set in each component to the initial position.
+ *          2) Add the scenario.
+ *          3) Set the current component to the first.
+ *          4) Increment the current file set in the current component.
+ *          5a) If this is a valid position in the current component and go to 2.
+ *          5b) Otherwise, reset the current file set in the current component to
+ *              the first position.
+ *          6a) If the current component is the last component exit the algorithm.
+ *          6b) Otherwise, increment the current component and go to 4.
+ *
+ *          Example: assume there are two components A and B. A has two file sets
+ *          named 1 and 2, and B has two file sets named 3 and 4. The scenarios would
+ *          be run in the order: [A1, B1], [A2, B1], [A1, B2], [A2, B2]
+ * \param aScenarios The list to add the scenarios to, each as a component containing
+ *                   the file sets to run.
+ */
+void BatchRunner::createScenarioList( vector<Component>& aScenarios ) {
     // Initialize each components iterator to the beginning of the vector. 
     for( ComponentSet::iterator currSet = mComponentSet.begin(); currSet != mComponentSet.end(); ++currSet ){
         currSet->mFileSetIterator = currSet->mFileSets.begin();
     }
     
-    // The scenarios are created by determining all possible combinations of
-    // file sets. The algorithm operates as follows:
-    // 1) Set the current file set in each component to the initial position.
-    // 2) Run the scenario.
-    // 3) Set the current component to the first.
-    // 4) Increment the current file set in the current component.
-    // 5a) If this is a valid position in the current component and go to 2.
-    // 5b) Otherwise, reset the current file set in the current component to
-    //     the first position.
-    // 6a) If the current component is the last component exit the algorithm.
-    // 6b) Otherwise, increment the current component and go to 4.
-    //
-    // Example: assume there are two components A and B. A has two file sets
-    // named 1 and 2, and B has two file sets named 3 and 4. The scenarios would
-    // be run in the order: [A1, B1], [A2, B1], [A1, B2], [A2, B2]
-    //
-    // All generated scenarios are run with each scenario runner in the order in
-    // which the scenario runners were read.
     bool shouldExit = false;
-    bool success = true;
-    BatchCSVOutputter csvOutputter;
     while( !shouldExit ){
         // The data structure containing the current run.
         Component fileSetsToRun;
@@ -145,17 +214,7 @@ bool BatchRunner::runScenarios( const int aSinglePeriod,
             fileSetsToRun.mFileSets.push_back( *( currSet->mFileSetIterator ) );
             fileSetsToRun.mName += currSet->mFileSetIterator->mName;
         }
-
-        // Run it using each possible type of IScenarioRunner.
-        for( RunnerIterator runner = mScenarioRunners.begin(); runner != mScenarioRunners.end(); ++runner ){
-            bool scenarioSuccess = runSingleScenario( *runner, fileSetsToRun, aSinglePeriod, aTimer );
-            success &= scenarioSuccess;
-            (*runner)->getInternalScenario()->accept( &csvOutputter, -1 );
-            csvOutputter.writeDidScenarioSolve( scenarioSuccess );
-            // Clean up the current scenario runner before we move on to the next
-            // so that we do not accumulate a large amount of idle memory.
-            (*runner)->cleanup();
-        }
+        aScenarios.push_back( fileSetsToRun );
 
         // Loop forward to find a position to increment.
         for( ComponentSet::iterator outPos = mComponentSet.begin(); outPos != mComponentSet.end(); ++outPos ){
@@ -174,8 +233,277 @@ bool BatchRunner::runScenarios( const int aSinglePeriod,
             }
         }
     }
+}
+
+#if BATCH_RUNNER_CAN_FORK
+/*!
+ * \brief Run the scenarios several at a time each in a child process.
+ * \details Each combination of scenario and scenario runner is run by a forked
+ *          child process with at most aNumConcurrent children running at once.
+ *          The threads available, "max-parallelism" or all cores if that is not
+ *          set, are divided evenly between the children.  Each child writes it's
+ *          batch CSV results to a temporary file which is appended to the batch
+ *          CSV file in the order the scenarios were generated once all children
+ *          have finished so the result is the same as a sequential run.
+ *          If "batch-fork-after-parse" is set the inputs shared by all scenarios
+ *          are parsed once here before any children are started.
+ * \warning The model must not have done any parallel calculation in this process
+ *          before forking as the TBB runtime does not survive a fork.
+ * \param aScenarios The scenarios to run.
+ * \param aNumConcurrent The maximum number of scenarios to run at once.
+ * \param aSinglePeriod The model period to run.
+ * \param aTimer The timer used to print out the amount of time spent performing
+ *        operations.
+ * \return Whether all model runs solved successfully.
+ */
+bool BatchRunner::runScenariosConcurrently( const vector<Component>& aScenarios,
+                                            const int aNumConcurrent,
+                                            const int aSinglePeriod,
+                                            Timer& aTimer )
+{
+    const Configuration* conf = Configuration::getInstance();
+    int totalThreads = conf->getInt( "max-parallelism", -1 );
+    if( totalThreads <= 0 ) {
+        totalThreads = max( static_cast<int>( thread::hardware_concurrency() ), 1 );
+    }
+    const int numThreads = max( totalThreads / aNumConcurrent, 1 );
+
+    ILogger& mainLog = ILogger::getLogger( "main_log" );
+    mainLog.setLevel( ILogger::NOTICE );
+    mainLog << "Running up to " << aNumConcurrent << " scenarios concurrently with "
+            << numThreads << " threads each." << endl;
+
+    // A single job for each combination of scenario and scenario runner.
+    struct Job {
+        const Component* mComponent;
+        IScenarioRunner* mRunner;
+        string mCSVFileName;
+        string mBinaryFileName;
+        bool mSuccess;
+    };
+    const bool writeCSV = conf->shouldWriteFile( "batchCSVOutputFile" );
+    const string csvFileName = conf->getFile( "batchCSVOutputFile", "batch-csv-out.csv" );
+    const bool writeBinary = conf->shouldWriteFile( "batchBinaryOutputFile", false, false );
+    const string binaryFileName = conf->getFile( "batchBinaryOutputFile", "batch-summary.gbsum", false );
+    vector<Job> jobs;
+    for( vector<Component>::const_iterator scenario = aScenarios.begin(); scenario != aScenarios.end(); ++scenario ){
+        for( RunnerIterator runner = mScenarioRunners.begin(); runner != mScenarioRunners.end(); ++runner ){
+            Job job;
+            job.mComponent = &*scenario;
+            job.mRunner = *runner;
+            job.mCSVFileName = writeCSV ? csvFileName + "." + util::toString( jobs.size() ) : "";
+            job.mBinaryFileName = writeBinary ? binaryFileName + "." + util::toString( jobs.size() ) : "";
+            job.mSuccess = false;
+            jobs.push_back( job );
+        }
+    }
+
+    // Parse the inputs shared by all scenarios once so that the children only
+    // need to parse their own file sets.  This is only possible if all runners
+    // are plain SingleScenarioRunners as others set up scenarios differently.
+    if( conf->getBool( "batch-fork-after-parse", false, false ) ){
+        bool canShareParse = true;
+        for( RunnerIterator runner = mScenarioRunners.begin(); runner != mScenarioRunners.end(); ++runner ){
+            canShareParse &= dynamic_cast<SingleScenarioRunner*>( *runner ) != 0;
+        }
+        if( canShareParse ){
+#if GCAM_PARALLEL_ENABLED
+            // Parsing must not start any TBB worker threads in this process, such
+            // as with "parallel-xml-parse", since they would not survive the fork.
+            tbb::global_control serialParse( tbb::global_control::max_allowed_parallelism, 1 );
+#endif
+            mainLog.setLevel( ILogger::NOTICE );
+            mainLog << "Parsing inputs shared by all scenarios before starting scenario processes." << endl;
+            XMLParseHelper::initParser();
+            mIsSharedParsed = true;
+            for( RunnerIterator runner = mScenarioRunners.begin(); runner != mScenarioRunners.end(); ++runner ){
+                mIsSharedParsed &= static_cast<SingleScenarioRunner*>( *runner )->parseSharedComponents();
+            }
+            if( !mIsSharedParsed ){
+                mainLog.setLevel( ILogger::SEVERE );
+                mainLog << "Failed to parse the inputs shared by all scenarios." << endl;
+                XMLParseHelper::cleanupParser();
+                cleanup();
+                return false;
+            }
+        }
+        else {
+            mainLog.setLevel( ILogger::WARNING );
+            mainLog << "Ignoring batch-fork-after-parse as not all scenario runners are "
+                    << "single-scenario-runners." << endl;
+        }
+    }
+
+    // Make sure nothing buffered so far gets written again by the children.
+    cout.flush();
+    cerr.flush();
+
+    map<pid_t, int> runningJobs;
+    size_t nextJob = 0;
+    while( nextJob < jobs.size() || !runningJobs.empty() ){
+        // Start as many children as we are allowed to.
+        while( nextJob < jobs.size() && runningJobs.size() < static_cast<size_t>( aNumConcurrent ) ){
+            Job& job = jobs[ nextJob ];
+            const pid_t pid = fork();
+            if( pid == 0 ){
+                const bool success = runConcurrentChild( job.mRunner, *job.mComponent, numThreads,
+                                                         job.mCSVFileName, job.mBinaryFileName,
+                                                         aSinglePeriod, aTimer );
+                // _exit skips static destructors so close the loggers, which
+                // writes their closing tags, as main would have.
+                LoggerFactory::cleanUp();
+                cout.flush();
+                cerr.flush();
+                _exit( success ? 0 : 1 );
+            }
+            else if( pid < 0 ){
+                mainLog.setLevel( ILogger::SEVERE );
+                mainLog << "Failed to start a process for scenario " << job.mComponent->mName << "." << endl;
+                mUnsolvedNames.push_back( job.mComponent->mName );
+            }
+            else {
+                runningJobs[ pid ] = nextJob;
+            }
+            ++nextJob;
+        }
+
+        // Wait for any child to finish.
+        if( !runningJobs.empty() ){
+            int status = 0;
+            const pid_t pid = waitpid( -1, &status, 0 );
+            map<pid_t, int>::iterator finishedJob = runningJobs.find( pid );
+            if( finishedJob != runningJobs.end() ){
+                Job& job = jobs[ finishedJob->second ];
+                job.mSuccess = WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+                if( !job.mSuccess ){
+                    mUnsolvedNames.push_back( job.mComponent->mName );
+                }
+                mainLog.setLevel( ILogger::NOTICE );
+                mainLog << "Scenario " << job.mComponent->mName << " finished"
+                        << ( job.mSuccess ? "." : " but did not solve." ) << endl;
+                runningJobs.erase( finishedJob );
+            }
+            else if( pid < 0 && errno != EINTR ){
+                // The children which are still running must not outlive the
+                // shared state which is cleaned up below so stop them.
+                mainLog.setLevel( ILogger::SEVERE );
+                mainLog << "Failed waiting for scenario processes to finish, stopping the remaining ones." << endl;
+                for( map<pid_t, int>::const_iterator job = runningJobs.begin(); job != runningJobs.end(); ++job ){
+                    kill( job->first, SIGTERM );
+                }
+                for( map<pid_t, int>::const_iterator job = runningJobs.begin(); job != runningJobs.end(); ++job ){
+                    while( waitpid( job->first, &status, 0 ) < 0 && errno == EINTR ){
+                    }
+                    mUnsolvedNames.push_back( jobs[ job->second ].mComponent->mName );
+                }
+                runningJobs.clear();
+                for( ; nextJob < jobs.size(); ++nextJob ){
+                    mUnsolvedNames.push_back( jobs[ nextJob ].mComponent->mName );
+                }
+            }
+        }
+    }
+
+    // The shared inputs are no longer needed now that all children have finished.
+    if( mIsSharedParsed ){
+        XMLParseHelper::cleanupParser();
+        cleanup();
+        mIsSharedParsed = false;
+    }
+
+    // Collect the batch CSV results, keeping the header from the first file only.
+    bool success = true;
+    AutoOutputFile csvFile( "batchCSVOutputFile", "batch-csv-out.csv" );
+    bool isFirstFile = true;
+    for( vector<Job>::const_iterator job = jobs.begin(); job != jobs.end(); ++job ){
+        success &= job->mSuccess;
+        if( job->mCSVFileName.empty() ){
+            continue;
+        }
+        ifstream jobCSV( job->mCSVFileName.c_str() );
+        string line;
+        bool isHeader = true;
+        while( getline( jobCSV, line ) ){
+            if( !isHeader || isFirstFile ){
+                *csvFile << line << endl;
+            }
+            isHeader = false;
+        }
+        if( jobCSV.is_open() ){
+            isFirstFile = false;
+            jobCSV.close();
+            remove( job->mCSVFileName.c_str() );
+        }
+    }
+
+    // Merge the batch summary shards of each scenario in the order they were run.
+    if( writeBinary ){
+        vector<string> shardFileNames;
+        for( vector<Job>::const_iterator job = jobs.begin(); job != jobs.end(); ++job ){
+            shardFileNames.push_back( job->mBinaryFileName );
+        }
+        BatchBinaryOutputter::mergeShards( binaryFileName, shardFileNames );
+    }
+    return success;
+}
+
+/*!
+ * \brief Run a single scenario in a child process started by runScenariosConcurrently.
+ * \param aScenarioRunner The scenario runner to use for the scenario.
+ * \param aComponent The scenario to run.
+ * \param aNumThreads The maximum number of threads this scenario may use.
+ * \param aCSVFileName The file to write the batch CSV results to or empty if
+ *                     they should not be written.
+ * \param aBinaryFileName The shard to write the batch summary to or empty if
+ *                        it should not be written.
+ * \param aSinglePeriod The model period to run.
+ * \param aTimer The timer used to print out the amount of time spent performing
+ *        operations.
+ * \return Whether the model run solved successfully.
+ */
+bool BatchRunner::runConcurrentChild( IScenarioRunner* aScenarioRunner,
+                                      const Component& aComponent,
+                                      const int aNumThreads,
+                                      const string& aCSVFileName,
+                                      const string& aBinaryFileName,
+                                      const int aSinglePeriod,
+                                      Timer& aTimer )
+{
+    mIsConcurrentChild = true;
+#if GCAM_PARALLEL_ENABLED
+    // TBB will use the most restrictive of all active controls so this still
+    // respects "max-parallelism" when the flow graph sets it.
+    tbb::global_control parallelism( tbb::global_control::max_allowed_parallelism, aNumThreads );
+#endif
+
+    // Append the scenario name to all output files so that concurrent scenarios
+    // do not overwrite each other.  The XML database and batch CSV and summary
+    // files are instead shared and handled explicitly.
+    list<string> sharedFiles;
+    sharedFiles.push_back( "xmldb-location" );
+    sharedFiles.push_back( "batchCSVOutputFile" );
+    sharedFiles.push_back( "batchBinaryOutputFile" );
+    Configuration::getInstance()->appendScnToAllFilesExcept( sharedFiles );
+
+    // Likewise give this process its own log files rather than interleaving
+    // messages in those inherited from the parent.
+    LoggerFactory::reopenWithSuffix( aComponent.mName );
+
+    const bool success = runSingleScenario( aScenarioRunner, aComponent, aSinglePeriod, aTimer );
+    if( !aCSVFileName.empty() ){
+        BatchCSVOutputter csvOutputter( aCSVFileName );
+        aScenarioRunner->getInternalScenario()->accept( &csvOutputter, -1 );
+        csvOutputter.writeDidScenarioSolve( success );
+    }
+    if( !aBinaryFileName.empty() ){
+        BatchBinaryOutputter binaryOutputter( aBinaryFileName, false );
+        aScenarioRunner->getInternalScenario()->accept( &binaryOutputter, -1 );
+        binaryOutputter.writeDidScenarioSolve( success );
+    }
+    aScenarioRunner->cleanup();
     return success;
 }
+#endif
 
 void BatchRunner::printOutput( Timer& aTimer ) const {
     // Print out any scenarios that did not solve.
@@ -239,7 +567,11 @@ bool BatchRunner::runSingleScenario( IScenarioRunner* aScenarioRunner,
             << " with scenario runner " << aScenarioRunner->getName()
             << "." << endl;
 
-    XMLParseHelper::initParser();
+    // When the shared inputs were parsed before forking this process the parser
+    // already holds the state from that which setupScenarios will need.
+    if( !mIsSharedParsed ){
+        XMLParseHelper::initParser();
+    }
     // Setup the scenario.
     const string runName = aComponent.mName;
     bool success = mInternalRunner->setupScenarios( aTimer, runName, components );
@@ -265,7 +597,30 @@ bool BatchRunner::runSingleScenario( IScenarioRunner* aScenarioRunner,
     success = mInternalRunner->runScenarios( runPeriod, false, aTimer );
     
     // Print the output.
+#if BATCH_RUNNER_CAN_FORK
+    if( mIsConcurrentChild ){
+        // Scenarios running concurrently share the XML database so only one
+        // may write to it at a time.
+        const string lockFileName = Configuration::getInstance()->getFile( "xmldb-location", "database_basexdb" ) + ".lock";
+        const int lockFD = open( lockFileName.c_str(), O_CREAT | O_RDWR, 0644 );
+        if( lockFD >= 0 ){
+            flock( lockFD, LOCK_EX );
+        }
+        mInternalRunner->printOutput( aTimer );
+        // The database may still be being written in the background so keep
+        // the lock until it is done.
+        XMLDBOutputter::waitForPendingWrites();
+        if( lockFD >= 0 ){
+            flock( lockFD, LOCK_UN );
+            close( lockFD );
+        }
+    }
+    else {
+        mInternalRunner->printOutput( aTimer );
+    }
+#else
     mInternalRunner->printOutput( aTimer );
+#endif
     
     // If the run failed, add to the list of failed runs. CHECK ME!
     if( !success ){
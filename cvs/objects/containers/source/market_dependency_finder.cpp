@@ -40,6 +40,13 @@
 
 #include "util/base/include/definitions.h"
 #include <cassert>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <map>
+#include <unordered_map>
 #include <boost/algorithm/string/predicate.hpp>
 #include "containers/include/market_dependency_finder.h"
 #include "util/logger/include/ilogger.h"
@@ -49,13 +56,50 @@
 #include "marketplace/include/market.h"
 #include "marketplace/include/linked_market.h"
 #include "containers/include/iactivity.h"
+#include "util/base/include/configuration.h"
+#include "util/base/include/util.h"
 
 #if GCAM_PARALLEL_ENABLED
 #include "parallel/include/gcam_parallel.hpp"
+#include "parallel/include/bitvector.hpp"
+#include <tbb/parallel_for.h>
 #endif
 
 using namespace std;
 
+namespace {
+    /*!
+     * \brief Call the given function for each index from zero to aCount, in
+     *        parallel when GCAM_PARALLEL_ENABLED.
+     * \param aCount The number of indices.
+     * \param aFunction The function to call with each index.
+     */
+    template<typename Function>
+    void forEachIndex( const size_t aCount, const Function& aFunction ) {
+#if GCAM_PARALLEL_ENABLED
+        tbb::parallel_for( size_t( 0 ), aCount, aFunction );
+#else
+        for( size_t i = 0; i < aCount; ++i ) {
+            aFunction( i );
+        }
+#endif
+    }
+
+    /*!
+     * \brief Fold a value into an FNV-1a hash.
+     * \param aHash The hash to update.
+     * \param aValue The value to add.
+     */
+    void hashValue( uint64_t& aHash, const string& aValue ) {
+        // Include the terminating null so adjacent strings are delimited.
+        util::hashBytes( aHash, aValue.c_str(), aValue.size() + 1 );
+    }
+
+    void hashValue( uint64_t& aHash, const int aValue ) {
+        util::hashBytes( aHash, &aValue, sizeof( aValue ) );
+    }
+}
+
 /*!
  * \brief Constructor.
  * \param aMarketplace The marketplace object in which this object is contained.
@@ -79,10 +123,15 @@ MarketDependencyFinder::~MarketDependencyFinder() {
     }
 #if GCAM_PARALLEL_ENABLED
     delete mTBBGraphGlobal;
+    // Flow graphs may be shared between markets so be sure to only delete each once.
+    set<GcamFlowGraph*> flowGraphs;
     for( CMarketToDepIterator it = mMarketsToDep.begin(); it != mMarketsToDep.end(); ++it ) {
-        delete (*it)->mFlowGraph;
+        flowGraphs.insert( (*it)->mFlowGraph );
         delete *it;
     }
+    for( GcamFlowGraph* flowGraph : flowGraphs ) {
+        delete flowGraph;
+    }
 #endif
 }
 
@@ -305,6 +354,121 @@ GcamFlowGraph* MarketDependencyFinder::getFlowGraph( const int aMarketNumber ) {
 }
 #endif
 
+/*!
+ * \brief Create the ordered list of activities to recalculate for every market at
+ *        once rather than as each is asked for in getOrdering.
+ * \details Rather than collecting the affected activities into a std::set, every
+ *          activity is given it's position in the global ordering ahead of time so
+ *          that the search from a market's entry points only needs to mark a
+ *          compact bit vector.  Reading the marked bits in order then directly
+ *          gives the ordered list.  The searches for all markets are done in
+ *          parallel when GCAM_PARALLEL_ENABLED.  Markets which affect exactly the
+ *          same activities, which is common for instance for markets that are
+ *          only used by a single sector, share the same result including the flow
+ *          graph if aCreateFlowGraphs is set.  The flow graphs for each distinct
+ *          list are also created in parallel and their parallel-grain-log
+ *          messages written once they are all done.
+ * \param aCreateFlowGraphs Whether to also create the flow graph of each market
+ *                          which getFlowGraph would otherwise create lazily.  Note
+ *                          this is ignored if not GCAM_PARALLEL_ENABLED.
+ * \pre createOrdering has been called and if GCAM_PARALLEL_ENABLED so has
+ *      getFlowGraph for the global flow graph.
+ */
+void MarketDependencyFinder::createAllMarketOrderings( const bool aCreateFlowGraphs ) {
+    // Give every activity an index, those in the global ordering first so that
+    // their index is their position in it.
+    unordered_map<const IActivity*, size_t> activityIndex;
+    for( IActivity* activity : mGlobalOrdering ) {
+        activityIndex.insert( make_pair( activity, activityIndex.size() ) );
+    }
+    for( DependencyItem* item : mDependencyItems ) {
+        for( const VertexList* vertices : { &item->mPriceVertices, &item->mDemandVertices } ) {
+            for( CalcVertex* vertex : *vertices ) {
+                activityIndex.insert( make_pair( vertex->mCalcItem, activityIndex.size() ) );
+            }
+        }
+    }
+    
+    // Mark the activities affected by each market.
+    const vector<MarketToDependencyItem*> markets( mMarketsToDep.begin(), mMarketsToDep.end() );
+    vector<bitvector> isAffected( markets.size() );
+    forEachIndex( markets.size(), [&] ( size_t aMarket ) {
+        bitvector& visited = isAffected[ aMarket ];
+        visited = bitvector( activityIndex.size() );
+        vector<const CalcVertex*> toVisit( markets[ aMarket ]->mImpliedVertices.begin(),
+                                           markets[ aMarket ]->mImpliedVertices.end() );
+        while( !toVisit.empty() ) {
+            const CalcVertex* vertex = toVisit.back();
+            toVisit.pop_back();
+            const size_t index = (*activityIndex.find( vertex->mCalcItem )).second;
+            if( !visited.get( index ) ) {
+                visited.set( index );
+                // Include any implied in edges that should be calculated (special
+                // case for the land-allocator) just as findVerticesToCalculate.
+                toVisit.insert( toVisit.end(), vertex->mOutEdges.begin(), vertex->mOutEdges.end() );
+                toVisit.insert( toVisit.end(), vertex->mImpliedInEdges.begin(), vertex->mImpliedInEdges.end() );
+            }
+        }
+    } );
+    
+    // Group markets which affect exactly the same activities.
+    auto bitvectorLess = [] ( const bitvector* aLHS, const bitvector* aRHS ) {
+        return *aLHS < *aRHS;
+    };
+    map<const bitvector*, size_t, decltype( bitvectorLess )> groupLookup( bitvectorLess );
+    vector<size_t> marketGroup( markets.size() );
+    vector<size_t> groupFirstMarket;
+    for( size_t i = 0; i < markets.size(); ++i ) {
+        auto group = groupLookup.insert( make_pair( &isAffected[ i ], groupFirstMarket.size() ) );
+        if( group.second ) {
+            groupFirstMarket.push_back( i );
+        }
+        marketGroup[ i ] = (*group.first).second;
+    }
+    groupLookup.clear();
+    
+    // Create the ordered list for each group and assign it to it's markets.
+    vector<vector<IActivity*> > groupOrdering( groupFirstMarket.size() );
+    forEachIndex( groupFirstMarket.size(), [&] ( size_t aGroup ) {
+        const bitvector& visited = isAffected[ groupFirstMarket[ aGroup ] ];
+        for( size_t i = 0; i < mGlobalOrdering.size(); ++i ) {
+            if( visited.get( i ) ) {
+                groupOrdering[ aGroup ].push_back( mGlobalOrdering[ i ] );
+            }
+        }
+    } );
+    for( size_t i = 0; i < markets.size(); ++i ) {
+        markets[ i ]->mCalcList = groupOrdering[ marketGroup[ i ] ];
+    }
+    
+#if GCAM_PARALLEL_ENABLED
+    if( aCreateFlowGraphs ) {
+        // the parallel-grain-log can not be written to from several threads so
+        // each group's messages are collected and written once all are done
+        vector<GcamFlowGraph*> groupFlowGraph( groupFirstMarket.size(), 0 );
+        vector<GcamParallel::GrainLogMessages> groupLog( groupFirstMarket.size() );
+        forEachIndex( groupFirstMarket.size(), [&] ( size_t aGroup ) {
+            GcamParallel::DeferGrainLog deferLog( groupLog[ aGroup ] );
+            groupFlowGraph[ aGroup ] = new GcamFlowGraph();
+            GcamParallel::makeTBBFlowGraph( *this, *groupFlowGraph[ aGroup ], groupOrdering[ aGroup ] );
+        } );
+        for( const GcamParallel::GrainLogMessages& messages : groupLog ) {
+            GcamParallel::writeGrainLog( messages );
+        }
+        for( size_t i = 0; i < markets.size(); ++i ) {
+            /*! \pre Flow graphs have not been created for any market yet. */
+            assert( !markets[ i ]->mFlowGraph );
+            markets[ i ]->mFlowGraph = groupFlowGraph[ marketGroup[ i ] ];
+        }
+    }
+#endif
+    
+    ILogger& mainLog = ILogger::getLogger( "main_log" );
+    mainLog.setLevel( ILogger::DEBUG );
+    mainLog << "Created orderings for " << markets.size() << " markets with "
+            << groupFirstMarket.size() << " distinct sets of affected activities." << endl;
+}
+
 /*!
  * \brief A depth first search collecting a unique set of the vertices visited.
  * \details Recursively search for vertices.  The end points for recursion are if
@@ -411,14 +575,14 @@ void MarketDependencyFinder::createOrdering() {
     }
     
     // Initialize vertices in the graph.
-    CalcVertexCountMap numDependencies;
+    VertexCounts numDependencies( mCalcVertexUIDCount );
     for( CItemIterator it = mDependencyItems.begin(); it != mDependencyItems.end(); ++it ) {
         // Initialize dependency counts which will be used to do the topological sort.
         for( CVertexIterator vertexIter = (*it)->mPriceVertices.begin(); vertexIter != (*it)->mPriceVertices.end(); ++vertexIter ) {
-            numDependencies[ (*vertexIter) ] = 0;
+            numDependencies.set( *vertexIter, 0 );
         }
         for( CVertexIterator vertexIter = (*it)->mDemandVertices.begin(); vertexIter != (*it)->mDemandVertices.end(); ++vertexIter ) {
-            numDependencies[ (*vertexIter) ] = 0;
+            numDependencies.set( *vertexIter, 0 );
         }
         
         // Should this dependency item have multiple activities then we will just
@@ -428,13 +592,13 @@ void MarketDependencyFinder::createOrdering() {
         if( (*it)->mPriceVertices.size() > 1 ) {
             for( vector<CalcVertex*>::iterator vertexIter = (*it)->mPriceVertices.begin() + 1; vertexIter != (*it)->mPriceVertices.end(); ++vertexIter ) {
                 (*(vertexIter - 1))->mOutEdges.push_back( *vertexIter );
-                ++numDependencies[ *vertexIter ];
+                numDependencies.increment( *vertexIter );
             }
         }
         if( (*it)->mDemandVertices.size() > 1 ) {
             for( vector<CalcVertex*>::reverse_iterator vertexIter = (*it)->mDemandVertices.rbegin() + 1; vertexIter != (*it)->mDemandVertices.rend(); ++vertexIter ) {
                 (*(vertexIter - 1))->mOutEdges.push_back( *vertexIter );
-                ++numDependencies[ *vertexIter ];
+                numDependencies.increment( *vertexIter );
             }
         }
     }
@@ -466,9 +630,9 @@ void MarketDependencyFinder::createOrdering() {
                     // all of the items which directly depend on it must also be recalculated.
                     if( !(*it)->mPriceVertices.empty() ) {
                         (*it)->getLastPriceVertex()->mOutEdges.push_back( (*dependIt)->getFirstDemandVertex() );
-                        ++numDependencies[ (*dependIt)->getFirstDemandVertex() ];
+                        numDependencies.increment( (*dependIt)->getFirstDemandVertex() );
                         (*dependIt)->getLastDemandVertex()->mOutEdges.push_back( (*it)->getFirstDemandVertex() );
-                        ++numDependencies[ (*it)->getFirstDemandVertex() ];
+                        numDependencies.increment( (*it)->getFirstDemandVertex() );
                     }
                     else {
                         // These implied in edges will be added to the list of verticies to calculate
@@ -502,7 +666,7 @@ void MarketDependencyFinder::createOrdering() {
             // This is the fold back point, or final demand, so loop back on self
             // by linking the final price calculation to it's demand calculation.
             (*it)->getLastPriceVertex()->mOutEdges.push_back( (*it)->getFirstDemandVertex() );
-            ++numDependencies[ (*it)->getFirstDemandVertex() ];
+            numDependencies.increment( (*it)->getFirstDemandVertex() );
         }
         else {
             for( CItemIterator dependIt = (*it)->mDependentList.begin(); dependIt != (*it)->mDependentList.end(); ++dependIt ) {
@@ -515,19 +679,19 @@ void MarketDependencyFinder::createOrdering() {
                         if( !(*dependIt)->mDemandVertices.empty() ) {
                         // Could get here for instance if a resource has dependencies
                         (*it)->getLastPriceVertex()->mOutEdges.push_back( (*dependIt)->getFirstDemandVertex() );
-                            ++numDependencies[ (*dependIt)->getFirstDemandVertex() ];
+                            numDependencies.increment( (*dependIt)->getFirstDemandVertex() );
                         }
                         // else would get here if we had dependencies between two items which do
                         // not have anything to calculate yet are unsolved such as linked markets.
                     }
                     else {
                         (*it)->getLastPriceVertex()->mOutEdges.push_back( (*dependIt)->getFirstPriceVertex() );
-                        ++numDependencies[ (*dependIt)->getFirstPriceVertex() ];
+                        numDependencies.increment( (*dependIt)->getFirstPriceVertex() );
                     }
                 }
                 if( !(*dependIt)->mDemandVertices.empty()) {
                     (*dependIt)->getLastDemandVertex()->mOutEdges.push_back( (*it)->getFirstDemandVertex() );
-                    ++numDependencies[ (*it)->getFirstDemandVertex() ];
+                    numDependencies.increment( (*it)->getFirstDemandVertex() );
                 }
             }
         }
@@ -545,6 +709,79 @@ void MarketDependencyFinder::createOrdering() {
         }
     }
 
+    // Collect the vertices into an array indexed by their UID so that the remaining
+    // steps may work with compact integer indices rather than searching containers
+    // of pointers.
+    VertexList vertices( mCalcVertexUIDCount, 0 );
+    for( CItemIterator it = mDependencyItems.begin(); it != mDependencyItems.end(); ++it ) {
+        for( CVertexIterator vertexIter = (*it)->mPriceVertices.begin(); vertexIter != (*it)->mPriceVertices.end(); ++vertexIter ) {
+            vertices[ (*vertexIter)->mUID ] = *vertexIter;
+        }
+        for( CVertexIterator vertexIter = (*it)->mDemandVertices.begin(); vertexIter != (*it)->mDemandVertices.end(); ++vertexIter ) {
+            vertices[ (*vertexIter)->mUID ] = *vertexIter;
+        }
+    }
+
+    // The global ordering and the items which must be solved with trial markets
+    // depend only on the graph constructed above.  When a cache file is configured
+    // they are stored keyed by a hash of that graph so that subsequent runs, such
+    // as each scenario in a batch, may skip sorting and breaking cycles entirely.
+    const string cacheBaseName = Configuration::getInstance()->getFile( "dependency-ordering-cache", "", false );
+    string cacheFileName;
+    uint64_t graphHash = 0;
+    bool loadedFromCache = false;
+    if( !cacheBaseName.empty() ) {
+        graphHash = calcOrderingHash( vertices );
+        stringstream hashStr;
+        hashStr << hex << setw( 16 ) << setfill( '0' ) << graphHash;
+        cacheFileName = cacheBaseName + "." + hashStr.str();
+        loadedFromCache = loadOrderingCache( cacheFileName, graphHash, vertices, numDependencies );
+        if( loadedFromCache ) {
+            depLog.setLevel( ILogger::NOTICE );
+            depLog << "Loaded the global ordering from " << cacheFileName << endl;
+        }
+    }
+
+    if( !loadedFromCache ) {
+        VertexList trialVertices;
+        VertexList ordering;
+        createGlobalOrdering( vertices, numDependencies, trialVertices, ordering );
+        mGlobalOrdering.reserve( ordering.size() );
+        for( CVertexIterator it = ordering.begin(); it != ordering.end(); ++it ) {
+            mGlobalOrdering.push_back( (*it)->mCalcItem );
+        }
+        if( !cacheFileName.empty() ) {
+            saveOrderingCache( cacheFileName, graphHash, trialVertices, ordering );
+        }
+    }
+    
+    // All vertices are now cleared and we have a global ordering.
+    depLog.setLevel( ILogger::DEBUG );
+    depLog << "Global Ordering:" << endl;
+    for( vector<IActivity*>::iterator it = mGlobalOrdering.begin(); it != mGlobalOrdering.end(); ++it ) {
+        depLog << "- " << (*it)->getDescription() << endl;
+    }
+}
+
+/*!
+ * \brief Perform a topological sort on the connected dependency graph to create
+ *        the global ordering.
+ * \details Items which have a self dependence are converted to be solved via
+ *          trial markets up front.  Any other cycles will be broken when they are
+ *          no longer possible to avoid.
+ * \param aVertices All of the CalcVertex indexed by their UID.
+ * \param aNumDependencies The number of dependencies on each vertex.
+ * \param aTrialVertices Will be filled with the first demand vertex of each item
+ *                       that was reset to use trial markets in the order in which
+ *                       they were reset.
+ * \param aOrdering Will be filled with the vertices in the order they should be
+ *                  calculated.
+ */
+void MarketDependencyFinder::createGlobalOrdering( const VertexList& aVertices, VertexCounts& aNumDependencies,
+                                                   VertexList& aTrialVertices, VertexList& aOrdering )
+{
+    ILogger& depLog = ILogger::getLogger( "dependency_finder_log" );
+
     // Before we can create an ordering we must take care of any item which have a
     // self dependence by converting them to solved via trial markets
     for( CItemIterator it = mDependencyItems.begin(); it != mDependencyItems.end(); ++it ) {
@@ -552,52 +789,45 @@ void MarketDependencyFinder::createOrdering() {
             depLog.setLevel( ILogger::WARNING );
             depLog << "Creating trial markets for " << (*it)->mName << " in " << (*it)->mLocatedInRegion
                    << " due to self dependency." << endl;
-            createTrialsForItem( it, numDependencies );
+            createTrialsForItem( it, aNumDependencies );
+            aTrialVertices.push_back( (*it)->getFirstDemandVertex() );
         }
     }
     
-    // A map which will be populated with vertices in cycles the first time one is
-    // found and can be used there after to break cycles as needed while
-    // performing the topological sort.
-    CalcVertexCountMap totalVisits;
+    // The vertices in cycles which will be populated the first time one is found
+    // and can be used there after to break cycles as needed while performing the
+    // topological sort.  The number of times each has been visited while searching
+    // for cycles is kept by UID where -1 indicates it is not part of a cycle.
+    VertexList cycleVertices;
+    vector<int> cycleVisits( aVertices.size(), -1 );
+    vector<bool> onStack( aVertices.size(), false );
+    vector<bool> onPath( aVertices.size(), false );
 
     // Create a global ordering by performing a topological sort on the graph.
     // Cycles will be broken when they are no longer possible to avoid.
-    while( !numDependencies.empty() ) {
+    VertexList justRemoved;
+    while( !aNumDependencies.empty() ) {
         // We can clear a vertex and add it to the ordering list if the number of
         // dependencies on it is equal to zero.
-        vector<CalcVertex*> justRemoved;
-        typedef CalcVertexCountMap::iterator NumDepIterator;
-        for( NumDepIterator it = numDependencies.begin(); it != numDependencies.end(); ) {
-            if( (*it).second == 0 ) {
-                justRemoved.push_back( (*it).first );
-                numDependencies.erase( it++ );
-            }
-            else {
-                ++it;
-            }
-        }
+        justRemoved.clear();
+        aNumDependencies.takeReady( aVertices, justRemoved );
         for( VertexIterator removedIter = justRemoved.begin(); removedIter != justRemoved.end(); ++removedIter ) {
             // When a vertex is cleared we can reduce the number of remaining
             // dependencies from it's direct dependents.
             for( VertexIterator depIter = (*removedIter)->mOutEdges.begin(); depIter != (*removedIter)->mOutEdges.end(); ++ depIter ) {
-                NumDepIterator dependCountIter = numDependencies.find( *depIter );
-                if( dependCountIter != numDependencies.end() ) {
-                    --(*dependCountIter).second;
-                }
+                aNumDependencies.decrement( *depIter );
             }
-            mGlobalOrdering.push_back( (*removedIter)->mCalcItem );
+            aOrdering.push_back( *removedIter );
         }
         
         // We are no longer able to find any vertices without any dependencies and
         // all vertices have not yet been cleared.  This means we are now forced
         // to break a cycle.
-        if( justRemoved.empty() && !numDependencies.empty() ) {
+        if( justRemoved.empty() && !aNumDependencies.empty() ) {
             depLog.setLevel( ILogger::WARNING );
             depLog << "Cycle detected attempting to break it." << endl;
 
-            list<CalcVertex*> hasVisited;
-            if( totalVisits.empty() ) {
+            if( cycleVertices.empty() ) {
                 // We will need to create the list of possible vertices to use to break the
                 // cycle.  We will do this by finding the strongly coupled components of the
                 // graph that we have left, or put another way the vertices that are part of
@@ -605,43 +835,48 @@ void MarketDependencyFinder::createOrdering() {
                 // the cycle without having to search through a potentially large number of
                 // extraneous vertices.
                 int index = 0;
-                for( NumDepIterator it = numDependencies.begin(); it != numDependencies.end(); ++it ) {
-                    if( (*it).first->mIndex == -1 ) {
-                        findStronglyConnected( (*it).first, index, hasVisited, totalVisits );
+                for( CVertexIterator it = aVertices.begin(); it != aVertices.end(); ++it ) {
+                    if( aNumDependencies.contains( *it ) && (*it)->mIndex == -1 ) {
+                        findStronglyConnected( *it, index, onStack, cycleVertices );
                     }
                 }
+                // Keep the vertices sorted by UID so that ties are broken consistently.
+                sort( cycleVertices.begin(), cycleVertices.end(), CalcVertexComp() );
             }
             else {
                 // Since we have already determined which vertices are in a cycle we 
                 // can just use them again.  We just need to update the list to remove
                 // vertices which have been cleared since the last time it was used.
-                for( NumDepIterator it = totalVisits.begin(); it != totalVisits.end(); ) {
-                    if( numDependencies.find( (*it).first ) == numDependencies.end() ) {
-                        totalVisits.erase( it++ );
+                VertexIterator keepEnd = cycleVertices.begin();
+                for( VertexIterator it = cycleVertices.begin(); it != cycleVertices.end(); ++it ) {
+                    if( aNumDependencies.contains( *it ) ) {
+                        *keepEnd++ = *it;
                     }
                     else {
-                        (*it).second = 0;
-                        ++it;
+                        cycleVisits[ (*it)->mUID ] = -1;
                     }
                 }
+                cycleVertices.erase( keepEnd, cycleVertices.end() );
+            }
+            for( CVertexIterator it = cycleVertices.begin(); it != cycleVertices.end(); ++it ) {
+                cycleVisits[ (*it)->mUID ] = 0;
             }
 
             // The vertex chosen to break the cycle will be the one most visited
             // when searching the graph from all of the vertices which are part of
             // a strongly connected component.
-            for( NumDepIterator it = totalVisits.begin(); it != totalVisits.end(); ++it ) {
-                hasVisited.clear();
-                markCycles( (*it).first, hasVisited, totalVisits );
+            for( CVertexIterator it = cycleVertices.begin(); it != cycleVertices.end(); ++it ) {
+                markCycles( *it, onPath, cycleVisits );
             }
 
             // We will choose the vertex with the most visits to break a cycle unless
             // it has a dependency which can not be broken when creating trial markets.
             int max = 0;
             CalcVertex* maxVertex = 0;
-            for( NumDepIterator it = totalVisits.begin(); it != totalVisits.end(); ++it ) {            
-                if( (*it).first->mDepItem->mCanBreakCycle && (*it).second > max ) {
-                    maxVertex = (*it).first;
-                    max = (*it).second;
+            for( CVertexIterator it = cycleVertices.begin(); it != cycleVertices.end(); ++it ) {
+                if( (*it)->mDepItem->mCanBreakCycle && cycleVisits[ (*it)->mUID ] > max ) {
+                    maxVertex = *it;
+                    max = cycleVisits[ (*it)->mUID ];
                 }
             }
             if( !maxVertex ) {
@@ -656,44 +891,29 @@ void MarketDependencyFinder::createOrdering() {
             // Now that we identified the best vertex to remove we must find the
             // corresponding dependency item since the current strategy for breaking
             // cycles requires that we solve the price and demand together.
-            CItemIterator maxItem = mDependencyItems.end();
-            for( CItemIterator it = mDependencyItems.begin(); it != mDependencyItems.end() && maxItem == mDependencyItems.end(); ++it ) {
-                // The max vertex could be either a price or demand vertex so we
-                // must check both vectors.
-                for( VertexIterator vertexIter = (*it)->mPriceVertices.begin(); vertexIter != (*it)->mPriceVertices.end() && maxItem == mDependencyItems.end(); ++vertexIter ) {
-                    if( *vertexIter == maxVertex ) {
-                        maxItem = it;
-                    }
-                }
-                for( VertexIterator vertexIter = (*it)->mDemandVertices.begin(); vertexIter != (*it)->mDemandVertices.end() && maxItem == mDependencyItems.end(); ++vertexIter ) {
-                    if( *vertexIter == maxVertex ) {
-                        maxItem = it;
-                    }
-                }
-            }
+            CItemIterator maxItem = mDependencyItems.find( maxVertex->mDepItem );
+            assert( maxItem != mDependencyItems.end() );
             
             // Reset this item to be solved via trials and adjust the depenencies accordingly.
-            createTrialsForItem( maxItem, numDependencies );
+            createTrialsForItem( maxItem, aNumDependencies );
+            aTrialVertices.push_back( (*maxItem)->getFirstDemandVertex() );
 
-            // Remove both the price and demand vertex from totalVisits since they can not be
-            // used again to try to break a dependency.
-            NumDepIterator delIt = totalVisits.find( (*maxItem)->getFirstDemandVertex() );
-            if( delIt != totalVisits.end() ) {
-                totalVisits.erase( delIt );
-            }
-            delIt = totalVisits.find( (*maxItem)->getFirstPriceVertex() );
-            if( delIt != totalVisits.end() ) {
-                totalVisits.erase( delIt );
+            // Remove both the price and demand vertex from the cycle vertices since they
+            // can not be used again to try to break a dependency.
+            CalcVertex* demandVertex = (*maxItem)->getFirstDemandVertex();
+            CalcVertex* priceVertex = (*maxItem)->mPriceVertices.empty() ? 0 : (*maxItem)->getFirstPriceVertex();
+            VertexIterator keepEnd = cycleVertices.begin();
+            for( VertexIterator it = cycleVertices.begin(); it != cycleVertices.end(); ++it ) {
+                if( *it != demandVertex && *it != priceVertex ) {
+                    *keepEnd++ = *it;
+                }
+                else {
+                    cycleVisits[ (*it)->mUID ] = -1;
+                }
             }
+            cycleVertices.erase( keepEnd, cycleVertices.end() );
         }
     }
-    
-    // All vertices are now cleared and we have a global ordering.
-    depLog.setLevel( ILogger::DEBUG );
-    depLog << "Global Ordering:" << endl;
-    for( vector<IActivity*>::iterator it = mGlobalOrdering.begin(); it != mGlobalOrdering.end(); ++it ) {
-        depLog << "- " << (*it)->getDescription() << endl;
-    }
 }
 
 /*!
@@ -702,55 +922,78 @@ void MarketDependencyFinder::createOrdering() {
  * \details This is an efficient algorithm to quickly identify activities that are
  *          part of a cycle and can give us a small subset of vertices to run
  *          markCycles on to figure out which is the best to use to break the cycles.
- * \param aCurrVertex The current vertex being visited.
+ *          The depth first search is done with an explicit stack so that it runs
+ *          in time linear in the size of the graph without risk of overflowing the
+ *          call stack on long dependency chains.
+ * \param aRootVertex The vertex from which to start the search.
  * \param aMaxIndex The current max index which can be used to give an index to an 
  *                  unprocessed vertex.
- * \param aHasVisited The list of vertices which make up the current search path.
- * \param aTotalVisits The map of vertices to the total number of times that node
- *                      has been visited to be used in markCycles but will be
- *                      initialized here.
+ * \param aOnStack Flags indexed by UID for vertices which are currently on the
+ *                 Tarjan stack.  These will all be reset before returning.
+ * \param aCycleVertices The vertices which are part of a strongly connected component
+ *                       that are found will be added to this list.
  */
-void MarketDependencyFinder::findStronglyConnected( CalcVertex* aCurrVertex, int& aMaxIndex,
-                                                    list<CalcVertex*>& aHasVisited,
-                                                    CalcVertexCountMap& aTotalVisits ) const
+void MarketDependencyFinder::findStronglyConnected( CalcVertex* aRootVertex, int& aMaxIndex,
+                                                    vector<bool>& aOnStack,
+                                                    VertexList& aCycleVertices ) const
 {
+    // The current search path along with the next out edge to follow for each.
+    vector<pair<CalcVertex*, size_t> > searchPath;
+    VertexList componentStack;
+
     // Initialize the newly found vertex with an index, increase the max count,
-    // and add it to the current search patch.
-    aCurrVertex->mIndex = aCurrVertex->mLowLink = aMaxIndex++;
-    aHasVisited.push_back( aCurrVertex );
-
-    for( VertexIterator it = aCurrVertex->mOutEdges.begin(); it != aCurrVertex->mOutEdges.end(); ++it ) {
-        if( (*it)->mIndex == -1 ) {
-            // This successor has not been processed recurse on it.
-            findStronglyConnected( *it, aMaxIndex, aHasVisited, aTotalVisits );
-            aCurrVertex->mLowLink = min( aCurrVertex->mLowLink, (*it)->mLowLink );
-        }
-        else if( find( aHasVisited.begin(), aHasVisited.end(), *it ) != aHasVisited.end() ) {
-            // This successor is in the path thus we have found a cycle.
-            aCurrVertex->mLowLink = min( aCurrVertex->mLowLink, (*it)->mIndex );
-        }
-    }
-
-    // If the current vertex was part of a cycle then initialize aTotalVisits
-    // with the members of the strongly connected component.
-    /*
-     * \note We are not currently keeping track of each set of strongly connected
-     *       components and instead are just interested in any vertex that is part
-     *       of a set of strongly connected components.  This is because we use
-     *       markCycles to perform searches on this set to understand how they relate
-     *       however if we want replace markCycles with a method that does not require
-     *       searching this information may be valuable.
-     */
-    if( aCurrVertex->mIndex == aCurrVertex->mLowLink ) {
-        if( aHasVisited.back() != aCurrVertex ) {
-            aTotalVisits[ aCurrVertex ] = 0;
+    // and add it to the current search path.
+    aRootVertex->mIndex = aRootVertex->mLowLink = aMaxIndex++;
+    componentStack.push_back( aRootVertex );
+    aOnStack[ aRootVertex->mUID ] = true;
+    searchPath.push_back( make_pair( aRootVertex, size_t( 0 ) ) );
+
+    while( !searchPath.empty() ) {
+        CalcVertex* currVertex = searchPath.back().first;
+        size_t& edgeIndex = searchPath.back().second;
+        if( edgeIndex < currVertex->mOutEdges.size() ) {
+            CalcVertex* nextVertex = currVertex->mOutEdges[ edgeIndex++ ];
+            if( nextVertex->mIndex == -1 ) {
+                // This successor has not been processed, search from it next.
+                nextVertex->mIndex = nextVertex->mLowLink = aMaxIndex++;
+                componentStack.push_back( nextVertex );
+                aOnStack[ nextVertex->mUID ] = true;
+                searchPath.push_back( make_pair( nextVertex, size_t( 0 ) ) );
+            }
+            else if( aOnStack[ nextVertex->mUID ] ) {
+                // This successor is in the stack thus we have found a cycle.
+                currVertex->mLowLink = min( currVertex->mLowLink, nextVertex->mIndex );
+            }
+            continue;
         }
-        while( aHasVisited.back() != aCurrVertex ) {
-            CalcVertex* w = aHasVisited.back();
-            aTotalVisits[ w ] = 0;
-            aHasVisited.pop_back();
+
+        // All successors have been processed.  If the current vertex was part of
+        // a cycle then add the members of the strongly connected component.
+        /*
+         * \note We are not currently keeping track of each set of strongly connected
+         *       components and instead are just interested in any vertex that is part
+         *       of a set of strongly connected components.  This is because we use
+         *       markCycles to perform searches on this set to understand how they relate
+         *       however if we want replace markCycles with a method that does not require
+         *       searching this information may be valuable.
+         */
+        if( currVertex->mIndex == currVertex->mLowLink ) {
+            const bool isCycle = componentStack.back() != currVertex;
+            CalcVertex* member;
+            do {
+                member = componentStack.back();
+                componentStack.pop_back();
+                aOnStack[ member->mUID ] = false;
+                if( isCycle ) {
+                    aCycleVertices.push_back( member );
+                }
+            } while( member != currVertex );
+        }
+        searchPath.pop_back();
+        if( !searchPath.empty() ) {
+            CalcVertex* parentVertex = searchPath.back().first;
+            parentVertex->mLowLink = min( parentVertex->mLowLink, currVertex->mLowLink );
         }
-        aHasVisited.pop_back();
     }
 }
 
@@ -763,52 +1006,40 @@ void MarketDependencyFinder::findStronglyConnected( CalcVertex* aCurrVertex, int
  *          of times a vertex can be found to be in a cycle to avoid excessive searching
  *          when a good vertex to break a cycle has already been found.
  * \param aCurrVertex The current vertex being visited.
- * \param aHasVisited The list of vertices which make up the current search path.
- * \param aTotalVisits The map of vertices to the total number of times that node
- *                      has been visited.
+ * \param aOnPath Flags indexed by UID for the vertices which make up the current
+ *                search path.
+ * \param aCycleVisits The total number of times each vertex, indexed by UID, has
+ *                     been visited or -1 if it is not part of a cycle.
  * \return The maximum number of cycle-visits so far.
  */
-int MarketDependencyFinder::markCycles( CalcVertex* aCurrVertex, list<CalcVertex*>& aHasVisited,
-                                        CalcVertexCountMap& aTotalVisits ) const
+int MarketDependencyFinder::markCycles( CalcVertex* aCurrVertex, vector<bool>& aOnPath,
+                                        vector<int>& aCycleVisits ) const
 {
-    if( aTotalVisits.find( aCurrVertex ) == aTotalVisits.end() ) {
+    int& currVisits = aCycleVisits[ aCurrVertex->mUID ];
+    if( currVisits == -1 ) {
         return 0;
     }
-    typedef CalcVertexCountMap::iterator NumDepIterator;
-    if( find( aHasVisited.begin(), aHasVisited.end(), aCurrVertex ) != aHasVisited.end() ) {
+    if( aOnPath[ aCurrVertex->mUID ] ) {
         // This search path has just formed a cycle, increase the visit count and
         // indicate that this path leads to a cycle.
-        NumDepIterator it = aTotalVisits.find( aCurrVertex );
-        if( it == aTotalVisits.end() ) {
-            aTotalVisits[ aCurrVertex ] = 1;
-        }
-        else {
-            ++aTotalVisits[ aCurrVertex ];
-        }
-        return aTotalVisits[ aCurrVertex ];
+        return ++currVisits;
     }
     else {
         // Have not yet created a cycle so add this vertex to the search path and
         // keep searching.
-        aHasVisited.push_back( aCurrVertex );
+        aOnPath[ aCurrVertex->mUID ] = true;
         const int MAX_CYCLE_VISITS = 1000;
         int cycleVisits = 0;
         for( VertexIterator it = aCurrVertex->mOutEdges.begin(); it != aCurrVertex->mOutEdges.end() && cycleVisits < MAX_CYCLE_VISITS; ++it ) {
-            int currCycleVisits = markCycles( *it, aHasVisited, aTotalVisits );
+            int currCycleVisits = markCycles( *it, aOnPath, aCycleVisits );
             cycleVisits = max( cycleVisits, currCycleVisits );
         }
-        aHasVisited.pop_back();
+        aOnPath[ aCurrVertex->mUID ] = false;
 
         // If any searches from this vertex eventually leads to a cycle then we
         // must increase the visit count for this vertex.
         if( cycleVisits ) {
-            NumDepIterator it = aTotalVisits.find( aCurrVertex );
-            if( it == aTotalVisits.end() ) {
-                aTotalVisits[ aCurrVertex ] = 1;
-            }
-            else {
-                ++aTotalVisits[ aCurrVertex ];
-            }
+            ++currVisits;
         }
         return cycleVisits;
     }
@@ -829,7 +1060,7 @@ int MarketDependencyFinder::markCycles( CalcVertex* aCurrVertex, list<CalcVertex
  *                         createOrdering.  This will need to be updated to reflect the changed
  *                         dependencies since the market is now solved.
  */
-void MarketDependencyFinder::createTrialsForItem( CItemIterator aItemToReset, CalcVertexCountMap& aNumDependencies ) {
+void MarketDependencyFinder::createTrialsForItem( CItemIterator aItemToReset, VertexCounts& aNumDependencies ) {
     // Instruct the marketplace to go ahead and create solved trial price and demand
     // markets for this good.
     const int demandMrkt = mMarketplace->resetToPriceMarket( (*aItemToReset)->mLinkedMarket );
@@ -858,7 +1089,7 @@ void MarketDependencyFinder::createTrialsForItem( CItemIterator aItemToReset, Ca
             }
         }
     }
-    aNumDependencies[ (*aItemToReset)->getFirstDemandVertex() ] = fixedOutputVertices.size();
+    aNumDependencies.set( (*aItemToReset)->getFirstDemandVertex(), fixedOutputVertices.size() );
 
     // Lookup/create the associated market linkages to the price and demand
     // vertices.
@@ -878,10 +1109,7 @@ void MarketDependencyFinder::createTrialsForItem( CItemIterator aItemToReset, Ca
 
     // Make dependencies from these price vertices implied only.
     for( VertexIterator dependIter = (*aItemToReset)->getLastPriceVertex()->mOutEdges.begin(); dependIter != (*aItemToReset)->getLastPriceVertex()->mOutEdges.end(); ) {
-        CalcVertexCountMap::iterator dependCountIter = aNumDependencies.find( *dependIter );
-        if( dependCountIter != aNumDependencies.end() ) {
-            --(*dependCountIter).second;
-        }
+        aNumDependencies.decrement( *dependIter );
         (*priceMrktIter)->mImpliedVertices.insert( *dependIter );
         dependIter = (*aItemToReset)->getLastPriceVertex()->mOutEdges.erase( dependIter );
     }
@@ -889,8 +1117,228 @@ void MarketDependencyFinder::createTrialsForItem( CItemIterator aItemToReset, Ca
     // The price vertex still must be calculated before the demand vertex
     // so add that dependency back in.
     (*aItemToReset)->getLastPriceVertex()->mOutEdges.push_back( (*aItemToReset)->getFirstDemandVertex() );
-    if( aNumDependencies.find( (*aItemToReset)->getFirstPriceVertex() ) != aNumDependencies.end() ) {
-        ++aNumDependencies[ (*aItemToReset)->getFirstDemandVertex() ];
+    if( aNumDependencies.contains( (*aItemToReset)->getFirstPriceVertex() ) ) {
+        aNumDependencies.increment( (*aItemToReset)->getFirstDemandVertex() );
+    }
+}
+
+
+/*!
+ * \brief Calculate a hash of the connected dependency graph which identifies
+ *        the inputs used to create the global ordering.
+ * \details The hash includes each vertex's activity and dependency item along
+ *          with all of the dependency edges.  It is used to key the ordering
+ *          cache so that a cached ordering is only reused when it was generated
+ *          from an identical graph.
+ * \param aVertices All of the CalcVertex indexed by their UID.
+ * \return A 64-bit hash of the dependency graph.
+ */
+uint64_t MarketDependencyFinder::calcOrderingHash( const VertexList& aVertices ) const {
+    uint64_t hash = util::FNV_OFFSET_BASIS;
+    hashValue( hash, static_cast<int>( aVertices.size() ) );
+    for( CVertexIterator it = aVertices.begin(); it != aVertices.end(); ++it ) {
+        const DependencyItem* depItem = (*it)->mDepItem;
+        hashValue( hash, (*it)->mCalcItem->getDescription() );
+        hashValue( hash, depItem->mName );
+        hashValue( hash, depItem->mLocatedInRegion );
+        hashValue( hash, depItem->mLinkedMarket );
+        hashValue( hash, depItem->mIsSolved );
+        hashValue( hash, depItem->mCanBreakCycle );
+        hashValue( hash, depItem->mHasSelfDependence );
+        hashValue( hash, static_cast<int>( (*it)->mOutEdges.size() ) );
+        for( CVertexIterator edgeIter = (*it)->mOutEdges.begin(); edgeIter != (*it)->mOutEdges.end(); ++edgeIter ) {
+            hashValue( hash, (*edgeIter)->mUID );
+        }
+    }
+    return hash;
+}
+
+/*!
+ * \brief Attempt to load the global ordering and trial markets from a cache file
+ *        written by saveOrderingCache.
+ * \details All of the cached data is validated before any changes are made so
+ *          that if the cache is unusable the ordering may still be created as
+ *          usual.  If it is valid the items recorded as requiring trial markets
+ *          are reset in the same order they originally were which reproduces the
+ *          same markets and dependencies.
+ * \param aFileName The cache file name.
+ * \param aHash The hash of the current dependency graph.
+ * \param aVertices All of the CalcVertex indexed by their UID.
+ * \param aNumDependencies The number of dependencies on each vertex.
+ * \return True if the global ordering was loaded from the cache.
+ */
+bool MarketDependencyFinder::loadOrderingCache( const string& aFileName, const uint64_t aHash,
+                                                const VertexList& aVertices, VertexCounts& aNumDependencies )
+{
+    ifstream cacheFile( aFileName.c_str() );
+    if( !cacheFile.is_open() ) {
+        return false;
+    }
+
+    uint64_t cachedHash = 0;
+    cacheFile >> hex >> cachedHash >> dec;
+    VertexList trialVertices;
+    VertexList ordering;
+    VertexList* uidLists[] = { &trialVertices, &ordering };
+    for( size_t listIndex = 0; listIndex < 2 && cacheFile; ++listIndex ) {
+        size_t numUIDs = 0;
+        cacheFile >> numUIDs;
+        for( size_t i = 0; i < numUIDs && cacheFile; ++i ) {
+            int uid = -1;
+            cacheFile >> uid;
+            if( uid < 0 || uid >= static_cast<int>( aVertices.size() ) ) {
+                cacheFile.setstate( ios_base::failbit );
+            }
+            else {
+                uidLists[ listIndex ]->push_back( aVertices[ uid ] );
+            }
+        }
+    }
+    if( !cacheFile || cachedHash != aHash ) {
+        ILogger& depLog = ILogger::getLogger( "dependency_finder_log" );
+        depLog.setLevel( ILogger::WARNING );
+        depLog << "Ignoring invalid dependency ordering cache: " << aFileName << endl;
+        return false;
+    }
+
+    for( CVertexIterator it = trialVertices.begin(); it != trialVertices.end(); ++it ) {
+        createTrialsForItem( mDependencyItems.find( (*it)->mDepItem ), aNumDependencies );
+    }
+    mGlobalOrdering.reserve( ordering.size() );
+    for( CVertexIterator it = ordering.begin(); it != ordering.end(); ++it ) {
+        mGlobalOrdering.push_back( (*it)->mCalcItem );
+    }
+    return true;
+}
+
+/*!
+ * \brief Write the global ordering and trial markets to a cache file so that
+ *        they may be loaded by loadOrderingCache in subsequent runs.
+ * \details Vertices are written by UID as a hash followed by the trial
+ *          market list then the ordering each preceded by their size.  The cache
+ *          is written to a temporary file which is then moved into place so that
+ *          a concurrent run never loads a partial file.
+ * \param aFileName The cache file name.
+ * \param aHash The hash of the dependency graph.
+ * \param aTrialVertices The first demand vertex of each item that was reset to
+ *                       use trial markets in the order in which they were reset.
+ * \param aOrdering The vertices in the global ordering.
+ */
+void MarketDependencyFinder::saveOrderingCache( const string& aFileName, const uint64_t aHash,
+                                                const VertexList& aTrialVertices,
+                                                const VertexList& aOrdering ) const
+{
+    const string tempFileName = util::getTempFileName( aFileName );
+    {
+        ofstream cacheFile( tempFileName.c_str() );
+        if( cacheFile.is_open() ) {
+            cacheFile << hex << aHash << dec << endl;
+            const VertexList* uidLists[] = { &aTrialVertices, &aOrdering };
+            for( size_t listIndex = 0; listIndex < 2; ++listIndex ) {
+                cacheFile << uidLists[ listIndex ]->size();
+                for( CVertexIterator it = uidLists[ listIndex ]->begin(); it != uidLists[ listIndex ]->end(); ++it ) {
+                    cacheFile << ' ' << (*it)->mUID;
+                }
+                cacheFile << endl;
+            }
+        }
+        if( !cacheFile ) {
+            cacheFile.close();
+            remove( tempFileName.c_str() );
+            ILogger& depLog = ILogger::getLogger( "dependency_finder_log" );
+            depLog.setLevel( ILogger::WARNING );
+            depLog << "Could not write dependency ordering cache: " << aFileName << endl;
+            return;
+        }
+    }
+    if( !util::replaceFile( tempFileName, aFileName ) ) {
+        ILogger& depLog = ILogger::getLogger( "dependency_finder_log" );
+        depLog.setLevel( ILogger::WARNING );
+        depLog << "Could not move dependency ordering cache into place: " << aFileName << endl;
+    }
+}
+
+/*!
+ * \brief Constructor.
+ * \param aNumVertices The total number of vertices.
+ */
+MarketDependencyFinder::VertexCounts::VertexCounts( const size_t aNumVertices ):
+mCount( aNumVertices, 0 ),
+mIsRemaining( aNumVertices, false ),
+mNumRemaining( 0 )
+{
+}
+
+/*!
+ * \brief Check if the given vertex remains to be ordered.
+ * \param aVertex The vertex to check.
+ * \return True if the vertex has not yet been ordered.
+ */
+bool MarketDependencyFinder::VertexCounts::contains( const CalcVertex* aVertex ) const {
+    return mIsRemaining[ aVertex->mUID ];
+}
+
+/*!
+ * \brief Check if all vertices have been ordered.
+ * \return True if no vertices remain.
+ */
+bool MarketDependencyFinder::VertexCounts::empty() const {
+    return mNumRemaining == 0;
+}
+
+/*!
+ * \brief Set the dependency count for a vertex, adding it to the vertices which
+ *        remain to be ordered if necessary.
+ * \param aVertex The vertex to set.
+ * \param aCount The number of dependencies on the vertex.
+ */
+void MarketDependencyFinder::VertexCounts::set( const CalcVertex* aVertex, const int aCount ) {
+    if( !mIsRemaining[ aVertex->mUID ] ) {
+        mIsRemaining[ aVertex->mUID ] = true;
+        ++mNumRemaining;
+    }
+    mCount[ aVertex->mUID ] = aCount;
+    mChanged.push_back( aVertex->mUID );
+}
+
+/*!
+ * \brief Increase the dependency count for a vertex, adding it to the vertices
+ *        which remain to be ordered if necessary.
+ * \param aVertex The vertex to increment.
+ */
+void MarketDependencyFinder::VertexCounts::increment( const CalcVertex* aVertex ) {
+    set( aVertex, mIsRemaining[ aVertex->mUID ] ? mCount[ aVertex->mUID ] + 1 : 1 );
+}
+
+/*!
+ * \brief Decrease the dependency count for a vertex if it remains to be ordered.
+ * \param aVertex The vertex to decrement.
+ */
+void MarketDependencyFinder::VertexCounts::decrement( const CalcVertex* aVertex ) {
+    if( mIsRemaining[ aVertex->mUID ] ) {
+        --mCount[ aVertex->mUID ];
+        mChanged.push_back( aVertex->mUID );
     }
 }
 
+/*!
+ * \brief Remove all vertices which no longer have any dependencies.
+ * \details Only the vertices whose count changed since the last call need to
+ *          be checked.  The ready vertices are returned in UID order.
+ * \param aVertices All of the CalcVertex indexed by their UID.
+ * \param aReady The list to which the removed vertices will be added.
+ */
+void MarketDependencyFinder::VertexCounts::takeReady( const vector<CalcVertex*>& aVertices,
+                                                      vector<CalcVertex*>& aReady )
+{
+    sort( mChanged.begin(), mChanged.end() );
+    mChanged.erase( unique( mChanged.begin(), mChanged.end() ), mChanged.end() );
+    for( vector<int>::const_iterator it = mChanged.begin(); it != mChanged.end(); ++it ) {
+        if( mIsRemaining[ *it ] && mCount[ *it ] == 0 ) {
+            mIsRemaining[ *it ] = false;
+            --mNumRemaining;
+            aReady.push_back( aVertices[ *it ] );
+        }
+    }
+    mChanged.clear();
+}
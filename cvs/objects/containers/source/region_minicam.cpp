@@ -150,6 +150,11 @@ bool RegionMiniCAM::XMLParse(rapidxml::xml_node<char>* & aNode) {
     }
 }
 
+//! Coefficients parsed by XMLParse are kept in mPrimaryFuelCO2Coef.
+bool RegionMiniCAM::isXMLParseReflected() const {
+    return true;
+}
+
 
 /*! Complete the initialization. Get the size of vectors, initialize AGLU,
 *   create all markets, call complete initialization
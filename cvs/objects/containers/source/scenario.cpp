@@ -50,13 +50,16 @@
 #include "marketplace/include/marketplace.h"
 #include "containers/include/world.h"
 #include "util/base/include/xml_helper.h"
+#include "util/base/include/util.h"
 #include "util/base/include/xml_parse_helper.h"
 #include "util/base/include/configuration.h"
 #include "util/logger/include/ilogger.h"
 #include "util/curves/include/curve.h"
 #include "solution/solvers/include/solver.h"
 #include "util/base/include/auto_file.h"
+#include "util/base/include/background_output_file.h"
 #include "util/base/include/timer.h"
+#include "util/base/include/activity_profiler.h"
 #include "reporting/include/graph_printer.h"
 #include "reporting/include/land_allocator_printer.h"
 #include "solution/solvers/include/solver_factory.h"
@@ -66,6 +69,7 @@
 #include "util/base/include/manage_state_variables.hpp"
 #include "util/base/include/supply_demand_curve_saver.h"
 #include "containers/include/calc_base_price.h"
+#include "reporting/include/period_results_streamer.h"
 
 #if GCAM_PARALLEL_ENABLED && PARALLEL_DEBUG
 #include <stdlib.h>
@@ -268,8 +272,10 @@ bool Scenario::run( const int aSinglePeriod,
     // Avoid accumulating unsolved periods.
     mUnsolvedPeriods.clear();
     
-    // Open the debugging files.
-    AutoOutputFile XMLDebugFile( "xmlDebugFileName", "debug.xml", aPrintDebugging );
+    // Open the debugging files.  The debug XML may be compressed, by naming it .gz
+    // or .zst, and written on a background thread as each period is completed.
+    BackgroundOutputFile XMLDebugFile( "xmlDebugFileName", "debug.xml", aPrintDebugging,
+                                       conf->getBool( "background-debug-output", false, false ) );
     Tabs tabs;
     if( aPrintDebugging ) {
         // Write opening tags for debug XML
@@ -279,6 +285,8 @@ bool Scenario::run( const int aSinglePeriod,
         tabs.increaseIndent();
     }
 
+    TimerRegistry::getInstance().initProfiling();
+    ActivityProfiler::getInstance().reset();
     Timer& fullScenarioTimer = TimerRegistry::getInstance().getTimer( TimerRegistry::FULLSCENARIO );
     fullScenarioTimer.start();
     
@@ -292,6 +300,7 @@ bool Scenario::run( const int aSinglePeriod,
     if( aSinglePeriod == RUN_ALL_PERIODS ){
         for( int per = 0; per < mModeltime->getmaxper(); per++ ){
             success &= calculatePeriod( per, *XMLDebugFile, &tabs, aPrintDebugging );
+            XMLDebugFile.endChunk();
             // If QuitFirstFailure bool is set to 1 and model is not running in target finder mode,
             // model will exit after any failed model period (rather than running to completion).
             if (!success & quitFirstFailure & !runTargetFinder) {
@@ -317,6 +326,7 @@ bool Scenario::run( const int aSinglePeriod,
         for( int per = 0; per < aSinglePeriod; per++ ){
             if( !mIsValidPeriod[ per ] ){
                 success &= calculatePeriod( per, *XMLDebugFile, &tabs, aPrintDebugging );
+                XMLDebugFile.endChunk();
                 // If QuitFirstFailure bool is set to 1 and model is not running in target finder mode,
                 // model will exit after any failed model period (rather than running to completion).
                 if (!success & quitFirstFailure & !runTargetFinder) {
@@ -338,6 +348,7 @@ bool Scenario::run( const int aSinglePeriod,
             // Now run the requested period. Results past this period will no longer
             // be valid. Do not attempt to use them!
             success &= calculatePeriod( aSinglePeriod, *XMLDebugFile, &tabs, aPrintDebugging );
+            XMLDebugFile.endChunk();
         }
     }
     
@@ -363,6 +374,21 @@ bool Scenario::run( const int aSinglePeriod,
     fullScenarioTimer.stop();
     TimerRegistry::getInstance().printAllTimers( mainLog );
 
+    // Write the timer profile if it was requested.
+    AutoOutputFile timerProfileFile( "timerProfile", "timer-profile.json", TimerRegistry::getInstance().isProfilingEnabled() );
+    if( timerProfileFile.shouldWrite() ) {
+        TimerRegistry::getInstance().writeProfile( *timerProfileFile );
+    }
+
+    // Write the activity profile if it was requested.
+    AutoOutputFile activityTraceFile( "activityProfileTrace", "activity-trace.json", ActivityProfiler::getInstance().isEnabled() );
+    if( activityTraceFile.shouldWrite() ) {
+        ILogger& profileLog = ILogger::getLogger( "activity-profile-log" );
+        profileLog.setLevel( ILogger::NOTICE );
+        ActivityProfiler::getInstance().printReport( mMarketplace->getDependencyFinder(), profileLog );
+        ActivityProfiler::getInstance().writeTrace( *activityTraceFile );
+    }
+
     // Run the climate model.
     mWorld->runClimateModel();
 
@@ -390,6 +416,8 @@ bool Scenario::calculatePeriod( const int aPeriod,
                                 bool aPrintDebugging )
 {
     logPeriodBeginning( aPeriod );
+    Timer& periodTimer = TimerRegistry::getInstance().getTimer( "Period " + util::toString( mModeltime->getper_to_yr( aPeriod ) ) );
+    periodTimer.start();
 
     // If this is period 0 initialize market price.
     if( aPeriod == 0 ){
@@ -453,7 +481,10 @@ bool Scenario::calculatePeriod( const int aPeriod,
 
     ILogger::WarningLevel old_main_log_level = mainlog.setLevel(ILogger::ERROR);
     if(aPeriod > 0) {
-        if( !mMarketplace->checkstate(aPeriod, serialrslt, &mainlog, DBL_CMP_LOOSE) ) {
+        // results must be bitwise identical when running in reproducible mode
+        const unsigned tolerance = Configuration::getInstance()->getBool( "parallel-reproducible", false, false ) ?
+            0 : DBL_CMP_LOOSE;
+        if( !mMarketplace->checkstate(aPeriod, serialrslt, &mainlog, tolerance) ) {
             std::cerr << "ERROR: parallel calc failed to reproduce serial results in period " << aPeriod
                       << ".\n";
             mainlog << "ERROR: parallel calc failed to reproduce serial results in period " << aPeriod
@@ -496,6 +527,10 @@ bool Scenario::calculatePeriod( const int aPeriod,
         modelFeedback->calcFeedbacksAfterPeriod( this, mWorld->getClimateModel(), aPeriod );
     }
 
+    // Write the results of this period now that they are final.
+    streamPeriodResults( aPeriod );
+
+    periodTimer.stop();
     logPeriodEnding( aPeriod );
     
     // Write out the results for debugging.
@@ -509,6 +544,28 @@ bool Scenario::calculatePeriod( const int aPeriod,
     return success;
 }
 
+/*!
+ * \brief Append the results of a period to the file set by the periodResultsStream
+ *        configuration parameter if it should be written.
+ * \details The file is opened when the first period is calculated and stays open
+ *          for the life of the scenario.
+ * \param aPeriod The model period which was just calculated.
+ */
+void Scenario::streamPeriodResults( const int aPeriod ) {
+    if( !mPeriodResultsStreamer ) {
+        const Configuration* conf = Configuration::getInstance();
+        if( !conf->shouldWriteFile( "periodResultsStream", false, false ) ) {
+            return;
+        }
+        string fileName = conf->getFile( "periodResultsStream", "period-results.csv" );
+        if( conf->shouldAppendScnToFile( "periodResultsStream" ) ) {
+            fileName = util::appendScenarioToFileName( fileName );
+        }
+        mPeriodResultsStreamer.reset( new PeriodResultsStreamer( fileName ) );
+    }
+    mPeriodResultsStreamer->writePeriod( this, aPeriod );
+}
+
 /*! \brief Perform any logging which should occur when a period begins.
 * \param aPeriod Model period.
 */
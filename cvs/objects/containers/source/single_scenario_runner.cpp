@@ -40,17 +40,23 @@
 
 #include "util/base/include/definitions.h"
 #include <cassert>
+#include <vector>
 #include "containers/include/single_scenario_runner.h"
 #include "containers/include/scenario.h"
 #include "util/base/include/xml_helper.h"
 #include "util/base/include/xml_parse_helper.h"
+#include "util/base/include/xml_input_file.h"
+#include "util/base/include/snapshot_helper.h"
 #include "util/base/include/configuration.h"
 #include "util/base/include/timer.h"
 #include "util/base/include/configuration.h"
 #include "util/base/include/auto_file.h"
+#include "util/base/include/util.h"
 #include "util/logger/include/ilogger.h"
 #include "util/logger/include/logger_factory.h"
 #include "reporting/include/xml_db_outputter.h"
+#include "reporting/include/columnar_outputter.h"
+#include "reporting/include/fusion_query_engine.h"
 
 using namespace std;
 
@@ -66,6 +72,7 @@ extern void createDBout();
 /*! \brief Constructor */
 SingleScenarioRunner::SingleScenarioRunner(){
     mXMLDBOutputter = 0;
+    mIsSharedParsed = false;
 }
 
 //! Destructor.
@@ -80,6 +87,76 @@ const string& SingleScenarioRunner::getName() const {
     return getXMLNameStatic();
 }
 
+/*!
+ * \brief Create a new scenario and parse the base input file and the scenario
+ *        components listed in the configuration file into it.
+ * \details This is called by setupScenarios if it has not already been called
+ *          since the last setup.  Calling it ahead of time allows the parsed
+ *          scenario to be shared, for instance by forking a process for each
+ *          scenario which then only needs to parse it's own additional components.
+ *          If an inputSnapshot file is configured the shared inputs are loaded from
+ *          it when it matches them, otherwise it is written after parsing.
+ * \return Whether parsing succeeded.
+ */
+bool SingleScenarioRunner::parseSharedComponents() {
+    const Configuration* conf = Configuration::getInstance();
+
+    // Ensure that a new scenario is created for each run.
+    mScenario.reset( new Scenario );
+
+    // Set the global scenario pointer.
+    // TODO: Remove global scenario pointer.
+    scenario = mScenario.get();
+
+    // The input file followed by the scenario components from the configuration
+    // file in the order they are parsed.
+    const list<string> scenComponents = conf->getScenarioComponents();
+    vector<string> sharedFiles( 1, conf->getFile( "xmlInputFileName" ) );
+    sharedFiles.insert( sharedFiles.end(), scenComponents.begin(), scenComponents.end() );
+
+    // If requested load the inputs from a snapshot of a previous parse of the exact
+    // same files, otherwise parse them and take a snapshot for next time.
+    const bool useSnapshot = conf->shouldWriteFile( "inputSnapshot", false, false );
+    uint64_t inputHash = 0;
+    if( useSnapshot ) {
+        inputHash = SnapshotHelper::calcInputHash( sharedFiles );
+        SnapshotHelper::ReadStatus status = SnapshotHelper::readSnapshot( conf->getFile( "inputSnapshot" ),
+                                                                          inputHash, mScenario.get() );
+        if( status == SnapshotHelper::LOADED ) {
+            mIsSharedParsed = true;
+            return true;
+        }
+        else if( status == SnapshotHelper::FAILED ) {
+            // The Modeltime may have been set from the snapshot so we can not
+            // safely fall back to parsing.
+            ILogger& mainLog = ILogger::getLogger( "main_log" );
+            mainLog.setLevel( ILogger::SEVERE );
+            mainLog << "Delete the input snapshot " << conf->getFile( "inputSnapshot" )
+                    << " and run again." << endl;
+            return false;
+        }
+        SnapshotHelper::startRecording();
+    }
+
+    // Parse the shared files in the same way as the components of each scenario
+    // are parsed by setupScenarios.
+    const bool success = XMLParseHelper::parseXML( sharedFiles, mScenario.get() );
+
+    if( useSnapshot ) {
+        if( success ) {
+            SnapshotHelper::writeSnapshot( conf->getFile( "inputSnapshot" ), inputHash, mScenario.get() );
+        }
+        SnapshotHelper::stopRecording();
+    }
+
+    // Check if parsing succeeded.
+    if( !success ){
+        return false;
+    }
+    mIsSharedParsed = true;
+    return true;
+}
+
 bool SingleScenarioRunner::setupScenarios( Timer& timer,
                                            const string aName,
                                            const list<string> aScenComponents )
@@ -93,48 +170,29 @@ bool SingleScenarioRunner::setupScenarios( Timer& timer,
         mainLog << "Early warning Java checks failed and database output was requested" << endl;
         abort();
     }
-    // Ensure that a new scenario is created for each run.
-    mScenario.reset( new Scenario );
 
-    // Set the global scenario pointer.
-    // TODO: Remove global scenario pointer.
+    // Parse the inputs shared by all scenarios unless that was already done
+    // ahead of time.
+    if( !mIsSharedParsed && !parseSharedComponents() ){
+        return false;
+    }
+    // The shared inputs may only be used once as parsing the scenario components
+    // modifies the scenario.
+    mIsSharedParsed = false;
     scenario = mScenario.get();
 
-    // Parse the input file.
-    bool success =
-        XMLParseHelper::parseXML( conf->getFile( "xmlInputFileName" ),
-                                  mScenario.get() );
+    // Parse the scenario components that were passed in, in order.
+    ILogger& mainLog = ILogger::getLogger( "main_log" );
+    bool success = XMLParseHelper::parseXML( vector<string>( aScenComponents.begin(), aScenComponents.end() ),
+                                             mScenario.get() );
+    // All of the inputs have been read so stop holding on to the buffer used to
+    // decompress them.
+    XMLInputFile::releaseBuffers();
     
     // Check if parsing succeeded.
     if( !success ){
         return false;
     }
-
-    // Fetch the listing of Scenario Components.
-    list<string> scenComponents = conf->getScenarioComponents();
-
-    // Add on any scenario components that were passed in.
-    for( list<string>::const_iterator curr = aScenComponents.begin();
-        curr != aScenComponents.end(); ++curr )
-    {
-        scenComponents.push_back( *curr );
-    }
-    
-    // Iterate over the vector.
-    typedef list<string>::const_iterator ScenCompIter;
-    ILogger& mainLog = ILogger::getLogger( "main_log" );
-    for( ScenCompIter currComp = scenComponents.begin();
-         currComp != scenComponents.end(); ++currComp )
-    {
-        mainLog.setLevel( ILogger::NOTICE );
-        mainLog << "Parsing " << *currComp << " scenario component." << endl;
-        success = XMLParseHelper::parseXML( *currComp, mScenario.get() );
-        
-        // Check if parsing succeeded.
-        if( !success ){
-            return false;
-        }
-    }
     
     // Override scenario name from data file with that from configuration file
     const string overrideName = conf->getString( "scenarioName" ) + aName;
@@ -241,6 +299,32 @@ void SingleScenarioRunner::printOutput( Timer& aTimer ) const {
             // Print the output.
             mXMLDBOutputter->finish();
         }
+
+        // Write the columnar results file which does not require Java.
+        if( conf->shouldWriteFile( "columnarOutput", false, false ) ) {
+            mainLog.setLevel( ILogger::NOTICE );
+            mainLog << "Starting output to columnar results file." << endl;
+            ColumnarOutputter columnarOutputter;
+            mScenario->accept( &columnarOutputter, -1 );
+            columnarOutputter.finish();
+        }
+
+        // Run the queries which can be answered directly from the model results.
+        if( conf->shouldWriteFile( "fusionQueryResults", false, false ) ) {
+            mainLog.setLevel( ILogger::NOTICE );
+            mainLog << "Starting output of in-process query results." << endl;
+            FusionQueryEngine queryEngine;
+            const string queryFile = conf->getFile( "fusionQueryFile", "../output/queries/fusion_queries.xml" );
+            if( queryEngine.parseQueries( queryFile ) ) {
+                string fileName = conf->getFile( "fusionQueryResults", "fusion-query-results.csv" );
+                if( conf->shouldAppendScnToFile( "fusionQueryResults" ) ) {
+                    fileName = util::appendScenarioToFileName( fileName );
+                }
+                ofstream out( fileName.c_str(), ios_base::out | ios_base::trunc );
+                util::checkIsOpen( out, fileName );
+                queryEngine.runQueries( mScenario.get(), out );
+            }
+        }
         writeTimer.stop();
 
         // Print the timestamps.
@@ -257,6 +341,7 @@ void SingleScenarioRunner::cleanup() {
     // The current scenario is no longer needed since a new scenario run will be
     // created from scratch the next time a scenario is setup and run.
     mScenario.reset( 0 );
+    mIsSharedParsed = false;
     scenario = 0;
 
     // If the XML database was opened then we should close it.
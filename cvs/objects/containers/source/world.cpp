@@ -40,6 +40,7 @@
 
 #include "util/base/include/definitions.h"
 #include "util/base/include/timer.h"
+#include "util/base/include/activity_profiler.h"
 
 #include <string>
 #include <cassert>
@@ -77,6 +78,8 @@
 
 #if GCAM_PARALLEL_ENABLED
 #include "parallel/include/gcam_parallel.hpp"
+#include "util/base/include/manage_state_variables.hpp"
+#include <tbb/task_arena.h>
 #endif
 
 // Uncommenting the following two lines will turn on floating-point exceptions within World::calc(),
@@ -147,6 +150,14 @@ void World::completeInit() {
     ILogger &mainlog = ILogger::getLogger("main_log");
     totalgraphtimer.print(mainlog, "Total of all graph analysis setup:  ");
 #endif
+
+    // Optionally create the orderings, and flow graphs, for all markets now rather
+    // than as the solver first asks for each of them.
+    const Configuration* conf = Configuration::getInstance();
+    const bool createPartialFlowGraphs = conf->getBool( "partial-derivative-flow-graphs", false, false );
+    if( createPartialFlowGraphs || conf->getBool( "prebuild-market-orderings", false, false ) ) {
+        depFinder->createAllMarketOrderings( createPartialFlowGraphs );
+    }
     
     // At this point we can assume all model components have been initialized and will
     // no longer require the global technology database to get parameters from so we are
@@ -211,6 +222,10 @@ const string& World::getName() const {
 //! initialize anything that won't change during the calculation
 /*! Examples: share weight scaling due to previous calibration, 
 * cumulative technology change, etc.
+* \details Regions are initialized serially in order.  Many initCalc paths write
+*          to markets which span several regions, such as setting prices and
+*          market info or changing which markets are solved, so initializing
+*          regions concurrently would make the results depend on scheduling.
 */
 void World::initCalc( const int period ) {
 
@@ -256,8 +271,16 @@ void World::calc( const int aPeriod, const std::vector<IActivity*>& aItemsToCalc
     mCalcCounter->incrementCount( static_cast<double>( aItemsToCalc.size() ) / static_cast<double>( mGlobalOrdering.size() ) );
     
     // Perform calculation on each item to calculate. 
-    for( vector<IActivity*>::const_iterator it = aItemsToCalc.begin(); it != aItemsToCalc.end(); ++it ) {
-        (*it)->calc( aPeriod );
+    ActivityProfiler& profiler = ActivityProfiler::getInstance();
+    if( profiler.isEnabled() ) {
+        for( vector<IActivity*>::const_iterator it = aItemsToCalc.begin(); it != aItemsToCalc.end(); ++it ) {
+            profiler.calc( *it, aPeriod );
+        }
+    }
+    else {
+        for( vector<IActivity*>::const_iterator it = aItemsToCalc.begin(); it != aItemsToCalc.end(); ++it ) {
+            (*it)->calc( aPeriod );
+        }
     }
 #ifdef GNU_SOURCE
     feenableexcept(except);
@@ -291,14 +314,74 @@ void World::calc( const int aPeriod, GcamFlowGraph *aWorkGraph, const vector<IAc
         aWorkGraph = mTBBGraphGlobal;
     }
 
+    // Supplies and demands are accumulated per thread during a full model
+    // calculation to avoid contention on popular markets.
+    Marketplace* marketplace = scenario->getMarketplace();
+    const bool accumulatePerThread = marketplace->startThreadAccumulation( aPeriod );
+
     // do the model calculation
     aWorkGraph->mHead.try_put( tbb::flow::continue_msg() );
     aWorkGraph->mTBBFlowGraph.wait_for_all();
 
+    if( accumulatePerThread ) {
+        marketplace->finishThreadAccumulation();
+    }
+
+    // If the flow graph is measuring the cost of it's activities check if it
+    // has seen enough evaluations to be coarsened into grains.
+    if( aWorkGraph->mCalibrationEvals > 0 && --aWorkGraph->mCalibrationEvals == 0 ) {
+        GcamParallel::coarsenFlowGraph( *aWorkGraph );
+    }
+
 #ifdef GNU_SOURCE
     feenableexcept(except);
 #endif
 }
+
+/*!
+ * \brief Calculate a single partial derivative using the flow graph of the
+ *        activities affected by it.
+ * \details Partial derivatives are typically run serially since they are
+ *          themselves calculated in parallel, however a few markets such as
+ *          CO2 or GDP affect a large part of the model and would otherwise hold
+ *          up the end of each Jacobian.  Those are run on their flow graph in the
+ *          current task arena so idle threads may help with them.  Every thread
+ *          which does calculates in the "scratch" space of the calling thread
+ *          rather than it's own and the wait is isolated so that the calling
+ *          thread will not pick up another partial derivative which would reset
+ *          that space in the mean time.
+ *          Flow graphs may be shared by markets which affect the same activities
+ *          and so if it is already running this returns false and the caller
+ *          should calculate serially instead.
+ * \param aPeriod Time period to calculate.
+ * \param aWorkGraph The flow graph of the activities affected by the partial
+ *                   derivative.
+ * \param aCalcList The same activities in order.
+ * \return Whether the calculation was done.
+ * \pre The calling thread has already copied the "base" state into it's
+ *      "scratch" space.
+ */
+bool World::calcPartial( const int aPeriod, GcamFlowGraph* aWorkGraph, const vector<IActivity*>& aCalcList )
+{
+    tbb::spin_mutex::scoped_lock runLock;
+    if( !runLock.try_acquire( aWorkGraph->mRunMutex ) ) {
+        return false;
+    }
+
+    mCalcCounter->incrementCount( static_cast<double>( aCalcList.size() ) / static_cast<double>( mGlobalOrdering.size() ) );
+
+    aWorkGraph->mSharedState = ManageStateVariables::getThreadState();
+    tbb::this_task_arena::isolate( [aWorkGraph] {
+        aWorkGraph->mHead.try_put( tbb::flow::continue_msg() );
+        aWorkGraph->mTBBFlowGraph.wait_for_all();
+    } );
+    aWorkGraph->mSharedState = 0;
+
+    if( aWorkGraph->mCalibrationEvals > 0 && --aWorkGraph->mCalibrationEvals == 0 ) {
+        GcamParallel::coarsenFlowGraph( *aWorkGraph );
+    }
+    return true;
+}
 #endif
 
 
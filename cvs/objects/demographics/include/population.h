@@ -69,6 +69,7 @@ class PopulationMiniCAM;
 class Population: public IYeared, public IVisitable, private boost::noncopyable
 {
     friend class XMLDBOutputter; // For getXMLName()
+    friend class ColumnarOutputter;
 public:
     Population();
     virtual ~Population();
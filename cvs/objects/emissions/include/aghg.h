@@ -83,6 +83,7 @@ class NonCO2Emissions;
 class AGHG: public INamed, public IVisitable, private boost::noncopyable
 { 
     friend class XMLDBOutputter;
+    friend class ColumnarOutputter;
 
 public:
     //! Virtual Destructor.
@@ -69,6 +69,7 @@
 #include "containers/include/scenario.h"
 #include "containers/include/iscenario_runner.h"
 #include "containers/include/scenario_runner_factory.h"
+#include "reporting/include/xml_db_outputter.h"
 #include "util/logger/include/ilogger.h"
 #include "util/logger/include/logger_factory.h"
 #include "util/base/include/timer.h"
@@ -198,8 +199,10 @@ int main( int argc, char *argv[] ) {
     // Print the output.
     runner->printOutput( timer );
     mainLog.setLevel( ILogger::WARNING ); // Increase level so that user will know that model is done
-    mainLog << "Model exiting successfully." << endl;
     runner->cleanup();
+    // The XML database may still be being written in the background.
+    XMLDBOutputter::waitForPendingWrites();
+    mainLog << "Model exiting successfully." << endl;
     
     // Return exit code based on whether the model succeeded(Non-zero is failure by convention).
     return success ? 0 : 1; 
@@ -47,6 +47,7 @@
 
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <boost/core/noncopyable.hpp>
 
 #include "marketplace/include/imarket_type.h"
@@ -78,6 +79,9 @@ class DemandMarket;
 class TrialValueMarket;
 class PriceMarket;
 class LinkedMarket;
+#if GCAM_PARALLEL_ENABLED
+class MarketAccumulator;
+#endif
 
 /*!
  * \ingroup Objects
@@ -115,6 +119,9 @@ class Market: public IYeared, public IVisitable, private boost::noncopyable
 {
     friend class XMLDBOutputter;
     friend class PriceMarket;
+#if GCAM_PARALLEL_ENABLED
+    friend class MarketAccumulator;
+#endif
 public:
     Market( const MarketContainer* aContainer );
     virtual ~Market();
@@ -184,6 +191,20 @@ public:
     static const std::string& convert_type_to_string( const IMarketType::Type aType );
 
     void accept( IVisitor* aVisitor, const int aPeriod ) const;
+    
+#if GCAM_PARALLEL_ENABLED
+    /*!
+     * \brief Set the position in the serial calculation order of the activity
+     *        the calling thread is about to calculate.
+     * \details Supplies and demands kept by a MarketAccumulator are tagged with
+     *          this position so that they can be summed in the order a serial
+     *          calculation would have added them.
+     * \param aOrdinal The position of the activity or -1 when done.
+     */
+    static void setCalcOrdinal( const int aOrdinal ) {
+        sCalcOrdinal = aOrdinal;
+    }
+#endif
 protected:
     void copy( const Market& aMarket );
     
@@ -233,6 +254,26 @@ protected:
     
     //! A fast lock to protect concurrent adds to supply.
     mutable Mutex mSupplyMutex;
+    
+    //! The accumulator which collects the supplies and demands added to this
+    //! market during a parallel calculation or null if there is none.
+    MarketAccumulator* mAccumulator;
+    
+    //! The position of this market in mAccumulator or -1 if there is none.
+    int mAccumulatorIndex;
+    
+    //! Flag set when demand kept by mAccumulator has not yet been added to mDemand.
+    mutable std::atomic<bool> mHasPendingDemand;
+    
+    //! Flag set when supply kept by mAccumulator has not yet been added to mSupply.
+    mutable std::atomic<bool> mHasPendingSupply;
+    
+    //! The position in the serial calculation order of the activity each
+    //! thread is calculating.
+    static thread_local int sCalcOrdinal;
+    
+    double getAccumulatedDemand() const;
+    double getAccumulatedSupply() const;
 #endif
     
     //! Object containing information related to the market.
@@ -256,4 +297,58 @@ protected:
     IInfo* releaseMarketInfo();
 };
 
+#if GCAM_PARALLEL_ENABLED
+/*!
+ * \ingroup Objects
+ * \brief Collects the supplies and demands added to the markets of a period
+ *        during a parallel calculation of the model without locking them.
+ * \details Each thread keeps the values it adds to each market tagged with the
+ *          position of the activity which added them in the serial calculation
+ *          order.  They are added to a market, in that order, on a single path:
+ *          either the first time the market is read during the calculation or
+ *          when the calculation finishes.  Each Marketplace owns one.
+ * \see Market::setCalcOrdinal
+ */
+class MarketAccumulator : private boost::noncopyable {
+    friend class Market;
+public:
+    MarketAccumulator();
+    ~MarketAccumulator();
+    
+    void start( const std::vector<Market*>& aMarkets );
+    
+    void finish();
+    
+private:
+    //! A single supply or demand kept until it is added to it's market.
+    struct OrderedTerm {
+        OrderedTerm( const int aOrdinal, const double aValue ):mOrdinal( aOrdinal ), mValue( aValue ) {}
+        //! The position in the serial calculation order of the activity which
+        //! added the value.
+        int mOrdinal;
+        double mValue;
+    };
+    
+    //! The values kept by a single thread by the position of the market.
+    struct ThreadTerms {
+        std::vector<std::vector<OrderedTerm> > mDemand;
+        std::vector<std::vector<OrderedTerm> > mSupply;
+    };
+    
+    //! The values kept for each thread slot in the task arena.
+    std::vector<ThreadTerms> mThreadTerms;
+    
+    //! The markets being accumulated by their position.  These keep their
+    //! position between calculations of the same period.
+    std::vector<Market*> mMarkets;
+    
+    //! Whether values are currently being kept.
+    bool mIsAccumulating;
+    
+    bool add( const int aIndex, const bool aIsDemand, const int aOrdinal, const double aValue );
+    
+    void flush( const int aIndex, const bool aIsDemand );
+};
+#endif
+
 #endif // _MARKET_H_
@@ -63,6 +63,9 @@ class IInfo;
 class CachedMarket;
 class MarketDependencyFinder;
 class Value;
+#if GCAM_PARALLEL_ENABLED
+class MarketAccumulator;
+#endif
 namespace objects {
     template<typename T>
     class PeriodVector;
@@ -153,6 +156,10 @@ public:
                              const int aStartPeriod );
     void initPrices();
     void nullSuppliesAndDemands( const int period );
+#if GCAM_PARALLEL_ENABLED
+    bool startThreadAccumulation( const int aPeriod );
+    void finishThreadAccumulation();
+#endif
     void assignMarketSerialNumbers( int aPeriod );
     void setPrice( const std::string& goodName, const std::string& regionName, const double value,
                    const int period, bool aMustExist = true );
@@ -225,6 +232,18 @@ protected:
     
     //! Flag indicating whether the next call to world->calc() will be part of a partial derivative calculation 
     static bool mIsDerivativeCalc;
+    
+#if GCAM_PARALLEL_ENABLED
+    //! Collects the supplies and demands added during a parallel calculation.
+    std::unique_ptr<MarketAccumulator> mAccumulator;
+    
+    //! The markets of mAccumulatingPeriod in the order of mMarkets which are
+    //! given to mAccumulator.
+    std::vector<Market*> mAccumulatingMarkets;
+    
+    //! The period mAccumulatingMarkets was built for or -1 if it has not been.
+    int mAccumulatingPeriod;
+#endif
 };
 
 #endif
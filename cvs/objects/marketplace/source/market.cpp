@@ -59,6 +59,11 @@
 #include "containers/include/iinfo.h"
 #include "util/logger/include/ilogger.h"
 #include "marketplace/include/marketplace.h"
+#include "util/base/include/manage_state_variables.hpp"
+
+#if GCAM_PARALLEL_ENABLED
+#include <tbb/task_arena.h>
+#endif
 
 /*!
  * \brief Perform a summation while being careful to calculate and preserve the error correction term.
@@ -67,12 +72,13 @@
  *       in the floating point summation.  This is of particular concern when GCAM_PARALLEL_ENABLED
  *       since the inherent nature of parallelism causes a different level of round off / truncation with each
  *       model call.
- * \param aSum The running sum Value to update.
+ * \param aSum The running sum Value (or double) to update.
  * \param aCorrection The current error correction which will be used to accumulate the error from
  *                    adding aValueIn.
  * \param aValueIn The next value to sum.
  */
-inline void kahanSum(Value& aSum, Value& aCorrection, const double aValueIn) {
+template<typename T>
+inline void kahanSum(T& aSum, T& aCorrection, const double aValueIn) {
     // the new sum without any error correction
     double t = aSum + aValueIn;
     // calculate and accumulate the error resulting from roundoff / truncation
@@ -93,6 +99,7 @@ using namespace objects;
 extern Scenario* scenario; 
 
 
+
 /*! \brief Constructor
  * \details This is the constructor for the market class. No default constructor
  *          exists to prevent the creation of empty markets.
@@ -111,10 +118,22 @@ mMarketInfo( InfoFactory::constructInfo( 0, aContainer->getName() ) )
     mForecastPrice = 0.0;
     mForecastDemand = 0.0;
     mOriginal_price = 0.0;
+#if GCAM_PARALLEL_ENABLED
+    mAccumulator = 0;
+    mAccumulatorIndex = -1;
+    mHasPendingDemand = false;
+    mHasPendingSupply = false;
+#endif
 }
 
 //! Destructor. This is needed because of the unique_ptr.
 Market::~Market(){
+#if GCAM_PARALLEL_ENABLED
+    // do not leave a dangling pointer in the markets which keep their index
+    if( mAccumulator ) {
+        mAccumulator->mMarkets[ mAccumulatorIndex ] = 0;
+    }
+#endif
 }
 
 /*! \brief Copy all data members from the given market object.
@@ -353,6 +372,20 @@ void Market::nullDemand() {
 void Market::addToDemand( const double demandIn ) {
 #if GCAM_PARALLEL_ENABLED
     if( !Marketplace::mIsDerivativeCalc ) {
+        if( mAccumulator && mAccumulator->add( mAccumulatorIndex, true, sCalcOrdinal, demandIn ) ) {
+            // only the first value needs to set the flag, avoid writing to it
+            // from every thread
+            if( !mHasPendingDemand.load( memory_order_relaxed ) ) {
+                mHasPendingDemand.store( true, memory_order_relaxed );
+            }
+        }
+        else {
+            Mutex::scoped_lock writeLock( mDemandMutex );
+            kahanSum(mDemand, mDemandCorrection, demandIn);
+        }
+    }
+    else if( ManageStateVariables::isThreadStateShared() ) {
+        // other threads are helping with this partial derivative
         Mutex::scoped_lock writeLock( mDemandMutex );
         kahanSum(mDemand, mDemandCorrection, demandIn);
     }
@@ -372,7 +405,11 @@ void Market::addToDemand( const double demandIn ) {
 * \sa getDemand
 */
 double Market::getRawDemand() const {
+#if GCAM_PARALLEL_ENABLED
+    return getAccumulatedDemand();
+#else
     return mDemand + mDemandCorrection;
+#endif
 }
 
 /*! \brief Get the demand used in the solver.
@@ -383,7 +420,11 @@ double Market::getRawDemand() const {
  * \sa getRawDemand
  */
 double Market::getSolverDemand() const {
+#if GCAM_PARALLEL_ENABLED
+    return getAccumulatedDemand();
+#else
     return mDemand + mDemandCorrection;
+#endif
 }
 
 /*! \brief Get the demand.
@@ -391,7 +432,11 @@ double Market::getSolverDemand() const {
 * \return Market demand.
 */
 double Market::getDemand() const {
+#if GCAM_PARALLEL_ENABLED
+    return getAccumulatedDemand();
+#else
     return mDemand + mDemandCorrection;
+#endif
 }
 
 /*! \brief Null the supply.
@@ -410,7 +455,11 @@ void Market::nullSupply() {
 * \sa getSupply
 */
 double Market::getRawSupply() const {
+#if GCAM_PARALLEL_ENABLED
+    return getAccumulatedSupply();
+#else
     return mSupply + mSupplyCorrection;
+#endif
 }
 
 /*! \brief Get the supply value to be used in the solver
@@ -422,7 +471,11 @@ double Market::getRawSupply() const {
 * \sa getRawSupply
 */
 double Market::getSolverSupply() const {
+#if GCAM_PARALLEL_ENABLED
+    return getAccumulatedSupply();
+#else
     return mSupply + mSupplyCorrection;
+#endif
 }
 
 /*! \brief Get the supply.
@@ -430,7 +483,11 @@ double Market::getSolverSupply() const {
 * \return Market supply
 */
 double Market::getSupply() const {
+#if GCAM_PARALLEL_ENABLED
+    return getAccumulatedSupply();
+#else
     return mSupply + mSupplyCorrection;
+#endif
 }
 
 /*! \brief Add to the the Market an amount of supply in a method based on the
@@ -442,6 +499,20 @@ double Market::getSupply() const {
 void Market::addToSupply( const double supplyIn ) {
 #if GCAM_PARALLEL_ENABLED
     if( !Marketplace::mIsDerivativeCalc ) {
+        if( mAccumulator && mAccumulator->add( mAccumulatorIndex, false, sCalcOrdinal, supplyIn ) ) {
+            // only the first value needs to set the flag, avoid writing to it
+            // from every thread
+            if( !mHasPendingSupply.load( memory_order_relaxed ) ) {
+                mHasPendingSupply.store( true, memory_order_relaxed );
+            }
+        }
+        else {
+            Mutex::scoped_lock writeLock( mSupplyMutex );
+            kahanSum(mSupply, mSupplyCorrection, supplyIn);
+        }
+    }
+    else if( ManageStateVariables::isThreadStateShared() ) {
+        // other threads are helping with this partial derivative
         Mutex::scoped_lock writeLock( mSupplyMutex );
         kahanSum(mSupply, mSupplyCorrection, supplyIn);
     }
@@ -653,3 +724,179 @@ bool Market::isSolvable() const {
 IInfo* Market::releaseMarketInfo() {
     return mMarketInfo.release();
 }
+
+#if GCAM_PARALLEL_ENABLED
+thread_local int Market::sCalcOrdinal = -1;
+
+/*!
+ * \brief Get the demand of this market after adding any values which were
+ *        added to it by a parallel calculation.
+ * \details The values are added once, the first time the market is read, which
+ *          is safe as the flow graph ensures all activities adding to a market
+ *          have finished before any activity which reads it starts.  Every read
+ *          after that simply returns mDemand.
+ * \return The total demand.
+ */
+double Market::getAccumulatedDemand() const {
+    if( mHasPendingDemand.load( memory_order_acquire ) ) {
+        // several activities may read the market at once
+        Mutex::scoped_lock readLock( mDemandMutex );
+        if( mHasPendingDemand.load( memory_order_relaxed ) ) {
+            mAccumulator->flush( mAccumulatorIndex, true );
+        }
+    }
+    return mDemand + mDemandCorrection;
+}
+
+/*!
+ * \brief Get the supply of this market after adding any values which were
+ *        added to it by a parallel calculation.
+ * \details See getAccumulatedDemand.
+ * \return The total supply.
+ */
+double Market::getAccumulatedSupply() const {
+    if( mHasPendingSupply.load( memory_order_acquire ) ) {
+        Mutex::scoped_lock readLock( mSupplyMutex );
+        if( mHasPendingSupply.load( memory_order_relaxed ) ) {
+            mAccumulator->flush( mAccumulatorIndex, false );
+        }
+    }
+    return mSupply + mSupplyCorrection;
+}
+
+//! Constructor
+MarketAccumulator::MarketAccumulator():
+mIsAccumulating( false )
+{
+}
+
+//! Destructor
+MarketAccumulator::~MarketAccumulator() {
+    for( Market* market : mMarkets ) {
+        if( market ) {
+            market->mAccumulator = 0;
+            market->mAccumulatorIndex = -1;
+        }
+    }
+}
+
+/*!
+ * \brief Start collecting the supplies and demands added to the given markets.
+ * \details Adding supply or demand to a market during a parallel calculation
+ *          would otherwise require a lock and popular markets are contended by
+ *          many activities.  Instead, until finish is called, each thread keeps
+ *          every value it adds to a market along with the position of the
+ *          activity which added it, as set by Market::setCalcOrdinal.  The
+ *          values of each market are then summed in that order, exactly as a
+ *          serial calculation would have, so that the results are bitwise
+ *          identical regardless of the number of threads or how activities were
+ *          scheduled.  Note values added by threads outside of the task arena
+ *          are still added directly under a lock.
+ * \param aMarkets The markets to accumulate, typically all markets in the period
+ *                 about to be calculated.  The markets are only told their
+ *                 positions again when these change.
+ */
+void MarketAccumulator::start( const vector<Market*>& aMarkets ) {
+    if( mMarkets != aMarkets ) {
+        for( Market* market : mMarkets ) {
+            if( market ) {
+                market->mAccumulator = 0;
+                market->mAccumulatorIndex = -1;
+            }
+        }
+        mMarkets = aMarkets;
+        for( size_t i = 0; i < mMarkets.size(); ++i ) {
+            mMarkets[ i ]->mAccumulator = this;
+            mMarkets[ i ]->mAccumulatorIndex = i;
+        }
+        mThreadTerms.clear();
+    }
+    const size_t numThreads = max( tbb::this_task_arena::max_concurrency(), 1 );
+    if( mThreadTerms.size() != numThreads ) {
+        mThreadTerms.resize( numThreads );
+        for( ThreadTerms& threadTerms : mThreadTerms ) {
+            threadTerms.mDemand.resize( mMarkets.size() );
+            threadTerms.mSupply.resize( mMarkets.size() );
+        }
+    }
+    mIsAccumulating = true;
+}
+
+/*!
+ * \brief Add all values which have not yet been added to their markets and
+ *        stop collecting.
+ * \details This must only be called once the parallel calculation has completed.
+ *          Markets which were read during the calculation have already been
+ *          added to.
+ */
+void MarketAccumulator::finish() {
+    for( size_t i = 0; i < mMarkets.size(); ++i ) {
+        const Market* market = mMarkets[ i ];
+        if( market && market->mHasPendingDemand.load( memory_order_relaxed ) ) {
+            flush( i, true );
+        }
+        if( market && market->mHasPendingSupply.load( memory_order_relaxed ) ) {
+            flush( i, false );
+        }
+    }
+    mIsAccumulating = false;
+}
+
+/*!
+ * \brief Keep a value added to a market by the calling thread.
+ * \param aIndex The position of the market in mMarkets.
+ * \param aIsDemand Whether the value is demand, otherwise supply.
+ * \param aOrdinal The position of the activity adding the value in the serial
+ *                 calculation order.
+ * \param aValue The value to add.
+ * \return True if the value was kept, false if it must be added to the market
+ *         directly as we are not accumulating or the thread is not in the task
+ *         arena.
+ */
+bool MarketAccumulator::add( const int aIndex, const bool aIsDemand, const int aOrdinal,
+                             const double aValue )
+{
+    if( !mIsAccumulating ) {
+        return false;
+    }
+    const int threadIndex = tbb::this_task_arena::current_thread_index();
+    if( threadIndex < 0 || threadIndex >= static_cast<int>( mThreadTerms.size() ) ) {
+        return false;
+    }
+    ThreadTerms& threadTerms = mThreadTerms[ threadIndex ];
+    ( aIsDemand ? threadTerms.mDemand : threadTerms.mSupply )[ aIndex ].push_back( OrderedTerm( aOrdinal, aValue ) );
+    return true;
+}
+
+/*!
+ * \brief Add the values kept by all threads for a single market to it in the
+ *        order a serial calculation would have added them.
+ * \details Values added by the same activity are always added by the same
+ *          thread and so a stable sort on the position of the activity gives
+ *          exactly the serial order.  This is the only place kept values are
+ *          added to a market and it must not run while any thread is still
+ *          adding to the same market.
+ * \param aIndex The position of the market in mMarkets.
+ * \param aIsDemand Whether to add the demand, otherwise the supply.
+ */
+void MarketAccumulator::flush( const int aIndex, const bool aIsDemand ) {
+    // reuse the memory to gather the values between calls
+    thread_local vector<OrderedTerm> terms;
+    terms.clear();
+    for( ThreadTerms& threadTerms : mThreadTerms ) {
+        vector<OrderedTerm>& pending = ( aIsDemand ? threadTerms.mDemand : threadTerms.mSupply )[ aIndex ];
+        terms.insert( terms.end(), pending.begin(), pending.end() );
+        pending.clear();
+    }
+    stable_sort( terms.begin(), terms.end(), []( const OrderedTerm& aLHS, const OrderedTerm& aRHS ) {
+        return aLHS.mOrdinal < aRHS.mOrdinal;
+    } );
+    Market* market = mMarkets[ aIndex ];
+    Value& sum = aIsDemand ? market->mDemand : market->mSupply;
+    Value& correction = aIsDemand ? market->mDemandCorrection : market->mSupplyCorrection;
+    for( const OrderedTerm& term : terms ) {
+        kahanSum( sum, correction, term.mValue );
+    }
+    ( aIsDemand ? market->mHasPendingDemand : market->mHasPendingSupply ).store( false, memory_order_release );
+}
+#endif
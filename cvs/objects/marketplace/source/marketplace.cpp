@@ -82,6 +82,10 @@ Marketplace::Marketplace():
 mMarketLocator( new MarketLocator() ),
 mDependencyFinder( new MarketDependencyFinder( this ) )
 {
+#if GCAM_PARALLEL_ENABLED
+    mAccumulator.reset( new MarketAccumulator() );
+    mAccumulatingPeriod = -1;
+#endif
 }
 
 /*! \brief Destructor
@@ -418,6 +422,49 @@ void Marketplace::unsetMarketToSolve ( const string& goodName, const string& reg
     }
 }
 
+#if GCAM_PARALLEL_ENABLED
+/*!
+ * \brief Start collecting the supplies and demands added to markets in the
+ *        given period per thread.
+ * \details This should be called before a parallel calculation of the model so
+ *          that activities do not contend on locks to add to popular markets.
+ *          finishThreadAccumulation must be called once the calculation has
+ *          completed to add the collected values to the markets.  They are
+ *          summed in the order of a serial calculation so that results are
+ *          bitwise identical to it.  Partial derivative calculations already
+ *          work on thread local state so they do not need to accumulate and
+ *          are left to add to the markets directly.
+ * \param aPeriod The period about to be calculated.
+ * \return Whether supplies and demands are being accumulated per thread.
+ * \see MarketAccumulator::start
+ */
+bool Marketplace::startThreadAccumulation( const int aPeriod ) {
+    if( mIsDerivativeCalc ) {
+        return false;
+    }
+    // the model is calculated many times in a period so only look up the markets
+    // when the period changes
+    if( aPeriod != mAccumulatingPeriod || mAccumulatingMarkets.size() != mMarkets.size() ) {
+        mAccumulatingMarkets.resize( mMarkets.size() );
+        for( size_t i = 0; i < mMarkets.size(); ++i ) {
+            mAccumulatingMarkets[ i ] = mMarkets[ i ]->getMarket( aPeriod );
+        }
+        mAccumulatingPeriod = aPeriod;
+    }
+    mAccumulator->start( mAccumulatingMarkets );
+    return true;
+}
+
+/*!
+ * \brief Add the supplies and demands collected during a parallel calculation
+ *        to their markets.
+ * \see MarketAccumulator::finish
+ */
+void Marketplace::finishThreadAccumulation() {
+    mAccumulator->finish();
+}
+#endif
+
 /*! \brief Clear all market supplies and demands for the given period.
 * 
 * This function iterates through the markets and nulls the supply and demand 
@@ -39,10 +39,16 @@
 
 #include <vector>
 #include <set>
+#include <string>
+#include <unordered_map>
+#include <boost/core/noncopyable.hpp>
 
 /* TBB headers */
 #include <tbb/flow_graph.h>
 #include <tbb/global_control.h>
+#include <tbb/spin_mutex.h>
+
+#include "util/logger/include/ilogger.h"
 
 // Forward declare when possible
 class IActivity;
@@ -70,6 +76,35 @@ private:
     //! need to keep track of it explicitly
     std::vector<tbb::flow::continue_node<tbb::flow::continue_msg>*> mTBBVertices;
     
+    //! The activities in this graph, only retained when grain coarsening is
+    //! enabled so that the graph can be rebuilt once costs have been measured.
+    std::vector<IActivity*> mActivities;
+    
+    //! The (transitively reduced) out edges for each activity in mActivities.
+    std::vector<std::vector<int> > mAdjList;
+    
+    //! The accumulated time in seconds spent calculating each activity in
+    //! mActivities while calibrating.
+    std::vector<double> mActivityCost;
+    
+    //! The number of model evaluations left to measure activity costs before
+    //! coarsening the graph into grains.  Zero if not (or no longer) calibrating.
+    int mCalibrationEvals;
+    
+    //! The position of each activity in the serial calculation order which
+    //! each node tags the supplies and demands it adds with.
+    std::unordered_map<const IActivity*, int> mCalcOrder;
+    
+    //! When set every node calculates in this state rather than that of the
+    //! thread it happens to run on.  This is how a partial derivative which is
+    //! large enough to be run on it's flow graph shares the "scratch" space of
+    //! the thread calculating it with the threads that help it.
+    double* mSharedState;
+    
+    //! Held while the graph is being run as a partial derivative since the same
+    //! graph may be shared by several markets and can only run once at a time.
+    tbb::spin_mutex mRunMutex;
+    
     static tbb::global_control* mParallelismConfig;
 
 public:
@@ -81,12 +116,52 @@ public:
 
 class GcamParallel {
 public:
+    //! Messages for the parallel-grain-log and the level to write each at.
+    typedef std::vector<std::pair<ILogger::WarningLevel, std::string> > GrainLogMessages;
+    
+    /*!
+     * \brief Collects the messages the calling thread would write to the
+     *        parallel-grain-log for as long as this object lives.
+     * \details Loggers may not be written to concurrently so when flow graphs are
+     *          created in parallel each task collects it's messages and they are
+     *          written with writeGrainLog once the parallel section is done.
+     */
+    class DeferGrainLog : private boost::noncopyable {
+    public:
+        explicit DeferGrainLog( GrainLogMessages& aMessages );
+        ~DeferGrainLog();
+    private:
+        //! The messages the calling thread was collecting before or null.
+        GrainLogMessages* mPrevMessages;
+    };
+    
+    static void writeGrainLog( const GrainLogMessages& aMessages );
+    
     static void makeTBBFlowGraph( const MarketDependencyFinder& aDependencyFinder,
                                   GcamFlowGraph& aTBBGraph );
     
     static void makeTBBFlowGraph( const MarketDependencyFinder& aDependencyFinder,
                                   GcamFlowGraph& aTBBGraph,
                                   const std::vector<IActivity*>& aPartialCalcList );
+
+    static void setCalcOrder( const std::vector<IActivity*>& aOrdering, GcamFlowGraph& aTBBGraph );
+
+    static int transitiveReduction( std::vector<std::vector<int> >& aAdjList );
+    
+    static void coarsenFlowGraph( GcamFlowGraph& aTBBGraph );
+
+private:
+    static void createTBBNodes( const std::vector<IActivity*>& aActivities,
+                                const std::vector<std::vector<int> >& aAdjList,
+                                GcamFlowGraph& aTBBGraph );
+    
+    static void createTBBGrainNodes( const std::vector<std::vector<IActivity*> >& aGrains,
+                                     const std::vector<std::vector<int> >& aAdjList,
+                                     const std::vector<double>& aGrainCost,
+                                     GcamFlowGraph& aTBBGraph );
+    
+    static std::vector<tbb::flow::node_priority_t> criticalPathPriorities( const std::vector<std::vector<int> >& aAdjList,
+                                                                           const std::vector<double>& aCost );
 };
 
   
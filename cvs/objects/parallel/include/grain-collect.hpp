@@ -37,6 +37,7 @@
 #include "parallel/include/clanid.hpp"
 #include "parallel/include/bitvector.hpp"
 #include <sstream>
+#include <vector>
 
 template<class T> T* unique_nodetitle(T* bestnode, size_t setsize)
 {
@@ -249,5 +250,116 @@ void grain_collect(const digraph<clanid<nodeid_t> > &ClanTree,
   } 
 }
 
-#endif
+//! Sum the measured cost of the nodes in a set 
+//! \param nodeset Set of nodes, indexed by topological index. 
+//! \param cost Cost of each node, indexed by topological index.
+inline double nodeset_cost(const bitvector &nodeset, const std::vector<double> &cost)
+{
+  double total = 0.0;
+  bitvector_iterator nodeit(&nodeset);
+  while(nodeit.next())
+    total += cost[nodeit.bindex()];
+  return total;
+}
+
+
+//! Collect grains from a clan tree using measured node costs 
+//! \param ClanTree The clan parse tree produced by graph_parse 
+//! \param claniterator The clan to collect grains from (initially the root) 
+//! \param cost The cost of each node in the original graph, indexed
+//!        by topological index
+//! \param grain_target The cost we would like each grain to have 
+//! \param grains Output list of grains, each as a bitvector set of
+//!        topological indices 
+//! \details This is the analog of grain_collect for the case where we
+//! have a cost estimate for each node, so we can aim for grains of
+//! roughly equal cost instead of roughly equal node count.  Clans
+//! that are already under the target become a single grain.  Larger
+//! clans are split as follows:
+//!   - independent: small subclans are pooled until the pool reaches
+//!     the target; large subclans are searched recursively.
+//!   - linear: runs of consecutive small subclans are pooled; a large
+//!     subclan closes the current run and is searched recursively.
+//!   - primitive: no union of the subclans is guaranteed to be a
+//!     clan, so each subclan is handled on its own.
+//! Every grain produced this way is a clan (or a union of clans that
+//! is itself a clan), which guarantees that the graph of grains is
+//! acyclic.  Unlike grain_collect we don't modify a graph here; it is
+//! up to the caller to assign any nodes that aren't covered to grains
+//! of their own and to build the reduced graph.
+template<class nodeid_t>
+void grain_collect_cost(const digraph<clanid<nodeid_t> > &ClanTree,
+                        const typename digraph<clanid<nodeid_t> >::nodelist_c_iter_t &claniterator,
+                        const std::vector<double> &cost,
+                        double grain_target,
+                        std::vector<bitvector> &grains)
+{
+  typedef clanid<nodeid_t> Clanid;
+  const bitvector &clan_nodes = claniterator->first.nodes();
+  const std::set<Clanid> &subclans = claniterator->second.successors;
+
+  if(subclans.empty() || nodeset_cost(clan_nodes, cost) <= grain_target) {
+    // small enough (or indivisible): the whole clan is a grain
+    grains.push_back(clan_nodes);
+    return;
+  }
+
+  bitvector node_group(clan_nodes.length());
+  double group_cost = 0.0;
 
+  switch(claniterator->first.type) {
+  case independent:
+  case pseudoindependent:
+    for(typename std::set<Clanid>::const_iterator subclan = subclans.begin();
+        subclan != subclans.end(); ++subclan) {
+      double subcost = nodeset_cost(subclan->nodes(), cost);
+      if(subcost > grain_target)
+        grain_collect_cost(ClanTree, ClanTree.nodelist().find(*subclan), cost, grain_target, grains);
+      else {
+        node_group.setunion(subclan->nodes());
+        group_cost += subcost;
+        if(group_cost >= grain_target) {
+          grains.push_back(node_group);
+          node_group.clearall();
+          group_cost = 0.0;
+        }
+      }
+    }
+    break;
+
+  case linear:
+    // The successor set is kept in topological order, so pooling
+    // consecutive entries keeps each pool contiguous in the chain.
+    for(typename std::set<Clanid>::const_iterator subclan = subclans.begin();
+        subclan != subclans.end(); ++subclan) {
+      double subcost = nodeset_cost(subclan->nodes(), cost);
+      if(subcost > grain_target || group_cost + subcost > grain_target) {
+        if(!node_group.empty()) {
+          grains.push_back(node_group);
+          node_group.clearall();
+          group_cost = 0.0;
+        }
+      }
+      if(subcost > grain_target)
+        grain_collect_cost(ClanTree, ClanTree.nodelist().find(*subclan), cost, grain_target, grains);
+      else {
+        node_group.setunion(subclan->nodes());
+        group_cost += subcost;
+      }
+    }
+    break;
+
+  case primitive:
+  default:
+    for(typename std::set<Clanid>::const_iterator subclan = subclans.begin();
+        subclan != subclans.end(); ++subclan)
+      grain_collect_cost(ClanTree, ClanTree.nodelist().find(*subclan), cost, grain_target, grains);
+    break;
+  }
+
+  // leftover nodes form the last grain
+  if(!node_group.empty())
+    grains.push_back(node_group);
+}
+
+#endif
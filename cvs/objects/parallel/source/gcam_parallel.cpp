@@ -35,8 +35,9 @@
 #if GCAM_PARALLEL_ENABLED
 #include <cassert>
 #include <vector>
-#include <list>
-#include <Eigen/SparseCore>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
 /* gcam headers */
 #include "parallel/include/gcam_parallel.hpp"
 #include "util/base/include/configuration.h"
@@ -45,8 +46,13 @@
 #include "containers/include/market_dependency_finder.h"
 #include "util/logger/include/ilogger.h"
 #include "util/base/include/timer.h"
+#include "util/base/include/util.h"
 #include "util/base/include/auto_file.h"
+#include "util/base/include/activity_profiler.h"
+#include "util/base/include/manage_state_variables.hpp"
+#include "marketplace/include/market.h"
 /* more graph analysis headers */
+#include "parallel/include/bitvector.hpp"
 #include "parallel/include/clanid.hpp"
 #include "parallel/include/graph-parse.hpp"
 #include "parallel/include/grain-collect.hpp"
@@ -54,6 +60,65 @@
 
 using namespace std;
 
+namespace {
+    //! The messages being collected by a GcamParallel::DeferGrainLog on the
+    //! current thread or null if they should be written directly.
+    thread_local GcamParallel::GrainLogMessages* tDeferredGrainLog = 0;
+    
+    /*!
+     * \brief Write a message to the parallel-grain-log or collect it if the
+     *        calling thread is deferring it's messages.
+     * \param aLevel The level to write the message at.
+     * \param aMessage The message.
+     */
+    void logGrain( const ILogger::WarningLevel aLevel, const string& aMessage ) {
+        if( tDeferredGrainLog ) {
+            tDeferredGrainLog->push_back( make_pair( aLevel, aMessage ) );
+        }
+        else {
+            ILogger& pgLog = ILogger::getLogger( "parallel-grain-log" );
+            pgLog.setLevel( aLevel );
+            pgLog << aMessage << endl;
+        }
+    }
+    
+    /*!
+     * \brief Find a topological ordering of a directed graph with Kahn's algorithm.
+     * \param aAdjList The out edges for each vertex.
+     * \param aTopoOrder Set to the vertices in topological order.
+     * \param aNumPredecessors Set to the number of in edges of each vertex.
+     * \return False if the graph contains a cycle in which case aTopoOrder only
+     *         contains the vertices which are not on or after a cycle.
+     */
+    bool topologicalSort( const vector<vector<int> >& aAdjList, vector<int>& aTopoOrder,
+                          vector<int>& aNumPredecessors )
+    {
+        const int numVertices = aAdjList.size();
+        aNumPredecessors.assign( numVertices, 0 );
+        for( const vector<int>& outEdges : aAdjList ) {
+            for( int outEdge : outEdges ) {
+                ++aNumPredecessors[ outEdge ];
+            }
+        }
+        vector<int> inDegree( aNumPredecessors );
+        aTopoOrder.clear();
+        aTopoOrder.reserve( numVertices );
+        for( int vert = 0; vert < numVertices; ++vert ) {
+            if( inDegree[ vert ] == 0 ) {
+                aTopoOrder.push_back( vert );
+            }
+        }
+        for( size_t i = 0; i < aTopoOrder.size(); ++i ) {
+            for( int outEdge : aAdjList[ aTopoOrder[ i ] ] ) {
+                if( --inDegree[ outEdge ] == 0 ) {
+                    aTopoOrder.push_back( outEdge );
+                }
+            }
+        }
+        return aTopoOrder.size() == static_cast<size_t>( numVertices );
+    }
+}
+
 int GcamFlowGraph::mPeriod = 0;
 tbb::global_control* GcamFlowGraph::mParallelismConfig = 0;
 
@@ -62,7 +127,8 @@ tbb::global_control* GcamFlowGraph::mParallelismConfig = 0;
  * \details We lookup the "max-parallelism", aka number of cores to use, from the
  *          configuration so we can initialize TBB with it.
  */
-GcamFlowGraph::GcamFlowGraph() : mTBBFlowGraph(), mHead( mTBBFlowGraph )
+GcamFlowGraph::GcamFlowGraph() : mTBBFlowGraph(), mHead( mTBBFlowGraph ), mCalibrationEvals( 0 ),
+mSharedState( 0 )
 {
     const int maxParallelism = Configuration::getInstance()->getInt( "max-parallelism", -1 );
     if( maxParallelism > 0 && !mParallelismConfig ) {
@@ -104,80 +170,30 @@ GcamFlowGraph::~GcamFlowGraph() {
 void GcamParallel::makeTBBFlowGraph( const MarketDependencyFinder& aDependencyFinder,
                                      GcamFlowGraph& aTBBGraph )
 {
-    using tbb::flow::continue_node;
-    using tbb::flow::continue_msg;
-    
-    tbb::flow::graph& tbbFlowGraph = aTBBGraph.mTBBFlowGraph;
-    tbb::flow::broadcast_node<tbb::flow::continue_msg>& head = aTBBGraph.mHead;
-    
-    ILogger& pgLog = ILogger::getLogger( "parallel-grain-log" );
-    pgLog.setLevel( ILogger::DEBUG );
-    
     // first read the information out of the dependency finder into an
-    // adjacency matrix for easy as we are going to have to take multiple
+    // adjacency list for easy as we are going to have to take multiple
     // passes to create the TBB structures required
     vector<IActivity*> globalOrdering = aDependencyFinder.getOrdering();
-    vector<MarketDependencyFinder::CalcVertex*> calcVertexList( globalOrdering.size(), 0 );
-    vector<bool> isSourceNode( globalOrdering.size(), true );
-    using TripletType = Eigen::Triplet<bool>;
-    list<TripletType> adjTriplets;
+    vector<IActivity*> activities( globalOrdering.size(), 0 );
+    vector<vector<int> > adjList( globalOrdering.size() );
     
     for( MarketDependencyFinder::DependencyItem* item : aDependencyFinder.getDependencyItems() ) {
         for( MarketDependencyFinder::CalcVertex* vertex : item->mPriceVertices ) {
-            calcVertexList[ vertex->mUID ] = vertex;
+            activities[ vertex->mUID ] = vertex->mCalcItem;
             for( MarketDependencyFinder::CalcVertex* outEdge : vertex->mOutEdges ) {
-                isSourceNode[ outEdge->mUID ] = false;
-                adjTriplets.push_back(TripletType(vertex->mUID, outEdge->mUID, true));
+                adjList[ vertex->mUID ].push_back( outEdge->mUID );
             }
         }
         for( MarketDependencyFinder::CalcVertex* vertex : item->mDemandVertices ) {
-            calcVertexList[ vertex->mUID ] = vertex;
+            activities[ vertex->mUID ] = vertex->mCalcItem;
             for( MarketDependencyFinder::CalcVertex* outEdge : vertex->mOutEdges ) {
-                isSourceNode[ outEdge->mUID ] = false;
-                adjTriplets.push_back(TripletType(vertex->mUID, outEdge->mUID, true));
+                adjList[ vertex->mUID ].push_back( outEdge->mUID );
             }
         }
     }
     
-    // TODO: in principle doing a transitive reduction should give us a speed up
-    // running the model, however it seems to be rather computationaly expensive
-    // see if we can come up with a faster algorithm that scales well with a large
-    // number of vertices/edges.
-    Eigen::SparseMatrix<bool> adjMatrix( globalOrdering.size(), globalOrdering.size());
-    adjMatrix.setFromTriplets( adjTriplets.begin(), adjTriplets.end() );
-    
-    /*Eigen::SparseMatrix<bool> adjMatrixTransClosure = adjMatrix;
-    for (int k=0; k<adjMatrix.outerSize(); ++k) {
-        adjMatrixTransClosure = adjMatrix * adjMatrix;
-    }
-    
-    // transative reduction
-    adjMatrix = (adjMatrix - adjMatrixTransClosure).pruned();*/
-    
-    // we have to take two passes, first to create each of the verticies which
-    // apparently can not be copied so we hang on to them with a pointer
-    vector<continue_node<continue_msg>*>& tbbVert = aTBBGraph.mTBBVertices;
-    tbbVert.reserve( calcVertexList.size() );
-    for( MarketDependencyFinder::CalcVertex* vert : calcVertexList ) {
-        IActivity* activity = vert->mCalcItem;
-        tbbVert.push_back(new continue_node<continue_msg>(tbbFlowGraph, [activity](continue_msg) {
-            activity->calc(GcamFlowGraph::mPeriod);
-        }));
-    }
-    // now create the edges
-    for (int k=0; k<adjMatrix.outerSize(); ++k) {
-        for (Eigen::SparseMatrix<bool>::InnerIterator it(adjMatrix,k); it; ++it) {
-            // regular dependency between activities
-            pgLog << calcVertexList[it.row()]->mCalcItem->getDescription() << " -> " << calcVertexList[it.col()]->mCalcItem->getDescription() << endl;
-            make_edge(*tbbVert[it.row()], *tbbVert[it.col()]);
-        }
-        // also include the "edge" from the head node to all activities that
-        // have no incoming dependencies
-        if(isSourceNode[k]) {
-            pgLog << " head -> " << calcVertexList[k]->mCalcItem->getDescription() << endl;
-            make_edge(head, *tbbVert[k]);
-        }
-    }
+    setCalcOrder( globalOrdering, aTBBGraph );
+    createTBBNodes( activities, adjList, aTBBGraph );
 }
 
 
@@ -185,9 +201,12 @@ void GcamParallel::makeTBBFlowGraph( const MarketDependencyFinder& aDependencyFi
 * \brief Build the TBB a partial flow graph from the given dependency finder which
 *        contains the activities and given the list of the activities which are to be included
  *  in the partial graph.
-* \details This method is basically does the same thing as for the global graph but is a bit
- *     more complicated due to not being able to use UIDs so we have to resort to set
- *     looks which are slower. So we seperate it into it's own method.
+* \details This method is basically does the same thing as for the global graph but
+ *     the UIDs of the vertices can not be used directly as indicies so we must first
+ *     map them into the position of the activity in the partial list.  Only edges
+ *     between two vertices that are both in the partial list are kept.  Since the
+ *     partial list is closed under the out edges of it's vertices the result is
+ *     the full dependency structure of the subgraph.
 * \param[in] aDependencyFinder Defines the activities and their relationships.
  * \param[in] aPartialCalcList A list representing the subset of vertices to include
  *     in this subgraph.
@@ -206,12 +225,478 @@ void GcamParallel::makeTBBFlowGraph( const MarketDependencyFinder& aDependencyFi
                                      GcamFlowGraph& aTBBGraph,
                                      const std::vector<IActivity*>& aPartialCalcList )
 {
-    // TODO:implement this.  We don't use it at the moment and to make sure
-    // it works it would be handy to actually test it with something.
-    ILogger& mainLog = ILogger::getLogger( "main_log" );
-    mainLog.setLevel( ILogger::ERROR );
-    mainLog << "TBB flow graphs for partial subgraphs are not yet implemented." << endl;
-    abort();
+    // lookup from activity to it's position in the partial list
+    unordered_map<const IActivity*, int> partialIndex;
+    partialIndex.reserve( aPartialCalcList.size() );
+    for( size_t i = 0; i < aPartialCalcList.size(); ++i ) {
+        partialIndex[ aPartialCalcList[ i ] ] = i;
+    }
+    
+    // map the UIDs of all vertices to their position in the partial list or -1
+    // if they are not included
+    const int numVertices = aDependencyFinder.getOrdering().size();
+    vector<int> uidToIndex( numVertices, -1 );
+    vector<MarketDependencyFinder::CalcVertex*> calcVertexList( aPartialCalcList.size(), 0 );
+    for( MarketDependencyFinder::DependencyItem* item : aDependencyFinder.getDependencyItems() ) {
+        for( const MarketDependencyFinder::VertexList* vertices : { &item->mPriceVertices, &item->mDemandVertices } ) {
+            for( MarketDependencyFinder::CalcVertex* vertex : *vertices ) {
+                auto indexIter = partialIndex.find( vertex->mCalcItem );
+                if( indexIter != partialIndex.end() ) {
+                    uidToIndex[ vertex->mUID ] = (*indexIter).second;
+                    calcVertexList[ (*indexIter).second ] = vertex;
+                }
+            }
+        }
+    }
+    
+    vector<vector<int> > adjList( aPartialCalcList.size() );
+    for( size_t i = 0; i < calcVertexList.size(); ++i ) {
+        assert( calcVertexList[ i ] );
+        for( MarketDependencyFinder::CalcVertex* outEdge : calcVertexList[ i ]->mOutEdges ) {
+            if( uidToIndex[ outEdge->mUID ] != -1 ) {
+                adjList[ i ].push_back( uidToIndex[ outEdge->mUID ] );
+            }
+        }
+    }
+    
+    setCalcOrder( aPartialCalcList, aTBBGraph );
+    createTBBNodes( aPartialCalcList, adjList, aTBBGraph );
+}
+
+/*!
+ * \brief Record the position of each activity in the serial calculation order.
+ * \details Each node will then let the markets know which activity it is
+ *          calculating so that the supplies and demands it adds can be summed in
+ *          the same order as a serial calculation, making the results bitwise
+ *          identical regardless of the number of threads or how activities were
+ *          grouped into grains and scheduled.
+ * \see MarketAccumulator
+ * \param aOrdering The activities of the graph in the order a serial
+ *                  calculation would calculate them.
+ * \param aTBBGraph The flow graph to record the order in.
+ */
+void GcamParallel::setCalcOrder( const vector<IActivity*>& aOrdering, GcamFlowGraph& aTBBGraph ) {
+    aTBBGraph.mCalcOrder.clear();
+    aTBBGraph.mCalcOrder.reserve( aOrdering.size() );
+    for( size_t i = 0; i < aOrdering.size(); ++i ) {
+        aTBBGraph.mCalcOrder[ aOrdering[ i ] ] = i;
+    }
+}
+
+/*!
+ * \brief Create the TBB flow graph nodes and edges for the given activities.
+ * \details The adjacency list is reduced via transitiveReduction before any
+ *          edges are created.  Every remaining edge adds to the dependency
+ *          counting the TBB runtime must do for each model evaluation so it is
+ *          well worth the one time cost.
+ *          If "parallel-grain-target-usec" is configured the activities and
+ *          reduced edges are retained and each node will time it's activity
+ *          for the first "parallel-grain-calibration-evals" model evaluations
+ *          after which World::calc will call coarsenFlowGraph.
+ * \param aActivities The activities to calculate, indexed consistently with aAdjList.
+ * \param aAdjList The out edges for each activity.
+ * \param aTBBGraph The flow graph to create the nodes in.
+ */
+void GcamParallel::createTBBNodes( const vector<IActivity*>& aActivities,
+                                   const vector<vector<int> >& aAdjList,
+                                   GcamFlowGraph& aTBBGraph )
+{
+    vector<vector<int> > adjList( aAdjList );
+    int numEdges = 0;
+    for( const vector<int>& outEdges : adjList ) {
+        numEdges += outEdges.size();
+    }
+    const int numRemoved = transitiveReduction( adjList );
+    logGrain( ILogger::DEBUG, "Transitive reduction removed " + util::toString( numRemoved ) + " of "
+              + util::toString( numEdges ) + " edges." );
+    
+    const Configuration* conf = Configuration::getInstance();
+    if( conf->getInt( "parallel-grain-target-usec", 0, false ) > 0 ) {
+        aTBBGraph.mActivities = aActivities;
+        aTBBGraph.mAdjList = adjList;
+        aTBBGraph.mActivityCost.assign( aActivities.size(), 0.0 );
+        aTBBGraph.mCalibrationEvals = max( conf->getInt( "parallel-grain-calibration-evals", 5, false ), 1 );
+    }
+    
+    vector<vector<IActivity*> > grains;
+    grains.reserve( aActivities.size() );
+    for( IActivity* activity : aActivities ) {
+        grains.push_back( vector<IActivity*>( 1, activity ) );
+    }
+    // no costs have been measured yet so each activity is assumed to cost the same
+    createTBBGrainNodes( grains, adjList, vector<double>(), aTBBGraph );
+}
+
+/*!
+ * \brief Create the TBB flow graph nodes and edges for the given grains of activities.
+ * \details Each grain becomes a single flow graph node which calculates it's
+ *          activities in the order given, which must be consistent with the
+ *          dependencies between them.  Grains which have no incoming edges
+ *          are connected to the head node.  Note no reduction of the edges
+ *          is done here.
+ *          If "parallel-critical-path-priority" is set each node is given a
+ *          TBB node priority by the length of the longest path from it to the
+ *          end of the graph so that when several nodes are ready those which
+ *          start long chains of dependencies run first.
+ *          Every node calculates in the graph's mSharedState when it is set and
+ *          if the graph has an mCalcOrder lets the markets know the position of
+ *          each activity it calculates.
+ * \param aGrains The grains of activities to calculate, indexed consistently with aAdjList.
+ * \param aAdjList The out edges for each grain.
+ * \param aGrainCost The measured cost of each grain or empty in which case the
+ *                   cost of a grain is estimated by the number of activities in it.
+ * \param aTBBGraph The flow graph to create the nodes in.
+ */
+void GcamParallel::createTBBGrainNodes( const vector<vector<IActivity*> >& aGrains,
+                                        const vector<vector<int> >& aAdjList,
+                                        const vector<double>& aGrainCost,
+                                        GcamFlowGraph& aTBBGraph )
+{
+    using tbb::flow::continue_node;
+    using tbb::flow::continue_msg;
+    
+    tbb::flow::graph& tbbFlowGraph = aTBBGraph.mTBBFlowGraph;
+    tbb::flow::broadcast_node<tbb::flow::continue_msg>& head = aTBBGraph.mHead;
+    
+    vector<bool> isSourceNode( aGrains.size(), true );
+    for( const vector<int>& outEdges : aAdjList ) {
+        for( int outEdge : outEdges ) {
+            isSourceNode[ outEdge ] = false;
+        }
+    }
+    
+    vector<tbb::flow::node_priority_t> priority( aGrains.size(), tbb::flow::no_priority );
+    if( Configuration::getInstance()->getBool( "parallel-critical-path-priority", false, false ) ) {
+        vector<double> cost( aGrainCost );
+        if( cost.empty() ) {
+            for( const vector<IActivity*>& grain : aGrains ) {
+                cost.push_back( grain.size() );
+            }
+        }
+        priority = criticalPathPriorities( aAdjList, cost );
+    }
+    
+    // we have to take two passes, first to create each of the verticies which
+    // apparently can not be copied so we hang on to them with a pointer
+    vector<continue_node<continue_msg>*>& tbbVert = aTBBGraph.mTBBVertices;
+    tbbVert.reserve( aGrains.size() );
+    // the profiler is only consulted here so that the node bodies do not pay
+    // for profiling unless it has been enabled
+    ActivityProfiler* profiler = ActivityProfiler::getInstance().isEnabled() ? &ActivityProfiler::getInstance() : 0;
+    // each node also redirects it's thread's state if the graph is running as a
+    // partial derivative, see World::calcPartial
+    const GcamFlowGraph* graph = &aTBBGraph;
+    const bool hasCalcOrder = !aTBBGraph.mCalcOrder.empty();
+    for( size_t i = 0; i < aGrains.size(); ++i ) {
+        // pair each activity with it's position in the calc order, which is
+        // only used if the graph has one
+        vector<pair<IActivity*, int> > orderedGrain;
+        for( IActivity* activity : aGrains[ i ] ) {
+            orderedGrain.push_back( make_pair( activity, hasCalcOrder ? aTBBGraph.mCalcOrder.at( activity ) : -1 ) );
+        }
+        // while calibrating grains are single activities and the indices
+        // line up with mActivityCost
+        double* cost = aTBBGraph.mCalibrationEvals > 0 ? &aTBBGraph.mActivityCost[ i ] : 0;
+        tbbVert.push_back(new continue_node<continue_msg>(tbbFlowGraph, [orderedGrain, hasCalcOrder, cost, profiler, graph](continue_msg) {
+            ManageStateVariables::SharedStateScope stateScope( graph->mSharedState );
+            for( const pair<IActivity*, int>& activity : orderedGrain ) {
+                if( hasCalcOrder ) {
+                    Market::setCalcOrdinal( activity.second );
+                }
+                if( cost ) {
+                    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                    activity.first->calc(GcamFlowGraph::mPeriod);
+                    const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+                    *cost += chrono::duration<double>( end - start ).count();
+                    if( profiler ) {
+                        profiler->record( activity.first, start, end );
+                    }
+                }
+                else if( profiler ) {
+                    profiler->calc( activity.first, GcamFlowGraph::mPeriod );
+                }
+                else {
+                    activity.first->calc(GcamFlowGraph::mPeriod);
+                }
+            }
+            if( hasCalcOrder ) {
+                Market::setCalcOrdinal( -1 );
+            }
+        }, priority[ i ]));
+    }
+    // now create the edges
+    for( size_t k = 0; k < aAdjList.size(); ++k ) {
+        for( int outEdge : aAdjList[ k ] ) {
+            // regular dependency between activities
+            logGrain( ILogger::DEBUG, aGrains[ k ].front()->getDescription() + " -> " + aGrains[ outEdge ].front()->getDescription() );
+            make_edge(*tbbVert[ k ], *tbbVert[ outEdge ]);
+        }
+        // also include the "edge" from the head node to all activities that
+        // have no incoming dependencies
+        if(isSourceNode[k]) {
+            logGrain( ILogger::DEBUG, " head -> " + aGrains[ k ].front()->getDescription() );
+            make_edge(head, *tbbVert[k]);
+        }
+    }
+}
+
+/*!
+ * \brief Rebuild a flow graph by merging it's activities into grains of roughly
+ *        "parallel-grain-target-usec" measured cost.
+ * \details Scheduling overhead in the TBB runtime dominates for the many tiny
+ *          activities in the model.  Once the cost of each activity has been
+ *          measured we parse the graph into a clan tree and use grain_collect_cost
+ *          to merge chains and small clans into grains.  Every grain is a clan
+ *          so the graph of grains is guaranteed to be acyclic.  The existing nodes
+ *          are discarded and replaced with one node per grain.
+ * \warning This must only be called while the flow graph is idle, i.e. after
+ *          wait_for_all() has returned.
+ * \param aTBBGraph The flow graph to coarsen.  It must have been built with
+ *                  grain coarsening enabled and finished it's calibration.
+ */
+void GcamParallel::coarsenFlowGraph( GcamFlowGraph& aTBBGraph ) {
+    ILogger& pgLog = ILogger::getLogger( "parallel-grain-log" );
+    pgLog.setLevel( ILogger::NOTICE );
+    
+    const Configuration* conf = Configuration::getInstance();
+    const double grainTarget = conf->getInt( "parallel-grain-target-usec", 0, false ) * 1.0e-6;
+    const int numEvals = max( conf->getInt( "parallel-grain-calibration-evals", 5, false ), 1 );
+    const vector<IActivity*>& activities = aTBBGraph.mActivities;
+    const vector<vector<int> >& adjList = aTBBGraph.mAdjList;
+    
+    Timer coarsenTimer;
+    coarsenTimer.start();
+    
+    // parse the graph, which has already been transitively reduced as required
+    // by graph_parse, into a tree of clans
+    digraph<IActivity*> graph;
+    unordered_map<IActivity*, int> activityIndex;
+    for( size_t i = 0; i < adjList.size(); ++i ) {
+        activityIndex[ activities[ i ] ] = i;
+        graph.addnode( activities[ i ] );
+        for( int outEdge : adjList[ i ] ) {
+            graph.addedge( activities[ i ], activities[ outEdge ] );
+        }
+    }
+    graph.topological_sort();
+    vector<double> cost( activities.size() );
+    for( size_t i = 0; i < activities.size(); ++i ) {
+        cost[ graph.topological_index( activities[ i ] ) ] = aTBBGraph.mActivityCost[ i ] / numEvals;
+    }
+    digraph<clanid<IActivity*> > clanTree;
+    graph_parse( graph, 0, clanTree );
+    
+    vector<bitvector> grainSets;
+    grain_collect_cost( clanTree, clanTree.nodelist().begin(), cost, grainTarget, grainSets );
+    
+    // map each activity to it's grain, the nodes in a grain set are visited in
+    // topological order which is the order they must be calculated in
+    vector<int> grainIndex( activities.size(), -1 );
+    vector<vector<IActivity*> > grains;
+    for( const bitvector& grainSet : grainSets ) {
+        vector<IActivity*> grain;
+        bitvector_iterator nodeIter( &grainSet );
+        while( nodeIter.next() ) {
+            IActivity* activity = graph.topological_lookup( nodeIter.bindex() );
+            const int node = activityIndex[ activity ];
+            if( grainIndex[ node ] == -1 ) {
+                grainIndex[ node ] = grains.size();
+                grain.push_back( activity );
+            }
+        }
+        if( !grain.empty() ) {
+            grains.push_back( grain );
+        }
+    }
+    // any activity not covered by the clan tree is a grain of it's own
+    for( size_t i = 0; i < activities.size(); ++i ) {
+        if( grainIndex[ i ] == -1 ) {
+            grainIndex[ i ] = grains.size();
+            grains.push_back( vector<IActivity*>( 1, activities[ i ] ) );
+        }
+    }
+    
+    vector<vector<int> > grainAdjList( grains.size() );
+    for( size_t i = 0; i < adjList.size(); ++i ) {
+        for( int outEdge : adjList[ i ] ) {
+            if( grainIndex[ i ] != grainIndex[ outEdge ] ) {
+                grainAdjList[ grainIndex[ i ] ].push_back( grainIndex[ outEdge ] );
+            }
+        }
+    }
+    transitiveReduction( grainAdjList );
+    
+    vector<double> grainCost( grains.size(), 0.0 );
+    for( size_t i = 0; i < activities.size(); ++i ) {
+        grainCost[ grainIndex[ i ] ] += aTBBGraph.mActivityCost[ i ] / numEvals;
+    }
+    
+    // tear down the existing nodes and replace them with the grains
+    aTBBGraph.mTBBFlowGraph.reset( tbb::flow::rf_clear_edges );
+    for( auto vert : aTBBGraph.mTBBVertices ) {
+        delete vert;
+    }
+    aTBBGraph.mTBBVertices.clear();
+    aTBBGraph.mCalibrationEvals = 0;
+    createTBBGrainNodes( grains, grainAdjList, grainCost, aTBBGraph );
+    
+    coarsenTimer.stop();
+    pgLog << "Coarsened " << activities.size() << " activities into " << grains.size()
+          << " grains with a target cost of " << grainTarget * 1.0e6 << " usec in "
+          << coarsenTimer.getTotalTimeDifference() << " seconds." << endl;
+    
+    // the activity data is no longer needed
+    aTBBGraph.mActivities.clear();
+    aTBBGraph.mAdjList.clear();
+    aTBBGraph.mActivityCost.clear();
+}
+
+/*!
+ * \brief Remove all edges from a directed acyclic graph which are implied by
+ *        some longer path.
+ * \details The result is the transitive reduction of the graph: the minimal set
+ *          of edges which has the same reachability as the original.  We visit
+ *          vertices in reverse topological order keeping a bitvector of the
+ *          vertices reachable from each one.  The out edges of a vertex are
+ *          checked in topological order so that any vertex which lies on a path
+ *          to another out edge is always processed first; an out edge is then
+ *          redundant exactly when it's target is already reachable.  The cost is
+ *          O(V*E/32) with the reachability of a vertex released as soon as all
+ *          of it's predecessors have been processed to keep the memory footprint
+ *          to the "frontier" of the graph rather than V^2 bits.
+ * \param[inout] aAdjList The out edges for each vertex.  On return only the
+ *                        edges in the transitive reduction remain.
+ * \return The number of edges removed including any duplicates.  If the graph
+ *         contains a cycle it is left unchanged and zero is returned.
+ */
+int GcamParallel::transitiveReduction( vector<vector<int> >& aAdjList ) {
+    const int numVertices = aAdjList.size();
+    if( numVertices == 0 ) {
+        return 0;
+    }
+    
+    vector<int> topoOrder;
+    vector<int> numPredecessors;
+    if( !topologicalSort( aAdjList, topoOrder, numPredecessors ) ) {
+        logGrain( ILogger::WARNING, "Skipping transitive reduction as the graph contains a cycle." );
+        return 0;
+    }
+    vector<int> topoIndex( numVertices );
+    for( int i = 0; i < numVertices; ++i ) {
+        topoIndex[ topoOrder[ i ] ] = i;
+    }
+    auto topoCompare = [&topoIndex]( const int aLHS, const int aRHS ) {
+        return topoIndex[ aLHS ] < topoIndex[ aRHS ];
+    };
+    
+    int numRemoved = 0;
+    vector<bitvector> reachable( numVertices );
+    vector<int> reducedEdges;
+    for( auto vertIter = topoOrder.rbegin(); vertIter != topoOrder.rend(); ++vertIter ) {
+        vector<int>& outEdges = aAdjList[ *vertIter ];
+        sort( outEdges.begin(), outEdges.end(), topoCompare );
+        
+        bitvector currReachable( numVertices );
+        reducedEdges.clear();
+        for( int outEdge : outEdges ) {
+            if( !currReachable.get( outEdge ) ) {
+                reducedEdges.push_back( outEdge );
+                currReachable.set( outEdge );
+                currReachable.setunion( reachable[ outEdge ] );
+            }
+        }
+        
+        // all predecessors of a vertex come before it in the topological ordering
+        // so once they have all been visited it's reachability is no longer needed
+        for( int outEdge : outEdges ) {
+            if( --numPredecessors[ outEdge ] == 0 ) {
+                reachable[ outEdge ] = bitvector();
+            }
+        }
+        numRemoved += outEdges.size() - reducedEdges.size();
+        outEdges = reducedEdges;
+        if( numPredecessors[ *vertIter ] > 0 ) {
+            reachable[ *vertIter ] = currReachable;
+        }
+    }
+    
+    return numRemoved;
+}
+
+/*!
+ * \brief Compute TBB node priorities which favor nodes on the critical path.
+ * \details The priority of each vertex is based on it's "bottom level": the cost
+ *          of the most expensive path from the vertex to the end of the graph,
+ *          including the vertex itself.  When the scheduler has several ready
+ *          nodes the one with the longest remaining path is the one which, if
+ *          delayed, would delay the completion of the whole graph the most.  The
+ *          bottom levels are scaled to the range [1, 1000000] so that all nodes
+ *          have some priority and relative differences are preserved.
+ * \param aAdjList The out edges for each vertex, which must be acyclic.
+ * \param aCost The (estimated) cost of each vertex.
+ * \return The node priority for each vertex or no_priority for all of them if
+ *         the graph contains a cycle.
+ */
+vector<tbb::flow::node_priority_t> GcamParallel::criticalPathPriorities( const vector<vector<int> >& aAdjList,
+                                                                         const vector<double>& aCost )
+{
+    const int numVertices = aAdjList.size();
+    vector<tbb::flow::node_priority_t> priority( numVertices, tbb::flow::no_priority );
+    
+    vector<int> topoOrder;
+    vector<int> numPredecessors;
+    if( !topologicalSort( aAdjList, topoOrder, numPredecessors ) ) {
+        logGrain( ILogger::WARNING, "Skipping critical path priorities as the graph contains a cycle." );
+        return priority;
+    }
+    
+    // the bottom level of a vertex only depends on it's successors so they are
+    // computed in reverse topological order
+    vector<double> bottomLevel( numVertices, 0.0 );
+    double maxBottomLevel = 0.0;
+    for( auto vertIter = topoOrder.rbegin(); vertIter != topoOrder.rend(); ++vertIter ) {
+        double longestSuccessor = 0.0;
+        for( int outEdge : aAdjList[ *vertIter ] ) {
+            longestSuccessor = max( longestSuccessor, bottomLevel[ outEdge ] );
+        }
+        bottomLevel[ *vertIter ] = aCost[ *vertIter ] + longestSuccessor;
+        maxBottomLevel = max( maxBottomLevel, bottomLevel[ *vertIter ] );
+    }
+    
+    const double maxPriority = 1.0e6;
+    for( int vert = 0; vert < numVertices; ++vert ) {
+        priority[ vert ] = 1 + static_cast<tbb::flow::node_priority_t>(
+            maxBottomLevel > 0.0 ? bottomLevel[ vert ] / maxBottomLevel * maxPriority : 0.0 );
+    }
+    
+    logGrain( ILogger::DEBUG, "Critical path length estimate: " + util::toString( maxBottomLevel ) );
+    
+    return priority;
+}
+
+/*!
+ * \brief Constructor which starts collecting the messages of the calling thread.
+ * \param aMessages The messages to add to.
+ */
+GcamParallel::DeferGrainLog::DeferGrainLog( GrainLogMessages& aMessages ):
+mPrevMessages( tDeferredGrainLog )
+{
+    tDeferredGrainLog = &aMessages;
+}
+
+//! Destructor which restores whatever the calling thread was doing before.
+GcamParallel::DeferGrainLog::~DeferGrainLog() {
+    tDeferredGrainLog = mPrevMessages;
+}
+
+/*!
+ * \brief Write messages collected by a DeferGrainLog to the parallel-grain-log.
+ * \param aMessages The messages to write.
+ */
+void GcamParallel::writeGrainLog( const GrainLogMessages& aMessages ) {
+    for( const pair<ILogger::WarningLevel, string>& message : aMessages ) {
+        logGrain( message.first, message.second );
+    }
 }
 
 #endif // GCAM_PARALLEL_ENABLED
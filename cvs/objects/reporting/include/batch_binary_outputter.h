@@ -0,0 +1,155 @@
+#ifndef _BATCH_BINARY_OUTPUTTER_H_
+#define _BATCH_BINARY_OUTPUTTER_H_
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*! 
+* \file batch_binary_outputter.h
+* \ingroup Objects
+* \brief BatchBinaryOutputter class header file.
+*/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+
+#include "util/base/include/default_visitor.h"
+
+/*! 
+* \ingroup Objects
+* \brief A visitor which appends a fixed width binary summary record per scenario
+*        to a file so that large batches can be loaded without any parsing.
+* \details This is a replacement for BatchCSVOutputter for very large batches.
+*          The gases to summarize are set by the batch-summary-gases string
+*          configuration parameter, default CO2, and the quantities by
+*          batch-summary-quantities, default price,emissions,concentration,
+*          forcing,temperature.  The quantities available are:
+*          - price: the price of the first tax market for the gas by period
+*          - emissions: the emissions of the gas by period
+*          - concentration: the concentration of the gas by climate year
+*          - forcing: the radiative forcing of the gas by climate year
+*          - temperature: the temperature change by climate year
+*          - total-forcing: the total radiative forcing by climate year
+*          Temperature and total forcing do not depend on the gas and so are
+*          included once.  Climate years are as in BatchCSVOutputter.
+*
+*          All values are in the native (little endian on all supported
+*          platforms) byte order:
+*          - char[8] "GCAMBSUM"
+*          - uint32 0x01020304 which reads as 0x04030201 if the byte order of
+*            the file does not match the reader's
+*          - uint32 header size which is the offset of the first record
+*          - uint32 record size
+*          - uint32 number of value columns followed by for each column:
+*            - string quantity
+*            - string gas which is empty for temperature and total-forcing
+*            - int32 year
+*          - zero padding to a multiple of 8 bytes
+*          - the records each of which is:
+*            - char[64] scenario name padded with nulls
+*            - uint8 1 if the scenario solved, otherwise 0
+*            - 7 bytes of padding
+*            - float64 per value column, NaN if not available
+*
+*          Strings are written as a uint32 length followed by the characters.
+*          If the file already exists with the same header records are appended
+*          to it after dropping any partially written record at its end,
+*          otherwise it is started over.  Scenarios run concurrently each
+*          write their own shard which is then merged in with mergeShards.
+*/
+class BatchBinaryOutputter : public DefaultVisitor {
+public:
+    BatchBinaryOutputter( const std::string& aFileName, const bool aAppend );
+
+    ~BatchBinaryOutputter();
+
+    void writeDidScenarioSolve( bool aDidSolve );
+
+    static bool mergeShards( const std::string& aFileName,
+                             const std::vector<std::string>& aShardFileNames );
+
+    // IVisitor methods
+    virtual void startVisitScenario( const Scenario* aScenario, const int aPeriod );
+
+    virtual void startVisitMarket( const Market* aMarket, const int aPeriod );
+
+    virtual void startVisitClimateModel( const IClimateModel* aClimateModel, const int aPeriod );
+
+private:
+    //! A key for a value column of quantity, gas and year.
+    typedef std::tuple<std::string, std::string, int> ColumnKey;
+
+    //! The file to write records to.
+    const std::string mFileName;
+
+    //! Whether to append to mFileName if it already has the same header.
+    const bool mAppend;
+
+    //! The gases to summarize.
+    std::vector<std::string> mGases;
+
+    //! The quantities to summarize.
+    std::vector<std::string> mQuantities;
+
+    //! The value columns in the order they are written.
+    std::vector<ColumnKey> mColumns;
+
+    //! The index of each column in mColumns.
+    std::map<ColumnKey, size_t> mColumnIndices;
+
+    //! The serialized header, which is empty until the first scenario is visited.
+    std::string mHeader;
+
+    //! The name of the scenario currently being summarized.
+    std::string mScenarioName;
+
+    //! The values of the scenario currently being summarized.
+    std::vector<double> mValues;
+
+    //! Whether the header of the file has been checked or written.
+    bool mHasStartedFile;
+
+    bool hasQuantity( const std::string& aQuantity ) const;
+
+    void setValue( const std::string& aQuantity, const std::string& aGas, const int aYear,
+                   const double aValue );
+
+    void createHeader( const Scenario* aScenario );
+};
+
+#endif // _BATCH_BINARY_OUTPUTTER_H_
@@ -0,0 +1,234 @@
+#ifndef _COLUMNAR_OUTPUTTER_H_
+#define _COLUMNAR_OUTPUTTER_H_
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*! 
+* \file columnar_outputter.h
+* \ingroup Objects
+* \brief ColumnarOutputter class header file.
+*/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+#include <iosfwd>
+
+#include "util/base/include/default_visitor.h"
+
+/*! 
+* \ingroup Objects
+* \brief A visitor which writes model results to a compact binary columnar file.
+* \details This is an alternative to the XMLDBOutputter which does not need Java
+*          or an XML database.  Results are collected into one table per type of
+*          entity: markets, resources, sectors, technology outputs, technology
+*          inputs, emissions, land allocation, population and climate.  Each row
+*          of a table is identified by a number of key columns, such as region,
+*          sector and technology, and holds one value per model period.
+*
+*          All strings are stored once in a dictionary shared by all tables and
+*          the key columns only hold the index into it.  Data are laid out by
+*          column so that downstream tools can read just the columns they need.
+*          All values are in the native (little endian on all supported
+*          platforms) byte order:
+*          - char[8] "GCAMCOL1"
+*          - string scenario name
+*          - uint32 number of periods followed by an int32 year per period
+*          - uint32 dictionary size followed by each string
+*          - uint32 number of tables followed by for each table:
+*            - string table name
+*            - uint32 number of key columns followed by each key column name
+*            - uint64 number of rows
+*            - for each key column uint32 dictionary index per row
+*            - for each period float64 value per row, NaN if not set
+*
+*          Strings are written as a uint32 length followed by the characters.
+*          Rows of technology outputs, inputs and emissions which are zero in all
+*          periods are skipped, as is done in the XML database.
+*
+*          If a single period is visited only results for that period are
+*          collected which may then be written as text with writeRecords.
+*/
+class ColumnarOutputter : public DefaultVisitor {
+public:
+    ColumnarOutputter();
+
+    ~ColumnarOutputter();
+
+    bool writeFile( std::ostream& aOut ) const;
+
+    void writeSchema( std::ostream& aOut ) const;
+
+    void writeRecords( std::ostream& aOut, const int aPeriod ) const;
+
+    // IVisitor methods
+    virtual void finish() const;
+
+    virtual void startVisitScenario( const Scenario* aScenario, const int aPeriod );
+
+    virtual void startVisitRegion( const Region* aRegion, const int aPeriod );
+
+    virtual void endVisitRegion( const Region* aRegion, const int aPeriod );
+
+    virtual void startVisitResource( const AResource* aResource, const int aPeriod );
+
+    virtual void endVisitResource( const AResource* aResource, const int aPeriod );
+
+    virtual void startVisitSubResource( const SubResource* aSubResource, const int aPeriod );
+
+    virtual void endVisitSubResource( const SubResource* aSubResource, const int aPeriod );
+
+    virtual void startVisitSector( const Sector* aSector, const int aPeriod );
+
+    virtual void endVisitSector( const Sector* aSector, const int aPeriod );
+
+    virtual void startVisitSubsector( const Subsector* aSubsector, const int aPeriod );
+
+    virtual void endVisitSubsector( const Subsector* aSubsector, const int aPeriod );
+
+    virtual void startVisitTechnology( const Technology* aTechnology, const int aPeriod );
+
+    virtual void endVisitTechnology( const Technology* aTechnology, const int aPeriod );
+
+    virtual void startVisitMiniCAMInput( const MiniCAMInput* aInput, const int aPeriod );
+
+    virtual void startVisitOutput( const IOutput* aOutput, const int aPeriod );
+
+    virtual void startVisitGHG( const AGHG* aGHG, const int aPeriod );
+
+    virtual void startVisitMarket( const Market* aMarket, const int aPeriod );
+
+    virtual void startVisitLandLeaf( const LandLeaf* aLandLeaf, const int aPeriod );
+
+    virtual void startVisitPopulation( const Population* aPopulation, const int aPeriod );
+
+    virtual void startVisitClimateModel( const IClimateModel* aClimateModel, const int aPeriod );
+
+private:
+    //! A table of results for one type of entity.
+    struct Table {
+        Table( const std::string& aName, const std::vector<std::string>& aKeyNames );
+
+        //! The name of the table.
+        std::string mName;
+
+        //! The names of the key columns.
+        std::vector<std::string> mKeyNames;
+
+        //! The dictionary index of each key by key column then by row.
+        std::vector<std::vector<uint32_t> > mKeyColumns;
+
+        //! The values by period then by row.
+        std::vector<std::vector<double> > mValueColumns;
+
+        //! The row index of each combination of keys.
+        std::map<std::vector<uint32_t>, size_t> mRowIndex;
+    };
+
+    //! The ways to organize results, listed in the order they are written.
+    enum TableType {
+        MARKET,
+        RESOURCE,
+        SECTOR,
+        TECHNOLOGY_OUTPUT,
+        TECHNOLOGY_INPUT,
+        EMISSIONS,
+        LAND_ALLOCATION,
+        POPULATION,
+        CLIMATE,
+        END
+    };
+
+    //! The results tables indexed by TableType.
+    std::vector<Table> mTables;
+
+    //! The strings in the dictionary in the order they were added.
+    std::vector<std::string> mDictionary;
+
+    //! The index of each string in mDictionary.
+    std::unordered_map<std::string, uint32_t> mDictionaryIndex;
+
+    //! The name of the scenario.
+    std::string mScenarioName;
+
+    //! The year of each model period.
+    std::vector<int> mYears;
+
+    //! The first period results are collected for.
+    int mStartPeriod;
+
+    //! One past the last period results are collected for.
+    int mEndPeriod;
+
+    //! The name of the current region.
+    std::string mCurrentRegion;
+
+    //! The name of the current sector or resource.
+    std::string mCurrentSector;
+
+    //! The name of the current subsector or subresource.
+    std::string mCurrentSubsector;
+
+    //! The output unit of the current sector or resource.
+    std::string mCurrentOutputUnit;
+
+    //! The input unit of the current sector.
+    std::string mCurrentInputUnit;
+
+    //! The price unit of the current sector or resource.
+    std::string mCurrentPriceUnit;
+
+    //! The name of the current technology.
+    std::string mCurrentTechnology;
+
+    //! The vintage year of the current technology.
+    std::string mCurrentVintage;
+
+    uint32_t encode( const std::string& aString );
+
+    size_t getRow( const TableType aTable, const std::vector<std::string>& aKeys );
+
+    void setValue( const TableType aTable, const std::vector<std::string>& aKeys,
+                   const int aPeriod, const double aValue );
+
+    void addNonZeroRow( const TableType aTable, const std::vector<std::string>& aKeys,
+                        const std::vector<double>& aValues );
+};
+
+#endif // _COLUMNAR_OUTPUTTER_H_
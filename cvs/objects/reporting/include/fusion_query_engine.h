@@ -0,0 +1,154 @@
+#ifndef _FUSION_QUERY_ENGINE_H_
+#define _FUSION_QUERY_ENGINE_H_
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*! 
+* \file fusion_query_engine.h
+* \ingroup Objects
+* \brief FusionQueryEngine class header file.
+*/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <iosfwd>
+
+class Scenario;
+
+/*! 
+* \ingroup Objects
+* \brief Runs simple aggregation queries directly on the model results using
+*        GCAMFusion and writes the results as CSV.
+* \details This covers the common shapes of the queries in Main_queries.xml,
+*          such as a sum by region, sector and technology, market prices or
+*          emissions, without the need for the XML database.  The queries are
+*          read from an XML file of the form:
+*          \code
+*          <queries>
+*              <query title="CO2 emissions by region" group-by="region" unit="MTC">
+*                  world/region/sector/subsector/technology/period/ghg[NamedFilter,StringEquals,CO2]/emissions
+*              </query>
+*          </queries>
+*          \endcode
+*          The text of a query is a GCAMFusion search string, see parseFilterString.
+*          The group-by attribute is a comma separated list of the names of steps
+*          in the search string which are used as the columns which identify a row.
+*          The value of such a column is the name of the container that was
+*          stepped into, or its year if it is an IYeared such as a technology
+*          vintage.  All values found which share the same columns are summed
+*          by year.  If the data found is an array the year is taken from its
+*          index, otherwise it is the year of the innermost IYeared container
+*          such as a Market.
+*
+*          Steps which follow a descendant step, "//", may still be used in
+*          group-by and are counted back from the data that was found.
+*
+*          Each query is written as a title line followed by a header of
+*          scenario, the group-by columns, each year and Units and then one
+*          line per row.  Rows which are zero in all years are skipped.
+*/
+class FusionQueryEngine {
+public:
+    FusionQueryEngine();
+
+    ~FusionQueryEngine();
+
+    bool parseQueries( const std::string& aFileName );
+
+    void runQueries( Scenario* aScenario, std::ostream& aOut );
+
+    // GCAMFusion callback methods
+    template<typename ContainerType>
+    void pushFilterStep( const ContainerType& aData );
+
+    template<typename ContainerType>
+    void popFilterStep( const ContainerType& aData );
+
+    template<typename DataType>
+    void processData( DataType& aData );
+
+private:
+    //! A single query parsed from the queries file.
+    struct Query {
+        //! The title to write with the results.
+        std::string mTitle;
+
+        //! The GCAMFusion search string.
+        std::string mPath;
+
+        //! The names of the steps to group results by.
+        std::vector<std::string> mGroupBy;
+
+        //! The units of the results which are only used as a label.
+        std::string mUnit;
+    };
+
+    //! The queries to run in the order they were read.
+    std::vector<Query> mQueries;
+
+    //! The label of each container which has been stepped into by the current search.
+    std::vector<std::string> mStepLabels;
+
+    //! The year of each container which has been stepped into by the current
+    //! search or -1 if it does not have one.
+    std::vector<int> mStepYears;
+
+    //! For each group-by column of the current query the index into mStepLabels
+    //! to use.  Negative values are counted back from the end of mStepLabels.
+    std::vector<int> mGroupByIndices;
+
+    //! The results of the current query by group-by columns then by year.
+    std::map<std::vector<std::string>, std::map<int, double> > mResults;
+
+    //! All of the years found by the current query.
+    std::set<int> mYears;
+
+    bool setGroupByIndices( const Query& aQuery );
+
+    void addValue( const int aYear, const double aValue );
+
+    template<typename ArrayType>
+    void processArray( const ArrayType& aArray );
+
+    int getCurrentYear() const;
+
+    void writeResults( const Query& aQuery, const std::string& aScenarioName, std::ostream& aOut ) const;
+};
+
+#endif // _FUSION_QUERY_ENGINE_H_
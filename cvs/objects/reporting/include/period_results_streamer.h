@@ -0,0 +1,87 @@
+#ifndef _PERIOD_RESULTS_STREAMER_H_
+#define _PERIOD_RESULTS_STREAMER_H_
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*! 
+* \file period_results_streamer.h
+* \ingroup Objects
+* \brief PeriodResultsStreamer class header file.
+*/
+
+#include <string>
+#include <fstream>
+
+class Scenario;
+
+/*! 
+* \ingroup Objects
+* \brief Appends the results of each model period to a text file as soon as the
+*        period has been calculated.
+* \details This allows results to be consumed while the model is still running
+*          and ensures results of completed periods are not lost if the run
+*          fails part way through.  Results are collected for just the given
+*          period with the ColumnarOutputter and are written as comma separated
+*          records, see ColumnarOutputter::writeRecords.  When the file is
+*          created the key columns of each table are written as "#schema" lines.
+*          The records for each period are enclosed by "#period,scenario,year"
+*          and "#end-period,scenario,year" lines and the file is flushed after
+*          each period so that readers may safely use any complete period.  The
+*          file is only ever appended to so if a period is calculated again, for
+*          instance while target finding, the last block for a year is the
+*          valid one.
+*/
+class PeriodResultsStreamer {
+public:
+    PeriodResultsStreamer( const std::string& aFileName );
+
+    ~PeriodResultsStreamer();
+
+    void writePeriod( const Scenario* aScenario, const int aPeriod );
+
+private:
+    //! The name of the file being written.
+    std::string mFileName;
+
+    //! The file to append results to.
+    std::ofstream mFile;
+
+    //! Whether the schema needs to be written before the first period.
+    bool mNeedsSchema;
+};
+
+#endif // _PERIOD_RESULTS_STREAMER_H_
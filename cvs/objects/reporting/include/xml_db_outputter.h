@@ -49,6 +49,7 @@
 #include <iosfwd>
 #include <boost/iostreams/filtering_stream.hpp>
 #include "util/base/include/default_visitor.h"
+#include "util/base/include/time_vector.h"
 
 #if( __HAVE_JAVA__ )
 #include <jni.h>
@@ -70,6 +71,8 @@ public:
 
     static bool checkJavaWorking();
 
+    static void waitForPendingWrites();
+
     void finish() const;
     void finalizeAndClose();
 
@@ -259,7 +262,25 @@ private:
     //! the like of the XMLDBOutputter.
     const std::unique_ptr<JNIContainer> mJNIContainer;
 
-    static std::unique_ptr<JNIContainer> createContainer( const bool aTestingOnly );
+    static std::unique_ptr<JNIContainer> createContainer( const bool aTestingOnly,
+                                                          const std::string& aScenarioName );
+
+    static void callFinish( const JNIContainer* aJNIContainer );
+
+    static void callFinalizeAndClose( const JNIContainer* aJNIContainer );
+
+    static bool callAppendData( const JNIContainer* aJNIContainer, const std::string& aData,
+                                const std::string& aLocation );
+
+    struct AsyncWriteQueue;
+
+    //! The queue of data and database operations to be processed by the background
+    //! writer thread when writing asynchronously, null otherwise.
+    const std::shared_ptr<AsyncWriteQueue> mAsyncQueue;
+
+    static std::shared_ptr<AsyncWriteQueue> createAsyncQueue();
+
+    static void runAsyncWriter( std::shared_ptr<AsyncWriteQueue> aQueue, const std::string aScenarioName );
 #endif
     static const std::string createContainerName( const std::string& aScenarioName );
 
@@ -324,6 +345,25 @@ private:
         //! on the Java side.
         bool mErrorFlag;
     };
+
+    /*!
+     * \brief A boost IO "sink" which hands XML as it is written to mBuffer to the
+     *        background writer thread.
+     * \details Each block of data flushed from mBuffer is copied into an immutable
+     *          chunk and queued for the writer thread which will send it to Java.
+     *          If too much data is waiting to be written the visit will block until
+     *          the writer catches up so memory use stays bounded.
+     */
+    class AsyncQueueIOSink : public boost::iostreams::sink {
+    public:
+        AsyncQueueIOSink( const std::shared_ptr<AsyncWriteQueue>& aQueue );
+
+        // boost::iostreams::sink methods
+        std::streamsize write( const char* aData, std::streamsize aLength );
+    private:
+        //! The queue to send the data to.
+        std::shared_ptr<AsyncWriteQueue> mQueue;
+    };
 #endif
 
 };
@@ -0,0 +1,427 @@
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*!
+* \file batch_binary_outputter.cpp
+* \ingroup Objects
+* \brief The BatchBinaryOutputter class source file for writing a fixed width
+*        binary summary of each scenario in a batch.
+*/
+
+#include "util/base/include/definitions.h"
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+
+#include "reporting/include/batch_binary_outputter.h"
+#include "util/base/include/configuration.h"
+#include "util/base/include/model_time.h"
+#include "util/base/include/util.h"
+#include "util/logger/include/ilogger.h"
+#include "containers/include/scenario.h"
+#include "marketplace/include/market.h"
+#include "marketplace/include/imarket_type.h"
+#include "climate/include/iclimate_model.h"
+
+using namespace std;
+
+namespace {
+    //! Identifies a batch summary file.
+    const char BATCH_SUMMARY_MAGIC[ 8 ] = { 'G', 'C', 'A', 'M', 'B', 'S', 'U', 'M' };
+
+    //! The fixed width of the scenario name in each record.
+    const size_t SCENARIO_NAME_SIZE = 64;
+
+    //! The size of the scenario name, solved flag and padding in each record.
+    const size_t RECORD_PREFIX_SIZE = SCENARIO_NAME_SIZE + 8;
+
+    //! Written in the native byte order so that readers can tell which it is.
+    const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+    //! The offsets of the fixed fields in the header.
+    const size_t BYTE_ORDER_OFFSET = sizeof( BATCH_SUMMARY_MAGIC );
+    const size_t HEADER_SIZE_OFFSET = BYTE_ORDER_OFFSET + sizeof( uint32_t );
+    const size_t RECORD_SIZE_OFFSET = HEADER_SIZE_OFFSET + sizeof( uint32_t );
+
+    template<typename T>
+    void appendRaw( string& aOut, const T aValue ) {
+        aOut.append( reinterpret_cast<const char*>( &aValue ), sizeof( T ) );
+    }
+
+    void appendString( string& aOut, const string& aValue ) {
+        appendRaw( aOut, static_cast<uint32_t>( aValue.size() ) );
+        aOut.append( aValue );
+    }
+
+    template<typename T>
+    T readRaw( const string& aData, const size_t aOffset ) {
+        T value;
+        memcpy( &value, aData.data() + aOffset, sizeof( T ) );
+        return value;
+    }
+
+    /*!
+     * \brief Read the header of a batch summary file.
+     * \param aIn The stream to read from positioned at the start of the file.
+     * \param aHeader Set to the full header.
+     * \return Whether a valid header in the native byte order could be read.
+     */
+    bool readHeader( istream& aIn, string& aHeader ) {
+        aHeader.assign( RECORD_SIZE_OFFSET + sizeof( uint32_t ), '\0' );
+        if( !aIn.read( &aHeader[ 0 ], aHeader.size() )
+            || aHeader.compare( 0, sizeof( BATCH_SUMMARY_MAGIC ), BATCH_SUMMARY_MAGIC, sizeof( BATCH_SUMMARY_MAGIC ) ) != 0
+            || readRaw<uint32_t>( aHeader, BYTE_ORDER_OFFSET ) != BYTE_ORDER_MARK )
+        {
+            return false;
+        }
+        const uint32_t headerSize = readRaw<uint32_t>( aHeader, HEADER_SIZE_OFFSET );
+        if( headerSize < aHeader.size() ) {
+            return false;
+        }
+        const size_t fixedSize = aHeader.size();
+        aHeader.resize( headerSize );
+        return static_cast<bool>( aIn.read( &aHeader[ fixedSize ], headerSize - fixedSize ) );
+    }
+
+    /*!
+     * \brief Drop any partial record from the end of a batch summary file.
+     * \details A run which stopped in the middle of appending a record would
+     *          otherwise misalign every record appended after it.
+     * \param aFileName The file to trim which must start with aHeader.
+     * \param aHeader The header of the file.
+     * \return Whether the file now holds only whole records.
+     */
+    bool trimToWholeRecords( const string& aFileName, const string& aHeader ) {
+        uint64_t fileSize = 0;
+        int64_t modifiedTime = 0;
+        if( !util::getFileStamp( aFileName, fileSize, modifiedTime ) || fileSize < aHeader.size() ) {
+            return false;
+        }
+        const uint32_t recordSize = readRaw<uint32_t>( aHeader, RECORD_SIZE_OFFSET );
+        const uint64_t wholeSize = aHeader.size() + ( fileSize - aHeader.size() ) / recordSize * recordSize;
+        if( wholeSize != fileSize ) {
+            ILogger& mainLog = ILogger::getLogger( "main_log" );
+            mainLog.setLevel( ILogger::WARNING );
+            mainLog << "Dropping a partially written record from the end of " << aFileName << endl;
+            return util::truncateFile( aFileName, wholeSize );
+        }
+        return true;
+    }
+
+    /*!
+     * \brief Open a batch summary file to append records to.
+     * \details If aAppend is set and the file already has the given header it is
+     *          trimmed to whole records and opened for appending, otherwise the
+     *          file is started over with the given header.
+     * \param aFileName The file to open.
+     * \param aHeader The header the file must have.
+     * \param aAppend Whether to keep the existing records.
+     * \param aOut The stream to open.
+     * \return Whether the file could be opened.
+     */
+    bool openForAppend( const string& aFileName, const string& aHeader, const bool aAppend, ofstream& aOut ) {
+        if( aAppend ) {
+            ifstream existingFile( aFileName.c_str(), ios_base::in | ios_base::binary );
+            string existingHeader;
+            const bool isSameHeader = existingFile.is_open() && readHeader( existingFile, existingHeader )
+                && existingHeader == aHeader;
+            existingFile.close();
+            if( isSameHeader && trimToWholeRecords( aFileName, aHeader ) ) {
+                aOut.open( aFileName.c_str(), ios_base::out | ios_base::binary | ios_base::app );
+                return aOut.is_open();
+            }
+            if( !existingHeader.empty() ) {
+                ILogger& mainLog = ILogger::getLogger( "main_log" );
+                mainLog.setLevel( ILogger::WARNING );
+                mainLog << "Starting over " << aFileName << " as it has a different byte order or set of columns." << endl;
+            }
+        }
+        aOut.open( aFileName.c_str(), ios_base::out | ios_base::binary | ios_base::trunc );
+        aOut.write( aHeader.data(), aHeader.size() );
+        return static_cast<bool>( aOut );
+    }
+}
+
+/*!
+ * \brief Constructor
+ * \param aFileName The file to write records to.
+ * \param aAppend Whether to keep any records already in the file if it has the
+ *                same columns.
+ */
+BatchBinaryOutputter::BatchBinaryOutputter( const string& aFileName, const bool aAppend ):
+mFileName( aFileName ),
+mAppend( aAppend ),
+mHasStartedFile( false )
+{
+    const Configuration* conf = Configuration::getInstance();
+    const string gases = conf->getString( "batch-summary-gases", "CO2", false );
+    const string quantities = conf->getString( "batch-summary-quantities",
+                                               "price,emissions,concentration,forcing,temperature", false );
+    boost::split( mGases, gases, boost::is_any_of( "," ) );
+    boost::split( mQuantities, quantities, boost::is_any_of( "," ) );
+    for( string& gas : mGases ) {
+        boost::trim( gas );
+    }
+    for( string& quantity : mQuantities ) {
+        boost::trim( quantity );
+    }
+    mGases.erase( remove( mGases.begin(), mGases.end(), string() ), mGases.end() );
+    mQuantities.erase( remove( mQuantities.begin(), mQuantities.end(), string() ), mQuantities.end() );
+}
+
+//! Destructor
+BatchBinaryOutputter::~BatchBinaryOutputter() {
+}
+
+/*!
+ * \brief Check if the given quantity was configured to be summarized.
+ * \param aQuantity The quantity to check.
+ * \return Whether to summarize aQuantity.
+ */
+bool BatchBinaryOutputter::hasQuantity( const string& aQuantity ) const {
+    return find( mQuantities.begin(), mQuantities.end(), aQuantity ) != mQuantities.end();
+}
+
+/*!
+ * \brief Create the value columns and the header from the model time.
+ * \details Columns are ordered by gas then quantity then year followed by the
+ *          quantities which do not depend on the gas.
+ * \param aScenario The first scenario visited.
+ */
+void BatchBinaryOutputter::createHeader( const Scenario* aScenario ) {
+    const Modeltime* modeltime = aScenario->getModeltime();
+    vector<int> periodYears;
+    for( int period = 0; period < modeltime->getmaxper(); ++period ) {
+        periodYears.push_back( modeltime->getper_to_yr( period ) );
+    }
+    const int outputInterval = Configuration::getInstance()->getInt( "climateOutputInterval",
+                                                                     modeltime->gettimestep( 0 ), false );
+    // print at least to 2100 if interval is set appropriately
+    const int endingYear = max( modeltime->getEndYear(), 2100 );
+    vector<int> climateYears;
+    for( int year = modeltime->getStartYear(); year <= endingYear; year += outputInterval ) {
+        climateYears.push_back( year );
+    }
+
+    const string gasQuantities[] = { "price", "emissions", "concentration", "forcing" };
+    const string globalQuantities[] = { "temperature", "total-forcing" };
+    for( const string& quantity : mQuantities ) {
+        if( find( begin( gasQuantities ), end( gasQuantities ), quantity ) == end( gasQuantities )
+            && find( begin( globalQuantities ), end( globalQuantities ), quantity ) == end( globalQuantities ) )
+        {
+            ILogger& mainLog = ILogger::getLogger( "main_log" );
+            mainLog.setLevel( ILogger::WARNING );
+            mainLog << "Unknown batch summary quantity " << quantity << " will be skipped." << endl;
+        }
+    }
+    for( const string& gas : mGases ) {
+        for( const string& quantity : gasQuantities ) {
+            if( hasQuantity( quantity ) ) {
+                const vector<int>& years = quantity == "price" || quantity == "emissions" ? periodYears : climateYears;
+                for( const int year : years ) {
+                    mColumns.push_back( ColumnKey( quantity, gas, year ) );
+                }
+            }
+        }
+    }
+    for( const string& quantity : globalQuantities ) {
+        if( hasQuantity( quantity ) ) {
+            for( const int year : climateYears ) {
+                mColumns.push_back( ColumnKey( quantity, string(), year ) );
+            }
+        }
+    }
+    for( size_t i = 0; i < mColumns.size(); ++i ) {
+        mColumnIndices[ mColumns[ i ] ] = i;
+    }
+
+    mHeader.assign( BATCH_SUMMARY_MAGIC, sizeof( BATCH_SUMMARY_MAGIC ) );
+    appendRaw( mHeader, BYTE_ORDER_MARK );
+    // the sizes are filled in once the columns have been written
+    appendRaw( mHeader, static_cast<uint32_t>( 0 ) );
+    appendRaw( mHeader, static_cast<uint32_t>( RECORD_PREFIX_SIZE + mColumns.size() * sizeof( double ) ) );
+    appendRaw( mHeader, static_cast<uint32_t>( mColumns.size() ) );
+    for( const ColumnKey& column : mColumns ) {
+        appendString( mHeader, get<0>( column ) );
+        appendString( mHeader, get<1>( column ) );
+        appendRaw( mHeader, static_cast<int32_t>( get<2>( column ) ) );
+    }
+    mHeader.resize( ( mHeader.size() + 7 ) / 8 * 8, '\0' );
+    const uint32_t headerSize = static_cast<uint32_t>( mHeader.size() );
+    memcpy( &mHeader[ HEADER_SIZE_OFFSET ], &headerSize, sizeof( headerSize ) );
+}
+
+void BatchBinaryOutputter::startVisitScenario( const Scenario* aScenario, const int aPeriod ) {
+    // the columns can not be created in the constructor because we will not have
+    // a model time at that point
+    if( mHeader.empty() ) {
+        createHeader( aScenario );
+    }
+    mScenarioName = aScenario->getName();
+    mValues.assign( mColumns.size(), numeric_limits<double>::quiet_NaN() );
+}
+
+/*!
+ * \brief Set the value of a column if it is being summarized and has not already
+ *        been set.
+ * \param aQuantity The quantity of the value.
+ * \param aGas The gas of the value or empty if it does not depend on the gas.
+ * \param aYear The year of the value.
+ * \param aValue The value to set.
+ */
+void BatchBinaryOutputter::setValue( const string& aQuantity, const string& aGas, const int aYear,
+                                     const double aValue )
+{
+    auto columnIter = mColumnIndices.find( ColumnKey( aQuantity, aGas, aYear ) );
+    if( columnIter != mColumnIndices.end() && std::isnan( mValues[ (*columnIter).second ] ) ) {
+        mValues[ (*columnIter).second ] = aValue;
+    }
+}
+
+void BatchBinaryOutputter::startVisitMarket( const Market* aMarket, const int aPeriod ) {
+    if( aMarket->getType() == IMarketType::TAX && hasQuantity( "price" ) ) {
+        setValue( "price", aMarket->getGoodName(), aMarket->getYear(), aMarket->getPrice() );
+    }
+}
+
+void BatchBinaryOutputter::startVisitClimateModel( const IClimateModel* aClimateModel, const int aPeriod ) {
+    for( const ColumnKey& column : mColumns ) {
+        const string& quantity = get<0>( column );
+        const string& gas = get<1>( column );
+        const int year = get<2>( column );
+        if( quantity == "emissions" ) {
+            setValue( quantity, gas, year, aClimateModel->getEmissions( gas, year ) );
+        }
+        else if( quantity == "concentration" ) {
+            setValue( quantity, gas, year, aClimateModel->getConcentration( gas, year ) );
+        }
+        else if( quantity == "forcing" ) {
+            setValue( quantity, gas, year, aClimateModel->getForcing( gas, year ) );
+        }
+        else if( quantity == "temperature" ) {
+            setValue( quantity, gas, year, aClimateModel->getTemperature( year ) );
+        }
+        else if( quantity == "total-forcing" ) {
+            setValue( quantity, gas, year, aClimateModel->getTotalForcing( year ) );
+        }
+    }
+}
+
+/*!
+ * \brief Append the record for the current scenario with whether it had solved.
+ * \details The record is written with a single write so that a partially written
+ *          file only ever loses its last record.
+ * \param aDidSolve Whether the current scenario solved.
+ */
+void BatchBinaryOutputter::writeDidScenarioSolve( bool aDidSolve ) {
+    if( mHeader.empty() ) {
+        return;
+    }
+    string record( SCENARIO_NAME_SIZE, '\0' );
+    if( mScenarioName.size() > SCENARIO_NAME_SIZE ) {
+        ILogger& mainLog = ILogger::getLogger( "main_log" );
+        mainLog.setLevel( ILogger::WARNING );
+        mainLog << "Scenario name " << mScenarioName << " will be truncated in " << mFileName << endl;
+    }
+    record.replace( 0, min( mScenarioName.size(), SCENARIO_NAME_SIZE ), mScenarioName, 0, SCENARIO_NAME_SIZE );
+    appendRaw( record, static_cast<uint8_t>( aDidSolve ? 1 : 0 ) );
+    record.resize( RECORD_PREFIX_SIZE, '\0' );
+    record.append( reinterpret_cast<const char*>( mValues.data() ), mValues.size() * sizeof( double ) );
+
+    ofstream out;
+    if( mHasStartedFile ) {
+        // a previous write may have failed part way through
+        trimToWholeRecords( mFileName, mHeader );
+        out.open( mFileName.c_str(), ios_base::out | ios_base::binary | ios_base::app );
+    }
+    else if( openForAppend( mFileName, mHeader, mAppend, out ) ) {
+        mHasStartedFile = true;
+    }
+    out.write( record.data(), record.size() );
+    if( !out ) {
+        ILogger& mainLog = ILogger::getLogger( "main_log" );
+        mainLog.setLevel( ILogger::ERROR );
+        mainLog << "Failed to write the batch summary for " << mScenarioName << " to " << mFileName << endl;
+    }
+}
+
+/*!
+ * \brief Append the records of each shard to the given file and remove the shards.
+ * \details Shards which do not exist are skipped, such as from scenarios which
+ *          failed to run.  Any shard with different columns than the file is left
+ *          in place and an error is given.
+ * \param aFileName The file to append the records to.
+ * \param aShardFileNames The shards to merge in the order given.
+ * \return Whether all existing shards were merged.
+ */
+bool BatchBinaryOutputter::mergeShards( const string& aFileName, const vector<string>& aShardFileNames ) {
+    ILogger& mainLog = ILogger::getLogger( "main_log" );
+    bool success = true;
+    ofstream out;
+    string fileHeader;
+    for( const string& shardFileName : aShardFileNames ) {
+        ifstream shard( shardFileName.c_str(), ios_base::in | ios_base::binary );
+        if( !shard.is_open() ) {
+            continue;
+        }
+        string header;
+        if( !readHeader( shard, header ) || ( !fileHeader.empty() && header != fileHeader ) ) {
+            mainLog.setLevel( ILogger::ERROR );
+            mainLog << "Could not merge " << shardFileName << " into " << aFileName << endl;
+            success = false;
+            continue;
+        }
+        if( fileHeader.empty() ) {
+            if( !openForAppend( aFileName, header, true, out ) ) {
+                mainLog.setLevel( ILogger::ERROR );
+                mainLog << "Could not open " << aFileName << endl;
+                return false;
+            }
+            fileHeader = header;
+        }
+        // only copy whole records in case the shard was not completely written
+        const uint32_t recordSize = readRaw<uint32_t>( header, RECORD_SIZE_OFFSET );
+        string records( ( istreambuf_iterator<char>( shard ) ), istreambuf_iterator<char>() );
+        records.resize( records.size() / recordSize * recordSize );
+        out.write( records.data(), records.size() );
+        shard.close();
+        remove( shardFileName.c_str() );
+    }
+    out.flush();
+    return success && ( !out.is_open() || static_cast<bool>( out ) );
+}
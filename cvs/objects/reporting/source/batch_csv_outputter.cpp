@@ -68,6 +68,16 @@ mIsFirstScenario(true)
 {
 }
 
+/*! \brief Constructor which writes to the given file regardless of the
+*          batchCSVOutputFile configuration.
+* \param aFileName The name of the file to write to.
+*/
+BatchCSVOutputter::BatchCSVOutputter( const string& aFileName ):
+mFile( aFileName ),
+mIsFirstScenario(true)
+{
+}
+
 /*!
  * \brief Destructor
  */
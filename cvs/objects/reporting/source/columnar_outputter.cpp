@@ -0,0 +1,499 @@
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+
+/*!
+* \file columnar_outputter.cpp
+* \ingroup Objects
+* \brief The ColumnarOutputter class source file for writing results to a binary
+*        columnar file.
+*/
+
+#include "util/base/include/definitions.h"
+#include <fstream>
+#include <cmath>
+#include <limits>
+
+#include "reporting/include/columnar_outputter.h"
+#include "util/base/include/configuration.h"
+#include "util/base/include/model_time.h"
+#include "util/base/include/util.h"
+#include "util/logger/include/ilogger.h"
+#include "containers/include/scenario.h"
+#include "containers/include/region.h"
+#include "containers/include/iinfo.h"
+#include "resources/include/aresource.h"
+#include "resources/include/subresource.h"
+#include "sectors/include/sector.h"
+#include "sectors/include/subsector.h"
+#include "technologies/include/technology.h"
+#include "technologies/include/ioutput.h"
+#include "functions/include/minicam_input.h"
+#include "emissions/include/aghg.h"
+#include "marketplace/include/marketplace.h"
+#include "marketplace/include/market.h"
+#include "land_allocator/include/land_leaf.h"
+#include "demographics/include/population.h"
+#include "climate/include/iclimate_model.h"
+
+using namespace std;
+
+extern Scenario* scenario;
+
+namespace {
+    //! Identifies a columnar results file.
+    const char COLUMNAR_MAGIC[ 8 ] = { 'G', 'C', 'A', 'M', 'C', 'O', 'L', '1' };
+
+    template<typename T>
+    void writeRaw( ostream& aOut, const T aValue ) {
+        aOut.write( reinterpret_cast<const char*>( &aValue ), sizeof( T ) );
+    }
+
+    void writeString( ostream& aOut, const string& aValue ) {
+        writeRaw( aOut, static_cast<uint32_t>( aValue.size() ) );
+        aOut.write( aValue.data(), aValue.size() );
+    }
+
+    //! Quote a string for a CSV file if it contains any special characters.
+    string toCSVField( const string& aValue ) {
+        if( aValue.find_first_of( ",\"\n" ) == string::npos ) {
+            return aValue;
+        }
+        string quoted = "\"";
+        for( const char c : aValue ) {
+            quoted += c;
+            if( c == '"' ) {
+                quoted += c;
+            }
+        }
+        return quoted + "\"";
+    }
+}
+
+ColumnarOutputter::Table::Table( const string& aName, const vector<string>& aKeyNames ):
+mName( aName ),
+mKeyNames( aKeyNames ),
+mKeyColumns( aKeyNames.size() )
+{
+}
+
+//! Constructor
+ColumnarOutputter::ColumnarOutputter():
+mStartPeriod( 0 ),
+mEndPeriod( 0 )
+{
+    // Tables must be added in the order of TableType.
+    mTables.reserve( END );
+    mTables.push_back( Table( "market", { "market", "region", "good", "variable", "unit" } ) );
+    mTables.push_back( Table( "resource", { "region", "resource", "variable", "unit" } ) );
+    mTables.push_back( Table( "sector", { "region", "sector", "variable", "unit" } ) );
+    mTables.push_back( Table( "technology-output", { "region", "sector", "subsector", "technology", "vintage", "output", "unit" } ) );
+    mTables.push_back( Table( "technology-input", { "region", "sector", "subsector", "technology", "vintage", "input", "unit" } ) );
+    mTables.push_back( Table( "emissions", { "region", "sector", "subsector", "technology", "vintage", "gas", "unit" } ) );
+    mTables.push_back( Table( "land-allocation", { "region", "land-leaf", "unit" } ) );
+    mTables.push_back( Table( "population", { "region", "unit" } ) );
+    mTables.push_back( Table( "climate", { "variable", "unit" } ) );
+}
+
+//! Destructor
+ColumnarOutputter::~ColumnarOutputter() {
+}
+
+/*!
+ * \brief Write the collected results to the file set by the columnarOutput
+ *        configuration parameter.
+ */
+void ColumnarOutputter::finish() const {
+    const Configuration* conf = Configuration::getInstance();
+    string fileName = conf->getFile( "columnarOutput", "gcam-results.gcol" );
+    if( conf->shouldAppendScnToFile( "columnarOutput" ) ) {
+        fileName = util::appendScenarioToFileName( fileName );
+    }
+    ofstream out( fileName.c_str(), ios_base::out | ios_base::binary | ios_base::trunc );
+    util::checkIsOpen( out, fileName );
+    const bool success = writeFile( out );
+
+    ILogger& mainLog = ILogger::getLogger( "main_log" );
+    mainLog.setLevel( success ? ILogger::NOTICE : ILogger::ERROR );
+    mainLog << ( success ? "Wrote" : "Failed to write" ) << " columnar results to " << fileName << endl;
+}
+
+/*!
+ * \brief Write the collected results in the format described in the class
+ *        documentation.
+ * \param aOut A binary stream to write to.
+ * \return Whether the stream is still good after writing.
+ */
+bool ColumnarOutputter::writeFile( ostream& aOut ) const {
+    aOut.write( COLUMNAR_MAGIC, sizeof( COLUMNAR_MAGIC ) );
+    writeString( aOut, mScenarioName );
+
+    writeRaw( aOut, static_cast<uint32_t>( mYears.size() ) );
+    for( const int year : mYears ) {
+        writeRaw( aOut, static_cast<int32_t>( year ) );
+    }
+
+    writeRaw( aOut, static_cast<uint32_t>( mDictionary.size() ) );
+    for( const string& entry : mDictionary ) {
+        writeString( aOut, entry );
+    }
+
+    writeRaw( aOut, static_cast<uint32_t>( mTables.size() ) );
+    for( const Table& table : mTables ) {
+        writeString( aOut, table.mName );
+        writeRaw( aOut, static_cast<uint32_t>( table.mKeyNames.size() ) );
+        for( const string& keyName : table.mKeyNames ) {
+            writeString( aOut, keyName );
+        }
+        const uint64_t numRows = table.mKeyColumns.front().size();
+        writeRaw( aOut, numRows );
+        for( const vector<uint32_t>& keyColumn : table.mKeyColumns ) {
+            aOut.write( reinterpret_cast<const char*>( keyColumn.data() ), keyColumn.size() * sizeof( uint32_t ) );
+        }
+        // a table which never got any rows will not have allocated its value columns
+        const vector<double> emptyColumn( numRows, numeric_limits<double>::quiet_NaN() );
+        for( size_t period = 0; period < mYears.size(); ++period ) {
+            const vector<double>& valueColumn = period < table.mValueColumns.size() ?
+                table.mValueColumns[ period ] : emptyColumn;
+            aOut.write( reinterpret_cast<const char*>( valueColumn.data() ), valueColumn.size() * sizeof( double ) );
+        }
+    }
+    aOut.flush();
+    return aOut.good();
+}
+
+/*!
+ * \brief Write a comma separated line for each table giving its name and the
+ *        names of its key columns.
+ * \details Each line starts with "#schema" so that it can be told apart from the
+ *          records written by writeRecords.
+ * \param aOut The stream to write to.
+ */
+void ColumnarOutputter::writeSchema( ostream& aOut ) const {
+    for( const Table& table : mTables ) {
+        aOut << "#schema," << toCSVField( table.mName );
+        for( const string& keyName : table.mKeyNames ) {
+            aOut << ',' << toCSVField( keyName );
+        }
+        aOut << ",value" << '\n';
+    }
+}
+
+/*!
+ * \brief Write the results for a single period as comma separated records.
+ * \details Each record is the table name, the year, the value of each key column
+ *          of the table as given by writeSchema and then the value.  Rows which
+ *          do not have a value for the period are skipped.
+ * \param aOut The stream to write to.
+ * \param aPeriod The model period to write.
+ */
+void ColumnarOutputter::writeRecords( ostream& aOut, const int aPeriod ) const {
+    const int year = mYears[ aPeriod ];
+    for( const Table& table : mTables ) {
+        if( static_cast<int>( table.mValueColumns.size() ) <= aPeriod ) {
+            continue;
+        }
+        const vector<double>& valueColumn = table.mValueColumns[ aPeriod ];
+        for( size_t row = 0; row < valueColumn.size(); ++row ) {
+            if( std::isnan( valueColumn[ row ] ) ) {
+                continue;
+            }
+            aOut << table.mName << ',' << year;
+            for( const vector<uint32_t>& keyColumn : table.mKeyColumns ) {
+                aOut << ',' << toCSVField( mDictionary[ keyColumn[ row ] ] );
+            }
+            aOut << ',' << valueColumn[ row ] << '\n';
+        }
+    }
+}
+
+/*!
+ * \brief Get the dictionary index of a string adding it to the dictionary if needed.
+ * \param aString The string to look up.
+ * \return The index of aString in the dictionary.
+ */
+uint32_t ColumnarOutputter::encode( const string& aString ) {
+    auto iter = mDictionaryIndex.find( aString );
+    if( iter == mDictionaryIndex.end() ) {
+        iter = mDictionaryIndex.insert( make_pair( aString, static_cast<uint32_t>( mDictionary.size() ) ) ).first;
+        mDictionary.push_back( aString );
+    }
+    return (*iter).second;
+}
+
+/*!
+ * \brief Find the row in a table with the given keys adding one if needed.
+ * \details A new row has all of its values set to NaN.
+ * \param aTable The table to find the row in.
+ * \param aKeys The value of each key column of the table.
+ * \return The index of the row.
+ */
+size_t ColumnarOutputter::getRow( const TableType aTable, const vector<string>& aKeys ) {
+    Table& table = mTables[ aTable ];
+    assert( aKeys.size() == table.mKeyNames.size() );
+    vector<uint32_t> encodedKeys( aKeys.size() );
+    for( size_t i = 0; i < aKeys.size(); ++i ) {
+        encodedKeys[ i ] = encode( aKeys[ i ] );
+    }
+
+    auto rowIter = table.mRowIndex.find( encodedKeys );
+    if( rowIter != table.mRowIndex.end() ) {
+        return (*rowIter).second;
+    }
+
+    const size_t row = table.mKeyColumns.front().size();
+    for( size_t i = 0; i < encodedKeys.size(); ++i ) {
+        table.mKeyColumns[ i ].push_back( encodedKeys[ i ] );
+    }
+    table.mValueColumns.resize( mYears.size() );
+    for( vector<double>& valueColumn : table.mValueColumns ) {
+        valueColumn.push_back( numeric_limits<double>::quiet_NaN() );
+    }
+    table.mRowIndex[ encodedKeys ] = row;
+    return row;
+}
+
+/*!
+ * \brief Set a single value in a table.
+ * \param aTable The table to set the value in.
+ * \param aKeys The value of each key column of the row to set.
+ * \param aPeriod The model period of the value.
+ * \param aValue The value to set.
+ */
+void ColumnarOutputter::setValue( const TableType aTable, const vector<string>& aKeys,
+                                  const int aPeriod, const double aValue )
+{
+    const size_t row = getRow( aTable, aKeys );
+    mTables[ aTable ].mValueColumns[ aPeriod ][ row ] = aValue;
+}
+
+/*!
+ * \brief Set the values for all periods of a row in a table unless they are all
+ *        zero.
+ * \param aTable The table to set the values in.
+ * \param aKeys The value of each key column of the row to set.
+ * \param aValues The value for each model period.
+ */
+void ColumnarOutputter::addNonZeroRow( const TableType aTable, const vector<string>& aKeys,
+                                       const vector<double>& aValues )
+{
+    bool hasValue = false;
+    for( const double value : aValues ) {
+        hasValue |= !objects::isEqual<double>( value, 0.0 ) && !std::isnan( value );
+    }
+    if( hasValue ) {
+        const size_t row = getRow( aTable, aKeys );
+        for( int period = mStartPeriod; period < mEndPeriod; ++period ) {
+            mTables[ aTable ].mValueColumns[ period ][ row ] = aValues[ period ];
+        }
+    }
+}
+
+void ColumnarOutputter::startVisitScenario( const Scenario* aScenario, const int aPeriod ) {
+    mScenarioName = aScenario->getName();
+    const Modeltime* modeltime = aScenario->getModeltime();
+    mYears.resize( modeltime->getmaxper() );
+    for( int period = 0; period < modeltime->getmaxper(); ++period ) {
+        mYears[ period ] = modeltime->getper_to_yr( period );
+    }
+    // Only collect results for the visited period unless all periods are visited.
+    mStartPeriod = aPeriod == -1 ? 0 : aPeriod;
+    mEndPeriod = aPeriod == -1 ? modeltime->getmaxper() : aPeriod + 1;
+}
+
+void ColumnarOutputter::startVisitRegion( const Region* aRegion, const int aPeriod ) {
+    mCurrentRegion = aRegion->getName();
+}
+
+void ColumnarOutputter::endVisitRegion( const Region* aRegion, const int aPeriod ) {
+    mCurrentRegion.clear();
+}
+
+void ColumnarOutputter::startVisitResource( const AResource* aResource, const int aPeriod ) {
+    // Resources play the part of the sector for any technologies and emissions
+    // contained within them.
+    mCurrentSector = aResource->getName();
+    mCurrentOutputUnit = aResource->mOutputUnit;
+    mCurrentPriceUnit = aResource->mPriceUnit;
+
+    const vector<string> keys = { mCurrentRegion, mCurrentSector, "output", mCurrentOutputUnit };
+    for( int period = mStartPeriod; period < mEndPeriod; ++period ) {
+        setValue( RESOURCE, keys, period, aResource->getAnnualProd( mCurrentRegion, period ) );
+    }
+}
+
+void ColumnarOutputter::endVisitResource( const AResource* aResource, const int aPeriod ) {
+    mCurrentSector.clear();
+    mCurrentOutputUnit.clear();
+    mCurrentPriceUnit.clear();
+}
+
+void ColumnarOutputter::startVisitSubResource( const SubResource* aSubResource, const int aPeriod ) {
+    mCurrentSubsector = aSubResource->getName();
+}
+
+void ColumnarOutputter::endVisitSubResource( const SubResource* aSubResource, const int aPeriod ) {
+    mCurrentSubsector.clear();
+}
+
+void ColumnarOutputter::startVisitSector( const Sector* aSector, const int aPeriod ) {
+    mCurrentSector = aSector->getName();
+    mCurrentOutputUnit = aSector->mOutputUnit;
+    mCurrentInputUnit = aSector->mInputUnit;
+    mCurrentPriceUnit = aSector->mPriceUnit;
+
+    const vector<string> keys = { mCurrentRegion, mCurrentSector, "cost", mCurrentPriceUnit };
+    for( int period = mStartPeriod; period < mEndPeriod; ++period ) {
+        setValue( SECTOR, keys, period, aSector->getPrice( period ) );
+    }
+}
+
+void ColumnarOutputter::endVisitSector( const Sector* aSector, const int aPeriod ) {
+    mCurrentSector.clear();
+    mCurrentOutputUnit.clear();
+    mCurrentInputUnit.clear();
+    mCurrentPriceUnit.clear();
+}
+
+void ColumnarOutputter::startVisitSubsector( const Subsector* aSubsector, const int aPeriod ) {
+    // Technologies are only contained in the innermost of any nested subsectors.
+    mCurrentSubsector = aSubsector->getName();
+}
+
+void ColumnarOutputter::endVisitSubsector( const Subsector* aSubsector, const int aPeriod ) {
+    mCurrentSubsector.clear();
+}
+
+void ColumnarOutputter::startVisitTechnology( const Technology* aTechnology, const int aPeriod ) {
+    mCurrentTechnology = aTechnology->getName();
+    mCurrentVintage = util::toString( aTechnology->getYear() );
+}
+
+void ColumnarOutputter::endVisitTechnology( const Technology* aTechnology, const int aPeriod ) {
+    mCurrentTechnology.clear();
+    mCurrentVintage.clear();
+}
+
+void ColumnarOutputter::startVisitMiniCAMInput( const MiniCAMInput* aInput, const int aPeriod ) {
+    vector<double> demands( mYears.size() );
+    for( int period = mStartPeriod; period < mEndPeriod; ++period ) {
+        demands[ period ] = aInput->getPhysicalDemand( period );
+    }
+
+    // Energy inputs are in the units of the market for that good.
+    string unit;
+    if( aInput->hasTypeFlag( IInput::ENERGY ) ) {
+        const IInfo* marketInfo = scenario->getMarketplace()->getMarketInfo( aInput->getName(), mCurrentRegion, 0, false );
+        if( marketInfo ) {
+            unit = marketInfo->getString( "output-unit", false );
+        }
+    }
+    if( unit.empty() ) {
+        unit = mCurrentInputUnit;
+    }
+    addNonZeroRow( TECHNOLOGY_INPUT, { mCurrentRegion, mCurrentSector, mCurrentSubsector, mCurrentTechnology,
+                                       mCurrentVintage, aInput->getName(), unit }, demands );
+}
+
+void ColumnarOutputter::startVisitOutput( const IOutput* aOutput, const int aPeriod ) {
+    vector<double> outputs( mYears.size() );
+    for( int period = mStartPeriod; period < mEndPeriod; ++period ) {
+        outputs[ period ] = aOutput->getPhysicalOutput( period );
+    }
+
+    // Avoid the units lookup when the output is the good of the current sector.
+    const string unit = aOutput->getName() == mCurrentSector ? mCurrentOutputUnit : aOutput->getOutputUnits( mCurrentRegion );
+    addNonZeroRow( TECHNOLOGY_OUTPUT, { mCurrentRegion, mCurrentSector, mCurrentSubsector, mCurrentTechnology,
+                                        mCurrentVintage, aOutput->getName(), unit }, outputs );
+}
+
+void ColumnarOutputter::startVisitGHG( const AGHG* aGHG, const int aPeriod ) {
+    vector<double> emissions( mYears.size() );
+    for( int period = mStartPeriod; period < mEndPeriod; ++period ) {
+        emissions[ period ] = aGHG->getEmission( period );
+    }
+    addNonZeroRow( EMISSIONS, { mCurrentRegion, mCurrentSector, mCurrentSubsector, mCurrentTechnology,
+                                mCurrentVintage, aGHG->getName(), aGHG->mEmissionsUnit }, emissions );
+}
+
+void ColumnarOutputter::startVisitMarket( const Market* aMarket, const int aPeriod ) {
+    // Each Market is for a single period.  Units are only reliably set in the
+    // market info of the base period which is visited first.
+    const int period = scenario->getModeltime()->getyr_to_per( aMarket->getYear() );
+    if( period < mStartPeriod || period >= mEndPeriod ) {
+        return;
+    }
+    if( period == 0 ) {
+        mCurrentPriceUnit = aMarket->getMarketInfo()->getString( "price-unit", false );
+        mCurrentOutputUnit = aMarket->getMarketInfo()->getString( "output-unit", false );
+    }
+    else if( mStartPeriod != 0 ) {
+        // The base period market was not visited so look up its info directly.
+        const IInfo* baseInfo = scenario->getMarketplace()->getMarketInfo( aMarket->getGoodName(),
+                                                                          aMarket->getRegionName(), 0, false );
+        mCurrentPriceUnit = baseInfo ? baseInfo->getString( "price-unit", false ) : "";
+        mCurrentOutputUnit = baseInfo ? baseInfo->getString( "output-unit", false ) : "";
+    }
+
+    const string& name = aMarket->getName();
+    const string& region = aMarket->getRegionName();
+    const string& good = aMarket->getGoodName();
+    setValue( MARKET, { name, region, good, "price", mCurrentPriceUnit }, period, aMarket->getPrice() );
+    setValue( MARKET, { name, region, good, "demand", mCurrentOutputUnit }, period, aMarket->getRawDemand() );
+    setValue( MARKET, { name, region, good, "supply", mCurrentOutputUnit }, period, aMarket->getRawSupply() );
+}
+
+void ColumnarOutputter::startVisitLandLeaf( const LandLeaf* aLandLeaf, const int aPeriod ) {
+    const vector<string> keys = { mCurrentRegion, aLandLeaf->getName(), "thous km2" };
+    for( int period = mStartPeriod; period < mEndPeriod; ++period ) {
+        setValue( LAND_ALLOCATION, keys, period, aLandLeaf->getLandAllocation( aLandLeaf->getName(), period ) );
+    }
+}
+
+void ColumnarOutputter::startVisitPopulation( const Population* aPopulation, const int aPeriod ) {
+    // Each Population is for a single period.
+    const int period = scenario->getModeltime()->getyr_to_per( aPopulation->getYear() );
+    if( period < mStartPeriod || period >= mEndPeriod ) {
+        return;
+    }
+    setValue( POPULATION, { mCurrentRegion, aPopulation->mPopulationUnit }, period, aPopulation->getTotal() );
+}
+
+void ColumnarOutputter::startVisitClimateModel( const IClimateModel* aClimateModel, const int aPeriod ) {
+    for( int period = mStartPeriod; period < mEndPeriod; ++period ) {
+        const int year = mYears[ period ];
+        setValue( CLIMATE, { "CO2-concentration", "PPM" }, period, aClimateModel->getConcentration( "CO2", year ) );
+        setValue( CLIMATE, { "forcing-total", "W/m^2" }, period, aClimateModel->getTotalForcing( year ) );
+        setValue( CLIMATE, { "global-mean-temperature", "degC" }, period, aClimateModel->getTemperature( year ) );
+    }
+}
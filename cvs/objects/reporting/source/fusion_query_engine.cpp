@@ -0,0 +1,380 @@
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*!
+* \file fusion_query_engine.cpp
+* \ingroup Objects
+* \brief The FusionQueryEngine class source file for running queries on the
+*        model results without a database.
+*/
+
+#include "util/base/include/definitions.h"
+#include <limits>
+#include <boost/algorithm/string.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/type_traits/is_base_of.hpp>
+#include <boost/utility/enable_if.hpp>
+
+#include "reporting/include/fusion_query_engine.h"
+#include "util/base/include/gcam_fusion.hpp"
+#include "util/base/include/gcam_data_containers.h"
+#include "util/base/include/xml_parse_helper.h"
+#include "util/base/include/iyeared.h"
+#include "util/base/include/util.h"
+#include "containers/include/scenario.h"
+#include "util/base/include/model_time.h"
+#include "util/logger/include/ilogger.h"
+
+using namespace std;
+
+namespace {
+    //! Quote a string for a CSV file if it contains any special characters.
+    string toCSVField( const string& aValue ) {
+        if( aValue.find_first_of( ",\"\n" ) == string::npos ) {
+            return aValue;
+        }
+        string quoted = "\"";
+        for( const char c : aValue ) {
+            quoted += c;
+            if( c == '"' ) {
+                quoted += c;
+            }
+        }
+        return quoted + "\"";
+    }
+
+    /*!
+     * \brief Detect if a container has a getName method.
+     */
+    template<typename T, typename Enable = void>
+    struct HasGetName : public std::false_type {};
+
+    template<typename T>
+    struct HasGetName<T, decltype( static_cast<void>( std::declval<const T&>().getName() ) )> : public std::true_type {};
+
+    //! IYeared containers such as technology vintages or markets are labeled by year.
+    template<typename T>
+    typename boost::enable_if<boost::is_base_of<IYeared, T>, string>::type getLabel( const T* aContainer, int& aYear ) {
+        aYear = aContainer->getYear();
+        return util::toString( aYear );
+    }
+
+    //! Otherwise containers are labeled by name if they have one.
+    template<typename T>
+    typename boost::enable_if_c<!boost::is_base_of<IYeared, T>::value && HasGetName<T>::value, string>::type
+    getLabel( const T* aContainer, int& aYear ) {
+        aYear = -1;
+        return aContainer->getName();
+    }
+
+    template<typename T>
+    typename boost::enable_if_c<!boost::is_base_of<IYeared, T>::value && !HasGetName<T>::value, string>::type
+    getLabel( const T* aContainer, int& aYear ) {
+        aYear = -1;
+        return string();
+    }
+}
+
+//! Constructor
+FusionQueryEngine::FusionQueryEngine()
+{
+}
+
+//! Destructor
+FusionQueryEngine::~FusionQueryEngine() {
+}
+
+/*!
+ * \brief Read the queries to run from the given XML file.
+ * \param aFileName The queries file as described in the class documentation.
+ * \return Whether the file could be read.
+ */
+bool FusionQueryEngine::parseQueries( const string& aFileName ) {
+    try {
+        boost::iostreams::mapped_file_source xmlFile( aFileName.c_str() );
+        rapidxml::xml_document<> doc;
+        doc.parse<rapidxml::parse_non_destructive>( const_cast<char*>( xmlFile.data() ) );
+
+        const rapidxml::xml_node<char>* root = doc.first_node();
+        for( rapidxml::xml_node<char>* node = root ? root->first_node() : 0; node; node = node->next_sibling() ) {
+            if( node->type() != rapidxml::node_element || XMLParseHelper::getNodeName( node ) != "query" ) {
+                continue;
+            }
+            map<string, string> attrs = XMLParseHelper::getAllAttrs( node );
+            Query query;
+            query.mTitle = attrs[ "title" ];
+            query.mUnit = attrs[ "unit" ];
+            query.mPath = XMLParseHelper::getValue<string>( node );
+            boost::trim( query.mPath );
+            if( !attrs[ "group-by" ].empty() ) {
+                boost::split( query.mGroupBy, attrs[ "group-by" ], boost::is_any_of( "," ) );
+                for( string& column : query.mGroupBy ) {
+                    boost::trim( column );
+                }
+            }
+            mQueries.push_back( query );
+        }
+    }
+    catch( std::ios_base::failure ioException ) {
+        ILogger& mainLog = ILogger::getLogger( "main_log" );
+        mainLog.setLevel( ILogger::ERROR );
+        mainLog << "Could not open: " << aFileName << " failed with: " << ioException.what() << endl;
+        return false;
+    }
+    catch( rapidxml::parse_error parseException ) {
+        ILogger& mainLog = ILogger::getLogger( "main_log" );
+        mainLog.setLevel( ILogger::ERROR );
+        mainLog << "Failed to parse: " << aFileName << " with error: " << parseException.what() << endl;
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief Find which container stepped into gives the value of each group-by column.
+ * \details Steps before any descendant step correspond directly to the containers
+ *          stepped into.  Steps after the last descendant step are counted back
+ *          from the data that was found.
+ * \param aQuery The query to set up.
+ * \return False if any group-by column is not a step of the query which can be
+ *         used for grouping.
+ */
+bool FusionQueryEngine::setGroupByIndices( const Query& aQuery ) {
+    vector<string> stepNames;
+    boost::split( stepNames, aQuery.mPath, boost::is_any_of( "/" ) );
+    for( string& stepName : stepNames ) {
+        stepName = stepName.substr( 0, stepName.find( '[' ) );
+    }
+    int firstDescendant = stepNames.size();
+    int lastDescendant = -1;
+    for( int i = 0; i < static_cast<int>( stepNames.size() ); ++i ) {
+        if( stepNames[ i ].empty() ) {
+            firstDescendant = min( firstDescendant, i );
+            lastDescendant = i;
+        }
+    }
+
+    mGroupByIndices.clear();
+    for( const string& column : aQuery.mGroupBy ) {
+        // The last step is the data itself and so can not be grouped by.
+        const int lastStep = static_cast<int>( stepNames.size() ) - 1;
+        auto stepIter = find( stepNames.begin(), stepNames.end(), column );
+        const int step = stepIter - stepNames.begin();
+        if( stepIter == stepNames.end() || step >= lastStep || ( step > firstDescendant && step < lastDescendant ) ) {
+            ILogger& mainLog = ILogger::getLogger( "main_log" );
+            mainLog.setLevel( ILogger::WARNING );
+            mainLog << "Can not group by " << column << " in query " << aQuery.mTitle << endl;
+            return false;
+        }
+        mGroupByIndices.push_back( step < firstDescendant ? step : step - lastStep );
+    }
+    return true;
+}
+
+/*!
+ * \brief Get the year of the innermost container with a year.
+ * \return The year or -1 if no container with a year has been stepped into.
+ */
+int FusionQueryEngine::getCurrentYear() const {
+    for( auto yearIter = mStepYears.rbegin(); yearIter != mStepYears.rend(); ++yearIter ) {
+        if( *yearIter != -1 ) {
+            return *yearIter;
+        }
+    }
+    return -1;
+}
+
+/*!
+ * \brief Add a value found by the current query to the row given by the
+ *        containers currently stepped into.
+ * \param aYear The year of the value.
+ * \param aValue The value to add.
+ */
+void FusionQueryEngine::addValue( const int aYear, const double aValue ) {
+    if( aYear == -1 ) {
+        return;
+    }
+    vector<string> key( mGroupByIndices.size() );
+    const int numSteps = mStepLabels.size();
+    for( size_t i = 0; i < mGroupByIndices.size(); ++i ) {
+        const int index = mGroupByIndices[ i ] < 0 ? numSteps + mGroupByIndices[ i ] : mGroupByIndices[ i ];
+        if( index >= 0 && index < numSteps ) {
+            key[ i ] = mStepLabels[ index ];
+        }
+    }
+    mResults[ key ][ aYear ] += aValue;
+    mYears.insert( aYear );
+}
+
+/*!
+ * \brief Add all of the values of an array with the year given by the position
+ *        in the array.
+ * \param aArray The array of values found.
+ */
+template<typename ArrayType>
+void FusionQueryEngine::processArray( const ArrayType& aArray ) {
+    for( auto iter = aArray.begin(); iter != aArray.end(); ++iter ) {
+        addValue( GetIndexAsYear::convertIterToYear( aArray, iter ), *iter );
+    }
+}
+
+template<typename ContainerType>
+void FusionQueryEngine::pushFilterStep( const ContainerType& aData ) {
+    int year = -1;
+    mStepLabels.push_back( getLabel( aData, year ) );
+    mStepYears.push_back( year );
+}
+
+template<typename ContainerType>
+void FusionQueryEngine::popFilterStep( const ContainerType& aData ) {
+    mStepLabels.pop_back();
+    mStepYears.pop_back();
+}
+
+template<typename DataType>
+void FusionQueryEngine::processData( DataType& aData ) {
+    // ignore data that is not a number
+}
+
+template<>
+void FusionQueryEngine::processData<double>( double& aData ) {
+    addValue( getCurrentYear(), aData );
+}
+
+template<>
+void FusionQueryEngine::processData<Value>( Value& aData ) {
+    addValue( getCurrentYear(), aData );
+}
+
+template<>
+void FusionQueryEngine::processData<objects::PeriodVector<double> >( objects::PeriodVector<double>& aData ) {
+    processArray( aData );
+}
+
+template<>
+void FusionQueryEngine::processData<objects::PeriodVector<Value> >( objects::PeriodVector<Value>& aData ) {
+    processArray( aData );
+}
+
+template<>
+void FusionQueryEngine::processData<objects::TechVintageVector<double> >( objects::TechVintageVector<double>& aData ) {
+    processArray( aData );
+}
+
+template<>
+void FusionQueryEngine::processData<objects::TechVintageVector<Value> >( objects::TechVintageVector<Value>& aData ) {
+    processArray( aData );
+}
+
+template<>
+void FusionQueryEngine::processData<objects::YearVector<double> >( objects::YearVector<double>& aData ) {
+    processArray( aData );
+}
+
+template<>
+void FusionQueryEngine::processData<objects::YearVector<Value> >( objects::YearVector<Value>& aData ) {
+    processArray( aData );
+}
+
+/*!
+ * \brief Write the results of the current query.
+ * \param aQuery The query which was run.
+ * \param aScenarioName The name of the scenario which was queried.
+ * \param aOut The stream to write to.
+ */
+void FusionQueryEngine::writeResults( const Query& aQuery, const string& aScenarioName, ostream& aOut ) const {
+    aOut << toCSVField( aQuery.mTitle ) << '\n';
+    aOut << "scenario";
+    for( const string& column : aQuery.mGroupBy ) {
+        aOut << ',' << toCSVField( column );
+    }
+    for( const int year : mYears ) {
+        aOut << ',' << year;
+    }
+    aOut << ",Units" << '\n';
+
+    for( auto rowIter = mResults.begin(); rowIter != mResults.end(); ++rowIter ) {
+        bool hasValue = false;
+        for( auto valueIter = (*rowIter).second.begin(); valueIter != (*rowIter).second.end(); ++valueIter ) {
+            hasValue |= !objects::isEqual<double>( (*valueIter).second, 0.0 );
+        }
+        if( !hasValue ) {
+            continue;
+        }
+
+        aOut << toCSVField( aScenarioName );
+        for( const string& label : (*rowIter).first ) {
+            aOut << ',' << toCSVField( label );
+        }
+        for( const int year : mYears ) {
+            auto valueIter = (*rowIter).second.find( year );
+            aOut << ',';
+            if( valueIter != (*rowIter).second.end() ) {
+                aOut << (*valueIter).second;
+            }
+        }
+        aOut << ',' << toCSVField( aQuery.mUnit ) << '\n';
+    }
+    aOut << '\n';
+}
+
+/*!
+ * \brief Run all of the queries on the given scenario and write the results.
+ * \param aScenario The scenario to query.
+ * \param aOut The stream to write the CSV results to.
+ */
+void FusionQueryEngine::runQueries( Scenario* aScenario, ostream& aOut ) {
+    aOut.precision( numeric_limits<double>::max_digits10 );
+    for( const Query& query : mQueries ) {
+        vector<FilterStep*> filterSteps = parseFilterString( query.mPath );
+        const bool isValid = find( filterSteps.begin(), filterSteps.end(), static_cast<FilterStep*>( 0 ) ) == filterSteps.end();
+        if( isValid && setGroupByIndices( query ) ) {
+            GCAMFusion<FusionQueryEngine, true, true, true> fusion( *this, filterSteps );
+            fusion.startFilter( aScenario );
+            writeResults( query, aScenario->getName(), aOut );
+        }
+        else {
+            ILogger& mainLog = ILogger::getLogger( "main_log" );
+            mainLog.setLevel( ILogger::WARNING );
+            mainLog << "Skipping invalid query: " << query.mTitle << endl;
+        }
+
+        for( FilterStep* step : filterSteps ) {
+            delete step;
+        }
+        mStepLabels.clear();
+        mStepYears.clear();
+        mResults.clear();
+        mYears.clear();
+    }
+}
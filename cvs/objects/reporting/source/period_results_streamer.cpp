@@ -0,0 +1,100 @@
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*!
+* \file period_results_streamer.cpp
+* \ingroup Objects
+* \brief The PeriodResultsStreamer class source file for appending the results
+*        of each model period to a file.
+*/
+
+#include "util/base/include/definitions.h"
+#include <limits>
+
+#include "reporting/include/period_results_streamer.h"
+#include "reporting/include/columnar_outputter.h"
+#include "containers/include/scenario.h"
+#include "util/base/include/model_time.h"
+#include "util/base/include/util.h"
+#include "util/base/include/timer.h"
+#include "util/logger/include/ilogger.h"
+
+using namespace std;
+
+/*!
+ * \brief Constructor which opens the file to append to.
+ * \param aFileName The name of the file to write.
+ */
+PeriodResultsStreamer::PeriodResultsStreamer( const string& aFileName ):
+mFileName( aFileName ),
+mNeedsSchema( false )
+{
+    mFile.open( mFileName.c_str(), ios_base::out | ios_base::app );
+    util::checkIsOpen( mFile, mFileName );
+    // Only a new file needs the schema.
+    mNeedsSchema = mFile.tellp() == streampos( 0 );
+    mFile.precision( numeric_limits<double>::max_digits10 );
+}
+
+//! Destructor
+PeriodResultsStreamer::~PeriodResultsStreamer() {
+}
+
+/*!
+ * \brief Append the results of the given period.
+ * \param aScenario The scenario which has just calculated aPeriod.
+ * \param aPeriod The model period to write.
+ */
+void PeriodResultsStreamer::writePeriod( const Scenario* aScenario, const int aPeriod ) {
+    Timer& streamTimer = TimerRegistry::getInstance().getTimer( "StreamPeriodResults" );
+    streamTimer.start();
+
+    ColumnarOutputter columnarOutputter;
+    aScenario->accept( &columnarOutputter, aPeriod );
+
+    if( mNeedsSchema ) {
+        columnarOutputter.writeSchema( mFile );
+        mNeedsSchema = false;
+    }
+    const int year = aScenario->getModeltime()->getper_to_yr( aPeriod );
+    mFile << "#period," << aScenario->getName() << ',' << year << '\n';
+    columnarOutputter.writeRecords( mFile, aPeriod );
+    mFile << "#end-period," << aScenario->getName() << ',' << year << endl;
+
+    if( !mFile.good() ) {
+        ILogger& mainLog = ILogger::getLogger( "main_log" );
+        mainLog.setLevel( ILogger::ERROR );
+        mainLog << "Failed to write results for " << year << " to " << mFileName << endl;
+    }
+    streamTimer.stop();
+}
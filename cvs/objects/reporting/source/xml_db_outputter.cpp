@@ -121,6 +121,10 @@
 #endif
 
 #include <ctime>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #include <string>
 #include <sstream>
@@ -171,13 +175,176 @@ XMLDBOutputter::JNIContainer::~JNIContainer() {
 }
 #endif
 
+#if( __HAVE_JAVA__ )
+namespace {
+    //! The size of the chunks of XML handed to the background writer.
+    const streamsize ASYNC_CHUNK_SIZE = 1024 * 1024;
+
+    //! Where the background writer thread collects its error messages, null on
+    //! every other thread.
+    thread_local ostream* gWriterErrors = 0;
+
+    /*!
+     * \brief Get the stream to report an error writing to the database to.
+     * \details The loggers are not safe to use from more than one thread at a time
+     *          so errors on the background writer are collected to be logged once
+     *          it has been joined, otherwise they go straight to the main log.
+     * \return The stream to write the error message to.
+     */
+    ostream& getErrorLog() {
+        if( gWriterErrors ) {
+            return *gWriterErrors;
+        }
+        ILogger& mainLog = ILogger::getLogger( "main_log" );
+        mainLog.setLevel( ILogger::SEVERE );
+        return mainLog;
+    }
+
+    /*!
+     * \brief Owns the thread writing the results of the most recent scenario to
+     *        the database when writing asynchronously.
+     * \details The thread is joined when this is destroyed so that exiting while a
+     *          write is still in progress waits for it rather than terminating.
+     */
+    class AsyncWriterThread {
+    public:
+        ~AsyncWriterThread() {
+            if( mThread.joinable() ) {
+                mThread.join();
+                // The loggers may already be gone at exit.
+                cerr << mErrors.str();
+            }
+        }
+
+        /*!
+         * \brief Start a new writer thread after waiting for any previous one.
+         * \param aWriter The function to run on the writer thread.
+         */
+        template<typename WriterFunction>
+        void start( WriterFunction aWriter ) {
+            join();
+            mThread = thread( [this, aWriter] () {
+                gWriterErrors = &mErrors;
+                aWriter();
+            } );
+        }
+
+        /*!
+         * \brief Wait for the writer thread to finish if one is running then log
+         *        any errors it reported.
+         */
+        void join() {
+            if( mThread.joinable() ) {
+                mThread.join();
+                const string errors = mErrors.str();
+                if( !errors.empty() ) {
+                    ILogger& mainLog = ILogger::getLogger( "main_log" );
+                    mainLog.setLevel( ILogger::SEVERE );
+                    mainLog << errors;
+                    mErrors.str( string() );
+                }
+            }
+        }
+
+    private:
+        //! The writer thread.
+        thread mThread;
+
+        //! The errors reported by the writer thread.
+        ostringstream mErrors;
+    };
+
+    //! The background writer for the most recent scenario.
+    AsyncWriterThread gAsyncWriter;
+}
+
+/*!
+ * \brief The data and database operations waiting to be processed by the background
+ *        writer thread.
+ * \details Operations are processed strictly in the order they were queued so that
+ *          calls to appendData and finalizeAndClose happen after all of the XML has
+ *          been sent just as they would when writing synchronously.
+ */
+struct XMLDBOutputter::AsyncWriteQueue {
+    //! The kinds of operations which may be queued.
+    enum OperationType {
+        //! A chunk of the XML document.
+        DATA,
+        //! No more XML will be written, call finish.
+        FINISH,
+        //! Call appendData with the given data and location.
+        APPEND,
+        //! Call finalizeAndClose and stop writing.
+        FINALIZE,
+        //! Stop writing without finalizing the database.
+        STOP
+    };
+
+    struct Operation {
+        OperationType mType;
+        string mData;
+        string mLocation;
+    };
+
+    //! The maximum number of bytes of XML allowed to wait in the queue.
+    size_t mMaxQueuedBytes;
+
+    //! The number of bytes of XML currently in the queue.
+    size_t mQueuedBytes;
+
+    //! The operations waiting to be processed.
+    deque<Operation> mOperations;
+
+    mutex mMutex;
+
+    //! Signaled when an operation has been queued.
+    condition_variable mHasOperation;
+
+    //! Signaled when queued XML has been written.
+    condition_variable mHasSpace;
+
+    /*!
+     * \brief Queue an operation, waiting first if too much data is already queued.
+     * \param aType The type of the operation.
+     * \param aData The XML or data to append if any.
+     * \param aLocation The location to append data to if any.
+     */
+    void push( const OperationType aType, string aData = string(), string aLocation = string() ) {
+        unique_lock<mutex> lock( mMutex );
+        // Always let at least one chunk through so that we can not dead lock.
+        mHasSpace.wait( lock, [this, &aData] () {
+            return mQueuedBytes == 0 || mQueuedBytes + aData.size() <= mMaxQueuedBytes;
+        } );
+        mQueuedBytes += aData.size();
+        mOperations.push_back( Operation{ aType, std::move( aData ), std::move( aLocation ) } );
+        mHasOperation.notify_one();
+    }
+
+    /*!
+     * \brief Remove the next operation, waiting until one is available.
+     * \return The next operation to process.
+     */
+    Operation pop() {
+        unique_lock<mutex> lock( mMutex );
+        mHasOperation.wait( lock, [this] () { return !mOperations.empty(); } );
+        Operation op = std::move( mOperations.front() );
+        mOperations.pop_front();
+        mQueuedBytes -= op.mData.size();
+        mHasSpace.notify_one();
+        return op;
+    }
+};
+#endif
+
 /*! \brief Constructor
 */
 XMLDBOutputter::XMLDBOutputter():
 mTabs( new Tabs ),
 mSubsectorDepth( 0 )
 #if( __HAVE_JAVA__ )
-,mJNIContainer( createContainer( false ) )
+,mJNIContainer( Configuration::getInstance()->getBool( "async-xmldb-output", false, false ) ?
+                unique_ptr<JNIContainer>() : createContainer( false, scenario->getName() ) )
+,mAsyncQueue( createAsyncQueue() )
 #endif
 {
 #if( DEBUG_XML_DB )
@@ -189,9 +356,19 @@ mSubsectorDepth( 0 )
 #endif
 
 #if( __HAVE_JAVA__ )
-    // Set Java as the sink of data for mBuffer.
-    SendToJavaIOSink sendToJavaSink( mJNIContainer.get() );
-    mBuffer.push( sendToJavaSink );
+    if( mAsyncQueue ) {
+        // Hand the data to the background writer which will send it to Java.
+        // Note the chunk size is also the buffer size of mBuffer.
+        mBuffer.push( AsyncQueueIOSink( mAsyncQueue ), ASYNC_CHUNK_SIZE );
+        const shared_ptr<AsyncWriteQueue> queue = mAsyncQueue;
+        const string scenarioName = scenario->getName();
+        gAsyncWriter.start( [queue, scenarioName] () { runAsyncWriter( queue, scenarioName ); } );
+    }
+    else {
+        // Set Java as the sink of data for mBuffer.
+        SendToJavaIOSink sendToJavaSink( mJNIContainer.get() );
+        mBuffer.push( sendToJavaSink );
+    }
 #else
     mBuffer.push( null_sink() );
 #endif
@@ -203,6 +380,15 @@ mSubsectorDepth( 0 )
  *       to be deleted correctly.
  */
 XMLDBOutputter::~XMLDBOutputter(){
+#if( __HAVE_JAVA__ )
+    // Make sure the background writer stops if finalizeAndClose was never called,
+    // otherwise this is simply ignored.  Any data still in mBuffer must be queued
+    // first.
+    if( mAsyncQueue ) {
+        mBuffer.reset();
+        mAsyncQueue->push( AsyncWriteQueue::STOP );
+    }
+#endif
 }
 
 /*!
@@ -218,7 +404,7 @@ XMLDBOutputter::~XMLDBOutputter(){
  */
 bool XMLDBOutputter::checkJavaWorking() {
 #if( __HAVE_JAVA__ )
-    unique_ptr<JNIContainer> testContainer = createContainer( true );
+    unique_ptr<JNIContainer> testContainer = createContainer( true, string() );
     // if we get back a null container then some error occured
     // createContainer would have already print any error messages.
     return testContainer.get();
@@ -239,66 +425,181 @@ void XMLDBOutputter::finish() const {
     close( mBuffer, ios_base::out );
 
 #if( __HAVE_JAVA__ )
-    if( !mJNIContainer.get() ) {
+    if( mAsyncQueue ) {
+        // The background writer will call finish once it has sent all of the data.
+        mAsyncQueue->push( AsyncWriteQueue::FINISH );
+    }
+    else {
+        callFinish( mJNIContainer.get() );
+    }
+#endif
+}
+
+/*!
+ * \brief A method to inform us that no more data will be appended to the open database so we can
+ *        now run any addtional processing necessary and close the database.
+ * \details We will simply call the finalizeAndClose method on the XMLDBDriver to do the work.
+ *          It may potentially run queries if configured then close the database.  When writing
+ *          asynchronously this will be done by the background writer and this method returns
+ *          immediately.
+ * \see waitForPendingWrites
+ */
+void XMLDBOutputter::finalizeAndClose() {
+#if( __HAVE_JAVA__ )
+    if( mAsyncQueue ) {
+        mAsyncQueue->push( AsyncWriteQueue::FINALIZE );
+    }
+    else {
+        callFinalizeAndClose( mJNIContainer.get() );
+    }
+#endif
+}
+
+/*!
+ * \brief Wait for the background writer to finish writing to the database.
+ * \details When "async-xmldb-output" is set the XML generated by the visit is sent to
+ *          the database by a background thread so that the model may continue on to
+ *          the next scenario.  Only the database writes are done in the background,
+ *          the visit which generates the XML still runs synchronously on the calling
+ *          thread since the scenario may be changed or deleted as soon as it returns.
+ *          This must be called before the process exits, or before anything else
+ *          may use the database, to ensure the results are actually written.  Any
+ *          errors reported by the writer are logged here.  It is safe to call at any
+ *          time and will return immediately if there is nothing to wait for.
+ */
+void XMLDBOutputter::waitForPendingWrites() {
+#if( __HAVE_JAVA__ )
+    gAsyncWriter.join();
+#endif
+}
+
+#if( __HAVE_JAVA__ )
+/*!
+ * \brief Call the Java finish method which waits for all data to be written.
+ * \param aJNIContainer The Java environment to use which may be null if it failed
+ *                      to initialize.
+ */
+void XMLDBOutputter::callFinish( const JNIContainer* aJNIContainer ) {
+    if( !aJNIContainer ) {
         // Failed to start Java, just return as an appropriate error message would
         // have already been given.
         return;
     }
     // First we need to look up the appropriate "finish" Java method with no
     // arguments and void return: "()V" then call it.
-    jmethodID finishMID = mJNIContainer->mJavaEnv->GetMethodID( mJNIContainer->mWriteDBClass, "finish", "()V" );
+    jmethodID finishMID = aJNIContainer->mJavaEnv->GetMethodID( aJNIContainer->mWriteDBClass, "finish", "()V" );
     if( !finishMID ) {
-        ILogger& mainLog = ILogger::getLogger( "main_log" );
-        mainLog.setLevel( ILogger::SEVERE );
-        mainLog << "Failed to find JNI method: finish" << endl;
+        getErrorLog() << "Failed to find JNI method: finish" << endl;
         return;
     }
 
     // The java method will wait until the database is done processing all data
     // before returning.
-    mJNIContainer->mJavaEnv->CallVoidMethod( mJNIContainer->mWriteDBInstance, finishMID );
-#endif
+    aJNIContainer->mJavaEnv->CallVoidMethod( aJNIContainer->mWriteDBInstance, finishMID );
 }
 
 /*!
- * \brief A method to inform us that no more data will be appended to the open database so we can
- *        now run any addtional processing necessary and close the database.
- * \details We will simply call the finalizeAndClose method on the XMLDBDriver to do the work.
- *          It may potentially run queries if configured then close the database.
+ * \brief Call the Java finalizeAndClose method which may run queries then closes
+ *        the database.
+ * \param aJNIContainer The Java environment to use which may be null if it failed
+ *                      to initialize.
  */
-void XMLDBOutputter::finalizeAndClose() {
-#if( __HAVE_JAVA__ )
+void XMLDBOutputter::callFinalizeAndClose( const JNIContainer* aJNIContainer ) {
     // Call finalizeAndClose on the XMLDBDriver if it was successfully opened in the first place.
-    if( mJNIContainer.get() ) {
+    if( aJNIContainer ) {
         // First we need to look up the appropriate "finalizeAndClose" Java method with no
         // arguments and void return: "()V" then call it.
-        jmethodID finalizeMID = mJNIContainer->mJavaEnv->GetMethodID( mJNIContainer->mWriteDBClass,
+        jmethodID finalizeMID = aJNIContainer->mJavaEnv->GetMethodID( aJNIContainer->mWriteDBClass,
                 "finalizeAndClose", "()V" );
         if( !finalizeMID ) {
-            ILogger& mainLog = ILogger::getLogger( "main_log" );
-            mainLog.setLevel( ILogger::SEVERE );
-            mainLog << "Failed to find JNI method: finalizeAndClose" << endl;
+            getErrorLog() << "Failed to find JNI method: finalizeAndClose" << endl;
             return;
         }
 
         // The java method will (potentially) run queries then close the database
         // before returning.
-        mJNIContainer->mJavaEnv->CallVoidMethod( mJNIContainer->mWriteDBInstance, finalizeMID );
+        aJNIContainer->mJavaEnv->CallVoidMethod( aJNIContainer->mWriteDBInstance, finalizeMID );
+    }
+}
+
+/*!
+ * \brief Create the queue for the background writer if asynchronous writing
+ *        was requested.
+ * \details Any previous background writer is waited on first as it may still be
+ *          writing to the same database.
+ * \return The new queue or null if writing synchronously.
+ */
+shared_ptr<XMLDBOutputter::AsyncWriteQueue> XMLDBOutputter::createAsyncQueue() {
+    const Configuration* conf = Configuration::getInstance();
+    if( !conf->getBool( "async-xmldb-output", false, false ) ) {
+        return shared_ptr<AsyncWriteQueue>();
+    }
+
+    waitForPendingWrites();
+    shared_ptr<AsyncWriteQueue> queue( new AsyncWriteQueue );
+    queue->mMaxQueuedBytes = static_cast<size_t>( max( conf->getInt( "async-xmldb-output-max-mb", 256, false ), 1 ) )
+        * ASYNC_CHUNK_SIZE;
+    queue->mQueuedBytes = 0;
+    return queue;
+}
+
+/*!
+ * \brief The body of the background writer thread.
+ * \details The JNI environment is only valid on the thread which created it so the
+ *          Java container is created, used, and destroyed all on this thread.  The
+ *          queued operations are then processed in order until the database is
+ *          finalized or the outputter is deleted.
+ * \param aQueue The queue of operations to process.
+ * \param aScenarioName The name of the scenario being written.  This is passed in
+ *                      as the scenario may be deleted while we are still writing.
+ */
+void XMLDBOutputter::runAsyncWriter( shared_ptr<AsyncWriteQueue> aQueue, const string aScenarioName ) {
+    unique_ptr<JNIContainer> jniContainer = createContainer( false, aScenarioName );
+    SendToJavaIOSink sendToJavaSink( jniContainer.get() );
+    bool done = false;
+    while( !done ) {
+        AsyncWriteQueue::Operation op = aQueue->pop();
+        switch( op.mType ) {
+            case AsyncWriteQueue::DATA:
+                sendToJavaSink.write( op.mData.data(), op.mData.size() );
+                break;
+            case AsyncWriteQueue::FINISH:
+                callFinish( jniContainer.get() );
+                break;
+            case AsyncWriteQueue::APPEND:
+                callAppendData( jniContainer.get(), op.mData, op.mLocation );
+                break;
+            case AsyncWriteQueue::FINALIZE:
+                callFinalizeAndClose( jniContainer.get() );
+                done = true;
+                break;
+            case AsyncWriteQueue::STOP:
+                done = true;
+                break;
+        }
+    }
+
+    // Release the Java references while this thread is still attached.
+    const bool attached = jniContainer.get() != 0;
+    jniContainer.reset();
+    if( attached ) {
+        JNIContainer::mJavaVM->DetachCurrentThread();
     }
-#endif
 }
 
-#if( __HAVE_JAVA__ )
 /*!
  * \brief Create an initialized Java environment.
  * \param aTestingOnly A flag if set indicates we don't want to actually start the
  *                     process for writing, instead are only interested if all of
  *                     the Java machinery is in place to successfully write to the DB.
+ * \param aScenarioName The name of the scenario which will be written.
  * \return An initialized Java environment with the Write DB class loaded and
  *         ready to accept data to write/alter to the database.  If an error occurs
  *         a null container will be returned.
  */
-unique_ptr<XMLDBOutputter::JNIContainer> XMLDBOutputter::createContainer( const bool aTestingOnly ) {
+unique_ptr<XMLDBOutputter::JNIContainer> XMLDBOutputter::createContainer( const bool aTestingOnly,
+                                                                         const string& aScenarioName )
+{
     // Create a Java instance.
     unique_ptr<JNIContainer> jniContainer( new JNIContainer );
 
@@ -334,9 +635,7 @@ unique_ptr<XMLDBOutputter::JNIContainer> XMLDBOutputter::createContainer( const
 
     // Ensure that the Java VM opened successfully.
     if( !jniContainer->mJavaVM || !jniContainer->mJavaEnv ) {
-        ILogger& mainLog = ILogger::getLogger( "main_log" );
-        mainLog.setLevel( ILogger::SEVERE );
-        mainLog << "Failed to start Java." << endl;
+        getErrorLog() << "Failed to start Java." << endl;
         jniContainer.reset( 0 );
         return jniContainer;
     }
@@ -349,9 +648,7 @@ unique_ptr<XMLDBOutputter::JNIContainer> XMLDBOutputter::createContainer( const
     jniContainer->mWriteDBClass = reinterpret_cast<jclass>( jniContainer->mJavaEnv->NewGlobalRef(
         jniContainer->mJavaEnv->FindClass( writeDBClassName.c_str() ) ) );
     if( !jniContainer->mWriteDBClass ) {
-        ILogger& mainLog = ILogger::getLogger( "main_log" );
-        mainLog.setLevel( ILogger::SEVERE );
-        mainLog << "Failed to find Java class " << writeDBClassName << " to write to the XML database." << endl;
+        getErrorLog() << "Failed to find Java class " << writeDBClassName << " to write to the XML database." << endl;
         jniContainer.reset( 0 );
         return jniContainer;
     }
@@ -362,9 +659,7 @@ unique_ptr<XMLDBOutputter::JNIContainer> XMLDBOutputter::createContainer( const
     jmethodID writeDBCtorMID = jniContainer->mJavaEnv->GetMethodID( jniContainer->mWriteDBClass,
         "<init>", "(Ljava/lang/String;Ljava/lang/String;)V" );
     if( !writeDBCtorMID ) {
-        ILogger& mainLog = ILogger::getLogger( "main_log" );
-        mainLog.setLevel( ILogger::SEVERE );
-        mainLog << "Failed to find the appropriate constructor of Java class " << writeDBClassName << "." << endl;
+        getErrorLog() << "Failed to find the appropriate constructor of Java class " << writeDBClassName << "." << endl;
         jniContainer.reset( 0 );
         return jniContainer;
     }
@@ -382,9 +677,9 @@ unique_ptr<XMLDBOutputter::JNIContainer> XMLDBOutputter::createContainer( const
         // note that util::appendScenarioToFileName searches for a '.' between which to insert
         // the scenario name however a '.' is not a valid character in a BaseX DB name so we
         // will just append it to the end.
-        xmldbContainerName = xmldbContainerName.append( scenario->getName() );
+        xmldbContainerName = xmldbContainerName.append( aScenarioName );
     }
-    const string docName = createContainerName( scenario->getName() );
+    const string docName = createContainerName( aScenarioName );
 
     // Convert the C++ string to a Java String so that they can be passed to the constructor.
     jstring jXMLDBContainerName = jniContainer->mJavaEnv->NewStringUTF( xmldbContainerName.c_str() );
@@ -394,9 +689,7 @@ unique_ptr<XMLDBOutputter::JNIContainer> XMLDBOutputter::createContainer( const
     jniContainer->mWriteDBInstance = jniContainer->mJavaEnv->NewGlobalRef(
         jniContainer->mJavaEnv->NewObject( jniContainer->mWriteDBClass, writeDBCtorMID, jXMLDBContainerName, jDocName ) );
     if( !jniContainer->mWriteDBInstance ) {
-        ILogger& mainLog = ILogger::getLogger( "main_log" );
-        mainLog.setLevel( ILogger::SEVERE );
-        mainLog << "Failed to construct the Java class " << writeDBClassName << "." << endl;
+        getErrorLog() << "Failed to construct the Java class " << writeDBClassName << "." << endl;
         jniContainer.reset( 0 );
         return jniContainer;
     }
@@ -441,8 +734,32 @@ bool XMLDBOutputter::appendData( const string& aData, const string& aLocation )
     }
 
 #if( __HAVE_JAVA__ )
+    if( mAsyncQueue ) {
+        // The data will be appended by the background writer after the rest of the
+        // XML has been written.  Any error will be reported from there.
+        mAsyncQueue->push( AsyncWriteQueue::APPEND, aData, aLocation );
+        return true;
+    }
+    return callAppendData( mJNIContainer.get(), aData, aLocation );
+#else
+    return false;
+#endif
+}
+
+#if( __HAVE_JAVA__ )
+/*!
+ * \brief Call the Java appendData method.
+ * \param aJNIContainer The Java environment to use which may be null if it failed
+ *                      to initialize.
+ * \param aData Data to append to the container.
+ * \param aLocation XPath of the location to add the data.
+ * \return Whether the data was added successfully.
+ */
+bool XMLDBOutputter::callAppendData( const JNIContainer* aJNIContainer, const string& aData,
+                                     const string& aLocation )
+{
     // Check if creating the container failed.
-    if( !mJNIContainer.get() ){
+    if( !aJNIContainer ){
         // An error message will have been printed by create container.
         return false;
     }
@@ -451,25 +768,21 @@ bool XMLDBOutputter::appendData( const string& aData, const string& aLocation )
     // "(Ljava/lang/String;Ljava/lang/String;)Z".  The arguments are the data, and
     // an XPath which gives the location after which to insert the data.  It will
     // return a bool "Z" if it successfully appended the data or not.
-    jmethodID appendDataMID = mJNIContainer->mJavaEnv->GetMethodID( mJNIContainer->mWriteDBClass,
+    jmethodID appendDataMID = aJNIContainer->mJavaEnv->GetMethodID( aJNIContainer->mWriteDBClass,
         "appendData", "(Ljava/lang/String;Ljava/lang/String;)Z" );
     if( !appendDataMID ) {
-        ILogger& mainLog = ILogger::getLogger( "main_log" );
-        mainLog.setLevel( ILogger::SEVERE );
-        mainLog << "Failed to find the appendData Java method" << endl;
+        getErrorLog() << "Failed to find the appendData Java method" << endl;
         return false;
     }
 
     // Convert the C++ string to a Java String so that they can be passed to the Java method.
-    jstring jData = mJNIContainer->mJavaEnv->NewStringUTF( aData.c_str() );
-    jstring jLocation = mJNIContainer->mJavaEnv->NewStringUTF( aLocation.c_str() );
+    jstring jData = aJNIContainer->mJavaEnv->NewStringUTF( aData.c_str() );
+    jstring jLocation = aJNIContainer->mJavaEnv->NewStringUTF( aLocation.c_str() );
 
     // Call the appendData method
-    return mJNIContainer->mJavaEnv->CallBooleanMethod( mJNIContainer->mWriteDBInstance, appendDataMID, jData, jLocation );
-#else
-    return false;
-#endif
+    return aJNIContainer->mJavaEnv->CallBooleanMethod( aJNIContainer->mWriteDBInstance, appendDataMID, jData, jLocation );
 }
+#endif
 
 void XMLDBOutputter::startVisitScenario( const Scenario* aScenario, const int aPeriod ){
     // write heading for XML input file
@@ -2216,4 +2529,26 @@ streamsize XMLDBOutputter::SendToJavaIOSink::write( const char *aData, std::stre
     }
     return offset;
 }
+
+/*!
+ * \brief Constructs a boost IO sink that queues data for the background writer.
+ * \param aQueue The queue to send the data to.
+ */
+XMLDBOutputter::AsyncQueueIOSink::AsyncQueueIOSink( const shared_ptr<AsyncWriteQueue>& aQueue )
+:mQueue( aQueue )
+{
+}
+
+/*!
+ * \brief Copy the data as it is generated into a chunk for the background writer.
+ * \param aData The current buffer of data that needs to be sent.
+ * \param aLength How many chars from the buffer should be read.
+ * \return The number of chars consumed which is always all of them.
+ */
+streamsize XMLDBOutputter::AsyncQueueIOSink::write( const char* aData, std::streamsize aLength ) {
+    if( aLength > 0 ) {
+        mQueue->push( AsyncWriteQueue::DATA, string( aData, aLength ) );
+    }
+    return aLength;
+}
 #endif
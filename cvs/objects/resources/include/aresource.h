@@ -66,6 +66,7 @@ class TrialValueResource;
 */
 class AResource: public INamed, public IVisitable, private boost::noncopyable {
     friend class XMLDBOutputter;
+    friend class ColumnarOutputter;
 public:
     virtual ~AResource();
 
@@ -92,6 +92,7 @@ class Sector: public IVisitable,
               private boost::noncopyable
 {
     friend class XMLDBOutputter;
+    friend class ColumnarOutputter;
     friend class CalibrateShareWeightVisitor;
 protected:
     
@@ -156,6 +156,8 @@ public:
    
     bool XMLParse( rapidxml::xml_node<char>* & aNode );
 
+    virtual bool isXMLParseReflected() const;
+
     virtual void completeInit( const IInfo* aSectorInfo,
                                ILandAllocator* aLandAllocator );
     
@@ -145,6 +145,11 @@ bool Subsector::XMLParse( rapidxml::xml_node<char>* & aNode ) {
     }
 }
 
+//! Interpolation rules parsed by XMLParse are kept in mShareWeightInterpRules.
+bool Subsector::isXMLParseReflected() const {
+    return true;
+}
+
 /*! \brief Write information useful for debugging to XML output stream
 *
 * Function writes market and other useful info to XML. Useful for debugging.
@@ -93,6 +93,9 @@ class LogEDFun : public VecFVec
                        //!required.
   int period;
   bool mLogPricep;               //!< Flag indicating whether inputs are prices or log-prices
+  size_t mNestedPartialThreshold; //!< Partial derivatives with at least this many
+                                  //!activities to calculate are run on their flow
+                                  //!graph, zero to always run serially
 
   // diagnostic variables
   std::vector<double> mstate;
@@ -34,6 +34,7 @@
 #include <math.h>
 #include <assert.h>
 #include <vector>
+#include <algorithm>
 
 #include "util/base/include/definitions.h"
 #include "solution/util/include/edfun.hpp"
@@ -43,6 +44,7 @@
 #include "util/logger/include/ilogger.h"
 #include "containers/include/scenario.h"
 #include "util/base/include/manage_state_variables.hpp"
+#include "util/base/include/configuration.h"
 
 #include "util/base/include/timer.h"
 
@@ -59,8 +61,18 @@ LogEDFun::LogEDFun(SolutionInfoSet &sisin,
     solnset(sisin),
     world(w), mktplc(m), period(per),
     mLogPricep(aLogPricep),
+    mNestedPartialThreshold(0),
     slope(UBVECTOR::Constant(mkts.size(), 1.0))
 {
+#if GCAM_PARALLEL_ENABLED
+    // Threads helping with a partial derivative add to the same markets in no
+    // particular order so it is always run serially when results must be
+    // reproducible.
+    const Configuration* conf = Configuration::getInstance();
+    if( !conf->getBool( "parallel-reproducible", false, false ) ) {
+        mNestedPartialThreshold = std::max( conf->getInt( "partial-derivative-nested-threshold", 0, false ), 0 );
+    }
+#endif
     na=nr=mkts.size();
     mdiagnostic=false;
 
@@ -306,9 +318,18 @@ void LogEDFun::operator()(const UBVECTOR &ax, UBVECTOR &fx, const int partj)
     Timer& evalPartTimer = TimerRegistry::getInstance().getTimer( TimerRegistry::EVAL_PART );
     evalPartTimer.start();
     // Note even when running with GCAM_PARALLEL_ENABLED we still run in serial
-    // mode for partial derivatives.  This is because the loop over each partial
-    // derivative to run is a parallel_for.
-    world->calc(period, affectedNodes);
+    // mode for most partial derivatives.  This is because the loop over each partial
+    // derivative to run is a parallel_for.  Only those which affect a large part
+    // of the model are run on their flow graph so that they do not hold up the
+    // end of the Jacobian.
+#if GCAM_PARALLEL_ENABLED
+    GcamFlowGraph* flowGraph = mkts[partj].getFlowGraph();
+    if( !flowGraph || mNestedPartialThreshold == 0 || affectedNodes.size() < mNestedPartialThreshold ||
+        !world->calcPartial(period, flowGraph, affectedNodes) )
+#endif
+    {
+        world->calc(period, affectedNodes);
+    }
     evalPartTimer.stop();
 
     if(mdiagnostic) {
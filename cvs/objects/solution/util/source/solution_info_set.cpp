@@ -95,6 +95,10 @@ void SolutionInfoSet::init( const unsigned int aPeriod, const double aDefaultSol
     // Create and initialize a SolutionInfo object for each market.
     typedef vector<Market*>::const_iterator ConstMarketIterator;
     MarketDependencyFinder* depFinder = marketplace->getDependencyFinder();
+#if GCAM_PARALLEL_ENABLED
+    const bool usePartialFlowGraphs = Configuration::getInstance()->getBool( "partial-derivative-flow-graphs", false, false );
+    const size_t nestedPartialThreshold = max( Configuration::getInstance()->getInt( "partial-derivative-nested-threshold", 0, false ), 0 );
+#endif
     for( ConstMarketIterator iter = marketsToSolve.begin(); iter != marketsToSolve.end(); ++iter ){
         const bool isSolvable = (*iter)->isSolvable();
         const int marketNumber = iter - marketsToSolve.begin();
@@ -103,9 +107,14 @@ void SolutionInfoSet::init( const unsigned int aPeriod, const double aDefaultSol
         // TODO: As it turns out the extra time generating these graphs does not typically
         // get paid back in terms of time saved while calculating partial derivatives.  At
         // least in a single scenario run.  We need to come up with some methodology to figure
-        // out when it is beneficial to do this or not until then we are not generating any.
+        // out when it is beneficial to do this or not until then we only use them when
+        // explicitly requested in which case they were all created during completeInit.
+        // The exception is markets which affect enough of the model to have their
+        // partial derivatives run on their flow graph, see LogEDFun.
+        const bool useFlowGraph = usePartialFlowGraphs ||
+            ( nestedPartialThreshold > 0 && partialList.size() >= nestedPartialThreshold );
         SolutionInfo currInfo( *iter, partialList, 
-               /*isSolvable ? depFinder->getFlowGraph( marketNumber ) :*/ 0 );
+               isSolvable && useFlowGraph ? depFinder->getFlowGraph( marketNumber ) : 0 );
 #else
         SolutionInfo currInfo( *iter, partialList );
 #endif
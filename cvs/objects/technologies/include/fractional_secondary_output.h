@@ -102,6 +102,8 @@ public:
 
     virtual bool XMLParse( rapidxml::xml_node<char>* & aNode );
 
+    virtual bool isXMLParseReflected() const;
+
     virtual void toDebugXML( const int aPeriod,
                              std::ostream& aOut,
                              Tabs* aTabs ) const;
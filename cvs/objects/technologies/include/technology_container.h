@@ -129,6 +129,7 @@ public:
     
     // AParsable methods
     virtual bool XMLParse( rapidxml::xml_node<char>* & aNode );
+    virtual bool isXMLParseReflected() const;
     
     // IVisitable methods
     virtual void accept( IVisitor* aVisitor, const int aPeriod ) const;
@@ -136,6 +136,11 @@ bool FractionalSecondaryOutput::XMLParse( rapidxml::xml_node<char>* & aNode ) {
     }
 }
 
+//! Points parsed by XMLParse are kept in mCostCurve.
+bool FractionalSecondaryOutput::isXMLParseReflected() const {
+    return true;
+}
+
 void FractionalSecondaryOutput::toDebugXML( const int aPeriod,
                                             ostream& aOut,
                                             Tabs* aTabs ) const
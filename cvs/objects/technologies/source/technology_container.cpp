@@ -243,6 +243,11 @@ bool TechnologyContainer::XMLParse( rapidxml::xml_node<char>* & aNode) {
     return false;
 }
 
+//! Technologies parsed by XMLParse are kept in mVintages.
+bool TechnologyContainer::isXMLParseReflected() const {
+    return true;
+}
+
 void TechnologyContainer::toDebugXML( const int aPeriod, ostream& aOut, Tabs* aTabs ) const {
     for( CVintageIterator vintageIt = mVintages.begin(); vintageIt != mVintages.end(); ++vintageIt ) {
         ( *vintageIt ).second->toDebugXML( aPeriod, aOut, aTabs );
@@ -0,0 +1,172 @@
+#ifndef _ACTIVITY_PROFILER_H_
+#define _ACTIVITY_PROFILER_H_
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*! 
+* \file activity_profiler.h
+* \ingroup Objects
+* \brief Header file for the ActivityProfiler class.
+*/
+
+#include <iosfwd>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <atomic>
+#include <boost/core/noncopyable.hpp>
+
+#include "util/base/include/definitions.h"
+
+#if GCAM_PARALLEL_ENABLED
+#include <tbb/enumerable_thread_specific.h>
+#endif
+
+class IActivity;
+class MarketDependencyFinder;
+
+/*!
+ * \ingroup Objects
+ * \brief An opt-in profiler which records the execution of each IActivity
+ *        during World::calc.
+ * \details When enabled, by setting write-output for the "activityProfileTrace"
+ *          file in the configuration, the flow graph nodes and the serial
+ *          calculation loop record the start and end time and the thread of
+ *          every activity they calculate.  Recording is done into thread local
+ *          buffers so that profiling does not introduce any synchronization
+ *          between threads.  At the end of the scenario the accumulated costs are
+ *          combined with the dependency graph to find the critical path which
+ *          bounds the achievable parallel speedup, and the individual events are
+ *          written as a Chrome trace (JSON) which can be viewed in chrome://tracing
+ *          or https://ui.perfetto.dev.
+ *
+ *          Only the first "activity-profile-max-events" events per thread are
+ *          kept for the trace to keep memory bounded, however all calculations
+ *          are included in the per-activity costs.
+ */
+class ActivityProfiler : private boost::noncopyable {
+public:
+    //! The clock used to time activities.
+    typedef std::chrono::steady_clock Clock;
+    
+    static ActivityProfiler& getInstance();
+    
+    void reset();
+    
+    /*!
+     * \brief Whether activities should be profiled.
+     * \return True if profiling was enabled in the configuration.
+     */
+    bool isEnabled() const {
+        return mEnabled;
+    }
+    
+    void calc( IActivity* aActivity, const int aPeriod );
+    
+    void record( const IActivity* aActivity, const Clock::time_point& aStart,
+                 const Clock::time_point& aEnd );
+    
+    void printReport( const MarketDependencyFinder* aDependencyFinder, std::ostream& aOut ) const;
+    
+    void writeTrace( std::ostream& aOut ) const;
+    
+private:
+    ActivityProfiler();
+    
+    //! The accumulated cost of a single activity.
+    struct ActivityStats {
+        ActivityStats():mTotalTime( 0 ), mCount( 0 ) {}
+        
+        //! Total time spent calculating the activity in seconds.
+        double mTotalTime;
+        
+        //! The number of times the activity was calculated.
+        int mCount;
+    };
+    
+    //! A single activity calculation to include in the trace.
+    struct TraceEvent {
+        //! The activity which was calculated.
+        const IActivity* mActivity;
+        
+        //! The start time in microseconds since the profiler was created.
+        double mStart;
+        
+        //! The duration of the calculation in microseconds.
+        double mDuration;
+    };
+    
+    //! The profiling data collected by a single thread.
+    struct ThreadData {
+        ThreadData():mThreadID( -1 ) {}
+        
+        //! A sequential ID for the thread to use in the trace.
+        int mThreadID;
+        
+        //! The events recorded by this thread in the order they occured.
+        std::vector<TraceEvent> mTrace;
+        
+        //! The accumulated cost of each activity calculated by this thread.
+        std::unordered_map<const IActivity*, ActivityStats> mStats;
+    };
+    
+    ThreadData& getThreadData();
+    
+    std::unordered_map<const IActivity*, ActivityStats> getCombinedStats() const;
+    
+    //! Flag if profiling is enabled.
+    bool mEnabled;
+    
+    //! The maximum number of trace events to keep for each thread.
+    size_t mMaxTraceEvents;
+    
+    //! The time the profiler was created which all trace times are relative to.
+    Clock::time_point mEpoch;
+    
+    //! Counter used to assign each thread a sequential ID.
+    std::atomic<int> mThreadCount;
+    
+#if GCAM_PARALLEL_ENABLED
+    //! The profiling data for each thread.
+    tbb::enumerable_thread_specific<ThreadData> mThreadData;
+#else
+    //! The profiling data for the single thread.
+    ThreadData mThreadData;
+#endif
+};
+
+#endif // _ACTIVITY_PROFILER_H_
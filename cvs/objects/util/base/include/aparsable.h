@@ -67,8 +67,9 @@ namespace rapidxml = boost::property_tree::detail::rapidxml;
 class AParsable {
 public:
     //! Virtual destructor so that instances of the interface may be deleted
-    //! correctly through a pointer to the interface.
-    inline virtual ~AParsable() {}
+    //! correctly through a pointer to the interface.  Also drops any XML recorded
+    //! for this instance by the SnapshotHelper.
+    virtual ~AParsable();
     
     /*!
      * \brief Perform custom behavior to parse Data out of XML DOM element.
@@ -89,6 +90,17 @@ public:
     virtual bool XMLParse( rapidxml::xml_node<char>* & aNode ) {
         return false;
     }
+
+    /*!
+     * \brief Whether everything set by XMLParse is held in Data member variables.
+     * \details If so the SnapshotHelper can re-create this object from its Data
+     *          alone and does not need to keep a copy of the XML handled by XMLParse
+     *          to give to it again when loading a snapshot.
+     * \return True if XMLParse only sets Data member variables.
+     */
+    virtual bool isXMLParseReflected() const {
+        return false;
+    }
 };
 
 #endif // _APARSABLE_H_
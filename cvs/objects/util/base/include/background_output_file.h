@@ -0,0 +1,118 @@
+#ifndef _BACKGROUND_OUTPUT_FILE_H_
+#define _BACKGROUND_OUTPUT_FILE_H_
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*!
+ * \file background_output_file.h
+ * \ingroup util
+ * \brief Header file for the BackgroundOutputFile class.
+ */
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <boost/iostreams/filtering_stream.hpp>
+
+/*!
+ * \ingroup util
+ * \brief An output file like AutoOutputFile which may be compressed and written
+ *        on a background thread.
+ * \details Data written to the stream is collected into chunks in memory.  A chunk
+ *          is handed off when it grows large enough or when endChunk is called,
+ *          such as at the end of each model period.  If writing in the background
+ *          the chunks are queued for a writer thread, which blocks the caller only
+ *          if too much data is waiting, otherwise they are written immediately.
+ *
+ *          If the file name ends in .gz or .zst the file is written gzip or zstd
+ *          compressed, which requires the model to be built with USE_ZLIB or
+ *          USE_ZSTD respectively.  If it was not the file is written uncompressed
+ *          and a warning is given.
+ */
+class BackgroundOutputFile {
+public:
+    BackgroundOutputFile( const std::string& aConfVariableName,
+                          const std::string& aDefaultName,
+                          const bool aShouldWriteOverride,
+                          const bool aInBackground );
+
+    ~BackgroundOutputFile();
+
+    /*!
+     * \brief Get the flag if this file should be written.
+     * \return True if this file is being written and false if the output is being ignored.
+     */
+    bool shouldWrite() const {
+        return mShouldWrite;
+    }
+
+    /*! \brief Write a value of type T to the output stream.
+    * \param aValue Value to write.
+    * \return The output stream for chaining.
+    */
+    template<class T>
+    std::ostream& operator<<( T& aValue ){
+        return mWrappedFile << aValue;
+    }
+
+    /*! \brief Dereference operator which returns the internal stream.
+    * \return The internal stream.
+    */
+    std::ostream& operator*(){
+        return mWrappedFile;
+    }
+
+    void endChunk();
+
+private:
+    struct ChunkQueue;
+    class ChunkSink;
+
+    //! The stream which collects data into chunks or discards it.
+    boost::iostreams::filtering_ostream mWrappedFile;
+
+    //! The flag if this file was not to be written
+    const bool mShouldWrite;
+
+    //! The chunks waiting to be written and the file they are written to.
+    std::shared_ptr<ChunkQueue> mQueue;
+
+    //! The thread writing chunks if writing in the background.
+    std::thread mWriterThread;
+};
+
+#endif // _BACKGROUND_OUTPUT_FILE_H_
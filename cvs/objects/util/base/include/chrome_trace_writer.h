@@ -0,0 +1,85 @@
+#ifndef _CHROME_TRACE_WRITER_H_
+#define _CHROME_TRACE_WRITER_H_
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*! 
+* \file chrome_trace_writer.h
+* \ingroup Objects
+* \brief Header file for the ChromeTraceWriter class.
+*/
+
+#include <ios>
+#include <string>
+#include <boost/core/noncopyable.hpp>
+
+/*!
+ * \ingroup Objects
+ * \brief Writes the "traceEvents" member of a JSON object in the Chrome trace
+ *        event format shared by the ActivityProfiler and TimerRegistry.
+ * \details The caller writes the opening of the enclosing object along with any
+ *          other members before creating the writer and closes the object after
+ *          it is destroyed.  Times are given in microseconds and are written in
+ *          fixed notation for the lifetime of the writer.  The result can be
+ *          loaded into chrome://tracing or https://ui.perfetto.dev.
+ */
+class ChromeTraceWriter : private boost::noncopyable {
+public:
+    explicit ChromeTraceWriter( std::ostream& aOut );
+    
+    ~ChromeTraceWriter();
+    
+    void writeThreadName( const int aThreadID );
+    
+    void writeEvent( const std::string& aName, const char* aCategory, const double aStart,
+                     const double aDuration, const int aThreadID, const std::string& aArgs = "" );
+    
+private:
+    //! The stream to write to.
+    std::ostream& mOut;
+    
+    //! The format flags of mOut to restore when done.
+    std::ios_base::fmtflags mOldFlags;
+    
+    //! The precision of mOut to restore when done.
+    std::streamsize mOldPrecision;
+    
+    //! Whether no event has been written yet.
+    bool mIsFirst;
+};
+
+#endif // _CHROME_TRACE_WRITER_H_
@@ -85,6 +85,7 @@ public:
 	int getInt( const std::string& key, const int defaultValue = 0, const bool mustExist = true ) const;
 	double getDouble( const std::string& key, const double defaultValue = 0, const bool mustExist = true ) const;
     const std::list<std::string>& getScenarioComponents() const;
+    void appendScnToAllFilesExcept( const std::list<std::string>& aExcludedKeys );
 private:
     const std::string mLogFile; //!< The name of the log to use.
     static std::unique_ptr<Configuration> gInstance; //!< The static instance of the Configuration class.
@@ -72,6 +72,16 @@
 #define GCAM_PARALLEL_ENABLED 1
 #endif
 
+//! A flag which turns on or off reading gzip compressed input files (zlib required)
+#ifndef USE_ZLIB
+#define USE_ZLIB 0
+#endif
+
+//! A flag which turns on or off reading zstd compressed input files (zstd required)
+#ifndef USE_ZSTD
+#define USE_ZSTD 0
+#endif
+
 // This allows for memory leak debugging.
 #if defined(_MSC_VER)
 #   ifdef _DEBUG
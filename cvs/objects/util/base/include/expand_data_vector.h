@@ -191,6 +191,27 @@ class ExpandDataVector  {
         } );
     }
 
+    /*!
+     * \brief Call back with the SubClass that was set by setSubClass.
+     * \details The call back is given the position of SubClass in SubClassFamilyVector
+     *          and the pointer to the instance as the SubClass type.  This is useful
+     *          to record exactly which member of the family an instance is so that
+     *          another instance of that same type can be created later.
+     * \tparam SubClassHandler Any callable which takes the position as an int and a
+     *                         pointer to any member of SubClassFamilyVector.
+     * \param aHandler The instance of SubClassHandler to call back on.
+     */
+    template<typename SubClassHandler>
+    void getSubClass( SubClassHandler aHandler ) const {
+        int index = 0;
+        boost::fusion::for_each( mSubClassPtrMap, [&index, &aHandler] ( auto& aPair ) {
+            if( aPair.second ) {
+                aHandler( index, aPair.second );
+            }
+            ++index;
+        } );
+    }
+
     protected:
     //! Alias a type that adds a pointer to each type in SubClassFamilyVector
     using SubClassVecPtr = typename boost::mpl::transform<SubClassFamilyVector, boost::add_pointer<boost::mpl::_> >::type;
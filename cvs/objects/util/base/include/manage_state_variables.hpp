@@ -46,6 +46,7 @@
 #include <cassert>
 #include <forward_list>
 #include <string>
+#include <boost/core/noncopyable.hpp>
 #include "util/base/include/definitions.h"
 
 class Value;
@@ -80,6 +81,41 @@ public:
     void setPartialDeriv( const bool aIsPartialDeriv );
     
 #if GCAM_PARALLEL_ENABLED
+    static double* getThreadState();
+    
+    /*!
+     * \brief Whether the calling thread is currently working in a "scratch" space
+     *        which other threads may be writing to concurrently.
+     * \details This is only the case while calculating nodes of a partial
+     *          derivative which is being run on it's flow graph, in which case
+     *          shared results such as market supplies and demands must be locked.
+     * \return True if the calling thread's state is shared.
+     */
+    static bool isThreadStateShared() {
+        return sIsThreadStateShared;
+    }
+    
+    /*!
+     * \brief Redirects the calling thread's STATE Values to the given state for
+     *        as long as this object lives.
+     * \details This allows worker threads to help with a single partial derivative
+     *          by calculating in the "scratch" space assigned to the thread which
+     *          started it rather than their own.  If the given state is null
+     *          this is a no-op.
+     */
+    class SharedStateScope : private boost::noncopyable {
+    public:
+        explicit SharedStateScope( double* aSharedState );
+        ~SharedStateScope();
+    private:
+        //! The state the calling thread was using before or null if it was not
+        //! redirected.
+        double* mPrevState;
+        
+        //! The value of sIsThreadStateShared before it was redirected.
+        bool mPrevIsShared;
+    };
+    
     //! A tbb task arena which is the closest tbb comes to a thread pool which we
     //! will insist parallel calculations use so that we can ensure that we have
     //! appropriately sized and allocated a slot in mStateData for each thread to
@@ -88,6 +124,11 @@ public:
 #endif
     
 private:
+#if GCAM_PARALLEL_ENABLED
+    //! Flag set for each thread while it's state is redirected by a SharedStateScope.
+    static thread_local bool sIsThreadStateShared;
+#endif
+    
     //! The actual home of all state data.  This is a two dimensional array where
     //! the first is by state the second is for each GCAM Data marketed as STATE.
     //! Note the first state is the "base" state and the rest are "scratch" for
@@ -0,0 +1,105 @@
+#ifndef _REGION_INDEX_H_
+#define _REGION_INDEX_H_
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*!
+ * \file region_index.h
+ * \ingroup Objects
+ * \brief The RegionIndex class header file.
+ */
+
+#include <string>
+#include <vector>
+#include <set>
+#include <cstdint>
+
+/*!
+ * \ingroup Objects
+ * \brief The byte offsets of each region in a scenario component XML file so
+ *        that only the regions a run needs have to be parsed.
+ * \details Scenario component files have the form scenario/world/region and the
+ *          index records where each region element, a child of world, begins and
+ *          ends in the file.  Finding these is a simple scan of the tags which is
+ *          far cheaper than having rapidxml tokenize the whole file and if the
+ *          regionIndexCache file configuration parameter is set to a directory the
+ *          index is kept there to be reused as long as the file does not change.
+ *
+ *          When the region-subset string configuration parameter is set to a comma
+ *          separated list of region names all other regions are cut out of each
+ *          scenario component file before it is parsed and so are never built.
+ *          This is intended for development and debugging runs which only need a
+ *          few regions.  Note that the regions kept must not depend on any of the
+ *          regions which were dropped.
+ */
+class RegionIndex {
+public:
+    static std::set<std::string> getRegionSubset();
+
+    static RegionIndex getRegionIndex( const std::string& aFileName, const char* aData,
+                                       const std::size_t aSize );
+
+    bool filterRegions( const std::set<std::string>& aRegionSubset, const char* aData,
+                        const std::size_t aSize, std::vector<char>& aFilteredData,
+                        unsigned int& aNumSkipped ) const;
+
+private:
+    //! The location of a single region element in the file.
+    struct RegionRange {
+        //! The value of the name attribute of the region.
+        std::string mName;
+
+        //! The offset of the opening '<' of the region element.
+        std::size_t mBegin;
+
+        //! The offset just past the closing '>' of the region element.
+        std::size_t mEnd;
+    };
+
+    //! Each region element in the order they appear in the file.
+    std::vector<RegionRange> mRegions;
+
+    void build( const char* aData, const std::size_t aSize );
+
+    bool load( const std::string& aIndexFileName, const std::uint64_t aFileSize,
+               const std::int64_t aModifiedTime );
+
+    void save( const std::string& aIndexFileName, const std::uint64_t aFileSize,
+               const std::int64_t aModifiedTime ) const;
+};
+
+#endif // _REGION_INDEX_H_
@@ -0,0 +1,133 @@
+#ifndef _SNAPSHOT_HELPER_H_
+#define _SNAPSHOT_HELPER_H_
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*!
+ * \file snapshot_helper.h
+ * \ingroup Objects
+ * \brief The SnapshotHelper class header file.
+ */
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "util/base/include/aparsable.h"
+
+class Scenario;
+
+/*!
+ * \ingroup Objects
+ * \brief A set of static helper functions to save a parsed Scenario to a binary
+ *        snapshot file and to load it back again without parsing any XML.
+ * \details The snapshot is generated through the same GCAM Fusion Data definitions
+ *          used by XMLParseHelper.  Starting from the Scenario every CONTAINER is
+ *          written as its position in its SubClassFamilyVector, so that the
+ *          correct subclass can be created when reading, followed by all of its
+ *          SIMPLE and ARRAY Data and then recursively its CONTAINER Data.  Data
+ *          which are pointers to anything other than a CONTAINER are references
+ *          which get set during completeInit and are skipped.
+ *
+ *          Some AParsable classes keep part of what they parse outside of their
+ *          Data definitions, for instance the Modeltime and solvers parsed by
+ *          Scenario.  While recording, which is turned on around the parse of the
+ *          inputs to snapshot, the XML nodes handled by AParsable::XMLParse are
+ *          copied and stored with the snapshot.  When loading they are given to
+ *          XMLParse again before the Data of that object are read.  Classes which
+ *          only set Data in XMLParse can skip this by overriding
+ *          AParsable::isXMLParseReflected.
+ *
+ *          The snapshot is taken after XML parsing and before completeInit, which
+ *          is run as usual after loading.  The state built by completeInit, such
+ *          as markets, infos and the dependency graph, is made of references
+ *          between objects which are not available through the Data definitions.
+ *
+ *          A snapshot is tagged with a hash of the input files and of the
+ *          configuration which decides what gets parsed from them and will only
+ *          be loaded if it matches.  The Data of each object is preceded by a hash
+ *          of the names and types in its data definitions so that a snapshot
+ *          written before those definitions changed is rejected.
+ */
+struct SnapshotHelper {
+    //! The result of attempting to load a snapshot.
+    enum ReadStatus {
+        //! The snapshot was loaded into the Scenario.
+        LOADED,
+
+        //! There was no snapshot or it was generated from different inputs or in
+        //! a different format.  The Scenario has not been modified.
+        NOT_AVAILABLE,
+
+        //! The snapshot could not be read after loading had begun and the Scenario
+        //! along with the Modeltime it may have parsed are in an unusable state.
+        FAILED
+    };
+
+    static uint64_t calcInputHash( const std::vector<std::string>& aXMLFiles );
+
+    static bool writeSnapshot( const std::string& aFileName, const uint64_t aInputHash,
+                               Scenario* aScenario );
+
+    static ReadStatus readSnapshot( const std::string& aFileName, const uint64_t aInputHash,
+                                    Scenario* aScenario );
+
+    static void startRecording();
+
+    static void stopRecording();
+
+    /*!
+     * \brief Whether XML handled by AParsable::XMLParse is currently being recorded.
+     * \return True if recording.
+     */
+    static bool isRecording() {
+        return sIsRecording;
+    }
+
+    static void recordXMLParse( AParsable* aContainer,
+                                const rapidxml::xml_node<char>* aParentNode,
+                                const rapidxml::xml_node<char>* aFirstNode,
+                                const rapidxml::xml_node<char>* aLastNode );
+
+    static void forgetXMLParse( const AParsable* aContainer );
+
+private:
+    //! Flag if we are recording XML handled by AParsable::XMLParse.
+    static bool sIsRecording;
+};
+
+#endif // _SNAPSHOT_HELPER_H_
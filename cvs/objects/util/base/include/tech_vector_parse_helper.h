@@ -91,7 +91,30 @@ public:
         
         return (*iter).second;
     }
-    
+
+    /*!
+     * \brief Find the temporary storage PeriodVector associated with a given TechVintageVector
+     *        if any has been made.
+     * \details Unlike getPeriodVector no new PeriodVector will be allocated.
+     * \param aTecVector The TechVintageVector instance to find the temporary storage for.
+     * \return The associated temporary storage for aTecVector or null if there is none.
+     */
+    const objects::PeriodVector<T>* findPeriodVector( const objects::TechVintageVector<T>& aTecVector ) const {
+        size_t tempDataKey = reinterpret_cast<size_t>( aTecVector.mData );
+        auto iter = mTempStore.find( tempDataKey );
+        return iter != mTempStore.end() ? &(*iter).second : 0;
+    }
+
+    /*!
+     * \brief Whether a TechVintageVector has been initialized and no longer uses
+     *        temporary storage.
+     * \param aTecVector The TechVintageVector instance to check.
+     * \return True if aTecVector has been initialized.
+     */
+    static bool isInitialized( const objects::TechVintageVector<T>& aTecVector ) {
+        return aTecVector.isInitialized();
+    }
+
     static void setDefaultValue( const T& aDefaultValue, objects::TechVintageVector<T>& aTechVector );
     
     static void initializeVector( const unsigned int aStartPeriod, const unsigned int aSize, objects::TechVintageVector<T>& aV );
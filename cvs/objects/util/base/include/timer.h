@@ -49,30 +49,44 @@
 #include <string>
 #include <vector>
 #include <map>
-#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <deque>
+#include <atomic>
+#include <cstdint>
 #include <boost/core/noncopyable.hpp>
 
 #include "util/base/include/definitions.h"
 
 #if GCAM_PARALLEL_ENABLED
 #include <tbb/spin_mutex.h>
+#include <tbb/enumerable_thread_specific.h>
 #endif
 
+class IActivity;
+
 /*!
 * \ingroup Objects
 * \brief A very basic class which times and prints events.
+* \details Times are taken from TimerRegistry::getTicks which is a low overhead
+*          timestamp counter.  In addition to the elapsed wall clock time, while
+*          profiling is enabled, the timer keeps the time accumulated by each
+*          thread which starts and stops it so that when it is used from within
+*          parallel work the total amount of work done is also reported.  When
+*          profiling is off starting and stopping a timer does not touch the
+*          TimerRegistry at all.
 * \author Josh Lurz
 */
 class Timer : private boost::noncopyable {
+    friend class TimerRegistry;
 public:
     Timer();        
     void start();
     void stop();
     double getTotalTimeDifference() const;
+    double getTotalThreadTime() const;
     void print( std::ostream& aOut, const std::string& aTitle = "Time: " ) const;
 private:
-    //! Time the timer started
-    boost::posix_time::ptime mStartTime;
+    //! Ticks when the timer started
+    uint64_t mStartTicks;
 
     //! State flag
     int mRunning;
@@ -81,8 +95,15 @@ private:
     tbb::spin_mutex mMutex;
 #endif
     
-    //! The total time measured by this timer between all starts and stops.
-    double mTotalTime;
+    //! The total ticks measured by this timer between all starts and stops.
+    uint64_t mTotalTicks;
+
+    //! The total ticks measured between starts and stops summed over all of
+    //! the threads which used this timer.
+    std::atomic<uint64_t> mThreadTicks;
+
+    //! The name of this timer if it is registered with the TimerRegistry.
+    std::string mName;
 };
 
 /*!
@@ -93,6 +114,16 @@ private:
  *          therefore it provides two interfaces.  One where timers are named by
  *          predefined enumerations where performance is critical and another they
  *          are named by string which is more convenient.
+ *
+ *          When profiling is enabled, by setting write-output for the
+ *          "timerProfile" file in the configuration, each thread keeps a stack of
+ *          the timers it currently has running.  These stacks are used to accumulate the time
+ *          spent in a hierarchy of scopes, such as period, solver, evaluation, and
+ *          optionally activity, per thread.  Scopes opened by worker threads which
+ *          have no timer running themselves are nested under the scope currently
+ *          open on the main thread which is the one driving the solver.  The
+ *          hierarchy is included in printAllTimers and written along with a trace
+ *          of the individual scopes to the profile by writeProfile.
  * \author Pralit Patel and Robert Link
  */
 class TimerRegistry {
@@ -118,11 +149,29 @@ public:
     
     static TimerRegistry& getInstance();
     
+    static uint64_t getTicks();
+    
+    static double ticksToSeconds( const uint64_t aTicks );
+    
     Timer& getTimer( const std::string& aTimerName );
     
     Timer& getTimer( const PredefinedTimers aTimerName );
     
+    void initProfiling();
+    
+    /*!
+     * \brief Whether hierarchical profiling is enabled.
+     * \return True if profiling was enabled in the configuration.
+     */
+    bool isProfilingEnabled() const {
+        return mProfilingEnabled;
+    }
+    
+    void recordActivity( const IActivity* aActivity, const double aSeconds );
+    
     void printAllTimers( std::ostream& aOut ) const;
+    
+    void writeProfile( std::ostream& aOut ) const;
 private:
     //! Private constructor to prevent multiple registries
     TimerRegistry();
@@ -131,11 +180,162 @@ private:
     //! Private undefined assignment operator to prevent copying
     TimerRegistry& operator=( const TimerRegistry& aTimerRegistry );
     
+    friend class Timer;
+    
+    //! A node in the hierarchy of profiled scopes.
+    struct ScopeNode {
+        //! The name of the timer or activity.
+        std::string mName;
+        
+        //! The index of the enclosing scope or -1 if it is a root.
+        int mParent;
+        
+        //! Whether this node is an activity rather than a timer.
+        bool mIsActivity;
+    };
+    
+    //! The time accumulated in a scope by a single thread.
+    struct ScopeStats {
+        ScopeStats():mTicks( 0 ), mSeconds( 0 ), mCount( 0 ) {}
+        
+        //! Total ticks spent in the scope.
+        uint64_t mTicks;
+        
+        //! Total seconds spent in the scope for times not measured in ticks.
+        double mSeconds;
+        
+        //! The number of times the scope was entered.
+        int mCount;
+    };
+    
+    //! A running timer on a thread's stack.
+    struct ScopeFrame {
+        //! The timer which was started.
+        const Timer* mTimer;
+        
+        //! The ticks when the timer was started.
+        uint64_t mStartTicks;
+        
+        //! The scope node for this frame or -1 if it is not profiled.
+        int mNode;
+        
+        //! Whether the timer was already running on this thread in which case
+        //! the time is not counted again.
+        bool mIsNested;
+    };
+    
+    //! A single scope to include in the trace.
+    struct TraceEvent {
+        //! The scope node.
+        int mNode;
+        
+        //! The ticks when the scope was entered.
+        uint64_t mStartTicks;
+        
+        //! The ticks when the scope was exited.
+        uint64_t mEndTicks;
+    };
+    
+    //! The time in a scope combined over all threads.
+    struct ScopeSummary {
+        ScopeSummary():mSeconds( 0 ), mCount( 0 ), mNumThreads( 0 ) {}
+        
+        //! Total seconds spent in the scope summed over threads.
+        double mSeconds;
+        
+        //! The number of times the scope was entered.
+        int mCount;
+        
+        //! The number of threads which entered the scope.
+        int mNumThreads;
+    };
+    
+    //! The timing data collected by a single thread.
+    struct ThreadData {
+        ThreadData():mThreadID( -1 ), mCurrentNode( -1 ) {}
+        
+        //! A sequential ID for the thread to use in the profile.
+        int mThreadID;
+        
+        //! The innermost scope node currently open on this thread.
+        int mCurrentNode;
+        
+        //! The timers currently running on this thread.
+        std::vector<ScopeFrame> mStack;
+        
+        //! The accumulated time in each scope node by this thread.
+        std::vector<ScopeStats> mStats;
+        
+        //! Scope nodes already looked up by this thread by parent and key so
+        //! that the shared hierarchy only needs to be locked for new scopes.
+        std::map<std::pair<int, const void*>, int> mNodeCache;
+        
+        //! The scopes exited by this thread in the order they occured.
+        std::vector<TraceEvent> mTrace;
+    };
+    
+    ThreadData& getThreadData();
+    
+    void enterScope( const Timer* aTimer );
+    
+    void exitScope( Timer* aTimer );
+    
+    int getScopeNode( ThreadData& aThreadData, const void* aKey, const Timer* aTimer,
+                      const IActivity* aActivity );
+    
+    std::vector<ScopeSummary> summarizeScopes() const;
+    
+    void printScopes( std::ostream& aOut, const int aParent, const int aDepth,
+                      const std::vector<std::vector<int> >& aChildren,
+                      const std::vector<ScopeSummary>& aSummary ) const;
+    
     //! A vector sized for the predefined timers for fast lookup.
     std::vector<Timer> mPredefinedTimers;
     
     //! A map for named timers.
     std::map<std::string, Timer> mNamedTimers;
+    
+    //! Flag if hierarchical profiling is enabled.
+    bool mProfilingEnabled;
+    
+    //! Flag if activities should be included in the scope hierarchy.
+    bool mProfileActivities;
+    
+    //! The maximum number of trace events to keep for each thread.
+    size_t mMaxTraceEvents;
+    
+    //! The ticks when profiling was enabled which trace times are relative to.
+    uint64_t mEpochTicks;
+    
+    //! All of the profiled scope nodes.  A deque is used so that existing nodes
+    //! are not moved as new ones are added.
+    std::deque<ScopeNode> mScopeNodes;
+    
+    //! Lookup of scope nodes by parent and the timer or activity they time.
+    std::map<std::pair<int, const void*>, int> mScopeIndex;
+    
+    //! The ID of the main thread which drives the solver.
+    int mDriverThreadID;
+    
+    //! The innermost scope node currently open on the main thread.
+    std::atomic<int> mDriverNode;
+    
+    //! Counter used to assign each thread a sequential ID.
+    std::atomic<int> mThreadCount;
+    
+#if GCAM_PARALLEL_ENABLED
+    //! Mutex to guard creating named timers.
+    tbb::spin_mutex mNamedTimersMutex;
+    
+    //! Mutex to guard creating scope nodes.
+    tbb::spin_mutex mScopeMutex;
+    
+    //! The timing data for each thread.
+    tbb::enumerable_thread_specific<ThreadData> mThreadData;
+#else
+    //! The timing data for the single thread.
+    ThreadData mThreadData;
+#endif
 };
 
 #endif // _TIMER_H_
@@ -60,6 +60,7 @@
 #include <boost/type_traits/is_convertible.hpp>
 #include <boost/lexical_cast.hpp>
 #include <limits>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -358,6 +359,41 @@ namespace objects {
     std::string appendScenarioToFileName( const std::string& aFileName );
     
     std::string replaceSpaces( const std::string& aString );
+    
+    std::string escapeJSON( const std::string& aString );
+    
+    std::string getTempFileName( const std::string& aFileName );
+    
+    bool replaceFile( const std::string& aTempFileName, const std::string& aFileName );
+    
+    std::string getAbsolutePath( const std::string& aFileName );
+    
+    bool getFileStamp( const std::string& aFileName, uint64_t& aFileSize, int64_t& aModifiedTime );
+    
+    bool createParentDirectories( const std::string& aFileName );
+    
+    bool truncateFile( const std::string& aFileName, const uint64_t aFileSize );
+
+    //! The starting value of a 64-bit FNV-1a hash.
+    const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+
+    /*!
+     * \brief Add bytes to a 64-bit FNV-1a hash.
+     * \details FNV-1a is used rather than std::hash when the hash is written to
+     *          a file so that it is stable across platforms and standard library
+     *          implementations.  A hash should start from FNV_OFFSET_BASIS.
+     * \param aHash The hash to update.
+     * \param aData The bytes to add.
+     * \param aSize The number of bytes to add.
+     */
+    inline void hashBytes( uint64_t& aHash, const void* aData, const size_t aSize ) {
+        const uint64_t FNV_PRIME = 1099511628211ULL;
+        const unsigned char* bytes = static_cast<const unsigned char*>( aData );
+        for( size_t i = 0; i < aSize; ++i ) {
+            aHash ^= bytes[ i ];
+            aHash *= FNV_PRIME;
+        }
+    }
 
     /*! \brief Static function which returns SMALL_NUM. 
     * \details This is a static function which is used to find the value of the
@@ -0,0 +1,118 @@
+#ifndef _XML_INPUT_FILE_H_
+#define _XML_INPUT_FILE_H_
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*!
+ * \file xml_input_file.h
+ * \ingroup Objects
+ * \brief The XMLInputFile class header file.
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+/*!
+ * \ingroup Objects
+ * \brief Gives the contents of an XML input file as a null terminated buffer
+ *        suitable for rapidxml whether or not the file is compressed.
+ * \details Uncompressed files are memory mapped just as before.  Files which are
+ *          gzip or zstd compressed, detected from the first bytes of the file rather
+ *          than the file name, are decompressed by streaming into a buffer which is
+ *          kept for reuse by the next compressed file once this one is closed until
+ *          releaseBuffers is called when parsing is complete.
+ *          Support for each format must be compiled in with USE_ZLIB or USE_ZSTD,
+ *          otherwise opening such a file is an error.
+ *
+ *          If the compressedInputCache file configuration parameter is set to a
+ *          directory each decompressed file is also written there and then memory
+ *          mapped directly by later runs, so long as the size and modified time of
+ *          the compressed file recorded with it still match exactly.  This saves the decompression when the same inputs are run many
+ *          times from a local scratch disk.
+ *
+ *          Errors are reported by throwing std::ios_base::failure, as
+ *          boost::iostreams::mapped_file_source does.
+ */
+class XMLInputFile {
+public:
+    XMLInputFile();
+
+    ~XMLInputFile();
+
+    void open( const std::string& aFileName );
+
+    void close();
+
+    static void releaseBuffers();
+
+    /*!
+     * \brief Get the null terminated contents of the file.
+     * \return The contents of the open file.
+     */
+    char* data() const {
+        return mData;
+    }
+
+    /*!
+     * \brief Get the size of the contents of the file not including the terminating
+     *        null.
+     * \return The size of the open file.
+     */
+    std::size_t size() const {
+        return mSize;
+    }
+
+private:
+    //! The memory mapped file if it was not compressed or was found in the cache.
+    boost::iostreams::mapped_file_source mMappedFile;
+
+    //! The decompressed contents of the file if it had to be decompressed.
+    std::unique_ptr<std::vector<char> > mBuffer;
+
+    //! The contents of the file which points into either mMappedFile or mBuffer.
+    char* mData;
+
+    //! The size of the contents of the file.
+    std::size_t mSize;
+
+    void decompress( const std::string& aFileName, const char* aCompressed,
+                     const std::size_t aCompressedSize );
+};
+
+#endif // _XML_INPUT_FILE_H_
@@ -94,6 +94,7 @@ struct XMLParseHelper {
     
     // the top level call to start the parsing of XML for the various "root" classes
     static bool parseXML( const std::string& aXMLFile, Scenario* aRootElement );
+    static bool parseXML( const std::vector<std::string>& aXMLFiles, Scenario* aRootElement );
     static bool parseXML( const std::string& aXMLFile, IScenarioRunner* & aRootElement );
     static bool parseXML( const std::string& aXMLFile, LoggerFactoryWrapper* aRootElement );
     static bool parseXML( const std::string& aXMLFile, Configuration* aRootElement );
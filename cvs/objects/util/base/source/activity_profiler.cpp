@@ -0,0 +1,353 @@
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*! 
+* \file activity_profiler.cpp
+* \ingroup Objects
+* \brief ActivityProfiler class source file.
+*/
+
+#include "util/base/include/definitions.h"
+#include <iostream>
+#include <algorithm>
+#include "util/base/include/activity_profiler.h"
+#include "util/base/include/configuration.h"
+#include "util/base/include/util.h"
+#include "util/base/include/timer.h"
+#include "util/base/include/chrome_trace_writer.h"
+#include "containers/include/iactivity.h"
+#include "containers/include/market_dependency_finder.h"
+
+using namespace std;
+
+//! Constructor
+ActivityProfiler::ActivityProfiler():
+mThreadCount( 0 )
+{
+    reset();
+}
+
+/*!
+ * \brief Discard everything recorded so far and start a new profile.
+ * \details This is called as each scenario begins to run so that the report
+ *          and trace of a scenario in a batch only include it's own activities
+ *          and trace times are relative to it's start.  The settings are read
+ *          again from the Configuration as well.  This must not be called while
+ *          activities are being calculated.
+ */
+void ActivityProfiler::reset() {
+    const Configuration* conf = Configuration::getInstance();
+    mEnabled = conf->shouldWriteFile( "activityProfileTrace", false );
+    mMaxTraceEvents = max( conf->getInt( "activity-profile-max-events", 1000000, false ), 0 );
+    
+    mEpoch = Clock::now();
+    mThreadCount = 0;
+#if GCAM_PARALLEL_ENABLED
+    mThreadData.clear();
+#else
+    mThreadData = ThreadData();
+#endif
+}
+
+/*!
+ * \brief Get the single instance of the profiler.
+ * \details The profiler reads it's settings from the Configuration when it
+ *          is first created therefore it must not be accessed until after the
+ *          configuration has been parsed.
+ * \return The profiler.
+ */
+ActivityProfiler& ActivityProfiler::getInstance() {
+    static ActivityProfiler ACTIVITY_PROFILER;
+    return ACTIVITY_PROFILER;
+}
+
+/*!
+ * \brief Get the profiling data for the calling thread, assigning it an ID
+ *        the first time it is used.
+ * \return The profiling data for the current thread.
+ */
+ActivityProfiler::ThreadData& ActivityProfiler::getThreadData() {
+#if GCAM_PARALLEL_ENABLED
+    bool exists;
+    ThreadData& threadData = mThreadData.local( exists );
+#else
+    ThreadData& threadData = mThreadData;
+#endif
+    if( threadData.mThreadID == -1 ) {
+        threadData.mThreadID = mThreadCount++;
+    }
+    return threadData;
+}
+
+/*!
+ * \brief Calculate the given activity and record the time it took.
+ * \param aActivity The activity to calculate.
+ * \param aPeriod The model period to calculate.
+ */
+void ActivityProfiler::calc( IActivity* aActivity, const int aPeriod ) {
+    const Clock::time_point start = Clock::now();
+    aActivity->calc( aPeriod );
+    record( aActivity, start, Clock::now() );
+}
+
+/*!
+ * \brief Record a single calculation of an activity.
+ * \details This is safe to call concurrently as the data is kept in thread
+ *          local storage.  The time is also given to the TimerRegistry so that
+ *          it may include activities in it's profile.
+ * \param aActivity The activity which was calculated.
+ * \param aStart The time the calculation started.
+ * \param aEnd The time the calculation finished.
+ */
+void ActivityProfiler::record( const IActivity* aActivity, const Clock::time_point& aStart,
+                               const Clock::time_point& aEnd )
+{
+    ThreadData& threadData = getThreadData();
+    ActivityStats& stats = threadData.mStats[ aActivity ];
+    const double seconds = chrono::duration<double>( aEnd - aStart ).count();
+    stats.mTotalTime += seconds;
+    ++stats.mCount;
+    TimerRegistry::getInstance().recordActivity( aActivity, seconds );
+    
+    if( threadData.mTrace.size() < mMaxTraceEvents ) {
+        TraceEvent event;
+        event.mActivity = aActivity;
+        event.mStart = chrono::duration<double, micro>( aStart - mEpoch ).count();
+        event.mDuration = chrono::duration<double, micro>( aEnd - aStart ).count();
+        threadData.mTrace.push_back( event );
+    }
+}
+
+/*!
+ * \brief Combine the per-activity costs accumulated by all threads.
+ * \return The total cost of each activity.
+ */
+unordered_map<const IActivity*, ActivityProfiler::ActivityStats> ActivityProfiler::getCombinedStats() const {
+    unordered_map<const IActivity*, ActivityStats> combinedStats;
+#if GCAM_PARALLEL_ENABLED
+    for( const ThreadData& threadData : mThreadData ) {
+#else
+    {
+        const ThreadData& threadData = mThreadData;
+#endif
+        for( const auto& stats : threadData.mStats ) {
+            ActivityStats& combined = combinedStats[ stats.first ];
+            combined.mTotalTime += stats.second.mTotalTime;
+            combined.mCount += stats.second.mCount;
+        }
+    }
+    return combinedStats;
+}
+
+/*!
+ * \brief Print a summary of the profile including the critical path through
+ *        the dependency graph.
+ * \details The cost of each activity is taken as the mean time of a single
+ *          calculation.  The total work is then the sum of those costs and the
+ *          span is the most expensive path through the dependency graph, i.e.
+ *          the time a full model evaluation would take given unlimited threads
+ *          and no scheduling overhead.  The ratio work / span is therefore an
+ *          upper bound on the speedup parallel World::calc could achieve and the
+ *          activities on the critical path are the ones which must get cheaper to
+ *          raise it.
+ * \param aDependencyFinder The dependency finder which defines the graph of
+ *                          activities.
+ * \param aOut The stream to write the report to.
+ */
+void ActivityProfiler::printReport( const MarketDependencyFinder* aDependencyFinder, ostream& aOut ) const {
+    if( !mEnabled ) {
+        return;
+    }
+    
+    const unordered_map<const IActivity*, ActivityStats> combinedStats = getCombinedStats();
+    
+    // gather the vertices by UID so that we can walk the out edges
+    const vector<IActivity*> globalOrdering = aDependencyFinder->getOrdering();
+    vector<const MarketDependencyFinder::CalcVertex*> vertices( globalOrdering.size(), 0 );
+    for( MarketDependencyFinder::DependencyItem* item : aDependencyFinder->getDependencyItems() ) {
+        for( const MarketDependencyFinder::VertexList* vertexList : { &item->mPriceVertices, &item->mDemandVertices } ) {
+            for( const MarketDependencyFinder::CalcVertex* vertex : *vertexList ) {
+                if( vertex->mUID >= static_cast<int>( vertices.size() ) ) {
+                    vertices.resize( vertex->mUID + 1, 0 );
+                }
+                vertices[ vertex->mUID ] = vertex;
+            }
+        }
+    }
+    // UIDs which are not in use have no vertex and are skipped
+    unordered_map<const IActivity*, int> activityToUID;
+    activityToUID.reserve( vertices.size() );
+    for( const MarketDependencyFinder::CalcVertex* vertex : vertices ) {
+        if( vertex ) {
+            activityToUID[ vertex->mCalcItem ] = vertex->mUID;
+        }
+    }
+    
+    // the mean cost of each vertex and it's position in the global ordering
+    vector<double> cost( vertices.size(), 0.0 );
+    vector<int> position( vertices.size(), 0 );
+    double totalWork = 0.0;
+    for( size_t i = 0; i < globalOrdering.size(); ++i ) {
+        auto uidIter = activityToUID.find( globalOrdering[ i ] );
+        if( uidIter == activityToUID.end() ) {
+            continue;
+        }
+        const int uid = uidIter->second;
+        position[ uid ] = i;
+        auto statsIter = combinedStats.find( globalOrdering[ i ] );
+        if( statsIter != combinedStats.end() && statsIter->second.mCount > 0 ) {
+            cost[ uid ] = statsIter->second.mTotalTime / statsIter->second.mCount;
+        }
+        totalWork += cost[ uid ];
+    }
+    
+    // the global ordering is a topological sort so we can find the longest
+    // path with a single pass relaxing the out edges of each vertex
+    vector<double> startTime( vertices.size(), 0.0 );
+    vector<int> criticalPred( vertices.size(), -1 );
+    int criticalEnd = -1;
+    double span = 0.0;
+    for( IActivity* activity : globalOrdering ) {
+        auto uidIter = activityToUID.find( activity );
+        if( uidIter == activityToUID.end() ) {
+            continue;
+        }
+        const int uid = uidIter->second;
+        const double finishTime = startTime[ uid ] + cost[ uid ];
+        if( criticalEnd == -1 || finishTime > span ) {
+            span = finishTime;
+            criticalEnd = uid;
+        }
+        for( const MarketDependencyFinder::CalcVertex* outEdge : vertices[ uid ]->mOutEdges ) {
+            // edges which were broken to remove cycles point backwards in the
+            // ordering and are not part of the graph
+            if( position[ outEdge->mUID ] > position[ uid ] && finishTime > startTime[ outEdge->mUID ] ) {
+                startTime[ outEdge->mUID ] = finishTime;
+                criticalPred[ outEdge->mUID ] = uid;
+            }
+        }
+    }
+    vector<int> criticalPath;
+    for( int uid = criticalEnd; uid != -1; uid = criticalPred[ uid ] ) {
+        criticalPath.push_back( uid );
+    }
+    reverse( criticalPath.begin(), criticalPath.end() );
+    
+    aOut << "Activity profile of " << globalOrdering.size() << " activities using "
+         << mThreadCount << " threads." << endl;
+    aOut << "Total work per evaluation: " << totalWork * 1.0e6 << " usec" << endl;
+    aOut << "Critical path per evaluation: " << span * 1.0e6 << " usec" << endl;
+    if( span > 0.0 ) {
+        aOut << "Parallelism (work / critical path): " << totalWork / span << endl;
+    }
+    
+    aOut << "Critical path (" << criticalPath.size() << " activities):" << endl;
+    for( int uid : criticalPath ) {
+        aOut << "    " << cost[ uid ] * 1.0e6 << " usec "
+             << ( cost[ uid ] / span * 100.0 ) << "% "
+             << vertices[ uid ]->mCalcItem->getDescription() << endl;
+    }
+    
+    // the activities with the most total time are the next place to look
+    vector<pair<double, const IActivity*> > byTotalTime;
+    byTotalTime.reserve( combinedStats.size() );
+    for( const auto& stats : combinedStats ) {
+        byTotalTime.push_back( make_pair( stats.second.mTotalTime, stats.first ) );
+    }
+    const size_t numTop = min( byTotalTime.size(), static_cast<size_t>( 25 ) );
+    partial_sort( byTotalTime.begin(), byTotalTime.begin() + numTop, byTotalTime.end(),
+                  []( const pair<double, const IActivity*>& aLHS, const pair<double, const IActivity*>& aRHS ) {
+                      return aLHS.first > aRHS.first;
+                  } );
+    aOut << "Most expensive activities by total time:" << endl;
+    for( size_t i = 0; i < numTop; ++i ) {
+        const ActivityStats& stats = combinedStats.at( byTotalTime[ i ].second );
+        aOut << "    " << stats.mTotalTime << " sec over " << stats.mCount << " calcs "
+             << byTotalTime[ i ].second->getDescription() << endl;
+    }
+    
+    // busy time per thread to gauge load balance
+    aOut << "Busy time by thread:" << endl;
+#if GCAM_PARALLEL_ENABLED
+    for( const ThreadData& threadData : mThreadData ) {
+#else
+    {
+        const ThreadData& threadData = mThreadData;
+#endif
+        double busyTime = 0.0;
+        int numCalcs = 0;
+        for( const auto& stats : threadData.mStats ) {
+            busyTime += stats.second.mTotalTime;
+            numCalcs += stats.second.mCount;
+        }
+        aOut << "    thread " << threadData.mThreadID << ": " << busyTime << " sec over "
+             << numCalcs << " calcs" << endl;
+    }
+}
+
+/*!
+ * \brief Write the recorded events in the Chrome trace event format.
+ * \details Each calculation is written as a complete ("X") event on the thread
+ *          which calculated it using the ChromeTraceWriter.
+ * \param aOut The stream to write the trace to.
+ */
+void ActivityProfiler::writeTrace( ostream& aOut ) const {
+    if( !mEnabled ) {
+        return;
+    }
+    
+    // cache descriptions as they are generated on each call
+    unordered_map<const IActivity*, string> descriptions;
+    aOut << "{\"displayTimeUnit\":\"ms\",";
+    {
+        ChromeTraceWriter trace( aOut );
+#if GCAM_PARALLEL_ENABLED
+        for( const ThreadData& threadData : mThreadData ) {
+#else
+        {
+            const ThreadData& threadData = mThreadData;
+#endif
+            trace.writeThreadName( threadData.mThreadID );
+            for( const TraceEvent& event : threadData.mTrace ) {
+                auto descIter = descriptions.find( event.mActivity );
+                if( descIter == descriptions.end() ) {
+                    descIter = descriptions.insert( make_pair( event.mActivity,
+                        util::escapeJSON( event.mActivity->getDescription() ) ) ).first;
+                }
+                trace.writeEvent( descIter->second, "activity", event.mStart, event.mDuration,
+                                  threadData.mThreadID );
+            }
+        }
+    }
+    aOut << "}" << endl;
+}
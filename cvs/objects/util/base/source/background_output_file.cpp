@@ -0,0 +1,394 @@
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*!
+ * \file background_output_file.cpp
+ * \ingroup util
+ * \brief BackgroundOutputFile class source file.
+ */
+
+#include "util/base/include/definitions.h"
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <boost/iostreams/concepts.hpp>
+#include <boost/iostreams/device/null.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#if USE_ZLIB
+#include <zlib.h>
+#endif
+#if USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "util/base/include/background_output_file.h"
+#include "util/base/include/configuration.h"
+#include "util/base/include/util.h"
+#include "util/logger/include/ilogger.h"
+
+using namespace std;
+
+namespace {
+    //! The size at which a chunk is handed off to be written.
+    const size_t CHUNK_SIZE = 4 << 20;
+
+    /*!
+     * \brief Writes raw bytes to an open file, compressing them if needed.
+     */
+    class FileWriter {
+    public:
+        virtual ~FileWriter() {}
+
+        /*!
+         * \brief Write the given data.
+         * \return Whether the write was successful.
+         */
+        virtual bool write( const char* aData, const size_t aSize ) = 0;
+
+        /*!
+         * \brief Finish writing and close the file.
+         * \return Whether all data was written successfully.
+         */
+        virtual bool close() = 0;
+    };
+
+    //! Writes the data as is.
+    class PlainFileWriter : public FileWriter {
+    public:
+        explicit PlainFileWriter( FILE* aFile ):mFile( aFile ) {}
+
+        virtual bool write( const char* aData, const size_t aSize ) {
+            return fwrite( aData, 1, aSize, mFile ) == aSize;
+        }
+
+        virtual bool close() {
+            return fclose( mFile ) == 0;
+        }
+    private:
+        FILE* mFile;
+    };
+
+#if USE_ZLIB
+    //! Writes the data gzip compressed.
+    class GzipFileWriter : public FileWriter {
+    public:
+        explicit GzipFileWriter( gzFile aFile ):mFile( aFile ) {}
+
+        virtual bool write( const char* aData, const size_t aSize ) {
+            // gzwrite counts bytes with an unsigned int so write large data in pieces
+            const size_t maxChunk = 1 << 30;
+            for( size_t pos = 0; pos < aSize; pos += maxChunk ) {
+                const unsigned int size = static_cast<unsigned int>( min( aSize - pos, maxChunk ) );
+                if( gzwrite( mFile, aData + pos, size ) != static_cast<int>( size ) ) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        virtual bool close() {
+            return gzclose( mFile ) == Z_OK;
+        }
+    private:
+        gzFile mFile;
+    };
+#endif
+
+#if USE_ZSTD
+    //! Writes the data zstd compressed.
+    class ZstdFileWriter : public FileWriter {
+    public:
+        explicit ZstdFileWriter( FILE* aFile ):mFile( aFile ), mContext( ZSTD_createCCtx() ),
+            mOutBuffer( ZSTD_CStreamOutSize() ) {}
+
+        ~ZstdFileWriter() {
+            ZSTD_freeCCtx( mContext );
+        }
+
+        virtual bool write( const char* aData, const size_t aSize ) {
+            ZSTD_inBuffer in = { aData, aSize, 0 };
+            while( in.pos < in.size ) {
+                if( !compress( in, ZSTD_e_continue ) ) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        virtual bool close() {
+            ZSTD_inBuffer in = { 0, 0, 0 };
+            bool success = true;
+            size_t remaining = 1;
+            while( success && remaining != 0 ) {
+                success = compress( in, ZSTD_e_end, &remaining );
+            }
+            return fclose( mFile ) == 0 && success;
+        }
+    private:
+        FILE* mFile;
+        ZSTD_CCtx* mContext;
+        vector<char> mOutBuffer;
+
+        bool compress( ZSTD_inBuffer& aIn, const ZSTD_EndDirective aMode, size_t* aRemaining = 0 ) {
+            ZSTD_outBuffer out = { mOutBuffer.data(), mOutBuffer.size(), 0 };
+            const size_t ret = ZSTD_compressStream2( mContext, &out, &aIn, aMode );
+            if( ZSTD_isError( ret ) ) {
+                return false;
+            }
+            if( aRemaining ) {
+                *aRemaining = ret;
+            }
+            return fwrite( mOutBuffer.data(), 1, out.pos, mFile ) == out.pos;
+        }
+    };
+#endif
+
+    /*!
+     * \brief Open the given file with a writer for the compression given by its
+     *        extension.
+     * \return The writer or null if the file could not be opened.
+     */
+    unique_ptr<FileWriter> openFileWriter( const string& aFileName ) {
+        const bool isGzip = boost::algorithm::ends_with( aFileName, ".gz" );
+        const bool isZstd = boost::algorithm::ends_with( aFileName, ".zst" );
+#if USE_ZLIB
+        if( isGzip ) {
+            gzFile file = gzopen( aFileName.c_str(), "wb" );
+            return unique_ptr<FileWriter>( file ? new GzipFileWriter( file ) : 0 );
+        }
+#endif
+        FILE* file = fopen( aFileName.c_str(), "wb" );
+        if( !file ) {
+            return unique_ptr<FileWriter>();
+        }
+#if USE_ZSTD
+        if( isZstd ) {
+            return unique_ptr<FileWriter>( new ZstdFileWriter( file ) );
+        }
+#endif
+        if( ( isGzip && !USE_ZLIB ) || ( isZstd && !USE_ZSTD ) ) {
+            ILogger& mainLog = ILogger::getLogger( "main_log" );
+            mainLog.setLevel( ILogger::WARNING );
+            mainLog << "Compression for " << aFileName << " was not compiled in, writing it uncompressed." << endl;
+        }
+        return unique_ptr<FileWriter>( new PlainFileWriter( file ) );
+    }
+}
+
+/*!
+ * \brief The chunks of data waiting to be written and the file to write them to.
+ */
+struct BackgroundOutputFile::ChunkQueue {
+    //! The maximum number of bytes allowed to wait in the queue.
+    size_t mMaxQueuedBytes;
+
+    //! The number of bytes currently in the queue.
+    size_t mQueuedBytes;
+
+    //! The chunk currently being collected which is only used by the thread
+    //! writing to the stream.
+    string mCurrentChunk;
+
+    //! The chunks waiting to be written.
+    deque<string> mChunks;
+
+    //! Flag that no more chunks will be queued.
+    bool mIsDone;
+
+    //! Whether the chunks are written by a writer thread.
+    bool mInBackground;
+
+    //! The file to write to.
+    unique_ptr<FileWriter> mFile;
+
+    //! The name of the file for error messages.
+    string mFileName;
+
+    //! Flag if any write failed.
+    bool mHasError;
+
+    mutex mMutex;
+
+    //! Signaled when a chunk has been queued or mIsDone set.
+    condition_variable mHasChunk;
+
+    //! Signaled when queued chunks have been written.
+    condition_variable mHasSpace;
+
+    /*!
+     * \brief Hand off the current chunk to be written.
+     */
+    void submit() {
+        if( mCurrentChunk.empty() ) {
+            return;
+        }
+        if( !mInBackground ) {
+            mHasError |= !mFile->write( mCurrentChunk.data(), mCurrentChunk.size() );
+            mCurrentChunk.clear();
+            return;
+        }
+        unique_lock<mutex> lock( mMutex );
+        // Always let at least one chunk through so that we can not dead lock.
+        mHasSpace.wait( lock, [this] () {
+            return mQueuedBytes == 0 || mQueuedBytes + mCurrentChunk.size() <= mMaxQueuedBytes;
+        } );
+        mQueuedBytes += mCurrentChunk.size();
+        mChunks.push_back( std::move( mCurrentChunk ) );
+        mCurrentChunk = string();
+        mHasChunk.notify_one();
+    }
+
+    /*!
+     * \brief Write chunks as they are queued until mIsDone is set.
+     */
+    void runWriter() {
+        while( true ) {
+            string chunk;
+            {
+                unique_lock<mutex> lock( mMutex );
+                mHasChunk.wait( lock, [this] () { return mIsDone || !mChunks.empty(); } );
+                if( mChunks.empty() ) {
+                    return;
+                }
+                chunk = std::move( mChunks.front() );
+                mChunks.pop_front();
+            }
+            const bool success = mFile->write( chunk.data(), chunk.size() );
+            unique_lock<mutex> lock( mMutex );
+            mHasError |= !success;
+            mQueuedBytes -= chunk.size();
+            mHasSpace.notify_one();
+        }
+    }
+};
+
+/*!
+ * \brief A boost iostreams sink which collects the data into the current chunk.
+ */
+class BackgroundOutputFile::ChunkSink : public boost::iostreams::sink {
+public:
+    explicit ChunkSink( const shared_ptr<ChunkQueue>& aQueue ):mQueue( aQueue ) {}
+
+    streamsize write( const char* aData, streamsize aSize ) {
+        mQueue->mCurrentChunk.append( aData, aSize );
+        if( mQueue->mCurrentChunk.size() >= CHUNK_SIZE ) {
+            mQueue->submit();
+        }
+        return aSize;
+    }
+private:
+    shared_ptr<ChunkQueue> mQueue;
+};
+
+/*! \brief Open an output file with a name found from the Configuration.
+* \details The file name is found as in AutoOutputFile.
+* \param aConfVariableName Name of the configuration variable that stores
+*        the file name.
+* \param aDefaultName Filename to use if the variable is not found.
+* \param aShouldWriteOverride If we should not write the file even if the user
+*                             specified they want it.
+* \param aInBackground Whether to write the file on a background thread.
+*/
+BackgroundOutputFile::BackgroundOutputFile( const string& aConfVariableName,
+                                            const string& aDefaultName,
+                                            const bool aShouldWriteOverride,
+                                            const bool aInBackground )
+    :mShouldWrite( aShouldWriteOverride && Configuration::getInstance()->shouldWriteFile( aConfVariableName ) )
+{
+    if( !mShouldWrite ) {
+        mWrappedFile.push( boost::iostreams::null_sink() );
+        return;
+    }
+
+    const Configuration* conf = Configuration::getInstance();
+    string fileName = conf->getFile( aConfVariableName, aDefaultName );
+    if( conf->shouldAppendScnToFile( aConfVariableName ) ) {
+        fileName = util::appendScenarioToFileName( fileName );
+    }
+    mQueue.reset( new ChunkQueue() );
+    mQueue->mMaxQueuedBytes = 16 * CHUNK_SIZE;
+    mQueue->mQueuedBytes = 0;
+    mQueue->mIsDone = false;
+    mQueue->mInBackground = aInBackground;
+    mQueue->mFileName = fileName;
+    mQueue->mHasError = false;
+    mQueue->mFile = openFileWriter( fileName );
+    if( !mQueue->mFile ) {
+        cerr << "Severe Error: File " << fileName << " could not be opened." << endl;
+        abort();
+    }
+    mWrappedFile.push( ChunkSink( mQueue ) );
+    if( aInBackground ) {
+        mWriterThread = thread( &ChunkQueue::runWriter, mQueue.get() );
+    }
+}
+
+/*!
+ * \brief Destructor which writes any remaining data and closes the file.
+ * \details If writing in the background this waits for the writer thread to finish.
+ */
+BackgroundOutputFile::~BackgroundOutputFile() {
+    mWrappedFile.flush();
+    mWrappedFile.reset();
+    if( !mQueue ) {
+        return;
+    }
+    mQueue->submit();
+    if( mWriterThread.joinable() ) {
+        {
+            lock_guard<mutex> lock( mQueue->mMutex );
+            mQueue->mIsDone = true;
+        }
+        mQueue->mHasChunk.notify_one();
+        mWriterThread.join();
+    }
+    if( !mQueue->mFile->close() || mQueue->mHasError ) {
+        ILogger& mainLog = ILogger::getLogger( "main_log" );
+        mainLog.setLevel( ILogger::ERROR );
+        mainLog << "Failed to write " << mQueue->mFileName << endl;
+    }
+}
+
+/*!
+ * \brief Hand off everything written so far to be written to the file.
+ * \details This lets the writer thread get started without waiting for a full
+ *          chunk, for instance at the end of each model period.
+ */
+void BackgroundOutputFile::endChunk() {
+    mWrappedFile.flush();
+    if( mQueue ) {
+        mQueue->submit();
+    }
+}
@@ -0,0 +1,97 @@
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+/*! 
+* \file chrome_trace_writer.cpp
+* \ingroup Objects
+* \brief ChromeTraceWriter class source file.
+*/
+
+#include "util/base/include/definitions.h"
+#include <iostream>
+#include "util/base/include/chrome_trace_writer.h"
+
+using namespace std;
+
+/*!
+ * \brief Constructor which starts the "traceEvents" array.
+ * \param aOut The stream to write to.
+ */
+ChromeTraceWriter::ChromeTraceWriter( ostream& aOut ):
+mOut( aOut ),
+mOldFlags( aOut.flags() ),
+mOldPrecision( aOut.precision( 3 ) ),
+mIsFirst( true )
+{
+    // times in microseconds must not be written in scientific notation
+    mOut << fixed << "\"traceEvents\":[";
+}
+
+//! Destructor which ends the "traceEvents" array and restores the stream format.
+ChromeTraceWriter::~ChromeTraceWriter() {
+    mOut << endl << "]";
+    mOut.flags( mOldFlags );
+    mOut.precision( mOldPrecision );
+}
+
+/*!
+ * \brief Write a metadata event which labels a thread.
+ * \param aThreadID The thread ID used by the events of the thread.
+ */
+void ChromeTraceWriter::writeThreadName( const int aThreadID ) {
+    mOut << ( mIsFirst ? "" : "," ) << endl
+         << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << aThreadID
+         << ",\"args\":{\"name\":\"thread " << aThreadID << "\"}}";
+    mIsFirst = false;
+}
+
+/*!
+ * \brief Write a complete ("X") event.
+ * \param aName The name of the event which must already be escaped for JSON.
+ * \param aCategory The category of the event.
+ * \param aStart The start time in microseconds.
+ * \param aDuration The duration in microseconds.
+ * \param aThreadID The thread which the event occured on.
+ * \param aArgs The members of the JSON object of arguments or empty for none.
+ */
+void ChromeTraceWriter::writeEvent( const string& aName, const char* aCategory, const double aStart,
+                                    const double aDuration, const int aThreadID, const string& aArgs )
+{
+    mOut << ( mIsFirst ? "" : "," ) << endl
+         << "{\"name\":\"" << aName << "\",\"cat\":\"" << aCategory << "\",\"ph\":\"X\",\"ts\":"
+         << aStart << ",\"dur\":" << aDuration << ",\"pid\":0,\"tid\":" << aThreadID;
+    if( !aArgs.empty() ) {
+        mOut << ",\"args\":{" << aArgs << "}";
+    }
+    mOut << "}";
+    mIsFirst = false;
+}
@@ -43,6 +43,7 @@
 #include <string>
 #include <map>
 #include <iostream>
+#include <algorithm>
 #include "util/base/include/configuration.h"
 #include "util/base/include/xml_helper.h"
 #include "util/base/include/xml_parse_helper.h"
@@ -405,3 +406,18 @@ double Configuration::getDouble( const string& key, const double defaultValue, c
 const list<string>& Configuration::getScenarioComponents() const {
     return scenarioComponents;
 }
+
+/*!
+* \brief Set the scenario name to be post-pended to the filenames of all files
+*        except those given.
+* \details This is used when several scenarios run at the same time so that they
+*          do not overwrite each other's files.
+* \param aExcludedKeys Keys of the files which should be left as configured.
+*/
+void Configuration::appendScnToAllFilesExcept( const list<string>& aExcludedKeys ) {
+    for( map<string,string>::const_iterator fileIter = fileMap.begin(); fileIter != fileMap.end(); ++fileIter ) {
+        if( find( aExcludedKeys.begin(), aExcludedKeys.end(), fileIter->first ) == aExcludedKeys.end() ) {
+            mShouldAppendScnFileMap[ fileIter->first ] = true;
+        }
+    }
+}
@@ -64,6 +64,10 @@ extern Scenario* scenario;
 Value::CentralValueType Value::sCentralValue( (double*)0 );
 double* Value::sBaseCentralValue( 0 );
 
+#if GCAM_PARALLEL_ENABLED
+thread_local bool ManageStateVariables::sIsThreadStateShared = false;
+#endif
+
 #if GCAM_PARALLEL_ENABLED
 #define NUM_STATES tbb::global_control::active_value(tbb::global_control::max_allowed_parallelism)+1
 #else
@@ -276,6 +280,43 @@ void ManageStateVariables::copyState() {
 #endif
 }
 
+#if GCAM_PARALLEL_ENABLED
+/*!
+ * \brief Get the state the calling thread's STATE Values currently read from
+ *        and write to.
+ * \details During a partial derivative this is the "scratch" space assigned to
+ *          the calling thread.
+ * \return The calling thread's state.
+ */
+double* ManageStateVariables::getThreadState() {
+    return Value::sCentralValue.local();
+}
+
+/*!
+ * \brief Constructor which redirects the calling thread to the given state.
+ * \param aSharedState The state to use or null to leave the thread's state as is.
+ */
+ManageStateVariables::SharedStateScope::SharedStateScope( double* aSharedState ):
+mPrevState( 0 ),
+mPrevIsShared( sIsThreadStateShared )
+{
+    if( aSharedState ) {
+        double*& threadState = Value::sCentralValue.local();
+        mPrevState = threadState;
+        threadState = aSharedState;
+        sIsThreadStateShared = true;
+    }
+}
+
+//! Destructor which restores the calling thread's previous state.
+ManageStateVariables::SharedStateScope::~SharedStateScope() {
+    if( mPrevState ) {
+        Value::sCentralValue.local() = mPrevState;
+        sIsThreadStateShared = mPrevIsShared;
+    }
+}
+#endif
+
 /*!
  * \brief Set up the Value classes static references into mStateData to appropriately
  *        point to the "base" state if aIsPartialDeriv is false or a "scratch"
@@ -0,0 +1,335 @@
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*!
+ * \file region_index.cpp
+ * \ingroup Objects
+ * \brief RegionIndex class source file.
+ */
+
+#include "util/base/include/definitions.h"
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <functional>
+#include <boost/algorithm/string.hpp>
+
+#include "util/base/include/region_index.h"
+#include "util/base/include/configuration.h"
+#include "util/base/include/util.h"
+
+using namespace std;
+
+namespace {
+    //! Identifies a region index file and its version.
+    const string REGION_INDEX_HEADER = "GCAM-REGION-INDEX 1";
+
+    /*!
+     * \brief Find the given string starting from aPos.
+     * \return The offset of aStr or aSize if it was not found.
+     */
+    size_t findStr( const char* aData, const size_t aSize, const size_t aPos, const char* aStr ) {
+        const size_t strSize = strlen( aStr );
+        for( size_t pos = aPos; pos + strSize <= aSize; ++pos ) {
+            const char* next = static_cast<const char*>( memchr( aData + pos, aStr[ 0 ], aSize - pos ) );
+            if( !next ) {
+                break;
+            }
+            pos = next - aData;
+            if( pos + strSize <= aSize && memcmp( next, aStr, strSize ) == 0 ) {
+                return pos;
+            }
+        }
+        return aSize;
+    }
+
+    //! Check if the data at aPos starts with aStr.
+    bool startsWith( const char* aData, const size_t aSize, const size_t aPos, const char* aStr ) {
+        const size_t strSize = strlen( aStr );
+        return aPos + strSize <= aSize && memcmp( aData + aPos, aStr, strSize ) == 0;
+    }
+
+    bool isNameChar( const char aChar ) {
+        return !isspace( static_cast<unsigned char>( aChar ) ) && aChar != '/' && aChar != '>' && aChar != '=';
+    }
+}
+
+/*!
+ * \brief Get the regions set by the region-subset configuration parameter.
+ * \return The names of the regions to parse or an empty set to parse all regions.
+ */
+set<string> RegionIndex::getRegionSubset() {
+    const string& regionSubsetStr = Configuration::getInstance()->getString( "region-subset", "", false );
+    vector<string> regions;
+    boost::split( regions, regionSubsetStr, boost::is_any_of( "," ) );
+    set<string> regionSubset;
+    for( string& region : regions ) {
+        boost::trim( region );
+        if( !region.empty() ) {
+            regionSubset.insert( region );
+        }
+    }
+    return regionSubset;
+}
+
+/*!
+ * \brief Get the region index for the given file, reading it from the cache if
+ *        possible and otherwise building it and adding it to the cache.
+ * \param aFileName The scenario component file name.
+ * \param aData The contents of the file.
+ * \param aSize The size of the contents of the file.
+ * \return The index for the file.
+ */
+RegionIndex RegionIndex::getRegionIndex( const string& aFileName, const char* aData, const size_t aSize ) {
+    RegionIndex index;
+    const string& cacheDir = Configuration::getInstance()->getFile( "regionIndexCache", "", false );
+    uint64_t fileSize = 0;
+    int64_t modifiedTime = 0;
+    if( cacheDir.empty() || !util::getFileStamp( aFileName, fileSize, modifiedTime ) ) {
+        index.build( aData, aSize );
+        return index;
+    }
+
+    // Different input directories could have files of the same name so include
+    // a hash of the full path.
+    const string inputPath = util::getAbsolutePath( aFileName );
+    ostringstream indexFileName;
+    indexFileName << cacheDir << '/' << hex << setw( 16 ) << setfill( '0' ) << hash<string>()( inputPath )
+                  << '-' << inputPath.substr( inputPath.find_last_of( "/\\" ) + 1 ) << ".region-index";
+    if( !index.load( indexFileName.str(), aSize, modifiedTime ) ) {
+        index.build( aData, aSize );
+        index.save( indexFileName.str(), aSize, modifiedTime );
+    }
+    return index;
+}
+
+/*!
+ * \brief Copy the given file contents without any regions which are not in the
+ *        given subset.
+ * \param aRegionSubset The names of the regions to keep.
+ * \param aData The contents of the file this index was made from.
+ * \param aSize The size of the contents of the file.
+ * \param aFilteredData The null terminated file contents without the dropped regions.
+ * \param aNumSkipped Set to the number of regions which were dropped.
+ * \return True if any regions were dropped, otherwise aFilteredData was not set
+ *         and the original contents should be used.
+ */
+bool RegionIndex::filterRegions( const set<string>& aRegionSubset, const char* aData, const size_t aSize,
+                                 vector<char>& aFilteredData, unsigned int& aNumSkipped ) const
+{
+    aNumSkipped = 0;
+    for( const RegionRange& region : mRegions ) {
+        aNumSkipped += aRegionSubset.find( region.mName ) == aRegionSubset.end() ? 1 : 0;
+    }
+    if( aNumSkipped == 0 ) {
+        return false;
+    }
+
+    aFilteredData.clear();
+    aFilteredData.reserve( aSize + 1 );
+    size_t pos = 0;
+    for( const RegionRange& region : mRegions ) {
+        if( aRegionSubset.find( region.mName ) == aRegionSubset.end() ) {
+            aFilteredData.insert( aFilteredData.end(), aData + pos, aData + region.mBegin );
+            pos = region.mEnd;
+        }
+    }
+    aFilteredData.insert( aFilteredData.end(), aData + pos, aData + aSize );
+    aFilteredData.push_back( '\0' );
+    return true;
+}
+
+/*!
+ * \brief Find each region element which is a child of the world element which is
+ *        a child of the root element.
+ * \details This is a scan of the tags only, skipping over comments, CDATA,
+ *          processing instructions and quoted attribute values.  If the file is
+ *          not well formed the index is left empty so that the file will simply be
+ *          parsed in full and rapidxml can report the error.
+ * \param aData The contents of the file.
+ * \param aSize The size of the contents of the file.
+ */
+void RegionIndex::build( const char* aData, const size_t aSize ) {
+    mRegions.clear();
+    // the names of the open elements which we need to keep track of, the root and world
+    string openNames[ 2 ];
+    int depth = 0;
+    bool inRegion = false;
+    size_t pos = 0;
+    while( pos < aSize ) {
+        const char* next = static_cast<const char*>( memchr( aData + pos, '<', aSize - pos ) );
+        if( !next ) {
+            break;
+        }
+        const size_t tagBegin = next - aData;
+        size_t tagEnd = aSize;
+        if( startsWith( aData, aSize, tagBegin, "<!--" ) ) {
+            tagEnd = findStr( aData, aSize, tagBegin + 4, "-->" ) + 3;
+        }
+        else if( startsWith( aData, aSize, tagBegin, "<![CDATA[" ) ) {
+            tagEnd = findStr( aData, aSize, tagBegin + 9, "]]>" ) + 3;
+        }
+        else if( startsWith( aData, aSize, tagBegin, "<?" ) ) {
+            tagEnd = findStr( aData, aSize, tagBegin + 2, "?>" ) + 2;
+        }
+        else if( startsWith( aData, aSize, tagBegin, "<!" ) ) {
+            // a DOCTYPE which may have an internal subset in brackets
+            const size_t close = findStr( aData, aSize, tagBegin, ">" );
+            const size_t bracket = findStr( aData, aSize, tagBegin, "[" );
+            tagEnd = ( bracket < close ? findStr( aData, aSize, findStr( aData, aSize, bracket, "]" ), ">" ) : close ) + 1;
+        }
+        else if( startsWith( aData, aSize, tagBegin, "</" ) ) {
+            tagEnd = findStr( aData, aSize, tagBegin, ">" ) + 1;
+            --depth;
+            if( depth < 0 ) {
+                mRegions.clear();
+                return;
+            }
+            if( depth == 2 && inRegion ) {
+                mRegions.back().mEnd = tagEnd;
+                inRegion = false;
+            }
+        }
+        else {
+            // a start tag, find its name and skip over the attributes taking care
+            // that a quoted value may contain a '>'
+            size_t nameEnd = tagBegin + 1;
+            while( nameEnd < aSize && isNameChar( aData[ nameEnd ] ) ) {
+                ++nameEnd;
+            }
+            const string name( aData + tagBegin + 1, nameEnd - tagBegin - 1 );
+            string regionName;
+            size_t curr = nameEnd;
+            while( curr < aSize && aData[ curr ] != '>' ) {
+                if( aData[ curr ] == '"' || aData[ curr ] == '\'' ) {
+                    const char quote[] = { aData[ curr ], '\0' };
+                    const size_t valueEnd = findStr( aData, aSize, curr + 1, quote );
+                    // check if this was the value of the name attribute
+                    size_t attrEnd = curr;
+                    while( attrEnd > nameEnd && ( aData[ attrEnd - 1 ] == '=' || isspace( static_cast<unsigned char>( aData[ attrEnd - 1 ] ) ) ) ) {
+                        --attrEnd;
+                    }
+                    if( attrEnd - nameEnd >= 5 && memcmp( aData + attrEnd - 4, "name", 4 ) == 0
+                        && !isNameChar( aData[ attrEnd - 5 ] ) && valueEnd < aSize )
+                    {
+                        regionName.assign( aData + curr + 1, valueEnd - curr - 1 );
+                    }
+                    curr = valueEnd;
+                }
+                ++curr;
+            }
+            tagEnd = curr + 1;
+            const bool isEmptyElement = curr < aSize && aData[ curr - 1 ] == '/';
+            if( depth == 2 && !inRegion && name == "region" && openNames[ 1 ] == "world" ) {
+                RegionRange region;
+                region.mName = regionName;
+                region.mBegin = tagBegin;
+                region.mEnd = tagEnd;
+                mRegions.push_back( region );
+                inRegion = !isEmptyElement;
+            }
+            if( !isEmptyElement ) {
+                if( depth < 2 ) {
+                    openNames[ depth ] = name;
+                }
+                ++depth;
+            }
+        }
+        pos = tagEnd;
+    }
+
+    // the file did not end as expected
+    if( pos > aSize || depth != 0 || inRegion ) {
+        mRegions.clear();
+    }
+}
+
+/*!
+ * \brief Read a cached index if it was made from the file as it is now.
+ * \param aIndexFileName The cached index file.
+ * \param aFileSize The current size of the file.
+ * \param aModifiedTime The current modified time of the file.
+ * \return Whether the index could be read and is still valid.
+ */
+bool RegionIndex::load( const string& aIndexFileName, const uint64_t aFileSize, const int64_t aModifiedTime ) {
+    ifstream indexFile( aIndexFileName.c_str() );
+    string header;
+    uint64_t fileSize = 0;
+    int64_t modifiedTime = 0;
+    if( !getline( indexFile, header ) || header != REGION_INDEX_HEADER
+        || !( indexFile >> fileSize >> modifiedTime ) || fileSize != aFileSize || modifiedTime != aModifiedTime )
+    {
+        return false;
+    }
+    // each line is the begin and end offsets followed by the region name which may
+    // contain spaces
+    RegionRange region;
+    while( indexFile >> region.mBegin >> region.mEnd ) {
+        indexFile.get();
+        if( !getline( indexFile, region.mName ) || region.mEnd > aFileSize || region.mBegin >= region.mEnd ) {
+            mRegions.clear();
+            return false;
+        }
+        mRegions.push_back( region );
+    }
+    return indexFile.eof();
+}
+
+/*!
+ * \brief Write the index to the cache.
+ * \details The index is written to a temporary file which is then moved into place
+ *          so that a concurrent run never sees a partial file.  The cache is only
+ *          an optimization so failures are silently ignored.
+ * \param aIndexFileName The cached index file.
+ * \param aFileSize The size of the file the index was made from.
+ * \param aModifiedTime The modified time of the file the index was made from.
+ */
+void RegionIndex::save( const string& aIndexFileName, const uint64_t aFileSize, const int64_t aModifiedTime ) const {
+    const string tempFileName = util::getTempFileName( aIndexFileName );
+    util::createParentDirectories( aIndexFileName );
+    {
+        ofstream indexFile( tempFileName.c_str(), ios_base::out | ios_base::trunc );
+        indexFile << REGION_INDEX_HEADER << '\n' << aFileSize << ' ' << aModifiedTime << '\n';
+        for( const RegionRange& region : mRegions ) {
+            indexFile << region.mBegin << ' ' << region.mEnd << ' ' << region.mName << '\n';
+        }
+        if( !indexFile ) {
+            indexFile.close();
+            remove( tempFileName.c_str() );
+            return;
+        }
+    }
+    util::replaceFile( tempFileName, aIndexFileName );
+}
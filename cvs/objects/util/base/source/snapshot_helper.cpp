@@ -0,0 +1,1002 @@
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+*
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+*
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+*
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*!
+* \file snapshot_helper.cpp
+* \ingroup Objects
+* \brief SnapshotHelper class source file.
+*/
+
+#include "util/base/include/definitions.h"
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <typeinfo>
+#include <type_traits>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/mpl/for_each.hpp>
+#include <boost/mpl/front.hpp>
+
+#include "util/base/include/snapshot_helper.h"
+#include "util/base/include/xml_parse_helper.h"
+#include "util/base/include/gcam_data_containers.h"
+#include "util/base/include/data_definition_util.h"
+#include "util/base/include/expand_data_vector.h"
+#include "util/base/include/gcam_fusion.hpp"
+#include "util/base/include/tech_vector_parse_helper.h"
+#include "util/base/include/time_vector.h"
+#include "util/base/include/value.h"
+#include "util/base/include/configuration.h"
+#include "util/base/include/util.h"
+#include "util/logger/include/ilogger.h"
+
+using namespace std;
+
+bool SnapshotHelper::sIsRecording = false;
+
+namespace {
+    //! Identifies a GCAM snapshot file.
+    const char SNAPSHOT_MAGIC[ 8 ] = { 'G', 'C', 'A', 'M', 'S', 'N', 'A', 'P' };
+
+    //! Incremented whenever the layout of a snapshot file changes.  Changes to
+    //! the data definitions are caught by the layout hash of each container.
+    const uint32_t SNAPSHOT_FORMAT_VERSION = 2;
+
+    //! The configuration strings which change what gets parsed from the inputs.
+    const char* const PARSE_CONFIG_STRINGS[] = { "region-subset" };
+
+    //! Written after the Data of each CONTAINER to catch any mismatch in the layout.
+    const uint32_t CONTAINER_END_MARKER = 0x5EC7E4D5;
+
+    //! A copy of XML handled by AParsable::XMLParse.
+    struct RecordedXML {
+        //! The original parent node of the handled XML.
+        const rapidxml::xml_node<char>* mSourceParent;
+
+        //! A copy of the parent node holding copies of just the handled child nodes.
+        rapidxml::xml_node<char>* mCopy;
+    };
+
+    /*!
+     * \brief Get a hash of the names and types of the Data in a full data vector.
+     * \details This is written ahead of the Data of each container so that a
+     *          snapshot written before the data definitions of a class changed is
+     *          rejected rather than read into the wrong members.  Data names are
+     *          fixed by the data definitions so the hash is only calculated once for
+     *          each type of data vector.
+     * \param aDataVector The full data vector of a container.
+     * \return The hash of the layout of aDataVector.
+     */
+    template<typename DataVectorType>
+    uint64_t getLayoutHash( const DataVectorType& aDataVector ) {
+        static const uint64_t layoutHash = [&aDataVector] () {
+            uint64_t hash = util::FNV_OFFSET_BASIS;
+            boost::fusion::for_each( aDataVector, [&hash] ( const auto& aData ) {
+                const char* typeName = typeid( typename boost::remove_reference<decltype( aData )>::type::value_type ).name();
+                // include the terminating nulls to separate each name
+                util::hashBytes( hash, aData.mDataName, strlen( aData.mDataName ) + 1 );
+                util::hashBytes( hash, typeName, strlen( typeName ) + 1 );
+            } );
+            return hash;
+        }();
+        return layoutHash;
+    }
+
+    //! Memory for the copies of XML recorded while recording is on.
+    rapidxml::memory_pool<char> gRecordedXMLPool;
+
+    //! The XML recorded for each object while recording is on.
+    map<const AParsable*, vector<RecordedXML> > gRecordedXML;
+
+    /*!
+     * \brief Copy a node into aPool.
+     * \param aPool The memory pool to allocate the copy in.
+     * \param aNode The node to copy.
+     * \param aIncludeChildren Whether to also copy all child elements.
+     * \return The copy of aNode.
+     */
+    rapidxml::xml_node<char>* copyXMLNode( rapidxml::memory_pool<char>& aPool,
+                                           const rapidxml::xml_node<char>* aNode,
+                                           const bool aIncludeChildren )
+    {
+        rapidxml::xml_node<char>* copy = aPool.allocate_node( rapidxml::node_element,
+            aPool.allocate_string( aNode->name(), aNode->name_size() ),
+            aPool.allocate_string( aNode->value(), aNode->value_size() ),
+            aNode->name_size(), aNode->value_size() );
+        for( const rapidxml::xml_attribute<char>* attr = aNode->first_attribute(); attr; attr = attr->next_attribute() ) {
+            copy->append_attribute( aPool.allocate_attribute(
+                aPool.allocate_string( attr->name(), attr->name_size() ),
+                aPool.allocate_string( attr->value(), attr->value_size() ),
+                attr->name_size(), attr->value_size() ) );
+        }
+        for( const rapidxml::xml_node<char>* child = aIncludeChildren ? aNode->first_node() : 0; child; child = child->next_sibling() ) {
+            if( child->type() == rapidxml::node_element ) {
+                copy->append_node( copyXMLNode( aPool, child, true ) );
+            }
+        }
+        return copy;
+    }
+
+    /*!
+     * \brief Whether a SIMPLE or ARRAY Data type holds pointers to objects owned
+     *        elsewhere.
+     * \details Such references get set during completeInit, or by XMLParse when the
+     *          objects are owned, and so are not written to a snapshot.
+     */
+    template<typename T>
+    struct IsReference : public boost::is_pointer<T> {};
+
+    template<typename T>
+    struct IsReference<vector<T> > : public IsReference<T> {};
+
+    template<typename T>
+    struct IsReference<objects::PeriodVector<T> > : public IsReference<T> {};
+
+    template<typename K, typename V>
+    struct IsReference<map<K, V> > : public boost::mpl::or_<IsReference<K>, IsReference<V> > {};
+
+    /*!
+     * \brief Create a new instance of a member of SubClassFamilyVector.
+     * \details Abstract members of the family, or those which must be constructed
+     *          with arguments, can not be created this way and are skipped.
+     * \tparam SubClass The member of the family to create.
+     */
+    template<typename SubClass, typename Enable = void>
+    struct CreateIfConcrete {
+        static SubClass* create() {
+            return new SubClass;
+        }
+    };
+
+    template<typename SubClass>
+    struct CreateIfConcrete<SubClass, typename boost::disable_if<std::is_default_constructible<SubClass> >::type> {
+        static SubClass* create() {
+            return 0;
+        }
+    };
+
+    /*!
+     * \brief Create a new instance of the member of SubClassFamilyVector at the given
+     *        position.
+     * \param aSubClassIndex The position in SubClassFamilyVector to create.
+     * \return The new instance as the base of the family or null if it could not be
+     *         created.
+     */
+    template<typename SubClassFamilyVector>
+    typename boost::mpl::front<SubClassFamilyVector>::type* createSubClass( const int aSubClassIndex ) {
+        typename boost::mpl::front<SubClassFamilyVector>::type* ret = 0;
+        int index = 0;
+        boost::mpl::for_each<SubClassFamilyVector, boost::add_pointer<boost::mpl::_> >( [&] ( auto aTypePtr ) {
+            if( index++ == aSubClassIndex ) {
+                ret = CreateIfConcrete<typename boost::remove_pointer<decltype( aTypePtr )>::type>::create();
+            }
+        } );
+        return ret;
+    }
+
+    /*!
+     * \brief Get the position of the actual type of an instance in SubClassFamilyVector.
+     * \param aContainer The instance to check.
+     * \param aIsExactType Set to whether the position refers to the exact type of
+     *                     aContainer and not just the closest member of the family.
+     * \return The position in SubClassFamilyVector.
+     */
+    template<typename ContainerType>
+    int getSubClassIndex( ContainerType* aContainer, bool& aIsExactType ) {
+        ExpandDataVector<typename ContainerType::SubClassFamilyVector> getDataVector;
+        aContainer->doDataExpansion( getDataVector );
+        int subClassIndex = -1;
+        getDataVector.getSubClass( [&] ( const int aIndex, auto aSubClass ) {
+            subClassIndex = aIndex;
+            aIsExactType = typeid( *aSubClass ) == typeid( typename boost::remove_pointer<decltype( aSubClass )>::type );
+        } );
+        return subClassIndex;
+    }
+
+    /*!
+     * \brief Writes the Data of a Scenario to a binary stream.
+     * \details Values are written in the native byte order and are only meant to be
+     *          read back by the same build on the same machine.
+     */
+    class SnapshotWriter {
+    public:
+        SnapshotWriter( ostream& aOut ):mOut( aOut ), mIsValid( true ) {}
+
+        //! Whether everything has been written and may be read back.
+        bool isValid() const {
+            return mIsValid && mOut.good();
+        }
+
+        template<typename ContainerType>
+        void writeContainer( ContainerType* aContainer ) {
+            if( !aContainer ) {
+                writeValue( int32_t( -1 ) );
+                return;
+            }
+
+            bool isExactType = true;
+            const int32_t subClassIndex = getSubClassIndex( aContainer, isExactType );
+            if( !isExactType ) {
+                // The reader would create the wrong type.
+                ILogger& mainLog = ILogger::getLogger( "main_log" );
+                mainLog.setLevel( ILogger::WARNING );
+                mainLog << "Can not snapshot " << typeid( *aContainer ).name()
+                        << " as it is not listed in its subclass family." << endl;
+                mIsValid = false;
+            }
+            writeValue( subClassIndex );
+
+            // XML handled by XMLParse if any was recorded for this object.
+            const AParsable* parsable = dynamic_cast<const AParsable*>( aContainer );
+            auto recordedIter = parsable ? gRecordedXML.find( parsable ) : gRecordedXML.end();
+            const uint32_t numRecorded = recordedIter != gRecordedXML.end() ? (*recordedIter).second.size() : 0;
+            writeValue( numRecorded );
+            for( uint32_t i = 0; i < numRecorded; ++i ) {
+                writeXMLNode( (*recordedIter).second[ i ].mCopy );
+            }
+
+            ExpandDataVector<typename ContainerType::SubClassFamilyVector> getDataVector;
+            aContainer->doDataExpansion( getDataVector );
+            getDataVector.getFullDataVector( *this );
+            writeValue( CONTAINER_END_MARKER );
+        }
+
+        template<typename DataVectorType>
+        void processDataVector( DataVectorType aDataVector ) {
+            writeValue( getLayoutHash( aDataVector ) );
+            boost::fusion::for_each( aDataVector, [this] ( auto& aData ) {
+                this->writeData( aData );
+            } );
+        }
+
+        //! Plain values such as numbers, enums and simple structs are written as is.
+        template<typename T>
+        typename boost::enable_if<boost::mpl::and_<std::is_trivially_copyable<T>, boost::mpl::not_<boost::is_pointer<T> > > >::type
+        writeValue( const T& aValue ) {
+            mOut.write( reinterpret_cast<const char*>( &aValue ), sizeof( T ) );
+        }
+
+        void writeValue( const string& aValue ) {
+            writeValue( uint64_t( aValue.size() ) );
+            mOut.write( aValue.data(), aValue.size() );
+        }
+
+        void writeValue( const Value& aValue ) {
+            writeValue( aValue.isInited() );
+            if( aValue.isInited() ) {
+                writeValue( aValue.get() );
+            }
+        }
+
+        template<typename T>
+        void writeValue( const vector<T>& aValue ) {
+            writeValue( uint64_t( aValue.size() ) );
+            for( auto iter = aValue.begin(); iter != aValue.end(); ++iter ) {
+                // copy out to also handle vector<bool>
+                const T value = *iter;
+                writeValue( value );
+            }
+        }
+
+        template<typename K, typename V>
+        void writeValue( const map<K, V>& aValue ) {
+            writeValue( uint64_t( aValue.size() ) );
+            for( auto iter = aValue.begin(); iter != aValue.end(); ++iter ) {
+                writeValue( (*iter).first );
+                writeValue( (*iter).second );
+            }
+        }
+
+        template<typename F, typename S>
+        void writeValue( const pair<F, S>& aValue ) {
+            writeValue( aValue.first );
+            writeValue( aValue.second );
+        }
+
+        template<typename T>
+        void writeValue( const objects::PeriodVector<T>& aValue ) {
+            writeValue( uint64_t( aValue.size() ) );
+            for( auto iter = aValue.begin(); iter != aValue.end(); ++iter ) {
+                writeValue( *iter );
+            }
+        }
+
+        template<typename T>
+        void writeValue( const objects::YearVector<T>& aValue ) {
+            writeValue( aValue.getStartYear() );
+            writeValue( aValue.getEndYear() );
+            for( auto iter = aValue.begin(); iter != aValue.end(); ++iter ) {
+                writeValue( *iter );
+            }
+        }
+
+        template<typename T>
+        void writeValue( const objects::TechVintageVector<T>& aValue ) {
+            const bool isInitialized = TechVectorParseHelper<T>::isInitialized( aValue );
+            writeValue( isInitialized );
+            if( isInitialized ) {
+                writeValue( aValue.getStartPeriod() );
+                writeValue( aValue.size() );
+                for( auto iter = aValue.begin(); iter != aValue.end(); ++iter ) {
+                    writeValue( *iter );
+                }
+            }
+            else {
+                // Any values set during parsing are held by TechVectorParseHelper.
+                const TechVectorParseHelper<T>* parseHelper = boost::fusion::at_key<T>( sTechVectorParseHelperMap );
+                const objects::PeriodVector<T>* tempStore = parseHelper ? parseHelper->findPeriodVector( aValue ) : 0;
+                writeValue( tempStore != 0 );
+                if( tempStore ) {
+                    writeValue( *tempStore );
+                }
+            }
+        }
+
+    private:
+        //! The stream to write to.
+        ostream& mOut;
+
+        //! If any object could not be written.
+        bool mIsValid;
+
+        void writeXMLNode( const rapidxml::xml_node<char>* aNode ) {
+            writeValue( string( aNode->name(), aNode->name_size() ) );
+            writeValue( string( aNode->value(), aNode->value_size() ) );
+            uint32_t numAttrs = 0;
+            for( const rapidxml::xml_attribute<char>* attr = aNode->first_attribute(); attr; attr = attr->next_attribute() ) {
+                ++numAttrs;
+            }
+            writeValue( numAttrs );
+            for( const rapidxml::xml_attribute<char>* attr = aNode->first_attribute(); attr; attr = attr->next_attribute() ) {
+                writeValue( string( attr->name(), attr->name_size() ) );
+                writeValue( string( attr->value(), attr->value_size() ) );
+            }
+            uint32_t numChildren = 0;
+            for( const rapidxml::xml_node<char>* child = aNode->first_node(); child; child = child->next_sibling() ) {
+                ++numChildren;
+            }
+            writeValue( numChildren );
+            for( const rapidxml::xml_node<char>* child = aNode->first_node(); child; child = child->next_sibling() ) {
+                writeXMLNode( child );
+            }
+        }
+
+        //! References are not written, see IsReference.
+        template<typename DataType>
+        typename boost::enable_if<boost::mpl::and_<
+            boost::mpl::not_<typename CheckDataFlagHelper<DataType>::is_container>,
+            IsReference<typename DataType::value_type> > >::type
+        writeData( DataType& aData ) {
+        }
+
+        template<typename DataType>
+        typename boost::enable_if<boost::mpl::and_<
+            boost::mpl::not_<typename CheckDataFlagHelper<DataType>::is_container>,
+            boost::mpl::not_<IsReference<typename DataType::value_type> > > >::type
+        writeData( DataType& aData ) {
+            writeValue( aData.mData );
+        }
+
+        template<typename DataType>
+        typename boost::enable_if<typename CheckDataFlagHelper<DataType>::is_container>::type
+        writeData( DataType& aData ) {
+            writeContainers( aData.mData );
+        }
+
+        template<typename T>
+        void writeContainers( T* aContainer ) {
+            writeContainer( aContainer );
+        }
+
+        template<typename T>
+        void writeContainers( const vector<T*>& aContainers ) {
+            writeValue( uint64_t( aContainers.size() ) );
+            for( auto container : aContainers ) {
+                writeContainer( container );
+            }
+        }
+
+        template<typename K, typename T>
+        void writeContainers( const map<K, T*>& aContainers ) {
+            writeValue( uint64_t( aContainers.size() ) );
+            for( auto entry : aContainers ) {
+                writeValue( entry.first );
+                writeContainer( entry.second );
+            }
+        }
+
+        template<typename T>
+        void writeContainers( const objects::PeriodVector<T*>& aContainers ) {
+            writeValue( uint64_t( aContainers.size() ) );
+            for( auto container : aContainers ) {
+                writeContainer( container );
+            }
+        }
+    };
+
+    /*!
+     * \brief Reads the Data of a Scenario back from a binary stream written by
+     *        SnapshotWriter.
+     * \details Existing objects are reused where they are of the same type as what
+     *          was written, otherwise they are replaced with new instances.  Reading
+     *          stops at the first inconsistency found.
+     */
+    class SnapshotReader {
+    public:
+        SnapshotReader( istream& aIn ):mIn( aIn ), mIsValid( true ) {}
+
+        //! Whether everything read so far was consistent.
+        bool isValid() const {
+            return mIsValid && mIn.good();
+        }
+
+        //! Flag the snapshot as unusable and stop reading.
+        void fail( const string& aReason ) {
+            if( mIsValid ) {
+                ILogger& mainLog = ILogger::getLogger( "main_log" );
+                mainLog.setLevel( ILogger::ERROR );
+                mainLog << "Failed to read snapshot: " << aReason << endl;
+            }
+            mIsValid = false;
+        }
+
+        /*!
+         * \brief Read a CONTAINER into aContainer.
+         * \param aContainer The existing object if any, which may get replaced.
+         * \return The object read which may be null.
+         */
+        template<typename ContainerType>
+        ContainerType* readContainer( ContainerType* aContainer ) {
+            int32_t subClassIndex = -1;
+            readValue( subClassIndex );
+            if( !isValid() || subClassIndex < 0 ) {
+                delete aContainer;
+                return 0;
+            }
+            bool isExactType = true;
+            if( aContainer && getSubClassIndex( aContainer, isExactType ) != subClassIndex ) {
+                delete aContainer;
+                aContainer = 0;
+            }
+            if( !aContainer ) {
+                auto newContainer = createSubClass<typename ContainerType::SubClassFamilyVector>( subClassIndex );
+                aContainer = dynamic_cast<ContainerType*>( newContainer );
+                if( !aContainer ) {
+                    delete newContainer;
+                    fail( "could not create a container" );
+                    return 0;
+                }
+            }
+            readContainerData( aContainer );
+            return aContainer;
+        }
+
+        /*!
+         * \brief Read a CONTAINER which must be of the same type as aContainer.
+         * \param aContainer The object to read into.
+         */
+        template<typename ContainerType>
+        void readRootContainer( ContainerType* aContainer ) {
+            int32_t subClassIndex = -1;
+            readValue( subClassIndex );
+            bool isExactType = true;
+            if( getSubClassIndex( aContainer, isExactType ) != subClassIndex ) {
+                fail( "unexpected root container" );
+            }
+            else {
+                readContainerData( aContainer );
+            }
+        }
+
+        template<typename DataVectorType>
+        void processDataVector( DataVectorType aDataVector ) {
+            uint64_t layoutHash = 0;
+            readValue( layoutHash );
+            if( isValid() && layoutHash != getLayoutHash( aDataVector ) ) {
+                fail( "the data definitions have changed since it was written" );
+            }
+            boost::fusion::for_each( aDataVector, [this] ( auto& aData ) {
+                this->readData( aData );
+            } );
+        }
+
+        template<typename T>
+        typename boost::enable_if<boost::mpl::and_<std::is_trivially_copyable<T>, boost::mpl::not_<boost::is_pointer<T> > > >::type
+        readValue( T& aValue ) {
+            mIn.read( reinterpret_cast<char*>( &aValue ), sizeof( T ) );
+        }
+
+        void readValue( string& aValue ) {
+            uint64_t size = 0;
+            readValue( size );
+            if( isValid() ) {
+                aValue.resize( size );
+                mIn.read( &aValue[ 0 ], size );
+            }
+        }
+
+        void readValue( Value& aValue ) {
+            bool isInited = false;
+            readValue( isInited );
+            if( isInited ) {
+                double value = 0;
+                readValue( value );
+                aValue = value;
+            }
+        }
+
+        template<typename T>
+        void readValue( vector<T>& aValue ) {
+            uint64_t size = 0;
+            readValue( size );
+            aValue.clear();
+            for( uint64_t i = 0; i < size && isValid(); ++i ) {
+                T value;
+                readValue( value );
+                aValue.push_back( value );
+            }
+        }
+
+        template<typename K, typename V>
+        void readValue( map<K, V>& aValue ) {
+            uint64_t size = 0;
+            readValue( size );
+            aValue.clear();
+            for( uint64_t i = 0; i < size && isValid(); ++i ) {
+                K key;
+                readValue( key );
+                readValue( aValue[ key ] );
+            }
+        }
+
+        template<typename F, typename S>
+        void readValue( pair<F, S>& aValue ) {
+            readValue( aValue.first );
+            readValue( aValue.second );
+        }
+
+        template<typename T>
+        void readValue( objects::PeriodVector<T>& aValue ) {
+            uint64_t size = 0;
+            readValue( size );
+            if( size != aValue.size() ) {
+                fail( "the number of model periods has changed" );
+                return;
+            }
+            for( auto iter = aValue.begin(); iter != aValue.end(); ++iter ) {
+                readValue( *iter );
+            }
+        }
+
+        template<typename T>
+        void readValue( objects::YearVector<T>& aValue ) {
+            unsigned int startYear = 0;
+            unsigned int endYear = 0;
+            readValue( startYear );
+            readValue( endYear );
+            if( !isValid() ) {
+                return;
+            }
+            if( startYear != aValue.getStartYear() || endYear != aValue.getEndYear() ) {
+                aValue = objects::YearVector<T>( startYear, endYear );
+            }
+            for( auto iter = aValue.begin(); iter != aValue.end(); ++iter ) {
+                readValue( *iter );
+            }
+        }
+
+        template<typename T>
+        void readValue( objects::TechVintageVector<T>& aValue ) {
+            bool isInitialized = false;
+            readValue( isInitialized );
+            if( isInitialized ) {
+                unsigned int startPeriod = 0;
+                unsigned int size = 0;
+                readValue( startPeriod );
+                readValue( size );
+                if( !isValid() ) {
+                    return;
+                }
+                TechVectorParseHelper<T>::initializeVector( startPeriod, size, aValue );
+                if( aValue.getStartPeriod() != startPeriod || aValue.size() != size ) {
+                    fail( "unexpected technology vintage vector" );
+                    return;
+                }
+                for( auto iter = aValue.begin(); iter != aValue.end(); ++iter ) {
+                    readValue( *iter );
+                }
+            }
+            else {
+                bool hasTempStore = false;
+                readValue( hasTempStore );
+                TechVectorParseHelper<T>* parseHelper = boost::fusion::at_key<T>( sTechVectorParseHelperMap );
+                if( hasTempStore && !parseHelper ) {
+                    fail( "the parser has not been initialized" );
+                }
+                else if( hasTempStore ) {
+                    readValue( parseHelper->getPeriodVector( aValue ) );
+                }
+            }
+        }
+
+    private:
+        //! The stream to read from.
+        istream& mIn;
+
+        //! If everything read so far was consistent.
+        bool mIsValid;
+
+        //! Memory for the XML read to give to XMLParse.
+        rapidxml::memory_pool<char> mXMLPool;
+
+        /*!
+         * \brief Read recorded XML and give it to the XMLParse of aContainer
+         *        followed by the Data of aContainer.
+         * \param aContainer The object to read into.
+         */
+        template<typename ContainerType>
+        void readContainerData( ContainerType* aContainer ) {
+            uint32_t numRecorded = 0;
+            readValue( numRecorded );
+            AParsable* parsable = dynamic_cast<AParsable*>( aContainer );
+            for( uint32_t i = 0; i < numRecorded && isValid(); ++i ) {
+                rapidxml::xml_node<char>* parent = readXMLNode();
+                if( !parsable ) {
+                    fail( "XML recorded for an object which can not parse it" );
+                    return;
+                }
+                for( rapidxml::xml_node<char>* child = parent->first_node(); child && isValid(); ) {
+                    parsable->XMLParse( child );
+                    // XMLParse may have consumed the rest of the siblings
+                    if( child ) {
+                        child = child->next_sibling();
+                    }
+                }
+            }
+
+            ExpandDataVector<typename ContainerType::SubClassFamilyVector> getDataVector;
+            aContainer->doDataExpansion( getDataVector );
+            getDataVector.getFullDataVector( *this );
+
+            uint32_t endMarker = 0;
+            readValue( endMarker );
+            if( endMarker != CONTAINER_END_MARKER ) {
+                fail( "the layout of a container did not match" );
+            }
+        }
+
+        rapidxml::xml_node<char>* readXMLNode() {
+            string name;
+            string value;
+            readValue( name );
+            readValue( value );
+            rapidxml::xml_node<char>* node = mXMLPool.allocate_node( rapidxml::node_element,
+                mXMLPool.allocate_string( name.c_str(), name.size() + 1 ),
+                mXMLPool.allocate_string( value.c_str(), value.size() + 1 ),
+                name.size(), value.size() );
+            uint32_t numAttrs = 0;
+            readValue( numAttrs );
+            for( uint32_t i = 0; i < numAttrs && isValid(); ++i ) {
+                readValue( name );
+                readValue( value );
+                node->append_attribute( mXMLPool.allocate_attribute(
+                    mXMLPool.allocate_string( name.c_str(), name.size() + 1 ),
+                    mXMLPool.allocate_string( value.c_str(), value.size() + 1 ),
+                    name.size(), value.size() ) );
+            }
+            uint32_t numChildren = 0;
+            readValue( numChildren );
+            for( uint32_t i = 0; i < numChildren && isValid(); ++i ) {
+                node->append_node( readXMLNode() );
+            }
+            return node;
+        }
+
+        template<typename DataType>
+        typename boost::enable_if<boost::mpl::and_<
+            boost::mpl::not_<typename CheckDataFlagHelper<DataType>::is_container>,
+            IsReference<typename DataType::value_type> > >::type
+        readData( DataType& aData ) {
+        }
+
+        template<typename DataType>
+        typename boost::enable_if<boost::mpl::and_<
+            boost::mpl::not_<typename CheckDataFlagHelper<DataType>::is_container>,
+            boost::mpl::not_<IsReference<typename DataType::value_type> > > >::type
+        readData( DataType& aData ) {
+            if( isValid() ) {
+                readValue( aData.mData );
+            }
+        }
+
+        template<typename DataType>
+        typename boost::enable_if<typename CheckDataFlagHelper<DataType>::is_container>::type
+        readData( DataType& aData ) {
+            if( isValid() ) {
+                readContainers( aData.mData );
+            }
+        }
+
+        template<typename T>
+        void readContainers( T*& aContainer ) {
+            aContainer = readContainer( aContainer );
+        }
+
+        template<typename T>
+        void readContainers( vector<T*>& aContainers ) {
+            uint64_t size = 0;
+            readValue( size );
+            if( !isValid() ) {
+                return;
+            }
+            for( size_t i = size; i < aContainers.size(); ++i ) {
+                delete aContainers[ i ];
+            }
+            aContainers.resize( size, 0 );
+            for( auto iter = aContainers.begin(); iter != aContainers.end(); ++iter ) {
+                *iter = readContainer( *iter );
+            }
+        }
+
+        template<typename K, typename T>
+        void readContainers( map<K, T*>& aContainers ) {
+            uint64_t size = 0;
+            readValue( size );
+            map<K, T*> containers;
+            for( uint64_t i = 0; i < size && isValid(); ++i ) {
+                K key;
+                readValue( key );
+                T* container = 0;
+                auto iter = aContainers.find( key );
+                if( iter != aContainers.end() ) {
+                    container = (*iter).second;
+                    aContainers.erase( iter );
+                }
+                containers[ key ] = readContainer( container );
+            }
+            for( auto entry : aContainers ) {
+                delete entry.second;
+            }
+            aContainers.swap( containers );
+        }
+
+        template<typename T>
+        void readContainers( objects::PeriodVector<T*>& aContainers ) {
+            uint64_t size = 0;
+            readValue( size );
+            if( size != aContainers.size() ) {
+                fail( "the number of model periods has changed" );
+                return;
+            }
+            for( auto iter = aContainers.begin(); iter != aContainers.end(); ++iter ) {
+                *iter = readContainer( *iter );
+            }
+        }
+    };
+}
+
+/*!
+ * \brief Calculate a hash of the given input files and the configuration which
+ *        decides what gets parsed from them.
+ * \details The hash includes the name and full contents of each file in the order
+ *          given, which covers the scenario components, as well as the value of
+ *          each configuration string in PARSE_CONFIG_STRINGS so that a snapshot can
+ *          be checked against the inputs it was made from.
+ * \param aXMLFiles The input files in the order they are parsed.
+ * \return A 64-bit FNV-1a hash of the inputs.
+ */
+uint64_t SnapshotHelper::calcInputHash( const vector<string>& aXMLFiles ) {
+    uint64_t hash = util::FNV_OFFSET_BASIS;
+    const Configuration* conf = Configuration::getInstance();
+    for( const char* configName : PARSE_CONFIG_STRINGS ) {
+        const string configValue = string( configName ) + "=" + conf->getString( configName, "", false );
+        util::hashBytes( hash, configValue.c_str(), configValue.size() + 1 );
+    }
+    for( const string& fileName : aXMLFiles ) {
+        // include the terminating null to separate the file name from its contents
+        util::hashBytes( hash, fileName.c_str(), fileName.size() + 1 );
+        try {
+            boost::iostreams::mapped_file_source xmlFile( fileName.c_str() );
+            util::hashBytes( hash, xmlFile.data(), xmlFile.size() );
+        }
+        catch( std::ios_base::failure& ) {
+            // A file that can not be read will be reported when it gets parsed,
+            // just make sure it does not hash the same as an empty file.
+            const char missing[] = "missing";
+            util::hashBytes( hash, missing, sizeof( missing ) );
+        }
+    }
+    return hash;
+}
+
+/*!
+ * \brief Write a snapshot of a Scenario that has just been parsed.
+ * \details XML recorded since startRecording is included.  The snapshot is written
+ *          to a temporary file first and then moved into place so that a partially
+ *          written snapshot is never picked up.
+ * \param aFileName The snapshot file to write.
+ * \param aInputHash The hash of the inputs aScenario was parsed from.
+ * \param aScenario The parsed Scenario.
+ * \return Whether the snapshot was written.
+ */
+bool SnapshotHelper::writeSnapshot( const string& aFileName, const uint64_t aInputHash,
+                                    Scenario* aScenario )
+{
+    ILogger& mainLog = ILogger::getLogger( "main_log" );
+    const string tempFileName = aFileName + ".tmp";
+    ofstream out( tempFileName.c_str(), ios_base::out | ios_base::binary | ios_base::trunc );
+    if( !out.is_open() ) {
+        mainLog.setLevel( ILogger::WARNING );
+        mainLog << "Could not open " << tempFileName << " to write the input snapshot." << endl;
+        return false;
+    }
+
+    SnapshotWriter writer( out );
+    out.write( SNAPSHOT_MAGIC, sizeof( SNAPSHOT_MAGIC ) );
+    writer.writeValue( SNAPSHOT_FORMAT_VERSION );
+    writer.writeValue( aInputHash );
+    writer.writeContainer( aScenario );
+    out.close();
+
+    if( !writer.isValid() || out.fail() ) {
+        mainLog.setLevel( ILogger::WARNING );
+        mainLog << "Could not write the input snapshot " << aFileName << "." << endl;
+        remove( tempFileName.c_str() );
+        return false;
+    }
+    // rename will not replace an existing file on all platforms
+    remove( aFileName.c_str() );
+    if( rename( tempFileName.c_str(), aFileName.c_str() ) != 0 ) {
+        mainLog.setLevel( ILogger::WARNING );
+        mainLog << "Could not move the input snapshot to " << aFileName << "." << endl;
+        remove( tempFileName.c_str() );
+        return false;
+    }
+    mainLog.setLevel( ILogger::NOTICE );
+    mainLog << "Wrote input snapshot " << aFileName << "." << endl;
+    return true;
+}
+
+/*!
+ * \brief Load a snapshot into a newly created Scenario.
+ * \details The snapshot is only used if it was written from inputs with the same
+ *          hash.  Data definitions which have changed since it was written are
+ *          only detected while reading and cause the load to fail.
+ * \param aFileName The snapshot file to read.
+ * \param aInputHash The hash of the inputs which would otherwise be parsed.
+ * \param aScenario A newly created Scenario to load into.
+ * \return The status of the load.
+ */
+SnapshotHelper::ReadStatus SnapshotHelper::readSnapshot( const string& aFileName, const uint64_t aInputHash,
+                                                         Scenario* aScenario )
+{
+    ILogger& mainLog = ILogger::getLogger( "main_log" );
+    ifstream in( aFileName.c_str(), ios_base::in | ios_base::binary );
+    if( !in.is_open() ) {
+        mainLog.setLevel( ILogger::NOTICE );
+        mainLog << "No input snapshot found at " << aFileName << "." << endl;
+        return NOT_AVAILABLE;
+    }
+
+    SnapshotReader reader( in );
+    char magic[ sizeof( SNAPSHOT_MAGIC ) ];
+    uint32_t version = 0;
+    uint64_t inputHash = 0;
+    in.read( magic, sizeof( magic ) );
+    reader.readValue( version );
+    reader.readValue( inputHash );
+    if( !reader.isValid() || !equal( magic, magic + sizeof( magic ), SNAPSHOT_MAGIC ) ||
+        version != SNAPSHOT_FORMAT_VERSION || inputHash != aInputHash )
+    {
+        mainLog.setLevel( ILogger::NOTICE );
+        mainLog << "The input snapshot " << aFileName << " does not match the current inputs." << endl;
+        return NOT_AVAILABLE;
+    }
+
+    try {
+        reader.readRootContainer( aScenario );
+    }
+    catch( const std::exception& aException ) {
+        reader.fail( aException.what() );
+    }
+    if( !reader.isValid() || in.peek() != char_traits<char>::eof() ) {
+        reader.fail( "the file is corrupt" );
+        return FAILED;
+    }
+    mainLog.setLevel( ILogger::NOTICE );
+    mainLog << "Loaded input snapshot " << aFileName << "." << endl;
+    return LOADED;
+}
+
+/*!
+ * \brief Start recording the XML handled by AParsable::XMLParse so that it may be
+ *        included in a snapshot.
+ */
+void SnapshotHelper::startRecording() {
+    sIsRecording = true;
+}
+
+/*!
+ * \brief Stop recording and free any XML recorded.
+ */
+void SnapshotHelper::stopRecording() {
+    sIsRecording = false;
+    gRecordedXML.clear();
+    gRecordedXMLPool.clear();
+}
+
+/*!
+ * \brief Record a copy of the XML handled by a call to AParsable::XMLParse.
+ * \details Nothing is recorded if aContainer reports all of that is reflected in its
+ *          Data.  Otherwise the sibling elements from aFirstNode through aLastNode
+ *          are copied as XMLParse may have consumed more than one.
+ * \param aContainer The object whose XMLParse handled the XML.
+ * \param aParentNode The parent of the handled XML.
+ * \param aFirstNode The node given to XMLParse.
+ * \param aLastNode The node XMLParse left off at, null if it consumed the remaining
+ *                  siblings.
+ */
+void SnapshotHelper::recordXMLParse( AParsable* aContainer,
+                                     const rapidxml::xml_node<char>* aParentNode,
+                                     const rapidxml::xml_node<char>* aFirstNode,
+                                     const rapidxml::xml_node<char>* aLastNode )
+{
+    if( aContainer->isXMLParseReflected() ) {
+        return;
+    }
+
+    // group consecutive nodes from the same parent under a single copy of it
+    vector<RecordedXML>& recorded = gRecordedXML[ aContainer ];
+    if( recorded.empty() || recorded.back().mSourceParent != aParentNode ) {
+        RecordedXML newRecord = { aParentNode, copyXMLNode( gRecordedXMLPool, aParentNode, false ) };
+        recorded.push_back( newRecord );
+    }
+    rapidxml::xml_node<char>* parentCopy = recorded.back().mCopy;
+    for( const rapidxml::xml_node<char>* curr = aFirstNode; curr; curr = curr->next_sibling() ) {
+        if( curr->type() == rapidxml::node_element ) {
+            parentCopy->append_node( copyXMLNode( gRecordedXMLPool, curr, true ) );
+        }
+        if( curr == aLastNode ) {
+            break;
+        }
+    }
+}
+
+/*!
+ * \brief Drop any XML recorded for an object that is being deleted.
+ * \param aContainer The object being deleted.
+ */
+void SnapshotHelper::forgetXMLParse( const AParsable* aContainer ) {
+    gRecordedXML.erase( aContainer );
+}
@@ -40,28 +40,78 @@
 
 #include "util/base/include/definitions.h"
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 #include "util/base/include/timer.h"
+#include "util/base/include/configuration.h"
+#include "util/base/include/util.h"
+#include "util/base/include/chrome_trace_writer.h"
+#include "containers/include/iactivity.h"
+
+// Use the processor's timestamp counter when it is available as it is much
+// cheaper to read than the system clocks.
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#define GCAM_TIMER_USE_TSC 1
+#elif defined( _M_X64 ) || defined( _M_IX86 )
+#include <intrin.h>
+#define GCAM_TIMER_USE_TSC 1
+#else
+#define GCAM_TIMER_USE_TSC 0
+#endif
 
 using namespace std;
-using namespace boost::posix_time;
+
+/*!
+ * \brief Determine the number of seconds in a single tick.
+ * \details When using the timestamp counter the rate is measured against the
+ *          steady clock over a short interval.  Note this assumes an invariant
+ *          timestamp counter which is synchronized across cores as is the case on
+ *          any recent x86 processor.
+ * \return The seconds per tick.
+ */
+static double calibrateSecondsPerTick() {
+#if GCAM_TIMER_USE_TSC
+    const chrono::steady_clock::time_point clockStart = chrono::steady_clock::now();
+    const uint64_t tickStart = __rdtsc();
+    chrono::steady_clock::time_point clockEnd;
+    do {
+        clockEnd = chrono::steady_clock::now();
+    } while( clockEnd - clockStart < chrono::milliseconds( 20 ) );
+    const uint64_t tickEnd = __rdtsc();
+    return chrono::duration<double>( clockEnd - clockStart ).count() / static_cast<double>( tickEnd - tickStart );
+#else
+    return 1.0e-9;
+#endif
+}
 
 //! Constructor
-Timer::Timer():mTotalTime( 0 ),
-mRunning( 0 )
+Timer::Timer():mStartTicks( 0 ),
+mRunning( 0 ),
+mTotalTicks( 0 ),
+mThreadTicks( 0 )
 {
 }
 
 /*! \brief Start the timer.
  * \details This function starts the timer. All times will be relative
  *          to this time.  Starting a timer that is already running is
- *          a no-op; however, no error is logged.
+ *          a no-op; however, no error is logged.  When profiling is enabled the
+ *          timer is also pushed on the calling thread's stack of running timers
+ *          so that the time spent by this thread is accumulated as well.
 */     
 void Timer::start(){
+    {
 #if GCAM_PARALLEL_ENABLED
-    tbb::spin_mutex::scoped_lock lock( mMutex );
+        tbb::spin_mutex::scoped_lock lock( mMutex );
 #endif
-    if( ++mRunning == 1 ) {
-        mStartTime = microsec_clock::universal_time();
+        if( ++mRunning == 1 ) {
+            mStartTicks = TimerRegistry::getTicks();
+        }
+    }
+    TimerRegistry& registry = TimerRegistry::getInstance();
+    if( registry.isProfilingEnabled() ) {
+        registry.enterScope( this );
     }
 }
 
@@ -72,15 +122,20 @@ void Timer::start(){
 *          logged.
 */
 void Timer::stop(){
+    {
 #if GCAM_PARALLEL_ENABLED
-    tbb::spin_mutex::scoped_lock lock( mMutex );
+        tbb::spin_mutex::scoped_lock lock( mMutex );
 #endif
-    if( --mRunning == 0 ) {
-        time_duration diff = microsec_clock::universal_time() - mStartTime;
-        mTotalTime += diff.total_seconds() + pow( 10.0, -time_duration::num_fractional_digits() ) * diff.fractional_seconds();
+        if( --mRunning == 0 ) {
+            mTotalTicks += TimerRegistry::getTicks() - mStartTicks;
+        }
+        // guard against excessive stops
+        mRunning = std::max( mRunning, 0 );
+    }
+    TimerRegistry& registry = TimerRegistry::getInstance();
+    if( registry.isProfilingEnabled() ) {
+        registry.exitScope( this );
     }
-    // guard against excessive stops
-    mRunning = std::max( mRunning, 0 );
 }
 
 /*!
@@ -88,34 +143,109 @@ void Timer::stop(){
  * \return The total time in seconds.
  */
 double Timer::getTotalTimeDifference() const {
-    return mTotalTime;
+    return TimerRegistry::ticksToSeconds( mTotalTicks );
+}
+
+/*!
+ * \brief Get the total time measured by this timer summed over each thread
+ *        which started and stopped it.
+ * \details When the timer is only used by a single thread at a time this is the
+ *          same as getTotalTimeDifference.  When it is used concurrently from
+ *          parallel work this is the total amount of work done.  Note the time
+ *          of each thread is only tracked while profiling is enabled otherwise
+ *          this is zero.
+ * \return The total thread time in seconds.
+ */
+double Timer::getTotalThreadTime() const {
+    return TimerRegistry::ticksToSeconds( mThreadTicks.load( memory_order_relaxed ) );
 }
 
 /*! \brief Print the accumulated time.
  * \details This function prints the accumulated time on the timer.
  *          It *can* be called on a running timer to print a split.
  *          Otherwise it will print the total saved at the last call
- *          to stop().
+ *          to stop().  If the time summed over threads is larger than the
+ *          elapsed time, meaning the timer was used concurrently, it is
+ *          printed as well.
  * \param aOut The output stream to print to.
  * \param aTitle The label to print in front of the time. Defaults to 'Time: '
 */
 void Timer::print( std::ostream& aOut, const string& aLabel ) const {
-    double tottime = mTotalTime;
+    uint64_t totalTicks = mTotalTicks;
     if(mRunning) {
         // Add the time currently on the clock to the accumulated total
-        time_duration dt = microsec_clock::universal_time() - mStartTime;
-        tottime += dt.total_seconds() +
-            pow(10.0, -time_duration::num_fractional_digits()) * dt.fractional_seconds();
+        totalTicks += TimerRegistry::getTicks() - mStartTicks;
     }
+    const double tottime = TimerRegistry::ticksToSeconds( totalTicks );
         
     if( tottime > 0 ) {
-        aOut << aLabel << " " << tottime << " seconds. " << endl;
+        aOut << aLabel << " " << tottime << " seconds.";
+        const double threadTime = getTotalThreadTime();
+        // allow for a small difference due to when each time was taken
+        if( threadTime > tottime * 1.01 ) {
+            aOut << " " << threadTime << " seconds summed over threads.";
+        }
+        aOut << " " << endl;
     }
 }
 
 //! Constructor
-TimerRegistry::TimerRegistry():mPredefinedTimers( END )
+TimerRegistry::TimerRegistry():mPredefinedTimers( END ),
+mProfilingEnabled( false ),
+mProfileActivities( false ),
+mMaxTraceEvents( 0 ),
+mEpochTicks( 0 ),
+mDriverThreadID( -1 ),
+mDriverNode( -1 ),
+mThreadCount( 0 )
 {
+    for( int timer = 0; timer < END; ++timer ) {
+        string timerName;
+        switch( timer ) {
+            case FULLSCENARIO:
+                timerName = "Full Scenario";
+                break;
+            case BISECT:
+                timerName = "Bisection solver";
+                break;
+            case SOLVER:
+                timerName = "Broyden Solver";
+                break;
+            case JACOBIAN:
+                timerName = "Jacobian calcs";
+                break;
+            case EVAL_PART:
+                timerName = "Partial function evaluations";
+                break;
+            case EVAL_FULL:
+                timerName = "Full function evaluations";
+                break;
+            case JAC_PRE:
+                timerName = "Jacobian Preconditioner (overlaps with Jacobian)";
+                break;
+            case JAC_PRE_JAC:
+                timerName = "Jacobian Preconditioner Jacobian overlap";
+                break;
+            case EDFUN_MISC:
+                timerName = "EDFUN miscellaneous";
+                break;
+            case EDFUN_PRE:
+                timerName = "EDFUN before world->calc";
+                break;
+            case EDFUN_POST:
+                timerName = "EDFUN after world->calc";
+                break;
+            case EDFUN_AN_RESET:
+                timerName = "EDFUN affected nodes reset";
+                break;
+            case WRITE_DATA:
+                timerName = "Write data";
+                break;
+                
+            default: timerName = "Predefined timer";
+        }
+        mPredefinedTimers[ timer ].mName = timerName;
+    }
 }
 
 /*!
@@ -127,6 +257,33 @@ TimerRegistry& TimerRegistry::getInstance() {
     return TIMER_REGISTRY;
 }
 
+/*!
+ * \brief Get the current value of the tick counter used for all timing.
+ * \details This is the processor's timestamp counter where available otherwise
+ *          nanoseconds from the steady clock.  Use ticksToSeconds to convert a
+ *          difference in ticks to a time.
+ * \return The current ticks.
+ */
+uint64_t TimerRegistry::getTicks() {
+#if GCAM_TIMER_USE_TSC
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>( chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+}
+
+/*!
+ * \brief Convert a number of ticks to seconds.
+ * \details The rate of the tick counter is calibrated the first time this is
+ *          called.
+ * \param aTicks A difference in ticks.
+ * \return The time in seconds.
+ */
+double TimerRegistry::ticksToSeconds( const uint64_t aTicks ) {
+    static const double SECONDS_PER_TICK = calibrateSecondsPerTick();
+    return static_cast<double>( aTicks ) * SECONDS_PER_TICK;
+}
+
 /*!
  * \brief Get the underlying timer for the given identifier.
  * \details This version looks up the timer by enumeration and should be used when
@@ -152,60 +309,378 @@ Timer& TimerRegistry::getTimer( const PredefinedTimers aTimerName ) {
  *         not already exist it will be created
  */
 Timer& TimerRegistry::getTimer( const string& aTimerName ) {
-    return mNamedTimers[ aTimerName ];
+#if GCAM_PARALLEL_ENABLED
+    tbb::spin_mutex::scoped_lock lock( mNamedTimersMutex );
+#endif
+    Timer& timer = mNamedTimers[ aTimerName ];
+    timer.mName = aTimerName;
+    return timer;
+}
+
+/*!
+ * \brief Read the profiling settings from the configuration.
+ * \details Profiling is enabled by setting write-output for the "timerProfile"
+ *          file.  Activities are only included in the hierarchy when the bool
+ *          "timer-profile-activities" is set, and since they are timed by the
+ *          ActivityProfiler it must be enabled as well.  Only the first
+ *          "timer-profile-max-events" scopes per thread are kept for the trace.
+ *          This must be called by the main thread, before the scopes to profile
+ *          are started, which is then considered to drive the solver.
+ */
+void TimerRegistry::initProfiling() {
+    const Configuration* conf = Configuration::getInstance();
+    mProfilingEnabled = conf->shouldWriteFile( "timerProfile", false );
+    mProfileActivities = mProfilingEnabled && conf->getBool( "timer-profile-activities", false, false );
+    mMaxTraceEvents = max( conf->getInt( "timer-profile-max-events", 1000000, false ), 0 );
+    
+    mDriverThreadID = getThreadData().mThreadID;
+    // keep trace times relative to the first scenario profiled
+    if( mEpochTicks == 0 ) {
+        mEpochTicks = getTicks();
+    }
+}
+
+/*!
+ * \brief Get the timing data for the calling thread, assigning it an ID
+ *        the first time it is used.
+ * \return The timing data for the current thread.
+ */
+TimerRegistry::ThreadData& TimerRegistry::getThreadData() {
+#if GCAM_PARALLEL_ENABLED
+    bool exists;
+    ThreadData& threadData = mThreadData.local( exists );
+#else
+    ThreadData& threadData = mThreadData;
+#endif
+    if( threadData.mThreadID == -1 ) {
+        threadData.mThreadID = mThreadCount++;
+    }
+    return threadData;
+}
+
+/*!
+ * \brief Get the scope node for the given key nested in the calling thread's
+ *        current scope, creating it if it does not already exist.
+ * \details A worker thread with no scope open of its own is nested in the scope
+ *          currently open on the main thread.
+ * \param aThreadData The calling thread's data.
+ * \param aKey The timer or activity which identifies the scope.
+ * \param aTimer The timer if the scope is a timer otherwise null.
+ * \param aActivity The activity if the scope is an activity otherwise null.
+ * \return The index of the scope node.
+ */
+int TimerRegistry::getScopeNode( ThreadData& aThreadData, const void* aKey, const Timer* aTimer,
+                                 const IActivity* aActivity )
+{
+    int parent = aThreadData.mCurrentNode;
+    if( parent == -1 && aThreadData.mThreadID != mDriverThreadID ) {
+        parent = mDriverNode.load( memory_order_relaxed );
+    }
+    const pair<int, const void*> key( parent, aKey );
+    auto cacheIter = aThreadData.mNodeCache.find( key );
+    if( cacheIter != aThreadData.mNodeCache.end() ) {
+        return cacheIter->second;
+    }
+    
+    int node;
+    {
+#if GCAM_PARALLEL_ENABLED
+        tbb::spin_mutex::scoped_lock lock( mScopeMutex );
+#endif
+        auto indexIter = mScopeIndex.find( key );
+        if( indexIter != mScopeIndex.end() ) {
+            node = indexIter->second;
+        }
+        else {
+            node = mScopeNodes.size();
+            ScopeNode newNode;
+            newNode.mName = aTimer ? aTimer->mName : aActivity->getDescription();
+            newNode.mParent = parent;
+            newNode.mIsActivity = !aTimer;
+            mScopeNodes.push_back( newNode );
+            mScopeIndex[ key ] = node;
+        }
+    }
+    aThreadData.mNodeCache[ key ] = node;
+    return node;
+}
+
+/*!
+ * \brief Push a timer which was just started on the calling thread's stack.
+ * \param aTimer The timer which was started.
+ */
+void TimerRegistry::enterScope( const Timer* aTimer ) {
+    ThreadData& threadData = getThreadData();
+    ScopeFrame frame;
+    frame.mTimer = aTimer;
+    frame.mNode = -1;
+    frame.mIsNested = false;
+    for( const ScopeFrame& openFrame : threadData.mStack ) {
+        frame.mIsNested |= openFrame.mTimer == aTimer;
+    }
+    // only registered timers have a name to be profiled under
+    if( mProfilingEnabled && !frame.mIsNested && !aTimer->mName.empty() ) {
+        frame.mNode = getScopeNode( threadData, aTimer, aTimer, 0 );
+        threadData.mCurrentNode = frame.mNode;
+        if( threadData.mThreadID == mDriverThreadID ) {
+            mDriverNode.store( frame.mNode, memory_order_relaxed );
+        }
+    }
+    frame.mStartTicks = getTicks();
+    threadData.mStack.push_back( frame );
+}
+
+/*!
+ * \brief Pop a timer which was just stopped from the calling thread's stack and
+ *        accumulate the time this thread spent in it.
+ * \details Timers are not required to be stopped in the reverse order they were
+ *          started.  If the timer is not running on this thread, such as when it
+ *          is stopped excessively, this is a no-op.
+ * \param aTimer The timer which was stopped.
+ */
+void TimerRegistry::exitScope( Timer* aTimer ) {
+    const uint64_t endTicks = getTicks();
+    ThreadData& threadData = getThreadData();
+    vector<ScopeFrame>& stack = threadData.mStack;
+    auto frameIter = find_if( stack.rbegin(), stack.rend(), [aTimer]( const ScopeFrame& aFrame ) {
+        return aFrame.mTimer == aTimer;
+    } );
+    if( frameIter == stack.rend() ) {
+        return;
+    }
+    const ScopeFrame frame = *frameIter;
+    stack.erase( ( frameIter + 1 ).base() );
+    
+    if( frame.mIsNested ) {
+        return;
+    }
+    const uint64_t ticks = endTicks - frame.mStartTicks;
+    aTimer->mThreadTicks.fetch_add( ticks, memory_order_relaxed );
+    if( frame.mNode == -1 ) {
+        return;
+    }
+    
+    if( threadData.mStats.size() <= static_cast<size_t>( frame.mNode ) ) {
+        threadData.mStats.resize( frame.mNode + 1 );
+    }
+    ScopeStats& stats = threadData.mStats[ frame.mNode ];
+    stats.mTicks += ticks;
+    ++stats.mCount;
+    if( threadData.mTrace.size() < mMaxTraceEvents ) {
+        TraceEvent event;
+        event.mNode = frame.mNode;
+        event.mStartTicks = frame.mStartTicks;
+        event.mEndTicks = endTicks;
+        threadData.mTrace.push_back( event );
+    }
+    
+    // the current scope is the innermost profiled timer still running
+    threadData.mCurrentNode = -1;
+    for( auto openIter = stack.rbegin(); openIter != stack.rend() && threadData.mCurrentNode == -1; ++openIter ) {
+        threadData.mCurrentNode = openIter->mNode;
+    }
+    if( threadData.mThreadID == mDriverThreadID ) {
+        mDriverNode.store( threadData.mCurrentNode, memory_order_relaxed );
+    }
+}
+
+/*!
+ * \brief Record the time a single calculation of an activity took in the
+ *        calling thread's current scope.
+ * \details This is a no-op unless activities are being profiled.
+ * \param aActivity The activity which was calculated.
+ * \param aSeconds The time the calculation took.
+ */
+void TimerRegistry::recordActivity( const IActivity* aActivity, const double aSeconds ) {
+    if( !mProfileActivities ) {
+        return;
+    }
+    
+    ThreadData& threadData = getThreadData();
+    const int node = getScopeNode( threadData, aActivity, 0, aActivity );
+    if( threadData.mStats.size() <= static_cast<size_t>( node ) ) {
+        threadData.mStats.resize( node + 1 );
+    }
+    ScopeStats& stats = threadData.mStats[ node ];
+    stats.mSeconds += aSeconds;
+    ++stats.mCount;
+}
+
+/*!
+ * \brief Combine the time spent in each scope by all threads.
+ * \return The combined time of each scope node.
+ */
+vector<TimerRegistry::ScopeSummary> TimerRegistry::summarizeScopes() const {
+    vector<ScopeSummary> summary( mScopeNodes.size() );
+#if GCAM_PARALLEL_ENABLED
+    for( const ThreadData& threadData : mThreadData ) {
+#else
+    {
+        const ThreadData& threadData = mThreadData;
+#endif
+        for( size_t node = 0; node < threadData.mStats.size(); ++node ) {
+            const ScopeStats& stats = threadData.mStats[ node ];
+            if( stats.mCount > 0 ) {
+                summary[ node ].mSeconds += ticksToSeconds( stats.mTicks ) + stats.mSeconds;
+                summary[ node ].mCount += stats.mCount;
+                ++summary[ node ].mNumThreads;
+            }
+        }
+    }
+    return summary;
+}
+
+/*!
+ * \brief Print the scopes nested in the given parent and recursively their
+ *        children.
+ * \details Activities are numerous so only a total over all of the activities
+ *          in the parent and the most expensive few are printed.
+ * \param aOut The output stream to print to.
+ * \param aParent The scope node to print the children of or -1 for the roots.
+ * \param aDepth The depth of the children used for indentation.
+ * \param aChildren The children of each scope node offset by one so that the
+ *                  roots are first.
+ * \param aSummary The combined time of each scope node.
+ */
+void TimerRegistry::printScopes( ostream& aOut, const int aParent, const int aDepth,
+                                 const vector<vector<int> >& aChildren,
+                                 const vector<ScopeSummary>& aSummary ) const
+{
+    const string indent( aDepth * 4, ' ' );
+    vector<int> activities;
+    for( int node : aChildren[ aParent + 1 ] ) {
+        if( mScopeNodes[ node ].mIsActivity ) {
+            activities.push_back( node );
+            continue;
+        }
+        const ScopeSummary& summary = aSummary[ node ];
+        aOut << indent << mScopeNodes[ node ].mName << ": " << summary.mSeconds << " seconds over "
+             << summary.mCount << " calls on " << summary.mNumThreads << " threads." << endl;
+        printScopes( aOut, node, aDepth + 1, aChildren, aSummary );
+    }
+    
+    if( !activities.empty() ) {
+        double totalTime = 0.0;
+        int totalCount = 0;
+        for( int node : activities ) {
+            totalTime += aSummary[ node ].mSeconds;
+            totalCount += aSummary[ node ].mCount;
+        }
+        aOut << indent << activities.size() << " activities: " << totalTime << " seconds over "
+             << totalCount << " calcs." << endl;
+        const size_t numTop = min( activities.size(), static_cast<size_t>( 5 ) );
+        partial_sort( activities.begin(), activities.begin() + numTop, activities.end(),
+                      [&aSummary]( const int aLHS, const int aRHS ) {
+                          return aSummary[ aLHS ].mSeconds > aSummary[ aRHS ].mSeconds;
+                      } );
+        for( size_t i = 0; i < numTop; ++i ) {
+            aOut << indent << "    " << mScopeNodes[ activities[ i ] ].mName << ": "
+                 << aSummary[ activities[ i ] ].mSeconds << " seconds." << endl;
+        }
+    }
 }
 
 /*!
  * \brief Have all registered timers print their current times using their names
  *        as a label.
+ * \details If profiling is enabled the hierarchy of scopes is printed as well.
  */
 void TimerRegistry::printAllTimers( ostream& aOut ) const {
     for( int timer = 0; timer < END; ++timer ) {
-        string timerName;
-        switch( timer ) {
-            case FULLSCENARIO:
-                timerName = "Full Scenario";
-                break;
-            case BISECT:
-                timerName = "Bisection solver";
-                break;
-            case SOLVER:
-                timerName = "Broyden Solver";
-                break;
-            case JACOBIAN:
-                timerName = "Jacobian calcs";
-                break;
-            case EVAL_PART:
-                timerName = "Partial function evaluations";
-                break;
-            case EVAL_FULL:
-                timerName = "Full function evaluations";
-                break;
-            case JAC_PRE:
-                timerName = "Jacobian Preconditioner (overlaps with Jacobian)";
-                break;
-            case JAC_PRE_JAC:
-                timerName = "Jacobian Preconditioner Jacobian overlap";
-                break;
-            case EDFUN_MISC:
-                timerName = "EDFUN miscellaneous";
-                break;
-            case EDFUN_PRE:
-                timerName = "EDFUN before world->calc";
-                break;
-            case EDFUN_POST:
-                timerName = "EDFUN after world->calc";
-                break;
-            case EDFUN_AN_RESET:
-                timerName = "EDFUN affected nodes reset";
-                break;
-                
-            default: timerName = "Predefined timer";
-        }
-        mPredefinedTimers[ timer ].print( aOut, timerName );
+        mPredefinedTimers[ timer ].print( aOut, mPredefinedTimers[ timer ].mName );
     }
     
     for( map<string, Timer>::const_iterator it = mNamedTimers.begin(); it != mNamedTimers.end(); ++it ) {
         (*it).second.print( aOut, (*it).first );
     }
+    
+    if( mProfilingEnabled ) {
+        const vector<ScopeSummary> summary = summarizeScopes();
+        vector<vector<int> > children( mScopeNodes.size() + 1 );
+        for( size_t node = 0; node < mScopeNodes.size(); ++node ) {
+            children[ mScopeNodes[ node ].mParent + 1 ].push_back( node );
+        }
+        aOut << "Timer scopes (time summed over threads):" << endl;
+        printScopes( aOut, -1, 1, children, summary );
+    }
+}
+
+/*!
+ * \brief Write the profiled scopes and trace as JSON.
+ * \details The "scopes" array contains the hierarchy of scopes with the time
+ *          spent in each by each thread.  The "traceEvents" array is in the
+ *          Chrome trace event format, written by the ChromeTraceWriter, with a
+ *          complete ("X") event for each timer scope so the file can also be loaded into chrome://tracing or
+ *          https://ui.perfetto.dev.  Activities are not included in the trace as
+ *          the ActivityProfiler already writes them.
+ * \param aOut The stream to write the profile to.
+ */
+void TimerRegistry::writeProfile( ostream& aOut ) const {
+    if( !mProfilingEnabled ) {
+        return;
+    }
+    
+    // the seconds each thread spent in each scope
+    vector<vector<pair<int, const ScopeStats*> > > threadStats( mScopeNodes.size() );
+#if GCAM_PARALLEL_ENABLED
+    for( const ThreadData& threadData : mThreadData ) {
+#else
+    {
+        const ThreadData& threadData = mThreadData;
+#endif
+        for( size_t node = 0; node < threadData.mStats.size(); ++node ) {
+            if( threadData.mStats[ node ].mCount > 0 ) {
+                threadStats[ node ].push_back( make_pair( threadData.mThreadID, &threadData.mStats[ node ] ) );
+            }
+        }
+    }
+    const vector<ScopeSummary> summary = summarizeScopes();
+    vector<string> names;
+    names.reserve( mScopeNodes.size() );
+    for( const ScopeNode& scopeNode : mScopeNodes ) {
+        names.push_back( util::escapeJSON( scopeNode.mName ) );
+    }
+    
+    // times must not be written in scientific notation
+    const ios_base::fmtflags oldFlags = aOut.flags();
+    const streamsize oldPrecision = aOut.precision( 6 );
+    aOut << fixed;
+    aOut << "{\"displayTimeUnit\":\"ms\",\"scopes\":[";
+    for( size_t node = 0; node < mScopeNodes.size(); ++node ) {
+        aOut << ( node == 0 ? "" : "," ) << endl
+             << "{\"id\":" << node << ",\"parent\":" << mScopeNodes[ node ].mParent
+             << ",\"name\":\"" << names[ node ] << "\",\"type\":\""
+             << ( mScopeNodes[ node ].mIsActivity ? "activity" : "timer" )
+             << "\",\"seconds\":" << summary[ node ].mSeconds << ",\"count\":" << summary[ node ].mCount
+             << ",\"threads\":[";
+        for( size_t i = 0; i < threadStats[ node ].size(); ++i ) {
+            const ScopeStats* stats = threadStats[ node ][ i ].second;
+            aOut << ( i == 0 ? "" : "," ) << "{\"tid\":" << threadStats[ node ][ i ].first
+                 << ",\"seconds\":" << ticksToSeconds( stats->mTicks ) + stats->mSeconds
+                 << ",\"count\":" << stats->mCount << "}";
+        }
+        aOut << "]}";
+    }
+    aOut << endl << "],";
+    {
+        ChromeTraceWriter trace( aOut );
+#if GCAM_PARALLEL_ENABLED
+        for( const ThreadData& threadData : mThreadData ) {
+#else
+        {
+            const ThreadData& threadData = mThreadData;
+#endif
+            trace.writeThreadName( threadData.mThreadID );
+            for( const TraceEvent& event : threadData.mTrace ) {
+                // scopes which started before profiling was enabled begin at zero
+                const uint64_t startTicks = max( event.mStartTicks, mEpochTicks );
+                trace.writeEvent( names[ event.mNode ], "timer", ticksToSeconds( startTicks - mEpochTicks ) * 1.0e6,
+                                  ticksToSeconds( event.mEndTicks - startTicks ) * 1.0e6, threadData.mThreadID,
+                                  "\"scope\":" + util::toString( event.mNode ) );
+            }
+        }
+    }
+    aOut << "}" << endl;
+    aOut.flags( oldFlags );
+    aOut.precision( oldPrecision );
 }
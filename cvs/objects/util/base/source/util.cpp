@@ -47,6 +47,23 @@
 
 #include <string>
 #include <ctime>
+#include <thread>
+#include <cstdio>
+
+#include <cstdlib>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <process.h>
+#include <direct.h>
+#include <io.h>
+#include <fcntl.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -121,6 +138,170 @@ namespace objects {
         return result;
     }
 
+    /*!
+     * \brief Escape a string so that it may be written as a JSON string value.
+     * \param aString The string to escape.
+     * \return The escaped string.
+     */
+    string escapeJSON( const string& aString ) {
+        string escaped;
+        escaped.reserve( aString.size() );
+        for( char c : aString ) {
+            if( c == '"' || c == '\\' ) {
+                escaped.push_back( '\\' );
+                escaped.push_back( c );
+            }
+            else if( static_cast<unsigned char>( c ) < 0x20 ) {
+                escaped.push_back( ' ' );
+            }
+            else {
+                escaped.push_back( c );
+            }
+        }
+        return escaped;
+    }
+
+    /*!
+     * \brief Create the name of a temporary file next to the given file which no
+     *        other process or thread will be using.
+     * \details Cache files are written to such a temporary file and then renamed
+     *          into place so that concurrent runs, whether threads or batch
+     *          children, never see a partially written file.
+     * \param aFileName The name of the file which will be replaced.
+     * \return The temporary file name.
+     */
+    string getTempFileName( const string& aFileName ) {
+        ostringstream tempFileName;
+        tempFileName << aFileName << ".tmp" << getpid() << '.'
+                     << hash<thread::id>()( this_thread::get_id() );
+        return tempFileName.str();
+    }
+
+    /*!
+     * \brief Move a file written under a temporary name into place, replacing
+     *        any existing file.
+     * \details On POSIX systems the rename is atomic so readers will either see
+     *          the old or the new file.  Windows will not rename over an existing
+     *          file so it is removed first.  The temporary file is removed if it
+     *          could not be moved.
+     * \param aTempFileName The file to move, typically from getTempFileName.
+     * \param aFileName The name to move it to.
+     * \return Whether the file was moved.
+     */
+    bool replaceFile( const string& aTempFileName, const string& aFileName ) {
+#if defined(_WIN32)
+        remove( aFileName.c_str() );
+#endif
+        if( rename( aTempFileName.c_str(), aFileName.c_str() ) != 0 ) {
+            remove( aTempFileName.c_str() );
+            return false;
+        }
+        return true;
+    }
+
+    /*!
+     * \brief Get the absolute path of an existing file with any symbolic links
+     *        and relative components resolved.
+     * \param aFileName The file name.
+     * \return The absolute path or aFileName if it could not be resolved.
+     */
+    string getAbsolutePath( const string& aFileName ) {
+#if defined(_WIN32)
+        char* absolutePath = _fullpath( 0, aFileName.c_str(), 0 );
+#else
+        char* absolutePath = realpath( aFileName.c_str(), 0 );
+#endif
+        if( !absolutePath ) {
+            return aFileName;
+        }
+        const string ret( absolutePath );
+        free( absolutePath );
+        return ret;
+    }
+
+    /*!
+     * \brief Get the size and last modified time of a file which together are
+     *        used to identify the version of an input a cache was made from.
+     * \param aFileName The file name.
+     * \param aFileSize The size of the file in bytes.
+     * \param aModifiedTime The modified time in nanoseconds since the epoch, with
+     *                      the resolution the platform provides.
+     * \return Whether the file could be queried.
+     */
+    bool getFileStamp( const string& aFileName, uint64_t& aFileSize, int64_t& aModifiedTime ) {
+#if defined(_WIN32)
+        struct _stat64 fileStat;
+        if( _stat64( aFileName.c_str(), &fileStat ) != 0 ) {
+            return false;
+        }
+        aModifiedTime = static_cast<int64_t>( fileStat.st_mtime ) * 1000000000;
+#else
+        struct stat fileStat;
+        if( stat( aFileName.c_str(), &fileStat ) != 0 ) {
+            return false;
+        }
+#if defined(__APPLE__)
+        aModifiedTime = static_cast<int64_t>( fileStat.st_mtimespec.tv_sec ) * 1000000000 + fileStat.st_mtimespec.tv_nsec;
+#else
+        aModifiedTime = static_cast<int64_t>( fileStat.st_mtim.tv_sec ) * 1000000000 + fileStat.st_mtim.tv_nsec;
+#endif
+#endif
+        aFileSize = static_cast<uint64_t>( fileStat.st_size );
+        return true;
+    }
+
+    /*!
+     * \brief Create the directory which will hold the given file along with any
+     *        of it's parents which do not exist yet.
+     * \param aFileName The file name.
+     * \return Whether the directory exists.
+     */
+    bool createParentDirectories( const string& aFileName ) {
+        const size_t parentEnd = aFileName.find_last_of( "/\\" );
+        if( parentEnd == string::npos || parentEnd == 0 ) {
+            return true;
+        }
+        // create each directory along the path in turn skipping a leading
+        // separator, those which already exist are simply checked
+        size_t pos = 0;
+        do {
+            pos = aFileName.find_first_of( "/\\", pos + 1 );
+            const string dir = aFileName.substr( 0, min( pos, parentEnd ) );
+#if defined(_WIN32)
+            const int result = _mkdir( dir.c_str() );
+#else
+            const int result = mkdir( dir.c_str(), 0777 );
+#endif
+            if( result != 0 && errno != EEXIST ) {
+                struct stat dirStat;
+                if( stat( dir.c_str(), &dirStat ) != 0 || ( dirStat.st_mode & S_IFMT ) != S_IFDIR ) {
+                    return false;
+                }
+            }
+        } while( pos < parentEnd );
+        return true;
+    }
+
+    /*!
+     * \brief Shorten an existing file to the given size.
+     * \param aFileName The file name.
+     * \param aFileSize The size in bytes to shorten the file to.
+     * \return Whether the file was resized.
+     */
+    bool truncateFile( const string& aFileName, const uint64_t aFileSize ) {
+#if defined(_WIN32)
+        int fileHandle;
+        if( _sopen_s( &fileHandle, aFileName.c_str(), _O_RDWR | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE ) != 0 ) {
+            return false;
+        }
+        const bool success = _chsize_s( fileHandle, static_cast<__int64>( aFileSize ) ) == 0;
+        _close( fileHandle );
+        return success;
+#else
+        return truncate( aFileName.c_str(), static_cast<off_t>( aFileSize ) ) == 0;
+#endif
+    }
+
     /*! \brief Create a Minicam style run identifier.
     * \details Creates a run identifier by combining the current date and time,
     *          including the number of seconds so that is is always unique.
@@ -0,0 +1,424 @@
+/*
+* LEGAL NOTICE
+* This computer software was prepared by Battelle Memorial Institute,
+* hereinafter the Contractor, under Contract No. DE-AC05-76RL0 1830
+* with the Department of Energy (DOE). NEITHER THE GOVERNMENT NOR THE
+* CONTRACTOR MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR ASSUMES ANY
+* LIABILITY FOR THE USE OF THIS SOFTWARE. This notice including this
+* sentence must appear on any copies of this computer software.
+* 
+* EXPORT CONTROL
+* User agrees that the Software will not be shipped, transferred or
+* exported into any country or used in any manner prohibited by the
+* United States Export Administration Act or any other applicable
+* export laws, restrictions or regulations (collectively the "Export Laws").
+* Export of the Software may require some form of license or other
+* authority from the U.S. Government, and failure to obtain such
+* export control license may result in criminal liability under
+* U.S. laws. In addition, if the Software is identified as export controlled
+* items under the Export Laws, User represents and warrants that User
+* is not a citizen, or otherwise located within, an embargoed nation
+* (including without limitation Iran, Syria, Sudan, Cuba, and North Korea)
+*     and that User is not otherwise prohibited
+* under the Export Laws from receiving the Software.
+* 
+* Copyright 2011 Battelle Memorial Institute.  All Rights Reserved.
+* Distributed as open-source under the terms of the Educational Community 
+* License version 2.0 (ECL 2.0). http://www.opensource.org/licenses/ecl2.php
+* 
+* For further details, see: http://www.globalchange.umd.edu/models/gcam/
+*
+*/
+
+
+/*!
+ * \file xml_input_file.cpp
+ * \ingroup Objects
+ * \brief XMLInputFile class source file.
+ */
+
+#include "util/base/include/definitions.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <mutex>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#if USE_ZLIB
+#include <zlib.h>
+#endif
+#if USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "util/base/include/xml_input_file.h"
+#include "util/base/include/configuration.h"
+#include "util/base/include/util.h"
+
+using namespace std;
+
+namespace {
+    //! The gzip magic number.
+    const unsigned char GZIP_MAGIC[] = { 0x1f, 0x8b };
+
+    //! The zstd magic number.
+    const unsigned char ZSTD_MAGIC[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+    //! The least amount of free space to have in the buffer before each
+    //! decompression step.
+    const size_t MIN_FREE_BUFFER = 1 << 20;
+
+    //! Identifies the trailer written after the contents of a cache file.
+    const char CACHE_TRAILER_TAG[] = { 'G', 'C', 'A', 'M', 'X', 'M', 'L', '1' };
+
+    //! The size of the trailer of a cache file: a null to terminate the contents
+    //! followed by the size and modified time of the compressed file and the tag.
+    const size_t CACHE_TRAILER_SIZE = 1 + sizeof( uint64_t ) + sizeof( int64_t ) + sizeof( CACHE_TRAILER_TAG );
+
+    //! Protects gFreeBuffer.
+    mutex gFreeBufferMutex;
+
+    //! A decompression buffer which is not in use and may be reused.  Only one is
+    //! kept as files are usually read one at a time.
+    unique_ptr<vector<char> > gFreeBuffer;
+
+    /*!
+     * \brief Check if the given bytes start with the given magic number.
+     */
+    template<size_t N>
+    bool hasMagic( const char* aData, const size_t aSize, const unsigned char ( &aMagic )[ N ] ) {
+        return aSize >= N && equal( aMagic, aMagic + N, reinterpret_cast<const unsigned char*>( aData ) );
+    }
+
+    /*!
+     * \brief Make sure there is at least MIN_FREE_BUFFER free space in aBuffer after aUsed.
+     */
+    void ensureFree( vector<char>& aBuffer, const size_t aUsed ) {
+        if( aBuffer.size() - aUsed < MIN_FREE_BUFFER ) {
+            aBuffer.resize( max( aBuffer.size() * 2, aUsed + MIN_FREE_BUFFER ) );
+        }
+    }
+
+    //! Report a failure to read aFileName in the same way as mapped_file_source.
+    void throwFailure( const string& aFileName, const string& aReason ) {
+        throw ios_base::failure( "failed to decompress " + aFileName + ": " + aReason );
+    }
+
+    /*!
+     * \brief Get the file which would hold the decompressed copy of aFileName in
+     *        the configured cache directory.
+     * \return The cache file or an empty string if no cache directory is set.
+     */
+    string getCacheFileName( const string& aFileName ) {
+        const string& cacheDir = Configuration::getInstance()->getFile( "compressedInputCache", "", false );
+        if( cacheDir.empty() ) {
+            return string();
+        }
+        // Different input directories could have files of the same name so include
+        // a hash of the full path along with the file name minus the compression
+        // extension.
+        const string inputPath = util::getAbsolutePath( aFileName );
+        const size_t nameStart = inputPath.find_last_of( "/\\" ) + 1;
+        const size_t extensionStart = inputPath.find_last_of( '.' );
+        const string stem = inputPath.substr( nameStart,
+            extensionStart != string::npos && extensionStart > nameStart ? extensionStart - nameStart : string::npos );
+        ostringstream cacheName;
+        cacheName << cacheDir << '/' << hex << setw( 16 ) << setfill( '0' ) << hash<string>()( inputPath )
+                  << '-' << stem;
+        return cacheName.str();
+    }
+
+    /*!
+     * \brief Check if the trailer of a cache file matches the current size and
+     *        modified time of the compressed file, as RegionIndex does.
+     * \param aData The contents of the cache file including the trailer.
+     * \param aSize The size of the cache file.
+     * \param aFileSize The current size of the compressed file.
+     * \param aModifiedTime The current modified time of the compressed file.
+     * \return Whether the cache was made from the compressed file as it is now.
+     */
+    bool isCacheValid( const char* aData, const size_t aSize, const uint64_t aFileSize,
+                       const int64_t aModifiedTime )
+    {
+        if( aSize < CACHE_TRAILER_SIZE ) {
+            return false;
+        }
+        const char* trailer = aData + aSize - CACHE_TRAILER_SIZE;
+        uint64_t fileSize = 0;
+        int64_t modifiedTime = 0;
+        memcpy( &fileSize, trailer + 1, sizeof( fileSize ) );
+        memcpy( &modifiedTime, trailer + 1 + sizeof( fileSize ), sizeof( modifiedTime ) );
+        return trailer[ 0 ] == '\0' && fileSize == aFileSize && modifiedTime == aModifiedTime
+            && memcmp( trailer + 1 + sizeof( fileSize ) + sizeof( modifiedTime ), CACHE_TRAILER_TAG,
+                       sizeof( CACHE_TRAILER_TAG ) ) == 0;
+    }
+
+    /*!
+     * \brief Write the decompressed contents to the cache followed by a trailer
+     *        which identifies the compressed file it was made from.
+     * \details The contents are written to a temporary file which is then moved into
+     *          place so that a concurrent run never sees a partial file.  The cache is
+     *          only an optimization so failures are silently ignored, note this may
+     *          be called before the loggers have been initialized.
+     */
+    void writeCache( const string& aCacheFileName, const char* aData, const size_t aSize,
+                     const uint64_t aFileSize, const int64_t aModifiedTime )
+    {
+        const string tempFileName = util::getTempFileName( aCacheFileName );
+        util::createParentDirectories( aCacheFileName );
+        {
+            ofstream cacheFile( tempFileName.c_str(), ios_base::out | ios_base::binary | ios_base::trunc );
+            cacheFile.write( aData, aSize );
+            cacheFile.put( '\0' );
+            cacheFile.write( reinterpret_cast<const char*>( &aFileSize ), sizeof( aFileSize ) );
+            cacheFile.write( reinterpret_cast<const char*>( &aModifiedTime ), sizeof( aModifiedTime ) );
+            cacheFile.write( CACHE_TRAILER_TAG, sizeof( CACHE_TRAILER_TAG ) );
+            if( !cacheFile ) {
+                cacheFile.close();
+                remove( tempFileName.c_str() );
+                return;
+            }
+        }
+        util::replaceFile( tempFileName, aCacheFileName );
+    }
+
+#if USE_ZLIB
+    /*!
+     * \brief Decompress gzip data, including any concatenated gzip members, into
+     *        aBuffer.
+     * \return The size of the decompressed data.
+     */
+    size_t gunzip( const string& aFileName, const char* aData, const size_t aSize, vector<char>& aBuffer ) {
+        // The gzip trailer holds the uncompressed size (mod 2^32) of the last member
+        // which is a good guess for the buffer size.
+        if( aSize >= 4 ) {
+            const unsigned char* trailer = reinterpret_cast<const unsigned char*>( aData + aSize - 4 );
+            const size_t sizeHint = trailer[ 0 ] | ( trailer[ 1 ] << 8 ) | ( trailer[ 2 ] << 16 )
+                                    | ( static_cast<size_t>( trailer[ 3 ] ) << 24 );
+            if( aBuffer.size() < sizeHint + 1 ) {
+                aBuffer.resize( sizeHint + 1 );
+            }
+        }
+
+        z_stream stream = z_stream();
+        // adding 32 to the window bits has zlib detect the gzip header
+        if( inflateInit2( &stream, 15 + 32 ) != Z_OK ) {
+            throwFailure( aFileName, "could not initialize zlib" );
+        }
+        // zlib counts bytes with a uInt so large files must be fed in pieces
+        const size_t maxChunk = numeric_limits<uInt>::max();
+        size_t inPos = 0;
+        size_t outPos = 0;
+        while( true ) {
+            if( stream.avail_in == 0 && inPos < aSize ) {
+                const size_t chunk = min( aSize - inPos, maxChunk );
+                stream.next_in = reinterpret_cast<Bytef*>( const_cast<char*>( aData + inPos ) );
+                stream.avail_in = static_cast<uInt>( chunk );
+                inPos += chunk;
+            }
+            ensureFree( aBuffer, outPos );
+            const size_t outAvail = min( aBuffer.size() - outPos, maxChunk );
+            stream.next_out = reinterpret_cast<Bytef*>( aBuffer.data() + outPos );
+            stream.avail_out = static_cast<uInt>( outAvail );
+            const int ret = inflate( &stream, Z_NO_FLUSH );
+            outPos += outAvail - stream.avail_out;
+            const bool inputDone = stream.avail_in == 0 && inPos == aSize;
+            if( ret == Z_STREAM_END ) {
+                if( inputDone ) {
+                    break;
+                }
+                inflateReset( &stream );
+            }
+            else if( ( ret != Z_OK && ret != Z_BUF_ERROR ) || ( ret == Z_BUF_ERROR && inputDone ) ) {
+                const string reason = stream.msg ? stream.msg : "truncated file";
+                inflateEnd( &stream );
+                throwFailure( aFileName, reason );
+            }
+        }
+        inflateEnd( &stream );
+        return outPos;
+    }
+#endif
+
+#if USE_ZSTD
+    /*!
+     * \brief Decompress zstd data, including any concatenated frames, into aBuffer.
+     * \return The size of the decompressed data.
+     */
+    size_t unzstd( const string& aFileName, const char* aData, const size_t aSize, vector<char>& aBuffer ) {
+        const unsigned long long sizeHint = ZSTD_getFrameContentSize( aData, aSize );
+        if( sizeHint != ZSTD_CONTENTSIZE_UNKNOWN && sizeHint != ZSTD_CONTENTSIZE_ERROR
+            && aBuffer.size() < sizeHint + 1 )
+        {
+            aBuffer.resize( sizeHint + 1 );
+        }
+
+        ZSTD_DStream* stream = ZSTD_createDStream();
+        ZSTD_initDStream( stream );
+        ZSTD_inBuffer in = { aData, aSize, 0 };
+        size_t outPos = 0;
+        // non-zero until the end of a frame has been reached and flushed
+        size_t ret = 1;
+        while( in.pos < in.size || ret != 0 ) {
+            ensureFree( aBuffer, outPos );
+            ZSTD_outBuffer out = { aBuffer.data() + outPos, aBuffer.size() - outPos, 0 };
+            ret = ZSTD_decompressStream( stream, &out, &in );
+            outPos += out.pos;
+            if( ZSTD_isError( ret ) ) {
+                const string reason = ZSTD_getErrorName( ret );
+                ZSTD_freeDStream( stream );
+                throwFailure( aFileName, reason );
+            }
+            if( ret != 0 && in.pos == in.size && out.pos < out.size ) {
+                ZSTD_freeDStream( stream );
+                throwFailure( aFileName, "truncated file" );
+            }
+        }
+        ZSTD_freeDStream( stream );
+        return outPos;
+    }
+#endif
+}
+
+//! Constructor
+XMLInputFile::XMLInputFile():
+mData( 0 ),
+mSize( 0 )
+{
+}
+
+//! Destructor
+XMLInputFile::~XMLInputFile() {
+    close();
+}
+
+/*!
+ * \brief Open the given file, decompressing it if needed.
+ * \param aFileName The XML file to open.
+ */
+void XMLInputFile::open( const string& aFileName ) {
+    close();
+
+    // Check the first bytes to see if the file is compressed.  If it can not be
+    // read let mapped_file_source report the error.
+    char magic[ sizeof( ZSTD_MAGIC ) ] = { 0 };
+    size_t magicSize = 0;
+    {
+        ifstream input( aFileName.c_str(), ios_base::in | ios_base::binary );
+        input.read( magic, sizeof( magic ) );
+        magicSize = input.gcount();
+    }
+    if( !hasMagic( magic, magicSize, GZIP_MAGIC ) && !hasMagic( magic, magicSize, ZSTD_MAGIC ) ) {
+        mMappedFile.open( aFileName.c_str() );
+        mData = const_cast<char*>( mMappedFile.data() );
+        mSize = mMappedFile.size();
+        return;
+    }
+
+    uint64_t fileSize = 0;
+    int64_t modifiedTime = 0;
+    const string cacheFileName = util::getFileStamp( aFileName, fileSize, modifiedTime ) ?
+        getCacheFileName( aFileName ) : string();
+    uint64_t cacheSize = 0;
+    int64_t cacheModifiedTime = 0;
+    if( !cacheFileName.empty() && util::getFileStamp( cacheFileName, cacheSize, cacheModifiedTime ) ) {
+        try {
+            mMappedFile.open( cacheFileName.c_str() );
+            if( isCacheValid( mMappedFile.data(), mMappedFile.size(), fileSize, modifiedTime ) ) {
+                // the trailer starts with the null rapidxml needs to end the contents
+                mData = const_cast<char*>( mMappedFile.data() );
+                mSize = mMappedFile.size() - CACHE_TRAILER_SIZE;
+                return;
+            }
+            mMappedFile.close();
+        }
+        catch( std::ios_base::failure& ) {
+            // fall back to decompressing the file again
+        }
+    }
+
+    {
+        boost::iostreams::mapped_file_source compressedFile( aFileName.c_str() );
+        decompress( aFileName, compressedFile.data(), compressedFile.size() );
+    }
+    if( !cacheFileName.empty() ) {
+        writeCache( cacheFileName, mData, mSize, fileSize, modifiedTime );
+    }
+}
+
+/*!
+ * \brief Decompress the given data into mBuffer and point mData to it.
+ * \param aFileName The name of the file for error messages.
+ * \param aCompressed The compressed data.
+ * \param aCompressedSize The size of the compressed data.
+ */
+void XMLInputFile::decompress( const string& aFileName, const char* aCompressed,
+                               const size_t aCompressedSize )
+{
+    {
+        lock_guard<mutex> lock( gFreeBufferMutex );
+        mBuffer.swap( gFreeBuffer );
+    }
+    if( !mBuffer ) {
+        mBuffer.reset( new vector<char>() );
+    }
+
+    if( hasMagic( aCompressed, aCompressedSize, GZIP_MAGIC ) ) {
+#if USE_ZLIB
+        mSize = gunzip( aFileName, aCompressed, aCompressedSize, *mBuffer );
+#else
+        throwFailure( aFileName, "gzip support was not compiled in, rebuild with USE_ZLIB" );
+#endif
+    }
+    else {
+#if USE_ZSTD
+        mSize = unzstd( aFileName, aCompressed, aCompressedSize, *mBuffer );
+#else
+        throwFailure( aFileName, "zstd support was not compiled in, rebuild with USE_ZSTD" );
+#endif
+    }
+
+    // rapidxml requires the contents to be null terminated
+    if( mBuffer->size() <= mSize ) {
+        mBuffer->resize( mSize + 1 );
+    }
+    (*mBuffer)[ mSize ] = '\0';
+    mData = mBuffer->data();
+}
+
+/*!
+ * \brief Release the contents of the file.
+ * \details A decompression buffer is kept for reuse if it is larger than the one
+ *          already kept.
+ */
+void XMLInputFile::close() {
+    if( mMappedFile.is_open() ) {
+        mMappedFile.close();
+    }
+    if( mBuffer ) {
+        lock_guard<mutex> lock( gFreeBufferMutex );
+        if( !gFreeBuffer || gFreeBuffer->size() < mBuffer->size() ) {
+            gFreeBuffer.swap( mBuffer );
+        }
+        mBuffer.reset();
+    }
+    mData = 0;
+    mSize = 0;
+}
+
+/*!
+ * \brief Free the decompression buffer kept for reuse.
+ * \details This should be called once all of the input files have been parsed
+ *          so that the largest decompressed file is not held for the rest of the
+ *          model run.  Files opened afterwards will simply allocate a new buffer.
+ */
+void XMLInputFile::releaseBuffers() {
+    unique_ptr<vector<char> > freeBuffer;
+    lock_guard<mutex> lock( gFreeBufferMutex );
+    freeBuffer.swap( gFreeBuffer );
+}
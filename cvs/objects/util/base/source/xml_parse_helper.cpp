@@ -38,7 +38,6 @@
  * \author Pralit Patel
  */
 
-#include <boost/iostreams/device/mapped_file.hpp>
 #include <boost/fusion/include/filter_if.hpp>
 #include <boost/preprocessor/tuple/enum.hpp>
 #include <boost/preprocessor/seq.hpp>
@@ -46,8 +45,12 @@
 #include <boost/preprocessor/punctuation/is_begin_parens.hpp>
 #include <boost/preprocessor/tuple/enum.hpp>
 #include <boost/mpl/set.hpp>
+#include <atomic>
+#include <charconv>
 
 #include "util/base/include/xml_parse_helper.h"
+#include "util/base/include/xml_input_file.h"
+#include "util/base/include/region_index.h"
 
 // A tuple of GCAM Containers for which we want to debug the XML parsing
 // such as `(World, ReserveSubResource)`.  Users can choose any class even
@@ -89,6 +92,12 @@
 #include "util/logger/include/logger_factory.h"
 #include "util/logger/include/logger.h"
 #include "util/base/include/configuration.h"
+#include "util/base/include/snapshot_helper.h"
+
+#if GCAM_PARALLEL_ENABLED
+#include <tbb/parallel_pipeline.h>
+#include <tbb/task_arena.h>
+#endif
 
 using namespace std;
 using namespace rapidxml;
@@ -628,6 +637,51 @@ void>::type parseDataI(const rapidxml::xml_node<char>* aNode, DataType& aData) {
     getDataVector.getFullDataVector(parseChildHelper);
 }
 
+/*!
+ * \brief Convert the character data of an XML node directly into a number without
+ *        first copying it into a temporary std::string.
+ * \details Year indexed array data makes up the bulk of the model input so this is
+ *          the fast path for it which uses std::from_chars when it is available.  Any
+ *          text std::from_chars does not fully consume, such as a leading '+', falls
+ *          back to boost::lexical_cast so that the results and errors are unchanged.
+ * \param aBegin The start of the character data.
+ * \param aSize The length of the character data.
+ * \return The converted value.
+ */
+template<typename T>
+typename boost::enable_if_c<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value, T>::type
+parseNumber( const char* aBegin, const std::size_t aSize ) {
+#if defined( __cpp_lib_to_chars )
+    T value;
+    const std::from_chars_result result = std::from_chars( aBegin, aBegin + aSize, value );
+    if( result.ec == std::errc() && result.ptr == aBegin + aSize ) {
+        return value;
+    }
+#endif
+    return boost::lexical_cast<T>( aBegin, aSize );
+}
+
+//! Value is always stored as a double so parse it as such.
+template<typename T>
+typename boost::enable_if<std::is_same<T, Value>, T>::type
+parseNumber( const char* aBegin, const std::size_t aSize ) {
+    return Value( parseNumber<double>( aBegin, aSize ) );
+}
+
+//! Any other type can only be converted with boost::lexical_cast.
+template<typename T>
+typename boost::enable_if_c<!std::is_arithmetic<T>::value && !std::is_same<T, Value>::value, T>::type
+parseNumber( const char* aBegin, const std::size_t aSize ) {
+    return boost::lexical_cast<T>( aBegin, aSize );
+}
+
+//! bool is arithmetic however std::from_chars does not support it.
+template<typename T>
+typename boost::enable_if<std::is_same<T, bool>, T>::type
+parseNumber( const char* aBegin, const std::size_t aSize ) {
+    return boost::lexical_cast<T>( aBegin, aSize );
+}
+
 // Specializations for arrays of non-containers i.e. actual data but not TechVintageVector
 template<typename DataType>
 typename boost::enable_if<
@@ -638,13 +692,14 @@ typename boost::enable_if<
     >,
 void>::type parseDataI(const rapidxml::xml_node<char>* aNode, DataType& aData) {
     using namespace std;
-    string nodeValueStr(aNode->value(), aNode->value_size());
-    auto nodeValue = boost::lexical_cast<typename DataType::value_type::value_type>(nodeValueStr);
+    auto nodeValue = parseNumber<typename DataType::value_type::value_type>( aNode->value(), aNode->value_size() );
     // find the year attribute (make sure it is valid) and see if we need to fillout
-    map<string, string> attrs = XMLParseHelper::getAllAttrs(aNode);
-    auto yearIter = attrs.find( "year" );
-    bool filloutFlagSet = XMLParseHelper::isAttrFlagSet( attrs, "fillout" );
-    if( yearIter == attrs.end() ) {
+    // note we look these up directly rather than through getAllAttrs as this is
+    // called for nearly every value in the input files
+    const rapidxml::xml_attribute<char>* yearAttr = aNode->first_attribute( "year", 4 );
+    const rapidxml::xml_attribute<char>* filloutAttr = aNode->first_attribute( "fillout", 7 );
+    bool filloutFlagSet = filloutAttr && filloutAttr->value_size() == 1 && *filloutAttr->value() == '1';
+    if( !yearAttr ) {
         ILogger& mainLog = ILogger::getLogger( "main_log" );
         mainLog.setLevel( ILogger::ERROR );
         mainLog << "Could not find year attribute to set simple array data" << endl;
@@ -654,7 +709,7 @@ void>::type parseDataI(const rapidxml::xml_node<char>* aNode, DataType& aData) {
         // convert year to period.  We rely on GetIndexAsYear::convertIterToYear to
         // convert between iterators and years and naively loop over the entire vector
         // checking if we have hit the right year yet.
-        const int currAttrYear = boost::lexical_cast<int>( (*yearIter).second );
+        const int currAttrYear = parseNumber<int>( yearAttr->value(), yearAttr->value_size() );
         bool done = false;
         bool doFillout = false;
         for( auto iter = aData.mData.begin(); iter != aData.mData.end() && !done; ++iter ) {
@@ -799,7 +854,13 @@ void ParseChildData::processDataVector( DataVectorType aDataVector ) {
             // set and we should first ask it to attempt to parse this node.  If it returns true
             // that indicates it did in fact handle the data so we should skip any further action
             // on this node.
+            rapidxml::xml_node<char>* customParseNode = child;
             bool found = mContainer ? mContainer->XMLParse(child) : false;
+            // keep a copy of any XML handled by XMLParse if a snapshot is going to be
+            // taken as it may have set data which SnapshotHelper can not otherwise get to
+            if(found && SnapshotHelper::isRecording()) {
+                SnapshotHelper::recordXMLParse(mContainer, mParentNode, customParseNode, child);
+            }
             // child could have changed and even moved to the end by XMLParse so double check
             if(child && !found) {
                 string childNodeName(child->name(), child->name_size());
@@ -874,54 +935,119 @@ void XMLParseHelper::parseData<Data<Logger*, CONTAINER> >(const rapidxml::xml_no
 
 //=============================================================================
 
+/*!
+ * \brief An XML file which has been read and tokenized into a rapidxml DOM but not
+ *        yet applied to the GCAM objects.
+ * \details This is the single place XML files are opened and parsed.  Tokenizing a
+ *          file does not touch any GCAM data so may be done for many files at once
+ *          while applying the DOM must be done one file at a time in the order given
+ *          so that later files may override earlier ones.  Errors from opening or
+ *          parsing the file are kept until the file is applied so that they are
+ *          reported in order as well.
+ */
+struct TokenizedXMLFile {
+    //! The path to the XML file.
+    string mFileName;
+    
+    //! The contents of the file which mDoc refers into.
+    XMLInputFile mXMLFile;
+    
+    //! The contents of the file without the regions excluded by region-subset
+    //! which mDoc refers into instead if any regions were excluded.
+    vector<char> mFilteredXML;
+    
+    //! The number of regions excluded by region-subset.
+    unsigned int mNumSkippedRegions;
+    
+    //! The parsed DOM of the file.
+    rapidxml::xml_document<> mDoc;
+    
+    //! The error to report if the file could not be opened or parsed.
+    string mError;
+    
+    explicit TokenizedXMLFile( const string& aFileName ):mFileName( aFileName ), mNumSkippedRegions( 0 ) {}
+    
+    /*!
+     * \brief Open the file and parse it into mDoc, setting mError on failure.
+     * \param aFilterRegions Whether to drop the regions not in region-subset, if
+     *                       it is set, before parsing using the RegionIndex of the
+     *                       file.  This only applies to Scenario inputs.
+     */
+    void tokenize( const bool aFilterRegions ) {
+        try {
+            // open the file, which may be compressed
+            mXMLFile.open( mFileName );
+            char* xmlData = mXMLFile.data();
+            const set<string> regionSubset = aFilterRegions ? RegionIndex::getRegionSubset() : set<string>();
+            if( !regionSubset.empty() ) {
+                RegionIndex regionIndex = RegionIndex::getRegionIndex( mFileName, mXMLFile.data(), mXMLFile.size() );
+                if( regionIndex.filterRegions( regionSubset, mXMLFile.data(), mXMLFile.size(), mFilteredXML, mNumSkippedRegions ) ) {
+                    xmlData = mFilteredXML.data();
+                }
+            }
+            mDoc.parse<rapidxml::parse_non_destructive>( xmlData );
+        }
+        catch(std::ios_base::failure ioException) {
+            mError = "Could not open: " + mFileName + " failed with: " + ioException.what();
+        }
+        catch(rapidxml::parse_error parseException) {
+            mError = "Failed to parse: " + mFileName + " with error: " + parseException.what();
+        }
+    }
+    
+    /*!
+     * \brief Report the error if the file could not be opened or parsed.
+     * \return True if the file was tokenized successfully.
+     */
+    bool checkTokenized() const {
+        if( !mError.empty() ) {
+            cerr << mError << endl;
+            return false;
+        }
+        return true;
+    }
+    
+    /*!
+     * \brief Process the tokenized XML starting with the given root element.
+     * \details Note, we assume that the instance of aRootElement already exists and
+     *          is a "single" container so there is no need to worry about setting
+     *          the data name of the root.
+     * \tparam ContainerType The type of the root CONTAINER to kick off processing.
+     * \param aRootElement A valid instance of a GCAM class, such as Scenario, which
+     *                     starts the processing of the XML nodes.
+     * \return False if the file could not be opened or parsed.
+     */
+    template<typename ContainerType>
+    bool apply( ContainerType* aRootElement ) {
+        if( !checkTokenized() ) {
+            return false;
+        }
+        Data<ContainerType*, CONTAINER> root( aRootElement, "" );
+        XMLParseHelper::parseData( mDoc.first_node(), root );
+        return true;
+    }
+};
+
 /*!
  * \brief Parse the given XML file using aRootElement as the parsing context to start processing the XML.
- * \details We will load the XML file using a memory mapped file then have Rapid XML parse it.  We then
- *          kick off the actual parsing by making the first call to parseData which will recursively kick off:
+ * \details The file is opened and parsed by TokenizedXMLFile.  We then kick off the actual parsing by
+ *          making the first call to parseData which will recursively kick off:
  *            - At compile time the template instantiations to generate the XML parsing code for ALL of GCAM.
  *            - At runtime the handling of all of the XML nodes so that they get matched up with and initialize
  *             the GCAM data structures.
- *           Note, we assume that the instance of aRootElement already exists and is a "single" container.
  * \tparam ContainerType The type of the root CONTAINER to kick off processing.
  * \param aXMLFile A string representing the path to the XML file to parse.
  * \param aRootElement A valid instance of a GCAM class, such as Scenario, which starts the processing
  *                    of the XML nodes.
+ * \param aFilterRegions Whether to drop the regions not in region-subset.
  * \return False if there was an error opening or with the XML syntax of aXMLFile.  Note, unrecognized nodes
  *         do not cause this method to return false however warnings about that will have been made.
  */
 template<typename ContainerType>
-bool parseXMLInternal(const string& aXMLFile, ContainerType* aRootElement) {
-    try {
-        // Create a Data wrapper around the given container.  Note, we are expecting
-        // aRootElement to already exist and can not be changed so no need to worry
-        // about setting the data name and can just leave it empty.
-        Data<ContainerType*, CONTAINER> root(aRootElement, "");
-        
-        // open the file as a memory mapped file and make sure it was successful
-        boost::iostreams::mapped_file_source xmlFile(aXMLFile.c_str());
-        
-        // Parse the file, note the memory for the parser will be released when doc
-        // goes out of scope.
-        rapidxml::xml_document<> doc;
-        doc.parse<rapidxml::parse_non_destructive>(const_cast<char*>(xmlFile.data()));
-        
-        // Kick off the processing of the XML nodes starting with the root element.
-        XMLParseHelper::parseData(doc.first_node(), root);
-        
-        xmlFile.close();
-    }
-    catch(std::ios_base::failure ioException) {
-        cerr << "Could not open: " << aXMLFile << " failed with: "
-             << ioException.what() << endl;
-        return false;
-    }
-    catch(rapidxml::parse_error parseException) {
-        cerr << "Failed to parse: " << aXMLFile << " with error: "
-             << parseException.what() << endl;
-        return false;
-    }
-    
-    return true;
+bool parseXMLInternal(const string& aXMLFile, ContainerType* aRootElement, const bool aFilterRegions = false) {
+    TokenizedXMLFile file( aXMLFile );
+    file.tokenize( aFilterRegions );
+    return file.apply( aRootElement );
 }
 
 /*!
@@ -932,7 +1058,79 @@ bool parseXMLInternal(const string& aXMLFile, ContainerType* aRootElement) {
 *         do not cause this method to return false however warnings about that will have been made.
 */
 bool XMLParseHelper::parseXML(const string& aXMLFile, Scenario* aRootElement) {
-    return parseXMLInternal(aXMLFile, aRootElement);
+    return parseXMLInternal(aXMLFile, aRootElement, true);
+}
+
+/*!
+ * \brief Apply a tokenized scenario component to the Scenario letting the user
+ *        know which file is being processed.
+ * \param aFile The tokenized file.
+ * \param aRootElement The Scenario which starts the processing of the XML nodes.
+ * \return False if the file could not be opened or parsed.
+ */
+bool applyScenarioComponent( TokenizedXMLFile& aFile, Scenario* aRootElement ) {
+    ILogger& mainLog = ILogger::getLogger( "main_log" );
+    mainLog.setLevel( ILogger::NOTICE );
+    mainLog << "Parsing " << aFile.mFileName << " scenario component." << endl;
+    if( aFile.mNumSkippedRegions > 0 ) {
+        mainLog << "Skipped " << aFile.mNumSkippedRegions << " regions not in region-subset." << endl;
+    }
+    return aFile.apply( aRootElement );
+}
+
+/*!
+ * \brief Parse the given list of scenario component files into the given Scenario.
+ * \details The files are processed in the order given so that data in later files
+ *          override earlier ones.  If GCAM_PARALLEL_ENABLED and the boolean configuration
+ *          value "parallel-xml-parse" is set the parse is done in two phases: reading
+ *          and tokenizing files into rapidxml DOMs is done in parallel for several files
+ *          at once while the DOMs are processed into the Scenario one at a time in order
+ *          as they become available.  The number of files in flight is limited to keep
+ *          memory use bounded.
+ * \param aXMLFiles The paths to the XML files to parse in order.
+ * \param aRootElement A valid Scenario instance, which starts the processing of the XML nodes.
+ * \return False if there was an error opening or with the XML syntax of any file in which
+ *         case the remaining files are not processed.
+ */
+bool XMLParseHelper::parseXML( const vector<string>& aXMLFiles, Scenario* aRootElement ) {
+#if GCAM_PARALLEL_ENABLED
+    if( Configuration::getInstance()->getBool( "parallel-xml-parse", false, false ) ) {
+        // The first stage reads from success while the last may set it.
+        atomic<bool> success( true );
+        size_t nextFile = 0;
+        tbb::parallel_pipeline( 2 * tbb::this_task_arena::max_concurrency(),
+            tbb::make_filter<void, TokenizedXMLFile*>( tbb::filter_mode::serial_in_order,
+                [&] ( tbb::flow_control& aControl ) -> TokenizedXMLFile* {
+                    if( !success || nextFile == aXMLFiles.size() ) {
+                        aControl.stop();
+                        return 0;
+                    }
+                    return new TokenizedXMLFile( aXMLFiles[ nextFile++ ] );
+                } ) &
+            tbb::make_filter<TokenizedXMLFile*, TokenizedXMLFile*>( tbb::filter_mode::parallel,
+                [] ( TokenizedXMLFile* aFile ) {
+                    aFile->tokenize( true );
+                    return aFile;
+                } ) &
+            tbb::make_filter<TokenizedXMLFile*, void>( tbb::filter_mode::serial_in_order,
+                [&] ( TokenizedXMLFile* aFile ) {
+                    // Any files tokenized after a failure are simply discarded.
+                    if( success && !applyScenarioComponent( *aFile, aRootElement ) ) {
+                        success = false;
+                    }
+                    delete aFile;
+                } ) );
+        return success;
+    }
+#endif
+    for( vector<string>::const_iterator currFile = aXMLFiles.begin(); currFile != aXMLFiles.end(); ++currFile ) {
+        TokenizedXMLFile file( *currFile );
+        file.tokenize( true );
+        if( !applyScenarioComponent( file, aRootElement ) ) {
+            return false;
+        }
+    }
+    return true;
 }
 
 /*!
@@ -946,45 +1144,27 @@ bool XMLParseHelper::parseXML(const string& aXMLFile, Scenario* aRootElement) {
 *         do not cause this method to return false however warnings about that will have been made.
 */
 bool XMLParseHelper::parseXML(const string& aXMLFile, IScenarioRunner* & aRootElement) {
-    try {
-        // we will first have to open and parse the XML file before we can determine the
-        // correct type of IScenarioRunner to create
-        boost::iostreams::mapped_file_source xmlFile(aXMLFile.c_str());
-        
-        rapidxml::xml_document<> doc;
-        doc.parse<rapidxml::parse_non_destructive>(const_cast<char*>(xmlFile.data()));
-        
-        if(!aRootElement) {
-            string runnerType = getNodeName(doc.first_node());
-            aRootElement = ScenarioRunnerFactory::create(runnerType).release();
-            if(!aRootElement) {
-                // Didn't recognize runnerType, an error will have already been generated
-                // so just close the file and indicate failure.
-                xmlFile.close();
-                return false;
-            }
-        }
-        
-        // We can now proceed with parsing as normal, we do not need to worry about the data
-        // name of the root as we have already taken care of creating that.
-        Data<IScenarioRunner*, CONTAINER> root(aRootElement, "");
-        
-        XMLParseHelper::parseData(doc.first_node(), root);
-        
-        xmlFile.close();
-    }
-    catch(std::ios_base::failure ioException) {
-        cerr << "Could not open: " << aXMLFile << " failed with: "
-             << ioException.what() << endl;
+    // we will first have to open and parse the XML file before we can determine the
+    // correct type of IScenarioRunner to create
+    TokenizedXMLFile file( aXMLFile );
+    file.tokenize( false );
+    if( !file.checkTokenized() ) {
         return false;
     }
-    catch(rapidxml::parse_error parseException) {
-        cerr << "Failed to parse: " << aXMLFile << " with error: "
-             << parseException.what() << endl;
-        return false;
+    
+    if(!aRootElement) {
+        string runnerType = getNodeName(file.mDoc.first_node());
+        aRootElement = ScenarioRunnerFactory::create(runnerType).release();
+        if(!aRootElement) {
+            // Didn't recognize runnerType, an error will have already been generated
+            // so just indicate failure.
+            return false;
+        }
     }
     
-    return true;
+    // We can now proceed with parsing as normal, we do not need to worry about the data
+    // name of the root as we have already taken care of creating that.
+    return file.apply( aRootElement );
 }
 
 /*!
@@ -1006,28 +1186,14 @@ bool XMLParseHelper::parseXML(const string& aXMLFile, LoggerFactoryWrapper* aRoo
 *         do not cause this method to return false however warnings about that will have been made.
 */
 bool XMLParseHelper::parseXML(const string& aXMLFile, Configuration* aRootElement) {
-    try {
-        boost::iostreams::mapped_file_source xmlFile(aXMLFile.c_str());
-        
-        rapidxml::xml_document<char> doc;
-        doc.parse<rapidxml::parse_non_destructive>(const_cast<char*>(xmlFile.data()));
-        
-        // We do not bother with the generic parseData for the Configuration object
-        // as it is all custom behavior anyways and there is no recursive processing
-        aRootElement->XMLParse(doc.first_node());
-        
-        xmlFile.close();
-    }
-    catch(std::ios_base::failure ioException) {
-        cerr << "Could not open: " << aXMLFile << " failed with: "
-             << ioException.what() << endl;
-        return false;
-    }
-    catch(rapidxml::parse_error parseException) {
-        cerr << "Failed to parse: " << aXMLFile << " with error: "
-             << parseException.what() << endl;
+    TokenizedXMLFile file( aXMLFile );
+    file.tokenize( false );
+    if( !file.checkTokenized() ) {
         return false;
     }
     
+    // We do not bother with the generic parseData for the Configuration object
+    // as it is all custom behavior anyways and there is no recursive processing
+    aRootElement->XMLParse(file.mDoc.first_node());
     return true;
 }
@@ -114,6 +114,9 @@ public:
     virtual void open( const char[] = 0 ) = 0; //!< Pure virtual function called to begin logging.
     int receiveCharFromUnderStream( int ch ); //!< Pure virtual function called to complete the log and clean up.
     virtual void close() = 0;
+    //! Pure virtual function called to continue logging to a different file
+    //! without finishing the current one, which may be shared with another process.
+    virtual void reopen( const std::string& aFileName ) = 0;
     ILogger::WarningLevel setLevel( const ILogger::WarningLevel newLevel );
     bool wouldPrint(ILogger::WarningLevel aLevel) const;
     void toDebugXML( std::ostream& out, Tabs* tabs ) const;
@@ -69,10 +69,11 @@ public:
     static Logger& getLogger( const std::string& aLogName );
     static void toDebugXML( std::ostream& aOut, Tabs* aTabs );
     static void logNewScenarioStarting( const std::string& aScenarioName );
+    static void reopenWithSuffix( const std::string& aSuffix );
+    static void cleanUp();
 private:
     static std::map<std::string,Logger*> mLoggers; //!< Map of logger names to loggers.
      static bool XMLParse( rapidxml::xml_node<char>* & aNode );
-    static void cleanUp();
     //! Private undefined constructor to prevent creating a LoggerFactory.
     LoggerFactory();
     //! Private undefined copy constructor to prevent  copying a LoggerFactory.
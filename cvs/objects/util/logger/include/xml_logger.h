@@ -66,6 +66,7 @@ class XMLLogger: public Logger {
 public:
     void open( const char[] = 0 );
     void close();
+    void reopen( const std::string& aFileName );
     void logCompleteMessage( const std::string& aMessage );	
 
 private:
@@ -148,6 +148,26 @@ void LoggerFactory::logNewScenarioStarting( const string& aScenarioName ) {
     }
 }
 
+/*!
+ * \brief Switch all loggers to files with the given suffix added to their names.
+ * \details This is used by processes which run a scenario concurrently with
+ *          others so that their log messages are not interleaved in the same files.
+ *          The suffix is inserted before the extension, for instance
+ *          logs/main_log.txt becomes logs/main_log_suffix.txt.
+ * \param aSuffix The suffix to add to the log file names.
+ */
+void LoggerFactory::reopenWithSuffix( const string& aSuffix ) {
+	for( map<string,Logger*>::const_iterator logIter = mLoggers.begin(); logIter != mLoggers.end(); ++logIter ){
+        const string& fileName = logIter->second->mFileName;
+        const size_t dirEnd = fileName.find_last_of( "/\\" );
+        size_t extStart = fileName.rfind( '.' );
+        if( extStart == string::npos || ( dirEnd != string::npos && extStart < dirEnd ) ) {
+            extStart = fileName.size();
+        }
+        logIter->second->reopen( fileName.substr( 0, extStart ) + "_" + aSuffix + fileName.substr( extStart ) );
+    }
+}
+
 const string& LoggerFactoryWrapper::getXMLNameStatic() {
     const static string XML_NAME = "LoggerFactoryWrapper";
     return XML_NAME;
@@ -73,6 +73,13 @@ void PlainTextLogger::close(){
     mLogFile.close();
 }
 
+//! Tells the logger to continue logging to a new file.
+void PlainTextLogger::reopen( const string& aFileName ){
+    mLogFile.close();
+    mFileName = aFileName;
+    open();
+}
+
 //! Logs a single message.
 void PlainTextLogger::logCompleteMessage( const string& aMessage ){
     // Decide whether to print the message
@@ -78,6 +78,14 @@ void XMLLogger::close(){
 	mLogFile.close();
 }
 
+//! Tells the logger to continue logging to a new file without closing the
+//! log tag of the current file.
+void XMLLogger::reopen( const string& aFileName ){
+	mLogFile.close();
+	mFileName = aFileName;
+	open();
+}
+
 //! Logs a single message.
 void XMLLogger::logCompleteMessage( const string& aMessage ){
 	// Decide whether to print the message